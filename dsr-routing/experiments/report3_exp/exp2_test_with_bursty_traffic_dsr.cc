@@ -28,10 +28,43 @@ void InstallDSRUdpApplication (Ptr<Node> node, Address sinkAddress, double start
   dsrApp->SetStopTime (Seconds (stopTime));
 }
 
+// Print the decision cache hit/miss counters of every DSR router
+void PrintDecisionCacheStats (NodeContainer nodes)
+{
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  for (uint32_t i = 0; i < nodes.GetN (); i++)
+    {
+      Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting> (nodes.Get (i)->GetObject<Ipv4> ()->GetRoutingProtocol ());
+      for (uint32_t j = 0; list != 0 && j < list->GetNRoutingProtocols (); j++)
+        {
+          int16_t priority;
+          Ptr<Ipv4DSRRouting> dsrRouting = DynamicCast<Ipv4DSRRouting> (list->GetRoutingProtocol (j, priority));
+          if (dsrRouting != 0)
+            {
+              hits += dsrRouting->GetDecisionCacheHits ();
+              misses += dsrRouting->GetDecisionCacheMisses ();
+            }
+        }
+    }
+  std::cout << "decision cache: " << hits << " hits, " << misses << " misses";
+  if (hits + misses > 0)
+    {
+      std::cout << ", hit ratio " << (double) hits / (hits + misses);
+    }
+  std::cout << std::endl;
+}
+
 int main (int argc, char *argv[])
 {
+  std::string decisionCacheTtl = "0ms";
+  uint32_t candidates = 0;
   CommandLine cmd;
+  cmd.AddValue ("decisionCacheTtl", "Lifetime of the cached forwarding decisions (0 to disable)", decisionCacheTtl);
+  cmd.AddValue ("candidates", "Most candidate routes per destination, with two-hop ones (0 for one per neighbor)", candidates);
   cmd.Parse (argc, argv);
+  Ipv4DSRRoutingHelper::SetCandidatesPerDestination (candidates);
+  Config::SetDefault ("ns3::dsr-routing::Ipv4DSRRouting::DecisionCacheTtl", TimeValue (Time (decisionCacheTtl)));
   
   // ------------------ build topology ---------------------------
   NS_LOG_INFO ("Create nodes.");
@@ -228,6 +261,7 @@ int main (int argc, char *argv[])
 
   Simulator::Stop(Seconds(20));
   Simulator::Run();
+  PrintDecisionCacheStats (nodes);
   Simulator::Destroy ();
 
 }
@@ -1,6 +1,7 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
 #include <ctime>
+#include <chrono>
 
 #include <sstream>
 
@@ -198,7 +199,12 @@ int main (int argc, char *argv[])
   // -- Run the simulation
   // --------------------------------------------
   NS_LOG_INFO ("Run Simulation.");
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
   Simulator::Run ();
+  double wallSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+  uint64_t events = Simulator::GetEventCount ();
+  std::cout << "wall-clock: " << wallSeconds << " s, events: " << events
+            << ", events/s: " << (wallSeconds > 0 ? events / wallSeconds : 0) << std::endl;
   Simulator::Destroy ();
 
   delete[] ipic;
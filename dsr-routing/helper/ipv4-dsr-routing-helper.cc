@@ -66,9 +66,56 @@ Ipv4DSRRoutingHelper::PopulateRoutingTables (void)
 void 
 Ipv4DSRRoutingHelper::RecomputeRoutingTables (void)
 {
-  DSRRouteManager::DeleteDSRRoutes ();
-  DSRRouteManager::BuildDSRRoutingDatabase ();
-  DSRRouteManager::InitializeRoutes ();
+  DSRRouteManager::RecomputeDSRRoutes ();
+}
+
+void
+Ipv4DSRRoutingHelper::UpdateLinkMetric (Ptr<Node> node, uint32_t interface, uint16_t metric)
+{
+  DSRRouteManager::UpdateLinkMetric (node, interface, metric);
+}
+
+void
+Ipv4DSRRoutingHelper::SetPopulationThreads (uint32_t n)
+{
+  DSRRouteManager::SetPopulationThreads (n);
+}
+
+void
+Ipv4DSRRoutingHelper::SetRouteEngine (DSRRouteManager::RouteEngine engine)
+{
+  DSRRouteManager::SetRouteEngine (engine);
+}
+
+void
+Ipv4DSRRoutingHelper::SetLoopFreeAlternates (bool enable)
+{
+  DSRRouteManager::SetLoopFreeAlternates (enable);
+}
+
+void
+Ipv4DSRRoutingHelper::SetCandidatesPerDestination (uint32_t k)
+{
+  DSRRouteManager::SetCandidatesPerDestination (k);
+}
+
+void
+Ipv4DSRRoutingHelper::SetRouteCache (const std::string &directory, bool verify)
+{
+  DSRRouteManager::SetRouteCacheDirectory (directory);
+  DSRRouteManager::SetRouteCacheVerification (verify);
+}
+
+void
+Ipv4DSRRoutingHelper::SetLazyRoutes (bool enable)
+{
+  DSRRouteManager::SetLazyRoutes (enable);
+}
+
+void
+Ipv4DSRRoutingHelper::SetAggregateRoutes (bool enable)
+{
+  DSRRouteManager::SetAggregateRoutes (enable);
 }
 
 
@@ -22,6 +22,7 @@
 
 #include "ns3/node-container.h"
 #include "ns3/ipv4-routing-helper.h"
+#include "ns3/dsr-route-manager.h"
 
 namespace ns3 {
 
@@ -81,9 +82,114 @@ public:
    * its representation of the global topology before recomputing routes.
    * Users must first call PopulateRoutingTables() and then may subsequently
    * call RecomputeRoutingTables() at any later time in the simulation.
+   * The new routes are built next to the current ones, which keep
+   * forwarding packets, and each node switches to its new table at once.
    *
    */
   static void RecomputeRoutingTables (void);
+  /**
+   * \brief Change the metric of a link and update the routes that depend
+   * on it, without recomputing the others.
+   *
+   * Meant for frequent metric changes (congestion, maintenance) after
+   * PopulateRoutingTables().  The interface metric of the node is set too.
+   *
+   * \param node the node advertising the link
+   * \param interface the interface of the node on the link
+   * \param metric the new metric of the link, from the node
+   *
+   * \see DSRRouteManager::UpdateLinkMetric
+   */
+  static void UpdateLinkMetric (Ptr<Node> node, uint32_t interface, uint16_t metric);
+  /**
+   * \brief Set the number of threads computing the routes in
+   * PopulateRoutingTables() and RecomputeRoutingTables().
+   *
+   * The routing tables are the same whatever the number of threads.
+   *
+   * \param n the number of threads; 0 uses one per hardware core, and 1
+   * (the default) computes the routes serially
+   *
+   * \see DSRRouteManager::SetPopulationThreads
+   */
+  static void SetPopulationThreads (uint32_t n);
+  /**
+   * \brief Set the algorithm computing the routes in
+   * PopulateRoutingTables() and RecomputeRoutingTables().
+   *
+   * DSRRouteManager::REVERSE_SPF runs one shortest path tree per
+   * destination rather than one per node and neighbor, which is about the
+   * average node degree times faster on large topologies.
+   *
+   * \param engine the algorithm, DSRRouteManager::SPF_PER_NEIGHBOR by default
+   *
+   * \see DSRRouteManager::SetRouteEngine
+   */
+  static void SetRouteEngine (DSRRouteManager::RouteEngine engine);
+  /**
+   * \brief Set whether PopulateRoutingTables() and RecomputeRoutingTables()
+   * mark the loop-free alternates that carry the traffic of a failed
+   * interface until the routes are recomputed.  The routers drop the routes
+   * of a failed interface only with the Ipv4DSRRouting::FastFailover
+   * attribute set.
+   *
+   * \param enable true to mark them, false (the default) not to
+   *
+   * \see DSRRouteManager::SetLoopFreeAlternates
+   */
+  static void SetLoopFreeAlternates (bool enable);
+  /**
+   * \brief Set how many candidate routes PopulateRoutingTables() and
+   * RecomputeRoutingTables() give each node to each destination.
+   *
+   * Above the node degree, the extra candidates are loop-free two-hop
+   * routes, which keep packets within their budget when the shortest
+   * routes of the neighbors are congested.
+   *
+   * \param k the most candidates per destination; 0 (the default) gives
+   * one per neighbor
+   *
+   * \see DSRRouteManager::SetCandidatesPerDestination
+   */
+  static void SetCandidatesPerDestination (uint32_t k);
+  /**
+   * \brief Keep the routing tables computed by PopulateRoutingTables() and
+   * RecomputeRoutingTables() in a cache directory.
+   *
+   * The tables are stored in a file named after a hash of the topology,
+   * the link metrics and the route options, and loaded from it when the
+   * same topology is populated again, e.g. in the other runs of a
+   * parameter sweep.
+   *
+   * \param directory the directory of the cache files, which must exist;
+   * an empty string (the default) disables the cache
+   * \param verify true to compute the tables anyway and stop with an error
+   * if they differ from the cached ones
+   *
+   * \see DSRRouteManager::SetRouteCacheDirectory
+   */
+  static void SetRouteCache (const std::string &directory, bool verify = false);
+  /**
+   * \brief Compute the routes of each node on demand, the first time it
+   * looks up a destination, instead of in PopulateRoutingTables() and
+   * RecomputeRoutingTables().
+   *
+   * \param enable true to compute the routes on demand, false (the
+   * default) to compute them all up front
+   *
+   * \see DSRRouteManager::SetLazyRoutes
+   */
+  static void SetLazyRoutes (bool enable);
+  /**
+   * \brief Store the host routes to each router once, under its router
+   * ID, and find them through a prefix table shared by all the nodes.
+   *
+   * \param enable true to aggregate the routes, false (the default) to
+   * store them once per address of the destination
+   *
+   * \see DSRRouteManager::SetAggregateRoutes
+   */
+  static void SetAggregateRoutes (bool enable);
 private:
   /**
    * \brief Assignment operator declared private and not implemented to disallow
@@ -49,24 +49,31 @@ operator<< (std::ostream& os, const DSRVertex::VertexType& t)
 std::ostream& 
 operator<< (std::ostream& os, const DsrCandidateQueue& q)
 {
-  typedef DsrCandidateQueue::DsrCandidateList_t List_t;
+  typedef std::vector<DsrCandidateQueue::Candidate> List_t;
   typedef List_t::const_iterator CIter_t;
-  const DsrCandidateQueue::DsrCandidateList_t& list = q.m_candidates;
+  // print in priority order
+  List_t list;
+  for (uint32_t i = 0; i < q.m_candidates.Size (); i++)
+    {
+      list.push_back (q.m_candidates.Get (i));
+    }
+  std::sort (list.begin (), list.end (), &DsrCandidateQueue::Before);
 
   os << "*** CandidateQueue Begin (<id, distance, LSA-type>) ***" << std::endl;
   for (CIter_t iter = list.begin (); iter != list.end (); iter++)
     {
       os << "<" 
-      << (*iter)->GetVertexId () << ", "
-      << (*iter)->GetDistanceFromRoot () << ", "
-      << (*iter)->GetVertexType () << ">" << std::endl;
+      << iter->vertex->GetVertexId () << ", "
+      << iter->vertex->GetDistanceFromRoot () << ", "
+      << iter->vertex->GetVertexType () << ">" << std::endl;
     }
   os << "*** CandidateQueue End ***";
   return os;
 }
 
 DsrCandidateQueue::DsrCandidateQueue()
-  : m_candidates ()
+  : m_candidates (),
+    m_nextSeq (0)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -81,7 +88,7 @@ void
 DsrCandidateQueue::Clear (void)
 {
   NS_LOG_FUNCTION (this);
-  while (!m_candidates.empty ())
+  while (!m_candidates.Empty ())
     {
       DSRVertex *p = Pop ();
       delete p;
@@ -93,70 +100,64 @@ void
 DsrCandidateQueue::Push (DSRVertex *vNew)
 {
   NS_LOG_FUNCTION (this << vNew);
+  NS_ASSERT_MSG (m_candidates.GetOrder ().positions.count (vNew->GetVertexId ()) == 0,
+                 "Vertex " << vNew->GetVertexId () << " already in the candidate queue");
 
-  DsrCandidateList_t::iterator i = std::upper_bound (
-      m_candidates.begin (), m_candidates.end (), vNew,
-      &DsrCandidateQueue::CompareDSRVertex
-      );
-  m_candidates.insert (i, vNew);
+  Candidate c;
+  c.vertex = vNew;
+  c.seq = m_nextSeq++;
+  m_candidates.Push (c);
 }
 
 DSRVertex *
 DsrCandidateQueue::Pop (void)
 {
   NS_LOG_FUNCTION (this);
-  if (m_candidates.empty ())
+  if (m_candidates.Empty ())
     {
       return 0;
     }
 
-  DSRVertex *v = m_candidates.front ();
-  m_candidates.pop_front ();
-  return v;
+  return m_candidates.Pop ().vertex;
 }
 
 DSRVertex *
 DsrCandidateQueue::Top (void) const
 {
   NS_LOG_FUNCTION (this);
-  if (m_candidates.empty ())
+  if (m_candidates.Empty ())
     {
       return 0;
     }
 
-  return m_candidates.front ();
+  return m_candidates.Top ().vertex;
 }
 
 bool
 DsrCandidateQueue::Empty (void) const
 {
   NS_LOG_FUNCTION (this);
-  return m_candidates.empty ();
+  return m_candidates.Empty ();
 }
 
 uint32_t
 DsrCandidateQueue::Size (void) const
 {
   NS_LOG_FUNCTION (this);
-  return m_candidates.size ();
+  return m_candidates.Size ();
 }
 
 DSRVertex *
 DsrCandidateQueue::Find (const Ipv4Address addr) const
 {
   NS_LOG_FUNCTION (this);
-  DsrCandidateList_t::const_iterator i = m_candidates.begin ();
-
-  for (; i != m_candidates.end (); i++)
+  const std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> &positions = m_candidates.GetOrder ().positions;
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator i = positions.find (addr);
+  if (i == positions.end ())
     {
-      DSRVertex *v = *i;
-      if (v->GetVertexId () == addr)
-        {
-          return v;
-        }
+      return 0;
     }
-
-  return 0;
+  return m_candidates.Get (i->second).vertex;
 }
 
 void
@@ -164,11 +165,56 @@ DsrCandidateQueue::Reorder (void)
 {
   NS_LOG_FUNCTION (this);
 
-  m_candidates.sort (&DsrCandidateQueue::CompareDSRVertex);
+  // bottom-up heap construction, O(n)
+  m_candidates.Reorder ();
   NS_LOG_LOGIC ("After reordering the CandidateQueue");
   NS_LOG_LOGIC (*this);
 }
 
+void
+DsrCandidateQueue::DecreaseKey (DSRVertex *v)
+{
+  NS_LOG_FUNCTION (this << v);
+  const std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> &positions = m_candidates.GetOrder ().positions;
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator i = positions.find (v->GetVertexId ());
+  NS_ASSERT_MSG (i != positions.end () && m_candidates.Get (i->second).vertex == v,
+                 "Vertex " << v->GetVertexId () << " not in the candidate queue");
+  m_candidates.DecreaseKey (i->second, m_candidates.Get (i->second));
+}
+
+bool
+DsrCandidateQueue::Before (const Candidate &c1, const Candidate &c2)
+{
+  if (CompareDSRVertex (c1.vertex, c2.vertex))
+    {
+      return true;
+    }
+  if (CompareDSRVertex (c2.vertex, c1.vertex))
+    {
+      return false;
+    }
+  return c1.seq < c2.seq;
+}
+
+bool
+DsrCandidateQueue::CandidateOrder::Before (const Candidate &c1, const Candidate &c2) const
+{
+  return DsrCandidateQueue::Before (c1, c2);
+}
+
+void
+DsrCandidateQueue::CandidateOrder::Moved (const Candidate &c, uint32_t pos)
+{
+  if (pos == DsrCandidateList_t::NO_POSITION)
+    {
+      positions.erase (c.vertex->GetVertexId ());
+    }
+  else
+    {
+      positions[c.vertex->GetVertexId ()] = pos;
+    }
+}
+
 /*
  * In this implementation, DSRVertex follows the ordering where
  * a vertex is ranked first if its GetDistanceFromRoot () is smaller;
@@ -22,8 +22,10 @@
 #define DSR_CANDIDATE_QUEUE_H
 
 #include <stdint.h>
-#include <list>
+#include <vector>
+#include <unordered_map>
 #include "ns3/ipv4-address.h"
+#include "dsr-indexed-heap.h"
 
 namespace ns3 {
 
@@ -45,8 +47,13 @@ class DSRVertex;
  *
  * Although a STL priority_queue almost does what we want, the requirement
  * for a Find () operation, the dynamic nature of the data and the derived
- * requirement for a Reorder () operation led us to implement this simple 
- * enhanced priority queue.
+ * requirement for a DecreaseKey () operation led us to implement this
+ * enhanced priority queue: an indexed 4-ary heap (DsrIndexedHeap), with the
+ * position of each vertex kept in a hash table keyed by vertex ID.  Push, Pop and DecreaseKey
+ * are O(log n), Top and Find are O(1).
+ *
+ * Vertices at the same distance are popped networks first (ECMP relies on
+ * it), then in the order they were pushed.
  */
 class DsrCandidateQueue
 {
@@ -154,6 +161,16 @@ public:
  */
   void Reorder (void);
 
+/**
+ * @brief Restore the priority order after the distance of one vertex of
+ * the queue decreased.
+ *
+ * @see DSRVertex
+ * @param v The Shortest Path First Vertex whose distance decreased; it
+ * must be in the queue.
+ */
+  void DecreaseKey (DSRVertex *v);
+
 private:
 /**
  * Candidate Queue copy construction is disallowed (not implemented) to 
@@ -184,8 +201,43 @@ private:
  */
   static bool CompareDSRVertex (const DSRVertex* v1, const DSRVertex* v2);
 
-  typedef std::list<DSRVertex*> DsrCandidateList_t; //!< container of DSRVertex pointers
+  /// A vertex of the heap and its push sequence number
+  struct Candidate
+  {
+    DSRVertex *vertex;  //!< the vertex
+    uint64_t seq;       //!< push order, breaks the remaining ties
+  };
+
+  /**
+   * \param c1 first operand
+   * \param c2 second operand
+   * \return True if c1 should be popped before c2
+   */
+  static bool Before (const Candidate &c1, const Candidate &c2);
+
+  /// Order of the candidates, and heap position of each vertex
+  struct CandidateOrder
+  {
+    /**
+     * \param c1 first operand
+     * \param c2 second operand
+     * \return True if c1 should be popped before c2
+     */
+    bool Before (const Candidate &c1, const Candidate &c2) const;
+    /**
+     * \brief Index a candidate at its new heap position.
+     * \param c the candidate
+     * \param pos the heap position, NO_POSITION once popped
+     */
+    void Moved (const Candidate &c, uint32_t pos);
+
+    /// heap position of each vertex ID
+    std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> positions;
+  };
+
+  typedef DsrIndexedHeap<Candidate, CandidateOrder> DsrCandidateList_t; //!< heap of DSRVertex candidates
   DsrCandidateList_t m_candidates;  //!< DSRVertex candidates
+  uint64_t m_nextSeq;               //!< sequence number of the next push
 
   /**
    * \brief Stream insertion operator.
@@ -0,0 +1,207 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include "dsr-deadline-queue.h"
+#include "dsr-tag.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrDeadlineQueue");
+
+NS_OBJECT_ENSURE_REGISTERED (DsrDeadlineQueue);
+
+TypeId
+DsrDeadlineQueue::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::DsrDeadlineQueue")
+    .SetParent<Queue<QueueDiscItem> > ()
+    .SetGroupName ("DsrRouting")
+    .AddConstructor<DsrDeadlineQueue> ()
+    .AddAttribute ("MaxSize",
+                   "The max queue size",
+                   QueueSizeValue (QueueSize ("100p")),
+                   MakeQueueSizeAccessor (&QueueBase::SetMaxSize,
+                                          &QueueBase::GetMaxSize),
+                   MakeQueueSizeChecker ())
+    .AddAttribute ("BucketWidth",
+                   "The span of deadlines sharing a calendar slot.",
+                   TimeValue (MicroSeconds (100)),
+                   MakeTimeAccessor (&DsrDeadlineQueue::m_bucketWidth),
+                   MakeTimeChecker (NanoSeconds (1)))
+    .AddAttribute ("Buckets",
+                   "The number of buckets of the calendar.  The earliest deadline is found in O(1) while the queued deadlines spread over less than Buckets * BucketWidth.",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&DsrDeadlineQueue::m_nBuckets),
+                   MakeUintegerChecker<uint32_t> (1))
+  ;
+  return tid;
+}
+
+DsrDeadlineQueue::DsrDeadlineQueue ()
+  : m_cursor (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DsrDeadlineQueue::~DsrDeadlineQueue ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+DsrDeadlineQueue::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_buckets.clear ();
+  Queue<QueueDiscItem>::DoDispose ();
+}
+
+Time
+DsrDeadlineQueue::GetDeadline (Ptr<const QueueDiscItem> item)
+{
+  DsrTag dsrTag;
+  if (item->GetPacket ()->PeekPacketTag (dsrTag) && dsrTag.GetBudget () != 0)
+    {
+      // the budget is in microseconds
+      return dsrTag.GetTimestamp () + MicroSeconds (dsrTag.GetBudget ());
+    }
+  return Time::Max ();
+}
+
+uint64_t
+DsrDeadlineQueue::GetSlot (uint64_t deadline) const
+{
+  return deadline / m_bucketWidth.GetNanoSeconds ();
+}
+
+bool
+DsrDeadlineQueue::Enqueue (Ptr<QueueDiscItem> item)
+{
+  NS_LOG_FUNCTION (this << item);
+  if (m_buckets.empty ())
+    {
+      m_buckets.resize (m_nBuckets);
+    }
+
+  Iterator pos;
+  if (!DoEnqueue (end (), item, pos))
+    {
+      return false;
+    }
+
+  Entry entry;
+  entry.deadline = GetDeadline (item).GetNanoSeconds ();
+  entry.item = pos;
+  uint64_t slot = GetSlot (entry.deadline);
+  Bucket &bucket = m_buckets[slot % m_nBuckets];
+  // after the packets of equal deadline, usually at the back
+  std::vector<Entry>::iterator at = bucket.entries.end ();
+  while (at != bucket.entries.begin () + bucket.head && entry.deadline < (at - 1)->deadline)
+    {
+      --at;
+    }
+  bucket.entries.insert (at, entry);
+  if (GetNPackets () == 1 || slot < m_cursor)
+    {
+      m_cursor = slot;
+    }
+  NS_LOG_LOGIC ("Deadline " << entry.deadline << "ns in slot " << slot);
+  return true;
+}
+
+uint32_t
+DsrDeadlineQueue::FindEarliest (void) const
+{
+  NS_ASSERT (!IsEmpty ());
+  // The first slot from the cursor whose bucket starts with a packet of
+  // that slot holds the earliest deadline: an earlier packet would be at
+  // the head of the bucket of its own slot, met before.
+  for (uint32_t i = 0; i < m_nBuckets; i++)
+    {
+      uint64_t slot = m_cursor + i;
+      const Bucket &bucket = m_buckets[slot % m_nBuckets];
+      if (bucket.head < bucket.entries.size () && GetSlot (bucket.entries[bucket.head].deadline) == slot)
+        {
+          m_cursor = slot;
+          return slot % m_nBuckets;
+        }
+    }
+  // nothing in the year following the cursor: compare the bucket heads
+  uint32_t earliest = m_nBuckets;
+  for (uint32_t i = 0; i < m_nBuckets; i++)
+    {
+      const Bucket &bucket = m_buckets[i];
+      if (bucket.head < bucket.entries.size ()
+          && (earliest == m_nBuckets
+              || bucket.entries[bucket.head].deadline < m_buckets[earliest].entries[m_buckets[earliest].head].deadline))
+        {
+          earliest = i;
+        }
+    }
+  NS_ASSERT (earliest < m_nBuckets);
+  m_cursor = GetSlot (m_buckets[earliest].entries[m_buckets[earliest].head].deadline);
+  return earliest;
+}
+
+DsrDeadlineQueue::Iterator
+DsrDeadlineQueue::PopEarliest (void)
+{
+  Bucket &bucket = m_buckets[FindEarliest ()];
+  Iterator pos = bucket.entries[bucket.head].item;
+  if (++bucket.head == bucket.entries.size ())
+    {
+      bucket.entries.clear ();
+      bucket.head = 0;
+    }
+  else if (bucket.head >= 32 && 2 * bucket.head >= bucket.entries.size ())
+    {
+      // reclaim the consumed half of the bucket
+      bucket.entries.erase (bucket.entries.begin (), bucket.entries.begin () + bucket.head);
+      bucket.head = 0;
+    }
+  return pos;
+}
+
+Ptr<QueueDiscItem>
+DsrDeadlineQueue::Dequeue (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  Ptr<QueueDiscItem> item = DoDequeue (PopEarliest ());
+  NS_LOG_LOGIC ("Popped " << item);
+  return item;
+}
+
+Ptr<QueueDiscItem>
+DsrDeadlineQueue::Remove (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  Ptr<QueueDiscItem> item = DoRemove (PopEarliest ());
+  NS_LOG_LOGIC ("Removed " << item);
+  return item;
+}
+
+Ptr<const QueueDiscItem>
+DsrDeadlineQueue::Peek (void) const
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  const Bucket &bucket = m_buckets[FindEarliest ()];
+  return DoPeek (bucket.entries[bucket.head].item);
+}
+
+} // namespace ns3
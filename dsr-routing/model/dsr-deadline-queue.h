@@ -0,0 +1,103 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_DEADLINE_QUEUE_H
+#define DSR_DEADLINE_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/queue.h"
+#include "ns3/queue-item.h"
+#include "ns3/nstime.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Queue serving its packets earliest deadline first.
+ *
+ * The deadline of a packet is the timestamp of its DsrTag plus its budget;
+ * packets without a budget have no deadline and are served after all the
+ * others, in arrival order.
+ *
+ * The packets are ordered by a calendar queue: deadlines are cut into
+ * slots of BucketWidth, and slot s goes to bucket s modulo Buckets.  Each
+ * bucket is a vector sorted by deadline, consumed from its head, and a
+ * cursor follows the earliest slot holding a packet, so that the earliest
+ * deadline is found in O(1) as long as the deadlines of the queued packets
+ * spread over less than Buckets * BucketWidth.  Packets of one flow come
+ * with increasing deadlines, so an insertion lands at the back of its
+ * bucket and the vectors are only reallocated while they grow.
+ *
+ * DsrVirtualQueueDisc uses it for the lanes of type "edf".
+ */
+class DsrDeadlineQueue : public Queue<QueueDiscItem>
+{
+public:
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  DsrDeadlineQueue ();
+  virtual ~DsrDeadlineQueue ();
+
+  virtual bool Enqueue (Ptr<QueueDiscItem> item);
+  virtual Ptr<QueueDiscItem> Dequeue (void);
+  virtual Ptr<QueueDiscItem> Remove (void);
+  virtual Ptr<const QueueDiscItem> Peek (void) const;
+
+  /**
+   * \brief Get the deadline of a packet from its DsrTag.
+   * \param item the packet
+   * \return the deadline, or Time::Max () if the packet has no budget
+   */
+  static Time GetDeadline (Ptr<const QueueDiscItem> item);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  /// A queued packet, by deadline
+  struct Entry
+  {
+    uint64_t deadline;                  //!< deadline, in nanoseconds
+    Iterator item;                      //!< the packet in the queue
+  };
+
+  /// The packets of the slots falling into one bucket
+  struct Bucket
+  {
+    std::vector<Entry> entries;         //!< packets sorted by deadline, from head
+    uint32_t head;                      //!< index of the first packet left
+  };
+
+  /**
+   * \param deadline a deadline, in nanoseconds
+   * \return the calendar slot of the deadline
+   */
+  uint64_t GetSlot (uint64_t deadline) const;
+
+  /**
+   * \brief Find the bucket holding the earliest deadline and move the
+   * cursor to its slot.
+   * \return the bucket index; the queue must not be empty
+   */
+  uint32_t FindEarliest (void) const;
+
+  /**
+   * \brief Take the packet of earliest deadline out of the calendar.
+   * \return the position of the packet in the queue; the queue must not
+   * be empty
+   */
+  Iterator PopEarliest (void);
+
+  Time m_bucketWidth;                   //!< width of a calendar slot
+  uint32_t m_nBuckets;                  //!< number of buckets
+  std::vector<Bucket> m_buckets;        //!< the calendar
+  mutable uint64_t m_cursor;            //!< no queued packet has a slot before it
+};
+
+} // namespace ns3
+
+#endif /* DSR_DEADLINE_QUEUE_H */
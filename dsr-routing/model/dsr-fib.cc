@@ -0,0 +1,328 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "dsr-fib.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrFib");
+
+DsrFib::DsrFib ()
+  : m_index (16, 0),
+    m_nRoutes (0),
+    m_cursorBucket (0),
+    m_cursorFirst (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DsrFib::~DsrFib ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+uint32_t
+DsrFib::Hash (uint32_t key)
+{
+  // Fibonacci hashing spreads the low-entropy, mostly sequential
+  // addresses of a simulated topology over the whole table
+  return key * 2654435769u;
+}
+
+int32_t
+DsrFib::FindBucket (Ipv4Address dest) const
+{
+  uint32_t key = dest.Get ();
+  uint32_t mask = m_index.size () - 1;
+  for (uint32_t slot = Hash (key) & mask; ; slot = (slot + 1) & mask)
+    {
+      uint32_t b = m_index[slot];
+      if (b == 0)
+        {
+          return -1;
+        }
+      if (m_buckets[b - 1].dest.Get () == key)
+        {
+          return b - 1;
+        }
+    }
+}
+
+void
+DsrFib::IndexInsert (uint32_t key, uint32_t bucket)
+{
+  uint32_t mask = m_index.size () - 1;
+  uint32_t slot = Hash (key) & mask;
+  while (m_index[slot] != 0)
+    {
+      slot = (slot + 1) & mask;
+    }
+  m_index[slot] = bucket + 1;
+}
+
+void
+DsrFib::Rehash (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+  m_index.assign (capacity, 0);
+  for (uint32_t b = 0; b < m_buckets.size (); b++)
+    {
+      IndexInsert (m_buckets[b].dest.Get (), b);
+    }
+}
+
+uint32_t
+DsrFib::GetBucket (Ipv4Address dest)
+{
+  int32_t b = FindBucket (dest);
+  if (b >= 0)
+    {
+      return b;
+    }
+  m_buckets.push_back (Bucket ());
+  m_buckets.back ().dest = dest;
+  m_buckets.back ().failedOver = false;
+  b = m_buckets.size () - 1;
+  // keep the load factor under one half
+  if (m_buckets.size () * 2 > m_index.size ())
+    {
+      Rehash (m_index.size () * 2);
+    }
+  else
+    {
+      IndexInsert (dest.Get (), b);
+    }
+  return b;
+}
+
+void
+DsrFib::InsertSorted (uint32_t bucket, const Ipv4DSRRoutingTableEntry &route)
+{
+  std::vector<Ipv4DSRRoutingTableEntry> &routes = m_buckets[bucket].routes;
+  // insert after every candidate that is not longer than the new one
+  std::vector<Ipv4DSRRoutingTableEntry>::iterator pos = routes.end ();
+  while (pos != routes.begin () && (pos - 1)->GetDistance () > route.GetDistance ())
+    {
+      --pos;
+    }
+  routes.insert (pos, route);
+  m_nRoutes++;
+  m_cursorBucket = m_cursorFirst = 0;
+}
+
+void
+DsrFib::Insert (const Ipv4DSRRoutingTableEntry &route)
+{
+  NS_LOG_FUNCTION (this << route.GetDest ());
+  NS_ASSERT (route.IsHost ());
+  InsertSorted (GetBucket (route.GetDest ()), route);
+}
+
+bool
+DsrFib::InsertUnique (const Ipv4DSRRoutingTableEntry &route)
+{
+  NS_LOG_FUNCTION (this << route.GetDest ());
+  NS_ASSERT (route.IsHost ());
+  uint32_t b = GetBucket (route.GetDest ());
+  std::vector<Ipv4DSRRoutingTableEntry> &routes = m_buckets[b].routes;
+  for (uint32_t i = 0; i < routes.size (); i++)
+    {
+      if (routes[i].GetGateway () == route.GetGateway ()
+          && routes[i].GetInterface () == route.GetInterface ()
+          && routes[i].GetVia () == route.GetVia ())
+        {
+          if (routes[i].GetDistance () <= route.GetDistance ())
+            {
+              return false;
+            }
+          routes.erase (routes.begin () + i);
+          m_nRoutes--;
+          m_cursorBucket = m_cursorFirst = 0;
+          break;
+        }
+    }
+  InsertSorted (b, route);
+  return true;
+}
+
+const Ipv4DSRRoutingTableEntry *
+DsrFib::Lookup (Ipv4Address dest, uint32_t &n) const
+{
+  int32_t b = FindBucket (dest);
+  if (b < 0 || m_buckets[b].routes.empty ())
+    {
+      n = 0;
+      return 0;
+    }
+  n = m_buckets[b].routes.size ();
+  return &m_buckets[b].routes[0];
+}
+
+uint32_t
+DsrFib::GetNRoutes (void) const
+{
+  return m_nRoutes;
+}
+
+void
+DsrFib::Locate (uint32_t i, uint32_t &bucket, uint32_t &offset) const
+{
+  NS_ASSERT (i < m_nRoutes);
+  if (i < m_cursorFirst)
+    {
+      m_cursorBucket = m_cursorFirst = 0;
+    }
+  uint32_t first = m_cursorFirst;
+  for (bucket = m_cursorBucket; bucket < m_buckets.size (); bucket++)
+    {
+      uint32_t size = m_buckets[bucket].routes.size ();
+      if (i - first < size)
+        {
+          offset = i - first;
+          m_cursorBucket = bucket;
+          m_cursorFirst = first;
+          return;
+        }
+      first += size;
+    }
+  NS_ASSERT (false);
+}
+
+Ipv4DSRRoutingTableEntry *
+DsrFib::GetRoute (uint32_t i) const
+{
+  uint32_t bucket, offset;
+  Locate (i, bucket, offset);
+  return const_cast<Ipv4DSRRoutingTableEntry *> (&m_buckets[bucket].routes[offset]);
+}
+
+void
+DsrFib::RemoveRoute (uint32_t i)
+{
+  NS_LOG_FUNCTION (this << i);
+  uint32_t bucket, offset;
+  Locate (i, bucket, offset);
+  std::vector<Ipv4DSRRoutingTableEntry> &routes = m_buckets[bucket].routes;
+  routes.erase (routes.begin () + offset);
+  m_nRoutes--;
+  m_cursorBucket = m_cursorFirst = 0;
+  if (routes.empty ())
+    {
+      m_buckets.erase (m_buckets.begin () + bucket);
+      Rehash (m_index.size ());
+    }
+}
+
+uint32_t
+DsrFib::RemoveRoutesTo (Ipv4Address dest)
+{
+  NS_LOG_FUNCTION (this << dest);
+  int32_t b = FindBucket (dest);
+  if (b < 0)
+    {
+      return 0;
+    }
+  // an empty bucket is skipped by Lookup and Locate, and refilled in place
+  uint32_t n = m_buckets[b].routes.size ();
+  m_buckets[b].routes.clear ();
+  m_buckets[b].failedOver = false;
+  m_nRoutes -= n;
+  m_cursorBucket = m_cursorFirst = 0;
+  return n;
+}
+
+uint32_t
+DsrFib::RemoveRoutesThrough (uint32_t interface, std::vector<Ipv4DSRRoutingTableEntry> *removed)
+{
+  NS_LOG_FUNCTION (this << interface);
+  uint32_t n = 0;
+  for (uint32_t b = 0; b < m_buckets.size (); b++)
+    {
+      std::vector<Ipv4DSRRoutingTableEntry> &routes = m_buckets[b].routes;
+      uint32_t kept = 0;
+      for (uint32_t i = 0; i < routes.size (); i++)
+        {
+          if (routes[i].GetInterface () != interface)
+            {
+              routes[kept++] = routes[i];
+            }
+          else if (removed != 0)
+            {
+              removed->push_back (routes[i]);
+            }
+        }
+      if (kept < routes.size ())
+        {
+          // the destination keeps its place, as with RemoveRoutesTo
+          n += routes.size () - kept;
+          routes.resize (kept);
+          m_buckets[b].failedOver = true;
+        }
+    }
+  m_nRoutes -= n;
+  m_cursorBucket = m_cursorFirst = 0;
+  return n;
+}
+
+bool
+DsrFib::IsFailedOver (Ipv4Address dest) const
+{
+  int32_t b = FindBucket (dest);
+  return b >= 0 && m_buckets[b].failedOver;
+}
+
+void
+DsrFib::SetFailedOver (Ipv4Address dest, bool failedOver)
+{
+  int32_t b = FindBucket (dest);
+  if (b >= 0)
+    {
+      m_buckets[b].failedOver = failedOver;
+    }
+}
+
+bool
+DsrFib::MarkLoopFreeAlternate (Ipv4Address dest, Ipv4Address gateway, uint32_t interface)
+{
+  int32_t b = FindBucket (dest);
+  if (b < 0)
+    {
+      return false;
+    }
+  std::vector<Ipv4DSRRoutingTableEntry> &routes = m_buckets[b].routes;
+  for (uint32_t i = 0; i < routes.size (); i++)
+    {
+      if (routes[i].GetGateway () == gateway && routes[i].GetInterface () == interface
+          && routes[i].GetVia () == Ipv4Address::GetZero ())
+        {
+          routes[i].SetLoopFreeAlternate (true);
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+DsrFib::Clear (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_buckets.clear ();
+  m_index.assign (16, 0);
+  m_nRoutes = 0;
+  m_cursorBucket = m_cursorFirst = 0;
+}
+
+void
+DsrFib::Swap (DsrFib &other)
+{
+  NS_LOG_FUNCTION (this);
+  m_buckets.swap (other.m_buckets);
+  m_index.swap (other.m_index);
+  std::swap (m_nRoutes, other.m_nRoutes);
+  m_cursorBucket = m_cursorFirst = 0;
+  other.m_cursorBucket = other.m_cursorFirst = 0;
+}
+
+} // namespace ns3
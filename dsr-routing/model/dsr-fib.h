@@ -0,0 +1,208 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_FIB_H
+#define DSR_FIB_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/ipv4-address.h"
+#include "ipv4-dsr-routing-table-entry.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Destination-indexed forwarding table used by Ipv4DSRRouting.
+ *
+ * Host routes are grouped per destination.  The candidate next hops of one
+ * destination are stored contiguously and kept sorted by increasing
+ * distance (routes with the same distance keep their insertion order), so
+ * a lookup is one hash probe followed by a walk over the candidates of that
+ * destination only.
+ *
+ * The destination index is a small open-addressing hash table (linear
+ * probing, power-of-two capacity) keyed by the 32-bit destination address.
+ *
+ * Externally the table still appears as a flat list of routes: destinations
+ * in the order they were first added, and the candidates of a destination
+ * in distance order.  This is the order used by GetRoute () and
+ * RemoveRoute ().
+ */
+class DsrFib
+{
+public:
+  DsrFib ();
+  ~DsrFib ();
+
+  /**
+   * \brief Add a host route, keeping the candidates of its destination
+   * sorted by distance.
+   * \param route the route to add
+   */
+  void Insert (const Ipv4DSRRoutingTableEntry &route);
+
+  /**
+   * \brief Add a host route unless its destination already has a candidate
+   * through the same gateway, interface and next hop of the gateway.
+   *
+   * If it has one, only the shorter of the two is kept.
+   *
+   * \param route the route to add
+   * \return true if \p route was added
+   */
+  bool InsertUnique (const Ipv4DSRRoutingTableEntry &route);
+
+  /**
+   * \brief Find the candidates to a destination.
+   * \param dest the destination address
+   * \param n the number of candidates (0 if the destination is unknown)
+   * \return a pointer to the first (shortest) candidate, or 0
+   */
+  const Ipv4DSRRoutingTableEntry *Lookup (Ipv4Address dest, uint32_t &n) const;
+
+  /**
+   * \return the number of host routes in the table
+   */
+  uint32_t GetNRoutes (void) const;
+
+  /**
+   * \param i the index of the route, in [0, GetNRoutes ())
+   * \return the i-th route of the table
+   *
+   * \warning The route is stored in place, in the candidate array of its
+   * destination.  The pointer is invalidated by the next Insert,
+   * InsertUnique, RemoveRoute, RemoveRoutesTo, RemoveRoutesThrough,
+   * Clear or Swap, as is the pointer returned by Lookup.
+   */
+  Ipv4DSRRoutingTableEntry *GetRoute (uint32_t i) const;
+
+  /**
+   * \brief Remove the i-th route of the table.
+   * \param i the index of the route, in [0, GetNRoutes ())
+   */
+  void RemoveRoute (uint32_t i);
+
+  /**
+   * \brief Remove every candidate to a destination.
+   *
+   * The destination keeps its place in the table, so that routes added
+   * to it again are listed where its previous ones were.
+   *
+   * \param dest the destination address
+   * \return the number of routes removed
+   */
+  uint32_t RemoveRoutesTo (Ipv4Address dest);
+
+  /**
+   * \brief Remove the candidates through an interface, to every
+   * destination.
+   *
+   * The destinations that lose a candidate are marked as failed over
+   * until their routes are replaced, or until SetFailedOver clears them.
+   *
+   * \param interface the interface index
+   * \param removed if not 0, where to append the routes removed
+   * \return the number of routes removed
+   */
+  uint32_t RemoveRoutesThrough (uint32_t interface, std::vector<Ipv4DSRRoutingTableEntry> *removed = 0);
+
+  /**
+   * \param dest the destination address
+   * \return true if a candidate to \p dest was removed by
+   * RemoveRoutesThrough () since its routes were last replaced
+   */
+  bool IsFailedOver (Ipv4Address dest) const;
+
+  /**
+   * \brief Mark a destination as failed over, or clear the mark.
+   * \param dest the destination address
+   * \param failedOver whether \p dest lost a candidate to an interface
+   * that is still down
+   */
+  void SetFailedOver (Ipv4Address dest, bool failedOver);
+
+  /**
+   * \brief Mark the candidate to a destination through a gateway and
+   * interface, on the gateway's own shortest route, as a loop-free
+   * alternate.
+   * \param dest the destination address
+   * \param gateway the next hop of the candidate
+   * \param interface the interface of the candidate
+   * \return true if the candidate was found
+   */
+  bool MarkLoopFreeAlternate (Ipv4Address dest, Ipv4Address gateway, uint32_t interface);
+
+  /**
+   * \brief Remove every route.
+   */
+  void Clear (void);
+
+  /**
+   * \brief Exchange the content of two tables.
+   * \param other the other table
+   */
+  void Swap (DsrFib &other);
+
+private:
+  /// The candidates of one destination, sorted by distance
+  struct Bucket
+  {
+    Ipv4Address dest;                                //!< destination
+    std::vector<Ipv4DSRRoutingTableEntry> routes;    //!< candidates
+    bool failedOver;                                 //!< lost a candidate to an interface failure
+  };
+
+  /**
+   * \param dest a destination address
+   * \return the bucket index of \p dest, or -1 if unknown
+   */
+  int32_t FindBucket (Ipv4Address dest) const;
+  /**
+   * \brief Get the bucket of a destination, creating it if needed.
+   * \param dest a destination address
+   * \return the bucket index of \p dest
+   */
+  uint32_t GetBucket (Ipv4Address dest);
+  /**
+   * \brief Insert a route in a bucket, after every candidate that is not
+   * longer than it.
+   * \param bucket the bucket index
+   * \param route the route
+   */
+  void InsertSorted (uint32_t bucket, const Ipv4DSRRoutingTableEntry &route);
+  /**
+   * \brief Rebuild the hash index for the current buckets.
+   * \param capacity the number of slots, a power of two
+   */
+  void Rehash (uint32_t capacity);
+  /**
+   * \brief Insert a bucket index into the hash index.
+   * \param key the destination address as an integer
+   * \param bucket the bucket index
+   */
+  void IndexInsert (uint32_t key, uint32_t bucket);
+  /**
+   * \brief Locate the i-th route of the table.
+   *
+   * The search starts from the bucket found by the previous call when it
+   * is not past \p i, so that walking the table with increasing indexes
+   * costs one step per route.
+   *
+   * \param i the route index
+   * \param bucket the bucket holding the route
+   * \param offset the position of the route in its bucket
+   */
+  void Locate (uint32_t i, uint32_t &bucket, uint32_t &offset) const;
+
+  static uint32_t Hash (uint32_t key);
+
+  std::vector<Bucket> m_buckets;   //!< destinations, in insertion order
+  std::vector<uint32_t> m_index;   //!< hash slots: bucket index + 1, 0 if empty
+  uint32_t m_nRoutes;              //!< total number of routes
+  mutable uint32_t m_cursorBucket; //!< bucket found by the last Locate ()
+  mutable uint32_t m_cursorFirst;  //!< index of the first route of that bucket
+};
+
+} // namespace ns3
+
+#endif /* DSR_FIB_H */
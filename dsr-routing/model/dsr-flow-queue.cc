@@ -0,0 +1,233 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "ns3/log.h"
+#include "ns3/uinteger.h"
+#include "dsr-flow-queue.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrFlowQueue");
+
+NS_OBJECT_ENSURE_REGISTERED (DsrFlowQueue);
+
+const uint32_t DsrFlowQueue::NONE;
+
+TypeId
+DsrFlowQueue::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::DsrFlowQueue")
+    .SetParent<Queue<QueueDiscItem> > ()
+    .SetGroupName ("DsrRouting")
+    .AddConstructor<DsrFlowQueue> ()
+    .AddAttribute ("MaxSize",
+                   "The max queue size",
+                   QueueSizeValue (QueueSize ("100p")),
+                   MakeQueueSizeAccessor (&QueueBase::SetMaxSize,
+                                          &QueueBase::GetMaxSize),
+                   MakeQueueSizeChecker ())
+    .AddAttribute ("Flows",
+                   "The number of buckets the flows are hashed into.",
+                   UintegerValue (16),
+                   MakeUintegerAccessor (&DsrFlowQueue::m_nFlows),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Perturbation",
+                   "The perturbation of the flow hash.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&DsrFlowQueue::m_perturbation),
+                   MakeUintegerChecker<uint32_t> ())
+  ;
+  return tid;
+}
+
+DsrFlowQueue::DsrFlowQueue ()
+  : m_ringHead (0),
+    m_nActive (0),
+    m_freeSlots (NONE)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+DsrFlowQueue::~DsrFlowQueue ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+DsrFlowQueue::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_flows.clear ();
+  m_ring.clear ();
+  m_slots.clear ();
+  Queue<QueueDiscItem>::DoDispose ();
+}
+
+void
+DsrFlowQueue::InitializeFlows (void)
+{
+  Flow empty;
+  empty.head = NONE;
+  empty.tail = NONE;
+  empty.nPackets = 0;
+  m_flows.assign (m_nFlows, empty);
+  m_ring.assign (m_nFlows, 0);
+  m_ringHead = 0;
+  m_nActive = 0;
+}
+
+uint32_t
+DsrFlowQueue::GetNActiveFlows (void) const
+{
+  return m_nActive;
+}
+
+bool
+DsrFlowQueue::Enqueue (Ptr<QueueDiscItem> item)
+{
+  NS_LOG_FUNCTION (this << item);
+  if (m_flows.empty ())
+    {
+      InitializeFlows ();
+    }
+
+  Iterator pos;
+  if (!DoEnqueue (end (), item, pos))
+    {
+      return false;
+    }
+
+  uint32_t slot = m_freeSlots;
+  if (slot == NONE)
+    {
+      slot = m_slots.size ();
+      m_slots.push_back (Slot ());
+    }
+  else
+    {
+      m_freeSlots = m_slots[slot].next;
+    }
+  m_slots[slot].item = pos;
+  m_slots[slot].next = NONE;
+
+  uint32_t flow = item->Hash (m_perturbation) % m_nFlows;
+  Flow &f = m_flows[flow];
+  if (f.nPackets == 0)
+    {
+      f.head = slot;
+      m_ring[(m_ringHead + m_nActive) % m_nFlows] = flow;
+      m_nActive++;
+    }
+  else
+    {
+      m_slots[f.tail].next = slot;
+    }
+  f.tail = slot;
+  f.nPackets++;
+  NS_LOG_LOGIC ("Packet " << item << " in flow bucket " << flow << " of " << f.nPackets << " packets");
+  return true;
+}
+
+DsrFlowQueue::Iterator
+DsrFlowQueue::PopFlow (uint32_t flow)
+{
+  Flow &f = m_flows[flow];
+  uint32_t slot = f.head;
+  Iterator pos = m_slots[slot].item;
+  f.head = m_slots[slot].next;
+  f.nPackets--;
+  m_slots[slot].next = m_freeSlots;
+  m_freeSlots = slot;
+
+  if (f.nPackets == 0)
+    {
+      f.tail = NONE;
+      // take the bucket out of the ring, keeping the order of the others
+      uint32_t i = 0;
+      while (m_ring[(m_ringHead + i) % m_nFlows] != flow)
+        {
+          i++;
+        }
+      if (i == 0)
+        {
+          m_ringHead = (m_ringHead + 1) % m_nFlows;
+        }
+      for (; i != 0 && i + 1 < m_nActive; i++)
+        {
+          m_ring[(m_ringHead + i) % m_nFlows] = m_ring[(m_ringHead + i + 1) % m_nFlows];
+        }
+      m_nActive--;
+    }
+  return pos;
+}
+
+Ptr<QueueDiscItem>
+DsrFlowQueue::Dequeue (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  uint32_t flow = m_ring[m_ringHead];
+  Iterator pos = PopFlow (flow);
+  if (m_flows[flow].nPackets != 0)
+    {
+      // the bucket goes to the back of the ring
+      m_ring[(m_ringHead + m_nActive) % m_nFlows] = flow;
+      m_ringHead = (m_ringHead + 1) % m_nFlows;
+    }
+  Ptr<QueueDiscItem> item = DoDequeue (pos);
+  NS_LOG_LOGIC ("Popped " << item << " from flow bucket " << flow);
+  return item;
+}
+
+Ptr<QueueDiscItem>
+DsrFlowQueue::Remove (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  Ptr<QueueDiscItem> item = DoRemove (PopFlow (m_ring[m_ringHead]));
+  NS_LOG_LOGIC ("Removed " << item);
+  return item;
+}
+
+Ptr<QueueDiscItem>
+DsrFlowQueue::DequeueFromLongestFlow (void)
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      return 0;
+    }
+  uint32_t longest = m_ring[m_ringHead];
+  for (uint32_t i = 1; i < m_nActive; i++)
+    {
+      uint32_t flow = m_ring[(m_ringHead + i) % m_nFlows];
+      if (m_flows[flow].nPackets > m_flows[longest].nPackets)
+        {
+          longest = flow;
+        }
+    }
+  Ptr<QueueDiscItem> item = DoDequeue (PopFlow (longest));
+  NS_LOG_LOGIC ("Popped " << item << " from the longest flow bucket " << longest);
+  return item;
+}
+
+Ptr<const QueueDiscItem>
+DsrFlowQueue::Peek (void) const
+{
+  NS_LOG_FUNCTION (this);
+  if (IsEmpty ())
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  return DoPeek (m_slots[m_flows[m_ring[m_ringHead]].head].item);
+}
+
+} // namespace ns3
@@ -0,0 +1,104 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_FLOW_QUEUE_H
+#define DSR_FLOW_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/queue.h"
+#include "ns3/queue-item.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Queue serving its flows round robin.
+ *
+ * The packets are hashed on their 5-tuple into Flows buckets, each bucket
+ * a FIFO, and the non-empty buckets take turns sending one packet each.
+ * A flow sending faster than the others therefore builds its own backlog
+ * without delaying theirs; when the queue is full, DequeueFromLongestFlow
+ * makes room at the expense of the longest backlog.
+ *
+ * The buckets and the ring of the non-empty ones are arrays of Flows
+ * entries.  The FIFO of a bucket is a list threaded through a pool of
+ * slots, recycled through a free list, so that the pool only grows while
+ * the queue holds more packets than ever before.
+ *
+ * DsrVirtualQueueDisc uses it for the lanes of type "fq".
+ */
+class DsrFlowQueue : public Queue<QueueDiscItem>
+{
+public:
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  DsrFlowQueue ();
+  virtual ~DsrFlowQueue ();
+
+  virtual bool Enqueue (Ptr<QueueDiscItem> item);
+  virtual Ptr<QueueDiscItem> Dequeue (void);
+  virtual Ptr<QueueDiscItem> Remove (void);
+  virtual Ptr<const QueueDiscItem> Peek (void) const;
+
+  /**
+   * \brief Take the head packet of the bucket with the most packets out of
+   * the queue, to make room for a new one.
+   * \return the packet, or 0 if the queue is empty
+   */
+  Ptr<QueueDiscItem> DequeueFromLongestFlow (void);
+
+  /**
+   * \return the number of buckets holding packets
+   */
+  uint32_t GetNActiveFlows (void) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  /// End of a slot list
+  static const uint32_t NONE = 0xffffffff;
+
+  /// A queued packet
+  struct Slot
+  {
+    Iterator item;                      //!< the packet in the queue
+    uint32_t next;                      //!< next slot of the bucket or of the free list
+  };
+
+  /// A bucket of flows
+  struct Flow
+  {
+    uint32_t head;                      //!< first slot, or NONE
+    uint32_t tail;                      //!< last slot, or NONE
+    uint32_t nPackets;                  //!< packets in the bucket
+  };
+
+  /// Allocate the buckets and the ring on first use
+  void InitializeFlows (void);
+
+  /**
+   * \brief Take the head packet of a bucket out of its FIFO and out of the
+   * ring if the bucket becomes empty.
+   * \param flow the bucket index
+   * \return the position of the packet in the queue
+   */
+  Iterator PopFlow (uint32_t flow);
+
+  uint32_t m_nFlows;                    //!< number of buckets
+  uint32_t m_perturbation;              //!< hash perturbation
+  std::vector<Flow> m_flows;            //!< the buckets
+  std::vector<uint32_t> m_ring;         //!< non-empty buckets, in service order
+  uint32_t m_ringHead;                  //!< index of the bucket served next in m_ring
+  uint32_t m_nActive;                   //!< number of buckets in m_ring
+  std::vector<Slot> m_slots;            //!< slot pool
+  uint32_t m_freeSlots;                 //!< first free slot, or NONE
+};
+
+} // namespace ns3
+
+#endif /* DSR_FLOW_QUEUE_H */
@@ -0,0 +1,234 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_INDEXED_HEAP_H
+#define DSR_INDEXED_HEAP_H
+
+#include <stdint.h>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Indexed 4-ary min-heap, the priority queue of the SPF calculations
+ * of the module.
+ *
+ * The heap only orders the items; the policy \p Order says which item comes
+ * first and keeps track of where each item is:
+ *
+ * - bool Order::Before (const Item &a, const Item &b) const, true if \p a
+ *   must be popped before \p b
+ * - void Order::Moved (const Item &item, uint32_t pos), called every time
+ *   \p item is placed at heap position \p pos, and with NO_POSITION when it
+ *   leaves the heap
+ *
+ * so the owner can find the position of an item in O(1) and call
+ * DecreaseKey on it.  Push, Pop and DecreaseKey are O(log n), Top is O(1).
+ *
+ * DsrCandidateQueue keeps the positions of its vertices in a hash table
+ * keyed by vertex ID; the SPF on the frozen LSDB of DSRRouteManagerImpl
+ * keeps them in an array indexed by router.
+ */
+template <class Item, class Order>
+class DsrIndexedHeap
+{
+public:
+  static const uint32_t NO_POSITION = 0xffffffff;  //!< position of an item out of the heap
+
+  /**
+   * \param order the order of the items
+   */
+  explicit DsrIndexedHeap (const Order &order = Order ())
+    : m_order (order)
+  {
+  }
+
+  /**
+   * \return the order of the items, and the positions it tracks
+   */
+  Order &GetOrder (void)
+  {
+    return m_order;
+  }
+
+  /**
+   * \return the order of the items, and the positions it tracks
+   */
+  const Order &GetOrder (void) const
+  {
+    return m_order;
+  }
+
+  /**
+   * \brief Remove every item, each one reported at NO_POSITION.
+   */
+  void Clear (void)
+  {
+    for (uint32_t i = 0; i < m_items.size (); i++)
+      {
+        m_order.Moved (m_items[i], NO_POSITION);
+      }
+    m_items.clear ();
+  }
+
+  /**
+   * \return true if the heap has no item
+   */
+  bool Empty (void) const
+  {
+    return m_items.empty ();
+  }
+
+  /**
+   * \return the number of items in the heap
+   */
+  uint32_t Size (void) const
+  {
+    return m_items.size ();
+  }
+
+  /**
+   * \param pos a heap position, in [0, Size ())
+   * \return the item at that position
+   */
+  const Item &Get (uint32_t pos) const
+  {
+    return m_items[pos];
+  }
+
+  /**
+   * \return the first item, the heap must not be empty
+   */
+  const Item &Top (void) const
+  {
+    return m_items.front ();
+  }
+
+  /**
+   * \param item the item to add
+   */
+  void Push (const Item &item)
+  {
+    m_items.push_back (item);
+    SiftUp (m_items.size () - 1);
+  }
+
+  /**
+   * \brief Remove the first item, the heap must not be empty.
+   * \return the item removed
+   */
+  Item Pop (void)
+  {
+    Item top = m_items.front ();
+    Item last = m_items.back ();
+    m_items.pop_back ();
+    m_order.Moved (top, NO_POSITION);
+    if (!m_items.empty ())
+      {
+        m_items[0] = last;
+        SiftDown (0);
+      }
+    return top;
+  }
+
+  /**
+   * \brief Replace an item by one that comes before it, or by itself once
+   * what Order compares has decreased.
+   * \param pos the heap position of the item
+   * \param item the new item
+   */
+  void DecreaseKey (uint32_t pos, const Item &item)
+  {
+    m_items[pos] = item;
+    SiftUp (pos);
+  }
+
+  /**
+   * \brief Restore the heap order of every item, in O(n), after what Order
+   * compares has changed in any direction.
+   */
+  void Reorder (void)
+  {
+    for (uint32_t i = m_items.size (); i-- > 0; )
+      {
+        SiftDown (i);
+      }
+  }
+
+private:
+  static const uint32_t ARITY = 4;  //!< children per heap node
+
+  /**
+   * \brief Place an item at a heap position and report it.
+   * \param pos the heap position
+   * \param item the item
+   */
+  void Place (uint32_t pos, const Item &item)
+  {
+    m_items[pos] = item;
+    m_order.Moved (item, pos);
+  }
+
+  /**
+   * \brief Move the item at a position up to its place.
+   * \param pos the heap position
+   */
+  void SiftUp (uint32_t pos)
+  {
+    Item item = m_items[pos];
+    while (pos > 0)
+      {
+        uint32_t parent = (pos - 1) / ARITY;
+        if (!m_order.Before (item, m_items[parent]))
+          {
+            break;
+          }
+        Place (pos, m_items[parent]);
+        pos = parent;
+      }
+    Place (pos, item);
+  }
+
+  /**
+   * \brief Move the item at a position down to its place.
+   * \param pos the heap position
+   */
+  void SiftDown (uint32_t pos)
+  {
+    Item item = m_items[pos];
+    uint32_t n = m_items.size ();
+    while (true)
+      {
+        uint32_t first = pos * ARITY + 1;
+        if (first >= n)
+          {
+            break;
+          }
+        uint32_t best = first;
+        for (uint32_t child = first + 1; child < first + ARITY && child < n; child++)
+          {
+            if (m_order.Before (m_items[child], m_items[best]))
+              {
+                best = child;
+              }
+          }
+        if (!m_order.Before (m_items[best], item))
+          {
+            break;
+          }
+        Place (pos, m_items[best]);
+        pos = best;
+      }
+    Place (pos, item);
+  }
+
+  std::vector<Item> m_items;    //!< the items, in heap order
+  Order m_order;                //!< the order of the items, and their positions
+};
+
+template <class Item, class Order>
+const uint32_t DsrIndexedHeap<Item, Order>::NO_POSITION;
+
+} // namespace ns3
+
+#endif /* DSR_INDEXED_HEAP_H */
@@ -0,0 +1,131 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <algorithm>
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "dsr-prefix-table.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("DsrPrefixTable");
+
+const uint32_t DsrPrefixTable::NONE;
+
+DsrPrefixTable::DsrPrefixTable ()
+  : m_starts (1, 0),
+    m_values (1, NONE)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+DsrPrefixTable::Insert (Ipv4Address prefix, Ipv4Mask mask, uint32_t value)
+{
+  NS_LOG_FUNCTION (this << prefix << mask << value);
+  NS_ASSERT (value != NONE);
+  Prefix p;
+  p.first = prefix.Get () & mask.Get ();
+  p.last = p.first | ~mask.Get ();
+  p.value = value;
+  p.order = m_prefixes.size ();
+  m_prefixes.push_back (p);
+}
+
+void
+DsrPrefixTable::Clear (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_prefixes.clear ();
+  m_starts.assign (1, 0);
+  m_values.assign (1, NONE);
+}
+
+void
+DsrPrefixTable::Append (uint32_t start, uint32_t value)
+{
+  if (!m_values.empty () && m_values.back () == value)
+    {
+      return;
+    }
+  m_starts.push_back (start);
+  m_values.push_back (value);
+}
+
+//
+// Two prefixes are either disjoint or nested.  Sorted by first address and
+// then from the widest to the narrowest, the prefixes open in the order of
+// their first address, and the ones covering the current address form a
+// stack, the narrowest on top.  Sweeping the addresses, each range runs up
+// to the next prefix opening or to the end of the prefix on top, and takes
+// its value.
+//
+void
+DsrPrefixTable::Build (void)
+{
+  NS_LOG_FUNCTION (this);
+  std::vector<Prefix> sorted (m_prefixes);
+  std::sort (sorted.begin (), sorted.end (),
+             [] (const Prefix &a, const Prefix &b)
+             {
+               if (a.first != b.first)
+                 {
+                   return a.first < b.first;
+                 }
+               if (a.last != b.last)
+                 {
+                   return a.last > b.last;
+                 }
+               return a.order < b.order;
+             });
+  m_starts.clear ();
+  m_values.clear ();
+  std::vector<const Prefix *> open;
+  uint64_t current = 0;
+  for (uint32_t i = 0; i <= sorted.size (); i++)
+    {
+      uint64_t next = i < sorted.size () ? sorted[i].first : uint64_t (1) << 32;
+      // close the prefixes ending before the next one opens
+      while (!open.empty () && open.back ()->last < next)
+        {
+          if (current <= open.back ()->last)
+            {
+              Append (current, open.back ()->value);
+              current = open.back ()->last + 1;
+            }
+          open.pop_back ();
+        }
+      if (current < next)
+        {
+          Append (current, open.empty () ? NONE : open.back ()->value);
+          current = next;
+        }
+      if (i < sorted.size ())
+        {
+          open.push_back (&sorted[i]);
+        }
+    }
+  NS_LOG_LOGIC (m_prefixes.size () << " prefixes in " << m_starts.size () << " ranges");
+}
+
+uint32_t
+DsrPrefixTable::Lookup (Ipv4Address address) const
+{
+  // the last range starting at or before the address
+  std::vector<uint32_t>::const_iterator i =
+    std::upper_bound (m_starts.begin (), m_starts.end (), address.Get ());
+  return m_values[i - m_starts.begin () - 1];
+}
+
+uint32_t
+DsrPrefixTable::GetNPrefixes (void) const
+{
+  return m_prefixes.size ();
+}
+
+uint32_t
+DsrPrefixTable::GetNRanges (void) const
+{
+  return m_starts.size ();
+}
+
+} // namespace ns3
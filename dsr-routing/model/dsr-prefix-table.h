@@ -0,0 +1,96 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSR_PREFIX_TABLE_H
+#define DSR_PREFIX_TABLE_H
+
+#include <stdint.h>
+#include <vector>
+#include "ns3/simple-ref-count.h"
+#include "ns3/ipv4-address.h"
+
+namespace ns3 {
+
+/**
+ * \ingroup dsr-routing
+ *
+ * \brief Longest-prefix-match table from IPv4 prefixes to 32-bit values.
+ *
+ * The prefixes are added with Insert () and the table is then flattened by
+ * Build () into the sorted start addresses of disjoint address ranges and
+ * the value of each range, the value of the longest prefix covering it.
+ * Neighboring ranges with the same value are merged, so a block of
+ * addresses mapping to the same value takes a single range whatever the
+ * prefixes it was added as.  A lookup is a binary search over the start
+ * addresses, which are stored contiguously.
+ *
+ * Ipv4DSRRouting uses it to map the addresses of the routers to their
+ * router ID, under which the candidates to the router are stored; one
+ * table is shared by all the nodes.
+ */
+class DsrPrefixTable : public SimpleRefCount<DsrPrefixTable>
+{
+public:
+  /// The value of the addresses covered by no prefix
+  static const uint32_t NONE = 0xffffffff;
+
+  DsrPrefixTable ();
+
+  /**
+   * \brief Add a prefix.  Of two equal prefixes, the last added wins.
+   *
+   * The table must be built again before the prefix is found.
+   *
+   * \param prefix the network address of the prefix
+   * \param mask the mask of the prefix, a contiguous one
+   * \param value the value of the addresses of the prefix, not NONE
+   */
+  void Insert (Ipv4Address prefix, Ipv4Mask mask, uint32_t value);
+  /**
+   * \brief Flatten the prefixes added so far into the lookup ranges.
+   */
+  void Build (void);
+  /**
+   * \brief Remove every prefix.
+   */
+  void Clear (void);
+
+  /**
+   * \brief Find the value of the longest prefix covering an address.
+   * \param address the address
+   * \return the value, or NONE if no prefix covers the address
+   */
+  uint32_t Lookup (Ipv4Address address) const;
+
+  /**
+   * \return the number of prefixes added
+   */
+  uint32_t GetNPrefixes (void) const;
+  /**
+   * \return the number of ranges of the built table
+   */
+  uint32_t GetNRanges (void) const;
+
+private:
+  /// A prefix, as the range of the addresses it covers
+  struct Prefix
+  {
+    uint64_t first;     //!< first address
+    uint64_t last;      //!< last address
+    uint32_t value;     //!< the value of the addresses
+    uint32_t order;     //!< insertion order
+  };
+  /**
+   * \brief Append a range to the built table, merging it with the previous
+   * one if they have the same value.
+   * \param start the first address of the range
+   * \param value the value of the range
+   */
+  void Append (uint32_t start, uint32_t value);
+
+  std::vector<Prefix> m_prefixes;       //!< prefixes added
+  std::vector<uint32_t> m_starts;       //!< first address of each range, sorted
+  std::vector<uint32_t> m_values;       //!< value of each range
+};
+
+} // namespace ns3
+
+#endif /* DSR_PREFIX_TABLE_H */
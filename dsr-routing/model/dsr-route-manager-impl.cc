@@ -26,15 +26,27 @@
 #include <vector>
 #include <queue>
 #include <algorithm>
+#include <functional>
 #include <iostream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <cstdio>
+#include <unistd.h>
 #include "ns3/assert.h"
 #include "ns3/fatal-error.h"
 #include "ns3/log.h"
+#include "ns3/hash.h"
 #include "ns3/node-list.h"
 #include "ns3/ipv4.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/ipv4-list-routing.h"
 #include "dsr-router-interface.h"
+#include "dsr-route-manager.h"
 #include "dsr-route-manager-impl.h"
 #include "dsr-candidate-queue.h"
 #include "ipv4-dsr-routing.h"
@@ -43,6 +55,97 @@ namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("DSRRouteManagerImpl");
 
+/// First word of a route cache file, "DSRT" in little-endian order
+static const uint32_t ROUTE_CACHE_MAGIC = 0x54525344;
+/// Version of the route cache format, also hashed with the routing database
+static const uint32_t ROUTE_CACHE_VERSION = 1;
+/// Words of the header of a route cache file
+static const uint32_t ROUTE_CACHE_HEADER_WORDS = 5;
+/// Most distances kept by UpdateLinkMetric from the trees of the routers near the link
+static const uint32_t MAX_FORWARD_TREE_WORDS = 1 << 24;
+/// Most distances kept by the reverse trees of the routes computed on demand
+static const uint32_t MAX_LAZY_TREE_WORDS = 1 << 24;
+
+/**
+ * \brief Read a route cache file.
+ * \param path the path of the file
+ * \param buffer the buffer receiving the words of the file
+ * \returns true if the file exists and is a whole number of words
+ */
+static bool
+ReadRouteCache (const std::string &path, std::vector<uint32_t> &buffer)
+{
+  std::ifstream file (path.c_str (), std::ios::in | std::ios::binary);
+  if (!file)
+    {
+      return false;
+    }
+  file.seekg (0, std::ios::end);
+  std::streamoff bytes = file.tellg ();
+  if (bytes <= 0 || bytes % sizeof (uint32_t) != 0)
+    {
+      return false;
+    }
+  buffer.resize (bytes / sizeof (uint32_t));
+  file.seekg (0, std::ios::beg);
+  return bool (file.read (reinterpret_cast<char *> (&buffer[0]), bytes));
+}
+
+/**
+ * \brief Write a route cache file.
+ *
+ * The words are written to a temporary file renamed over the cache file,
+ * so that runs started in parallel never read a partial file.
+ *
+ * \param path the path of the file
+ * \param buffer the words of the file
+ * \returns true if the file was written
+ */
+static bool
+WriteRouteCache (const std::string &path, const std::vector<uint32_t> &buffer)
+{
+  std::ostringstream temporary;
+  temporary << path << "." << getpid ();
+  {
+    std::ofstream file (temporary.str ().c_str (), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.write (reinterpret_cast<const char *> (&buffer[0]), buffer.size () * sizeof (uint32_t)))
+      {
+        std::remove (temporary.str ().c_str ());
+        return false;
+      }
+  }
+  return std::rename (temporary.str ().c_str (), path.c_str ()) == 0;
+}
+
+/**
+ * \brief Find the first router whose routes differ in two route cache buffers.
+ * \param a a buffer
+ * \param b the other buffer
+ * \returns the node ID of the router, or UINT32_MAX if the headers differ
+ */
+static uint32_t
+RouteCacheMismatch (const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+{
+  if (a.size () < ROUTE_CACHE_HEADER_WORDS || b.size () < ROUTE_CACHE_HEADER_WORDS
+      || !std::equal (a.begin (), a.begin () + ROUTE_CACHE_HEADER_WORDS, b.begin ()))
+    {
+      return UINT32_MAX;
+    }
+  uint32_t offset = ROUTE_CACHE_HEADER_WORDS;
+  while (offset < a.size () && offset < b.size ())
+    {
+      uint32_t sizeA = Ipv4DSRRouting::GetSerializedSize (a.data () + offset + 1, a.size () - offset - 1);
+      uint32_t sizeB = Ipv4DSRRouting::GetSerializedSize (b.data () + offset + 1, b.size () - offset - 1);
+      if (a[offset] != b[offset] || sizeA == 0 || sizeA != sizeB
+          || !std::equal (a.begin () + offset, a.begin () + offset + 1 + sizeA, b.begin () + offset))
+        {
+          return a[offset];
+        }
+      offset += 1 + sizeA;
+    }
+  return UINT32_MAX;
+}
+
 /**
  * \brief Stream insertion operator.
  *
@@ -445,6 +548,7 @@ DSRRouteManagerLSDB::~DSRRouteManagerLSDB ()
     }
   NS_LOG_LOGIC ("clear map");
   m_database.clear ();
+  m_linkDataIndex.clear ();
 }
 
 void
@@ -467,9 +571,21 @@ DSRRouteManagerLSDB::Insert (Ipv4Address addr, DSRRoutingLSA* lsa)
     {
       m_extdatabase.push_back (lsa);
     } 
-  else
+  else if (m_database.insert (LSDBPair_t (addr, lsa)).second)
     {
-      m_database.insert (LSDBPair_t (addr, lsa));
+      for (uint32_t j = 0; j < lsa->GetNLinkRecords (); j++)
+        {
+          DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
+          if (lr->GetLinkType () != DSRRoutingLinkRecord::TransitNetwork)
+            {
+              continue;
+            }
+          std::pair<LSDBMap_t::iterator, bool> result = m_linkDataIndex.insert (LSDBPair_t (lr->GetLinkData (), lsa));
+          if (!result.second && addr < result.first->second->GetLinkStateId ())
+            {
+              result.first->second = lsa;
+            }
+        }
     }
 }
 
@@ -491,16 +607,10 @@ DSRRoutingLSA*
 DSRRouteManagerLSDB::GetLSA (Ipv4Address addr) const
 {
   NS_LOG_FUNCTION (this << addr);
-//
-// Look up an LSA by its address.
-//
-  LSDBMap_t::const_iterator i;
-  for (i= m_database.begin (); i!= m_database.end (); i++)
+  LSDBMap_t::const_iterator i = m_database.find (addr);
+  if (i != m_database.end ())
     {
-      if (i->first == addr)
-        {
-          return i->second;
-        }
+      return i->second;
     }
   return 0;
 }
@@ -509,23 +619,10 @@ DSRRoutingLSA*
 DSRRouteManagerLSDB::GetLSAByLinkData (Ipv4Address addr) const
 {
   NS_LOG_FUNCTION (this << addr);
-//
-// Look up an LSA by its address.
-//
-  LSDBMap_t::const_iterator i;
-  for (i= m_database.begin (); i!= m_database.end (); i++)
+  LSDBMap_t::const_iterator i = m_linkDataIndex.find (addr);
+  if (i != m_linkDataIndex.end ())
     {
-      DSRRoutingLSA* temp = i->second;
-// Iterate among temp's Link Records
-      for (uint32_t j = 0; j < temp->GetNLinkRecords (); j++)
-        {
-          DSRRoutingLinkRecord *lr = temp->GetLinkRecord (j);
-          if ( lr->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork &&
-               lr->GetLinkData () == addr)
-            {
-              return temp;
-            }
-        }
+      return i->second;
     }
   return 0;
 }
@@ -603,10 +700,14 @@ DSRRouteManagerNSDB::GetNumNetDevices () const
 
 DSRRouteManagerImpl::DSRRouteManagerImpl () 
   :
-    m_spfroot (0)
+    m_checkStubNodes (true),
+    m_nodeIndexValid (false),
+    m_graph ()
 {
   NS_LOG_FUNCTION (this);
   m_lsdb = new DSRRouteManagerLSDB ();
+  m_lazy.enabled = false;
+  m_aggregate = false;
 }
 
 DSRRouteManagerImpl::~DSRRouteManagerImpl ()
@@ -627,6 +728,10 @@ DSRRouteManagerImpl::DebugUseLsdb (DSRRouteManagerLSDB* lsdb)
       delete m_lsdb;
     }
   m_lsdb = lsdb;
+  m_graph = SPFGraph ();
+  InitializeLazyRoutes (false);
+  m_aggregate = false;
+  m_prefixes = 0;
 }
 
 void
@@ -643,25 +748,367 @@ DSRRouteManagerImpl::DeleteDSRRoutes ()
           continue;
         }
       Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-      uint32_t j = 0;
-      uint32_t nRoutes = gr->GetNRoutes ();
       NS_LOG_LOGIC ("Deleting " << gr->GetNRoutes ()<< " routes from node " << node->GetId ());
-      // Each time we delete route 0, the route index shifts downward
-      // We can delete all routes if we delete the route numbered 0
-      // nRoutes times
-      for (j = 0; j < nRoutes; j++)
+      gr->ClearRoutes ();
+      gr->SetOnDemandRoutes (false);
+      gr->SetPrefixTable (0);
+    }
+  m_nodeIndexValid = false;
+  if (m_lsdb)
+    {
+      NS_LOG_LOGIC ("Deleting LSDB, creating new one");
+      delete m_lsdb;
+      m_lsdb = new DSRRouteManagerLSDB ();
+    }
+  m_graph = SPFGraph ();
+  InitializeLazyRoutes (false);
+  m_aggregate = false;
+  m_prefixes = 0;
+}
+
+//
+// Recompute the routes of every router without ever leaving them with an
+// empty or partial table: the new tables are built next to the current
+// ones, which keep forwarding packets, and swapped in once complete.
+//
+void
+DSRRouteManagerImpl::RecomputeDSRRoutes ()
+{
+  NS_LOG_FUNCTION (this);
+  std::vector<Ptr<Ipv4DSRRouting> > routers;
+  NodeList::Iterator listEnd = NodeList::End ();
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<DSRRouter> router = (*i)->GetObject<DSRRouter> ();
+      if (router == 0)
         {
-          NS_LOG_LOGIC ("Deleting global route " << j << " from node " << node->GetId ());
-          gr->RemoveRoute (0);
+          continue;
         }
-      NS_LOG_LOGIC ("Deleted " << j << " global routes from node "<< node->GetId ());
+      routers.push_back (router->GetRoutingProtocol ());
+      routers.back ()->BeginRouteUpdate ();
     }
   if (m_lsdb)
     {
-      NS_LOG_LOGIC ("Deleting LSDB, creating new one");
       delete m_lsdb;
       m_lsdb = new DSRRouteManagerLSDB ();
     }
+  BuildDSRRoutingDatabase ();
+  InitializeRoutes ();
+  for (uint32_t i = 0; i < routers.size (); i++)
+    {
+      routers[i]->CommitRouteUpdate ();
+    }
+}
+
+//
+// Change the metric of one link, from router a to router b, and patch the
+// routes that depend on it.
+//
+// The host routes of a router x to a router t depend on the metrics of the
+// links of x and of the first links back to x, and on the distance d(y, t)
+// of each neighbor y of x; the network routes of x to t, on d(x, t) and on
+// the d(y, t).  Raising the metric of the link changes d(., t) only if the
+// link is on a shortest path from a to t, and lowering it only if the path
+// through it becomes no longer than the shortest one: the trees of a and b
+// tell which destinations t are affected.  Their reverse trees are grown
+// before and after the change, and x gets new host routes to t if one of
+// its neighbors got closer to t or farther from it.  The network routes
+// of the routers whose exits may have changed are rebuilt from their own
+// tree.
+//
+// A few routers need new host routes to every destination, not only to the
+// affected ones.  If the link is the first one of a to b, b uses its metric
+// for its routes through a.  The two-hop candidates of x also depend on
+// d(x, t) and on the distances two hops away, and those of the routers
+// within one link of a or b on the metric of the link itself.  The
+// loop-free alternates of x depend on the distances d(y, x) back to it,
+// which change if x is affected, and those of a on the metric.  The
+// routes of these routers come from the trees rooted at the routers within
+// two links of them, or from one reverse tree per destination if those
+// are too many; the other routers keep their marks.
+//
+// When the routes are computed on demand, the routes of the same routers
+// to the same destinations are removed instead, with the reverse trees of
+// the affected destinations, and computed again when next asked for.
+//
+void
+DSRRouteManagerImpl::UpdateLinkMetric (Ptr<Node> node, uint32_t interface, uint16_t metric)
+{
+  NS_LOG_FUNCTION (this << node->GetId () << interface << metric);
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  NS_ASSERT_MSG (ipv4, "UpdateLinkMetric on a node without Ipv4");
+  ipv4->SetMetric (interface, metric);
+  Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+  if (rtr == 0)
+    {
+      return;
+    }
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator r =
+    m_graph.index.find (rtr->GetRouterId ());
+  if (!m_graph.valid || r == m_graph.index.end ())
+    {
+      NS_LOG_LOGIC ("No frozen LSDB for " << rtr->GetRouterId () << ", recomputing every route");
+      RecomputeDSRRoutes ();
+      return;
+    }
+  uint32_t a = r->second;
+  uint32_t k = m_graph.linkBegin[a];
+  while (k < m_graph.linkBegin[a + 1] && m_graph.links[k].interface != (int32_t) interface)
+    {
+      k++;
+    }
+  if (k == m_graph.linkBegin[a + 1])
+    {
+      NS_LOG_LOGIC ("No point-to-point link on interface " << interface << ", no route to update");
+      return;
+    }
+  uint32_t b = m_graph.links[k].router;
+  uint32_t oldMetric = m_graph.links[k].metric;
+  if (oldMetric == metric)
+    {
+      return;
+    }
+  uint32_t nRouters = m_graph.routers.size ();
+  SPFContext context;
+  std::vector<PendingRoute> routes;
+  context.spfroot = 0;
+  context.routes = &routes;
+  SPFGraphTree (context, a, 0);
+  std::vector<uint32_t> fromA (context.distance);
+  SPFGraphTree (context, b, 0);
+  std::vector<uint32_t> targets;
+  for (uint32_t t = 0; t < nRouters; t++)
+    {
+      if (t == b || (context.distance[t] != DISTINFINITY
+                     && std::min<uint32_t> (metric, oldMetric) + context.distance[t] <= fromA[t]))
+        {
+          targets.push_back (t);
+        }
+    }
+  NS_LOG_LOGIC (targets.size () << " destinations affected");
+  bool twoHop = DSRRouteManager::GetCandidatesPerDestination () > 0;
+  bool loopFree = DSRRouteManager::GetLoopFreeAlternates ();
+  if (loopFree && !m_lazy.enabled && m_loopFreeBack.size () != m_graph.links.size ())
+    {
+      // the routes were loaded from the route cache
+      ComputeLoopFreeBack (context);
+    }
+  std::vector<std::vector<uint32_t> > before (targets.size ());
+  for (uint32_t i = 0; i < targets.size (); i++)
+    {
+      ReverseSPFCalculate (context, targets[i]);
+      before[i].swap (context.distance);
+    }
+
+  bool first = SetGraphLinkMetric (a, k, metric);
+
+  // the routers whose routes to every destination may change, not only to
+  // the affected ones: b, whose routes through a use the metric of the
+  // link; with the two-hop candidates, the routers within one link of a or
+  // b, whose candidates may go over it; with the loop-free alternates, a
+  // and the affected routers, whose alternates depend on the distances
+  // back to them
+  std::vector<uint8_t> everyDest (nRouters, 0);
+  everyDest[b] = first;
+  if (twoHop)
+    {
+      for (uint32_t j = m_graph.linkBegin[a]; j < m_graph.linkBegin[a + 1]; j++)
+        {
+          everyDest[m_graph.links[j].router] = 1;
+        }
+      for (uint32_t j = m_graph.linkBegin[b]; j < m_graph.linkBegin[b + 1]; j++)
+        {
+          everyDest[m_graph.links[j].router] = 1;
+        }
+    }
+  if (loopFree)
+    {
+      everyDest[a] = 1;
+      for (uint32_t i = 0; i < targets.size (); i++)
+        {
+          everyDest[targets[i]] = 1;
+        }
+    }
+
+  std::vector<uint8_t> exitsChanged (nRouters, 0);
+  for (uint32_t i = 0; i < targets.size (); i++)
+    {
+      uint32_t t = targets[i];
+      ReverseSPFCalculate (context, t);
+      const std::vector<uint32_t> &after = context.distance;
+      if (m_lazy.enabled)
+        {
+          m_lazy.trees.erase (t);
+          m_lazy.backValid[t] = false;
+        }
+      else if (loopFree)
+        {
+          for (uint32_t j = m_graph.linkBegin[t]; j < m_graph.linkBegin[t + 1]; j++)
+            {
+              m_loopFreeBack[j] = after[m_graph.links[j].router];
+            }
+        }
+      for (uint32_t x = 0; x < nRouters; x++)
+        {
+          // the direct routes of a to b use the metric of the link
+          bool changed = x == a && t == b;
+          for (uint32_t j = m_graph.linkBegin[x]; j < m_graph.linkBegin[x + 1] && !changed; j++)
+            {
+              changed = before[i][m_graph.links[j].router] != after[m_graph.links[j].router];
+            }
+          if (twoHop && !changed)
+            {
+              // the two-hop candidates also depend on d(x, t) and on the
+              // distances of the neighbors of the neighbors
+              changed = before[i][x] != after[x];
+              for (uint32_t j = m_graph.linkBegin[x]; j < m_graph.linkBegin[x + 1] && !changed; j++)
+                {
+                  uint32_t w = m_graph.links[j].router;
+                  for (uint32_t m = m_graph.linkBegin[w]; m < m_graph.linkBegin[w + 1] && !changed; m++)
+                    {
+                      changed = before[i][m_graph.links[m].router] != after[m_graph.links[m].router];
+                    }
+                }
+            }
+          if (changed || x == a || before[i][x] != after[x])
+            {
+              exitsChanged[x] = 1;
+            }
+          if (!changed || !m_graph.routers[x].local || everyDest[x])
+            {
+              continue;
+            }
+          if (m_lazy.enabled)
+            {
+              ForgetLazyRoutes (x, t);
+              continue;
+            }
+          ReplaceGraphHostRoutes (context, x, t, after);
+          if (loopFree && x != t)
+            {
+              // x is not affected, the distances back to it are the same
+              MarkLoopFreeAlternates (x, t, after, m_loopFreeBack.data () + m_graph.linkBegin[x]);
+            }
+        }
+    }
+
+  if (m_lazy.enabled)
+    {
+      for (uint32_t u = 0; u < nRouters; u++)
+        {
+          for (uint32_t t = 0; everyDest[u] && m_graph.routers[u].local && t < nRouters; t++)
+            {
+              ForgetLazyRoutes (u, t);
+            }
+        }
+    }
+  else
+    {
+      ReplaceGraphHostRoutes (context, everyDest);
+    }
+
+  for (uint32_t u = 0; u < nRouters; u++)
+    {
+      if (exitsChanged[u] && m_graph.routers[u].rooted && !(m_checkStubNodes && m_graph.routers[u].stub)
+          && !(m_lazy.enabled && !m_lazy.networks[u]))
+        {
+          ReplaceGraphNetworkRoutes (context, u);
+        }
+    }
+}
+
+//
+// Index the routers by router ID and their interfaces by address, so that
+// the SPF phases can find the node to update, or the node owning an
+// address, without walking the whole NodeList.
+//
+void
+DSRRouteManagerImpl::BuildNodeIndex ()
+{
+  NS_LOG_FUNCTION (this);
+  m_routerIndex.clear ();
+  m_interfaceIndex.clear ();
+  NodeList::Iterator listEnd = NodeList::End ();
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<Node> node = *i;
+      Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+      RouterRecord *router = 0;
+      if (rtr != 0)
+        {
+          router = &m_routerIndex[rtr->GetRouterId ()];
+          router->node = node;
+          router->routing = rtr->GetRoutingProtocol ();
+          router->addresses.clear ();
+        }
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      if (ipv4 == 0)
+        {
+          continue;
+        }
+      for (uint32_t j = 0; j < ipv4->GetNInterfaces (); j++)
+        {
+          for (uint32_t k = 0; k < ipv4->GetNAddresses (j); k++)
+            {
+              Ipv4Address local = ipv4->GetAddress (j, k).GetLocal ();
+              InterfaceRecord record;
+              record.node = node;
+              record.interface = j;
+              // keep the first owner, as the NodeList walk did
+              m_interfaceIndex.insert (std::make_pair (local, record));
+              if (router != 0)
+                {
+                  router->addresses.push_back (std::make_pair (local, j));
+                }
+            }
+        }
+    }
+  m_nodeIndexValid = true;
+}
+
+const DSRRouteManagerImpl::RouterRecord *
+DSRRouteManagerImpl::GetRouterRecord (Ipv4Address routerId)
+{
+  if (!m_nodeIndexValid)
+    {
+      BuildNodeIndex ();
+    }
+  RouterIndex_t::const_iterator i = m_routerIndex.find (routerId);
+  if (i == m_routerIndex.end ())
+    {
+      return 0;
+    }
+  return &i->second;
+}
+
+const DSRRouteManagerImpl::InterfaceRecord *
+DSRRouteManagerImpl::GetInterfaceRecord (Ipv4Address address)
+{
+  if (!m_nodeIndexValid)
+    {
+      BuildNodeIndex ();
+    }
+  InterfaceIndex_t::const_iterator i = m_interfaceIndex.find (address);
+  if (i == m_interfaceIndex.end ())
+    {
+      return 0;
+    }
+  return &i->second;
+}
+
+int32_t
+DSRRouteManagerImpl::GetInterfaceForPrefix (const RouterRecord *record, Ipv4Address a, Ipv4Mask amask)
+{
+  // same search as Ipv4L3Protocol::GetInterfaceForPrefix
+  Ipv4Address prefix = a.CombineMask (amask);
+  for (uint32_t i = 0; i < record->addresses.size (); i++)
+    {
+      if (record->addresses[i].first.CombineMask (amask) == prefix)
+        {
+          return record->addresses[i].second;
+        }
+    }
+  return -1;
 }
 
 //
@@ -677,6 +1124,7 @@ void
 DSRRouteManagerImpl::BuildDSRRoutingDatabase () 
 {
   NS_LOG_FUNCTION (this);
+  BuildNodeIndex ();
 //
 // Walk the list of nodes looking for the DSRRouter Interface.  Nodes with
 // global router interfaces are, not too surprisingly, our routers.
@@ -720,6 +1168,10 @@ DSRRouteManagerImpl::BuildDSRRoutingDatabase ()
           m_lsdb->Insert (lsa->GetLinkStateId (), lsa); 
         }
     }
+//
+// Freeze the complete LSDB for the SPF calculations.
+//
+  BuildSPFGraph ();
 }
 
 //
@@ -756,49 +1208,358 @@ DSRRouteManagerImpl::BuildDSRRoutingDatabase ()
 // list becomes empty. 
 //
 void
-DSRRouteManagerImpl::InitializeRoutes ()
+DSRRouteManagerImpl::ComputeRoutes ()
 {
   NS_LOG_FUNCTION (this);
+  if (!m_nodeIndexValid)
+    {
+      BuildNodeIndex ();
+    }
+  m_checkStubNodes = NodeList::GetNNodes () > 0;
 //
-// Walk the list of nodes in the system.
+// One SPF calculation per router and neighbor, listed in the order in which
+// their routes are installed, or one reverse SPF calculation per destination
+// router.
 //
-  NS_LOG_INFO ("About to start SPF calculation");
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+  std::vector<SPFJob> jobs;
+  if (DSRRouteManager::GetRouteEngine () == DSRRouteManager::REVERSE_SPF)
     {
-      Ptr<Node> node = *i;
-      //
-      // Look for the DSRRouter interface that indicates that the node is
-      // participating in routing.
-      //
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
+      RequireSPFGraph ("SetRouteEngine (REVERSE_SPF)");
+      CollectReverseSPFJobs (jobs);
+    }
+  else
+    {
+      CollectSPFJobs (jobs);
+    }
 
-      uint32_t systemId = Simulator::GetSystemId ();
-      // Ignore nodes that are not assigned to our systemId (distributed sim)
-      if (node->GetSystemId () != systemId) 
+  uint32_t nThreads = DSRRouteManager::GetPopulationThreads ();
+  if (nThreads == 0)
+    {
+      nThreads = std::max (std::thread::hardware_concurrency (), 1u);
+    }
+  nThreads = std::min<uint32_t> (nThreads, jobs.size ());
+  NS_LOG_INFO ("About to start SPF calculation: " << jobs.size () <<
+               " trees on " << nThreads << " threads");
+  if (nThreads > 1)
+    {
+      RunSPFJobs (jobs, nThreads);
+    }
+  else
+    {
+      SPFContext context;
+      for (uint32_t i = 0; i < jobs.size (); i++)
         {
-          continue;
+          RunSPFJob (jobs[i], context);
+          InstallRoutes (jobs[i].routes);
+          std::vector<PendingRoute> ().swap (jobs[i].routes);
         }
+    }
+  NS_LOG_INFO ("Finished DSR-SPF calculation");
 
-      //
-      // if the node has a DSR router interface, then run the DSR routing
-      // algorithms.
-      //
-        DSRVertex *v;
-        DSRRoutingLSA* w_lsa = 0;
-        DSRRoutingLinkRecord *l = 0;
-        uint32_t numRecordsInVertex = 0;
-        v = new DSRVertex (m_lsdb->GetLSA(rtr->GetRouterId ()));
-        //
-        // V points to a Router-LSA or Network-LSA
-        // Loop over the links in router LSA or attached routers in Network LSA
-        //
-        if (v->GetVertexType () == DSRVertex::VertexRouter)
-          {
-            numRecordsInVertex = v->GetLSA ()->GetNLinkRecords (); 
-          }
-        if (v->GetVertexType () == DSRVertex::VertexNetwork)
+  // the reverse trees record the two-hop candidates with the others, the
+  // trees rooted at the neighbors do not give the distances they need
+  if (DSRRouteManager::GetCandidatesPerDestination () > 0
+      && DSRRouteManager::GetRouteEngine () != DSRRouteManager::REVERSE_SPF)
+    {
+      RequireSPFGraph ("SetCandidatesPerDestination");
+      SPFContext context;
+      std::vector<PendingRoute> routes;
+      context.routes = &routes;
+      for (uint32_t t = 0; t < m_graph.routers.size (); t++)
+        {
+          ReverseSPFCalculate (context, t);
+          for (uint32_t u = 0; u < m_graph.routers.size (); u++)
+            {
+              if (m_graph.routers[u].local && u != t)
+                {
+                  RecordTwoHopHostRoutes (context, u, t, context.distance);
+                }
+            }
+          InstallRoutes (routes);
+          routes.clear ();
+        }
+    }
+
+  if (DSRRouteManager::GetLoopFreeAlternates ())
+    {
+      RequireSPFGraph ("SetLoopFreeAlternates");
+      SPFContext context;
+      MarkLoopFreeAlternates (context);
+    }
+}
+
+//
+// Route cache.  The routes of every router are a function of the LSDB, of
+// the addresses, metrics and states of the interfaces of the routers and of
+// the options of the route manager, which are hashed.  The routes are kept
+// in <directory>/dsr-routes-<hash>.bin: a header of ROUTE_CACHE_HEADER_WORDS
+// 32-bit words (magic, version, the two halves of the hash and the number of
+// routers), then for each router its node ID followed by the block written
+// by Ipv4DSRRouting::SerializeRoutes.  Every record has the same size, so
+// the file can be read in one go or mapped in memory.
+//
+void
+DSRRouteManagerImpl::InitializeRoutes ()
+{
+  NS_LOG_FUNCTION (this);
+  InitializePrefixTable ();
+  if (DSRRouteManager::GetLazyRoutes ())
+    {
+      RequireSPFGraph ("SetLazyRoutes");
+      InitializeLazyRoutes (true);
+      return;
+    }
+  InitializeLazyRoutes (false);
+  std::string directory = DSRRouteManager::GetRouteCacheDirectory ();
+  if (directory.empty ())
+    {
+      ComputeRoutes ();
+      return;
+    }
+
+  uint64_t hash = HashRoutingDatabase ();
+  std::ostringstream path;
+  path << directory << "/dsr-routes-" << std::hex << std::setw (16)
+       << std::setfill ('0') << hash << ".bin";
+  std::vector<uint32_t> cached;
+  bool hit = ReadRouteCache (path.str (), cached);
+  bool verify = DSRRouteManager::GetRouteCacheVerification ();
+  if (hit && !verify)
+    {
+      if (DeserializeRoutes (hash, cached))
+        {
+          NS_LOG_INFO ("Routes loaded from " << path.str ());
+          return;
+        }
+      NS_LOG_WARN ("Route cache " << path.str () << " does not match the routers; recomputing");
+      hit = false;
+    }
+
+  ComputeRoutes ();
+  std::vector<uint32_t> computed;
+  SerializeRoutes (hash, computed);
+  if (hit)
+    {
+      if (computed == cached)
+        {
+          NS_LOG_INFO ("Routes of " << path.str () << " verified");
+          return;
+        }
+      uint32_t node = RouteCacheMismatch (computed, cached);
+      NS_FATAL_ERROR ("Route cache " << path.str () << " differs from the computed routes"
+                      << (node == UINT32_MAX ? std::string () : " at node ")
+                      << (node == UINT32_MAX ? std::string () : std::to_string (node)));
+    }
+  if (!WriteRouteCache (path.str (), computed))
+    {
+      NS_LOG_WARN ("Could not write the route cache " << path.str ());
+    }
+}
+
+uint64_t
+DSRRouteManagerImpl::HashRoutingDatabase () const
+{
+  NS_LOG_FUNCTION (this);
+  std::vector<uint32_t> words;
+  words.push_back (ROUTE_CACHE_VERSION);
+  words.push_back (DSRRouteManager::GetRouteEngine ());
+  words.push_back (DSRRouteManager::GetLoopFreeAlternates ());
+  words.push_back (DSRRouteManager::GetCandidatesPerDestination ());
+  words.push_back (m_aggregate);
+  words.push_back (Simulator::GetSystemId ());
+  words.push_back (NodeList::GetNNodes ());
+  NodeList::Iterator listEnd = NodeList::End ();
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<Node> node = *i;
+      Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+      if (rtr == 0)
+        {
+          continue;
+        }
+      words.push_back (node->GetId ());
+      words.push_back (node->GetSystemId ());
+      words.push_back (rtr->GetRouterId ().Get ());
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      words.push_back (ipv4->GetNInterfaces ());
+      for (uint32_t j = 0; j < ipv4->GetNInterfaces (); j++)
+        {
+          words.push_back (ipv4->IsUp (j));
+          words.push_back (ipv4->GetMetric (j));
+          words.push_back (ipv4->GetNAddresses (j));
+          for (uint32_t k = 0; k < ipv4->GetNAddresses (j); k++)
+            {
+              words.push_back (ipv4->GetAddress (j, k).GetLocal ().Get ());
+              words.push_back (ipv4->GetAddress (j, k).GetMask ().Get ());
+            }
+        }
+      DSRRoutingLSA *lsa = m_lsdb ? m_lsdb->GetLSA (rtr->GetRouterId ()) : 0;
+      words.push_back (lsa ? lsa->GetNLinkRecords () : 0);
+      for (uint32_t j = 0; lsa && j < lsa->GetNLinkRecords (); j++)
+        {
+          DSRRoutingLinkRecord *record = lsa->GetLinkRecord (j);
+          words.push_back (record->GetLinkType ());
+          words.push_back (record->GetLinkId ().Get ());
+          words.push_back (record->GetLinkData ().Get ());
+          words.push_back (record->GetMetric ());
+        }
+    }
+  uint32_t nExternal = m_lsdb ? m_lsdb->GetNumExtLSAs () : 0;
+  words.push_back (nExternal);
+  for (uint32_t i = 0; i < nExternal; i++)
+    {
+      DSRRoutingLSA *lsa = m_lsdb->GetExtLSA (i);
+      words.push_back (lsa->GetLinkStateId ().Get ());
+      words.push_back (lsa->GetNetworkLSANetworkMask ().Get ());
+      words.push_back (lsa->GetAdvertisingRouter ().Get ());
+    }
+  return Hash64 (reinterpret_cast<const char *> (&words[0]), words.size () * sizeof (uint32_t));
+}
+
+void
+DSRRouteManagerImpl::SerializeRoutes (uint64_t hash, std::vector<uint32_t> &buffer) const
+{
+  NS_LOG_FUNCTION (this << hash);
+  buffer.assign (ROUTE_CACHE_HEADER_WORDS, 0);
+  buffer[0] = ROUTE_CACHE_MAGIC;
+  buffer[1] = ROUTE_CACHE_VERSION;
+  buffer[2] = static_cast<uint32_t> (hash);
+  buffer[3] = static_cast<uint32_t> (hash >> 32);
+  NodeList::Iterator listEnd = NodeList::End ();
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<DSRRouter> rtr = (*i)->GetObject<DSRRouter> ();
+      if (rtr == 0)
+        {
+          continue;
+        }
+      buffer.push_back ((*i)->GetId ());
+      rtr->GetRoutingProtocol ()->SerializeRoutes (buffer);
+      buffer[4]++;
+    }
+}
+
+bool
+DSRRouteManagerImpl::DeserializeRoutes (uint64_t hash, const std::vector<uint32_t> &buffer)
+{
+  NS_LOG_FUNCTION (this << hash);
+  if (buffer.size () < ROUTE_CACHE_HEADER_WORDS
+      || buffer[0] != ROUTE_CACHE_MAGIC || buffer[1] != ROUTE_CACHE_VERSION
+      || buffer[2] != static_cast<uint32_t> (hash)
+      || buffer[3] != static_cast<uint32_t> (hash >> 32))
+    {
+      return false;
+    }
+//
+// Check every block before installing anything, so that a bad file leaves
+// the tables untouched for ComputeRoutes.
+//
+  std::vector<std::pair<Ptr<Ipv4DSRRouting>, uint32_t> > blocks;
+  uint32_t offset = ROUTE_CACHE_HEADER_WORDS;
+  for (uint32_t i = 0; i < buffer[4]; i++)
+    {
+      if (offset >= buffer.size () || buffer[offset] >= NodeList::GetNNodes ())
+        {
+          return false;
+        }
+      Ptr<DSRRouter> rtr = NodeList::GetNode (buffer[offset])->GetObject<DSRRouter> ();
+      uint32_t size = Ipv4DSRRouting::GetSerializedSize (buffer.data () + offset + 1,
+                                                         buffer.size () - offset - 1);
+      if (rtr == 0 || size == 0)
+        {
+          return false;
+        }
+      blocks.push_back (std::make_pair (rtr->GetRoutingProtocol (), offset + 1));
+      offset += 1 + size;
+    }
+  if (offset != buffer.size ())
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < blocks.size (); i++)
+    {
+      blocks[i].first->DeserializeRoutes (buffer.data () + blocks[i].second);
+    }
+  return true;
+}
+
+void
+DSRRouteManagerImpl::CollectSPFJobs (std::vector<SPFJob> &jobs)
+{
+  NS_LOG_FUNCTION (this);
+//
+// With a frozen LSDB, walk the links of the local routers, which are in the
+// same order as in the walk of the LSDB below.
+//
+  if (m_graph.valid)
+    {
+      for (uint32_t u = 0; u < m_graph.routers.size (); u++)
+        {
+          if (!m_graph.routers[u].local)
+            {
+              continue;
+            }
+          for (uint32_t i = m_graph.linkBegin[u]; i < m_graph.linkBegin[u + 1]; i++)
+            {
+              const GraphLink &link = m_graph.links[i];
+              SPFJob job;
+              job.type = SPFJob::GRAPH;
+              job.router = u;
+              job.graphLink = i;
+              job.link = 0;
+              job.iface = link.interface;
+              jobs.push_back (job);
+
+              // host routes to every address of the neighbor
+              RouteKeys_t keys = GetRouteKeys (link.router, true);
+              for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+                {
+                  RecordRoute (jobs.back ().routes, PendingRoute::HOST, m_graph.routers[u].routing,
+                               *key, Ipv4Mask::GetOnes (), link.nextHop, link.interface, link.metric);
+                }
+            }
+        }
+      return;
+    }
+//
+// Walk the list of nodes in the system.
+//
+  NodeList::Iterator listEnd = NodeList::End ();
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<Node> node = *i;
+      //
+      // Look for the DSRRouter interface that indicates that the node is
+      // participating in routing.
+      //
+      Ptr<DSRRouter> rtr = 
+        node->GetObject<DSRRouter> ();
+
+      uint32_t systemId = Simulator::GetSystemId ();
+      // Ignore nodes that are not assigned to our systemId (distributed sim)
+      if (node->GetSystemId () != systemId) 
+        {
+          continue;
+        }
+
+      //
+      // if the node has a DSR router interface, then run the DSR routing
+      // algorithms.
+      //
+        DSRRoutingLSA* w_lsa = 0;
+        DSRRoutingLinkRecord *l = 0;
+        uint32_t numRecordsInVertex = 0;
+        DSRVertex vertex (m_lsdb->GetLSA(rtr->GetRouterId ()));
+        DSRVertex *v = &vertex;
+        //
+        // V points to a Router-LSA or Network-LSA
+        // Loop over the links in router LSA or attached routers in Network LSA
+        //
+        if (v->GetVertexType () == DSRVertex::VertexRouter)
+          {
+            numRecordsInVertex = v->GetLSA ()->GetNLinkRecords (); 
+          }
+        if (v->GetVertexType () == DSRVertex::VertexNetwork)
           {
             numRecordsInVertex = v->GetLSA ()->GetNAttachedRouters (); 
           }
@@ -845,52 +1606,1351 @@ DSRRouteManagerImpl::InitializeRoutes ()
                   Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
                   NS_ASSERT (gr);
                   DSRRoutingLinkRecord *linkRemote =0;
-                  DSRVertex* w = new DSRVertex (w_lsa);
-                  linkRemote = SPFGetNextLink (w, v, linkRemote);
+                  DSRVertex w (w_lsa);
+                  linkRemote = SPFGetNextLink (&w, v, linkRemote);
                   Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
                   int32_t Iface = ipv4->GetInterfaceForAddress (l->GetLinkData ());
                   // std::cout << "The interface = " << Iface << std::endl;
                   // gr->AddHostRouteTo (linkRemote->GetLinkData (), linkRemote->GetLinkData (), Iface, l->GetMetric ());
 
-                  // todo
-                  for (NodeList::Iterator j = NodeList::Begin (); j != listEnd; j++)
+                  SPFJob job;
+                  job.type = SPFJob::LSDB;
+                  job.router = 0;
+                  job.graphLink = 0;
+                  job.root = w_lsa->GetLinkStateId ();
+                  job.initroot = rtr->GetRouterId ();
+                  job.link = linkRemote;
+                  job.iface = Iface;
+                  jobs.push_back (job);
+
+                  // host routes to every address of the neighbor
+                  const InterfaceRecord *remote = GetInterfaceRecord (linkRemote->GetLinkData ());
+                  if (remote != 0)
                     {
-                      Ptr<Node> nextNode = *j;
-                      Ptr<Ipv4> nextIpv4 = nextNode->GetObject<Ipv4> ();
-                      for (uint32_t iter =0; iter < nextIpv4->GetNInterfaces (); iter ++)
+                      Ptr<Ipv4> nextIpv4 = remote->node->GetObject<Ipv4> ();
+                      for (uint32_t nIfc = 1; nIfc < nextIpv4->GetNInterfaces (); nIfc ++)
                         {
-                          Ipv4InterfaceAddress ifc = nextIpv4->GetAddress (iter,0);
-                          Ipv4Address addr = ifc.GetLocal ();
-                          if (addr == linkRemote->GetLinkData ())
-                            {
-                              for (uint32_t nIfc = 1; nIfc < nextIpv4->GetNInterfaces (); nIfc ++)
-                                {
-                                  gr->AddHostRouteTo (nextIpv4->GetAddress (nIfc,0).GetLocal (), linkRemote->GetLinkData (), Iface, l->GetMetric ());
-                                }
-                            }
+                          RecordRoute (jobs.back ().routes, PendingRoute::HOST, PeekPointer (gr),
+                                       nextIpv4->GetAddress (nIfc,0).GetLocal (), Ipv4Mask::GetOnes (),
+                                       linkRemote->GetLinkData (), Iface, l->GetMetric ());
                         }
-                    }   
+                    }
+                }
+                else if (l->GetLinkType () == 
+                          DSRRoutingLinkRecord::TransitNetwork)
+                  {
+                    w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
+                    NS_ASSERT (w_lsa);
+                    NS_LOG_LOGIC ("Found a Transit record from " << 
+                                  v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
+                    SPFJob job;
+                    job.type = SPFJob::LSDB;
+                    job.router = 0;
+                    job.graphLink = 0;
+                    job.root = w_lsa->GetLinkStateId ();
+                    job.initroot = rtr->GetRouterId ();
+                    job.link = l;
+                    job.iface = i+1;
+                    jobs.push_back (job);
+                  }
+                else 
+                  {
+                    NS_ASSERT_MSG (0, "illegal Link Type");
+                  }
+                }
+          }
+    }
+}
+
+void
+DSRRouteManagerImpl::RunSPFJob (SPFJob &job, SPFContext &context)
+{
+  NS_LOG_FUNCTION (this << job.type << job.router);
+  context.spfroot = 0;
+  context.routes = &job.routes;
+  switch (job.type)
+    {
+    case SPFJob::LSDB:
+      SPFCalculate (context, job.root, job.initroot, job.link, job.iface);
+      break;
+    case SPFJob::GRAPH:
+      SPFCalculateGraph (context, job.router, job.graphLink);
+      break;
+    case SPFJob::REVERSE:
+      RunReverseSPFJob (job, context);
+      break;
+    }
+  context.routes = 0;
+}
+
+//
+// Freeze the router LSAs into flat arrays once the LSDB is complete.  The
+// SPF calculations on this graph then neither look up LSAs by address nor
+// scan the link records for the link back, and the routers, their links and
+// their addresses are contiguous in memory.  The links keep the order of the
+// link records, which is the order of the SPF jobs of CollectSPFJobs.
+//
+void
+DSRRouteManagerImpl::BuildSPFGraph ()
+{
+  NS_LOG_FUNCTION (this);
+  m_graph = SPFGraph ();
+  m_loopFreeBack.clear ();
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> &index = m_graph.index;
+  std::vector<DSRRoutingLSA *> lsas;
+  uint32_t systemId = Simulator::GetSystemId ();
+  NodeList::Iterator listEnd = NodeList::End ();
+  m_graph.interfaceAddressBegin.push_back (0);
+  for (NodeList::Iterator i = NodeList::Begin (); i != listEnd; i++)
+    {
+      Ptr<Node> node = *i;
+      Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+      if (rtr == 0)
+        {
+          continue;
+        }
+      DSRRoutingLSA *lsa = m_lsdb->GetLSA (rtr->GetRouterId ());
+      if (lsa == 0 || index.count (lsa->GetLinkStateId ()))
+        {
+          continue;
+        }
+      index[lsa->GetLinkStateId ()] = lsas.size ();
+      lsas.push_back (lsa);
+      GraphRouter router;
+      router.routerId = lsa->GetLinkStateId ();
+      router.routing = PeekPointer (rtr->GetRoutingProtocol ());
+      router.local = node->GetSystemId () == systemId;
+      router.rooted = false;
+      router.stub = false;
+      m_graph.routers.push_back (router);
+      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+      for (uint32_t j = 1; j < ipv4->GetNInterfaces (); j++)
+        {
+          m_graph.interfaceAddresses.push_back (ipv4->GetAddress (j, 0).GetLocal ());
+        }
+      m_graph.interfaceAddressBegin.push_back (m_graph.interfaceAddresses.size ());
+    }
+
+  uint32_t nRouters = m_graph.routers.size ();
+  std::vector<uint32_t> inDegree (nRouters, 0);
+  m_graph.linkBegin.push_back (0);
+  m_graph.linkAddressBegin.push_back (0);
+  m_graph.stubBegin.push_back (0);
+  for (uint32_t u = 0; u < nRouters; u++)
+    {
+      DSRRoutingLSA *lsa = lsas[u];
+      const RouterRecord *record = GetRouterRecord (lsa->GetLinkStateId ());
+      NS_ASSERT (record);
+      for (uint32_t i = 0; i < lsa->GetNLinkRecords (); i++)
+        {
+          DSRRoutingLinkRecord *l = lsa->GetLinkRecord (i);
+          if (l->GetLinkType () == DSRRoutingLinkRecord::TransitNetwork)
+            {
+              NS_LOG_LOGIC ("Transit network " << l->GetLinkId () << ", the LSDB is not frozen");
+              m_graph = SPFGraph ();
+              return;
+            }
+          if (l->GetLinkType () == DSRRoutingLinkRecord::StubNetwork)
+            {
+              GraphPrefix stub;
+              stub.mask = Ipv4Mask (l->GetLinkData ().Get ());
+              stub.prefix = l->GetLinkId ().CombineMask (stub.mask);
+              m_graph.stubs.push_back (stub);
+              continue;
+            }
+          m_graph.linkAddresses.push_back (l->GetLinkData ());
+          std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator w =
+            index.find (l->GetLinkId ());
+          NS_ASSERT_MSG (w != index.end (), "No router LSA for " << l->GetLinkId ());
+          // the link back, as SPFGetNextLink finds it
+          DSRRoutingLSA *w_lsa = lsas[w->second];
+          DSRRoutingLinkRecord *linkRemote = 0;
+          for (uint32_t j = 0; j < w_lsa->GetNLinkRecords () && linkRemote == 0; j++)
+            {
+              DSRRoutingLinkRecord *lr = w_lsa->GetLinkRecord (j);
+              if (lr->GetLinkType () == DSRRoutingLinkRecord::PointToPoint
+                  && lr->GetLinkId () == lsa->GetLinkStateId ())
+                {
+                  linkRemote = lr;
+                }
+            }
+          NS_ASSERT_MSG (linkRemote, "No link back from " << l->GetLinkId ());
+          GraphLink link;
+          link.router = w->second;
+          link.metric = l->GetMetric ();
+          link.remoteMetric = linkRemote->GetMetric ();
+          link.nextHop = linkRemote->GetLinkData ();
+          link.interface = GetInterfaceForPrefix (record, l->GetLinkData (), Ipv4Mask::GetOnes ());
+          m_graph.links.push_back (link);
+          inDegree[w->second]++;
+          if (m_graph.routers[u].local)
+            {
+              m_graph.routers[w->second].rooted = true;
+            }
+        }
+      m_graph.linkBegin.push_back (m_graph.links.size ());
+      m_graph.linkAddressBegin.push_back (m_graph.linkAddresses.size ());
+      m_graph.stubBegin.push_back (m_graph.stubs.size ());
+      // CheckForStubNode short-circuits the routers with a single link
+      m_graph.routers[u].stub = m_graph.linkBegin[u + 1] - m_graph.linkBegin[u] <= 1;
+    }
+
+  // the links to each router, and the external routes of each router, by
+  // counting sort
+  m_graph.inBegin.assign (nRouters + 1, 0);
+  for (uint32_t u = 0; u < nRouters; u++)
+    {
+      m_graph.inBegin[u + 1] = m_graph.inBegin[u] + inDegree[u];
+    }
+  m_graph.in.resize (m_graph.links.size ());
+  std::vector<uint32_t> next (m_graph.inBegin.begin (), m_graph.inBegin.end () - 1);
+  for (uint32_t u = 0; u < nRouters; u++)
+    {
+      for (uint32_t i = m_graph.linkBegin[u]; i < m_graph.linkBegin[u + 1]; i++)
+        {
+          const GraphLink &link = m_graph.links[i];
+          m_graph.in[next[link.router]++] = std::make_pair (u, link.metric);
+        }
+    }
+  std::vector<uint32_t> advertiser (m_lsdb->GetNumExtLSAs (), nRouters);
+  m_graph.externalBegin.assign (nRouters + 1, 0);
+  for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
+    {
+      std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator u =
+        index.find (m_lsdb->GetExtLSA (i)->GetAdvertisingRouter ());
+      if (u != index.end ())
+        {
+          advertiser[i] = u->second;
+          m_graph.externalBegin[u->second + 1]++;
+        }
+    }
+  for (uint32_t u = 0; u < nRouters; u++)
+    {
+      m_graph.externalBegin[u + 1] += m_graph.externalBegin[u];
+    }
+  m_graph.externals.resize (m_graph.externalBegin[nRouters]);
+  next.assign (m_graph.externalBegin.begin (), m_graph.externalBegin.end () - 1);
+  for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
+    {
+      if (advertiser[i] < nRouters)
+        {
+          DSRRoutingLSA *extlsa = m_lsdb->GetExtLSA (i);
+          GraphPrefix external;
+          external.mask = extlsa->GetNetworkLSANetworkMask ();
+          external.prefix = extlsa->GetLinkStateId ().CombineMask (external.mask);
+          m_graph.externals[next[advertiser[i]]++] = external;
+        }
+    }
+  m_graph.valid = true;
+}
+
+void
+DSRRouteManagerImpl::RequireSPFGraph (const char *option) const
+{
+  if (!m_graph.valid)
+    {
+      NS_FATAL_ERROR ("DSRRouteManager::" << option << " needs a routing database without "
+                      "transit networks; disable it or use point-to-point links only");
+    }
+}
+
+void
+DSRRouteManagerImpl::CollectReverseSPFJobs (std::vector<SPFJob> &jobs)
+{
+  NS_LOG_FUNCTION (this);
+  jobs.resize (m_graph.routers.size ());
+  for (uint32_t t = 0; t < jobs.size (); t++)
+    {
+      jobs[t].type = SPFJob::REVERSE;
+      jobs[t].router = t;
+      jobs[t].graphLink = 0;
+      jobs[t].link = 0;
+      jobs[t].iface = 0;
+    }
+}
+
+//
+// SPFCalculate on the flat graph, from the tree of SPFGraphTree: the host
+// routes of initroot through the link, then the network routes of the
+// root, in the order the routers entered the tree.
+//
+void
+DSRRouteManagerImpl::SPFCalculateGraph (SPFContext &context, uint32_t initroot, uint32_t link)
+{
+  const GraphLink &l = m_graph.links[link];
+  uint32_t root = l.router;
+  NS_LOG_FUNCTION (this << m_graph.routers[root].routerId << m_graph.routers[initroot].routerId);
+  if (m_checkStubNodes && m_graph.routers[root].stub)
+    {
+      NS_LOG_LOGIC ("SPFCalculate truncated for stub node " << m_graph.routers[root].routerId);
+      RecordStubDefaultRoute (context, root);
+      return;
+    }
+  SPFGraphTree (context, root, l.remoteMetric);
+
+  // SPFIntraAddRouter
+  Ipv4DSRRouting *routing = m_graph.routers[initroot].routing;
+  for (uint32_t i = 0; i < context.settled.size (); i++)
+    {
+      RouteKeys_t keys = GetRouteKeys (context.settled[i], false);
+      for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+        {
+          RecordRoute (*context.routes, PendingRoute::HOST, routing, *key,
+                       Ipv4Mask::GetOnes (), l.nextHop, l.interface, context.distance[context.settled[i]]);
+        }
+    }
+
+  // second stage: SPFProcessStubs and ProcessASExternals
+  for (uint32_t i = 0; i < context.settled.size (); i++)
+    {
+      RecordGraphNetworkRoutes (context, root, context.settled[i], context.exits[context.settled[i]]);
+    }
+}
+
+//
+// The steps of SPFCalculate and SPFNext, with the SPF status, distance and
+// root exits of the routers in arrays indexed by router: a router is
+// settled once, its exits are the sorted union of those of its equal-cost
+// parents, and a heap of router indexes (the heap of DsrCandidateQueue)
+// replaces the candidate queue.
+//
+void
+DSRRouteManagerImpl::SPFGraphTree (SPFContext &context, uint32_t root, uint32_t rootDistance)
+{
+  NS_LOG_FUNCTION (this << m_graph.routers[root].routerId << rootDistance);
+  uint32_t nRouters = m_graph.routers.size ();
+  std::vector<uint32_t> &distance = context.distance;
+  std::vector<DSRRoutingLSA::SPFStatus> &state = context.state;
+  std::vector<std::vector<DSRVertex::NodeExit_t> > &exits = context.exits;
+  GraphCandidateHeap &heap = context.heap;
+  std::vector<uint32_t> &position = heap.GetOrder ().position;
+  distance.assign (nRouters, DISTINFINITY);
+  state.assign (nRouters, DSRRoutingLSA::LSA_SPF_NOT_EXPLORED);
+  if (exits.size () < nRouters)
+    {
+      exits.resize (nRouters);
+    }
+  for (uint32_t i = 0; i < nRouters; i++)
+    {
+      exits[i].clear ();
+    }
+  heap.Clear ();
+  position.assign (nRouters, GraphCandidateHeap::NO_POSITION);
+  context.settled.clear ();
+
+  distance[root] = rootDistance;
+  state[root] = DSRRoutingLSA::LSA_SPF_IN_SPFTREE;
+  uint32_t v = root;
+  for (;;)
+    {
+      // SPFNext
+      for (uint32_t i = m_graph.linkBegin[v]; i < m_graph.linkBegin[v + 1]; i++)
+        {
+          const GraphLink &vw = m_graph.links[i];
+          uint32_t w = vw.router;
+          if (state[w] == DSRRoutingLSA::LSA_SPF_IN_SPFTREE)
+            {
+              continue;
+            }
+          uint32_t d = distance[v] + vw.metric;
+          if (state[w] == DSRRoutingLSA::LSA_SPF_CANDIDATE && distance[w] < d)
+            {
+              continue;
+            }
+          if (state[w] == DSRRoutingLSA::LSA_SPF_NOT_EXPLORED || distance[w] > d)
+            {
+              exits[w].clear ();
+              distance[w] = d;
+              if (state[w] == DSRRoutingLSA::LSA_SPF_CANDIDATE)
+                {
+                  heap.DecreaseKey (position[w], GraphCandidate (d, w));
+                }
+              else
+                {
+                  heap.Push (GraphCandidate (d, w));
+                }
+              state[w] = DSRRoutingLSA::LSA_SPF_CANDIDATE;
+            }
+          // SPFNexthopCalculation, and MergeRootExitDirections for an equal
+          // cost path
+          if (v == root)
+            {
+              exits[w].push_back (DSRVertex::NodeExit_t (vw.nextHop, vw.interface));
+            }
+          else
+            {
+              exits[w].insert (exits[w].end (), exits[v].begin (), exits[v].end ());
+            }
+          std::sort (exits[w].begin (), exits[w].end ());
+          exits[w].erase (std::unique (exits[w].begin (), exits[w].end ()), exits[w].end ());
+        }
+
+      if (heap.Empty ())
+        {
+          break;
+        }
+      v = heap.Pop ().second;
+      state[v] = DSRRoutingLSA::LSA_SPF_IN_SPFTREE;
+      context.settled.push_back (v);
+    }
+}
+
+void
+DSRRouteManagerImpl::RecordStubDefaultRoute (SPFContext &context, uint32_t router)
+{
+  NS_LOG_FUNCTION (this << m_graph.routers[router].routerId);
+  if (m_graph.linkBegin[router] == m_graph.linkBegin[router + 1])
+    {
+      NS_LOG_WARN ("all nodes should have at least one transit link:" << m_graph.routers[router].routerId);
+      return;
+    }
+  const GraphLink &link = m_graph.links[m_graph.linkBegin[router]];
+  RecordRoute (*context.routes, PendingRoute::NETWORK, m_graph.routers[router].routing,
+               Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0"), link.nextHop, link.interface, 0);
+}
+
+void
+DSRRouteManagerImpl::RecordGraphNetworkRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                                               const std::vector<DSRVertex::NodeExit_t> &exits)
+{
+  Ipv4DSRRouting *routing = m_graph.routers[router].routing;
+  for (uint32_t i = m_graph.stubBegin[to]; i < m_graph.stubBegin[to + 1]; i++)
+    {
+      for (uint32_t j = 0; j < exits.size (); j++)
+        {
+          if (exits[j].second >= 0)
+            {
+              RecordRoute (*context.routes, PendingRoute::NETWORK, routing, m_graph.stubs[i].prefix,
+                           m_graph.stubs[i].mask, exits[j].first, exits[j].second, 0);
+            }
+        }
+    }
+  for (uint32_t i = m_graph.externalBegin[to]; i < m_graph.externalBegin[to + 1]; i++)
+    {
+      for (uint32_t j = 0; j < exits.size (); j++)
+        {
+          if (exits[j].second >= 0)
+            {
+              RecordRoute (*context.routes, PendingRoute::AS_EXTERNAL, routing, m_graph.externals[i].prefix,
+                           m_graph.externals[i].mask, exits[j].first, exits[j].second, 0);
+            }
+        }
+    }
+}
+
+void
+DSRRouteManagerImpl::ReverseSPFCalculate (SPFContext &context, uint32_t destination)
+{
+  NS_LOG_FUNCTION (this << destination);
+  std::vector<uint32_t> &distance = context.distance;
+  GraphCandidateHeap &heap = context.heap;
+  std::vector<uint32_t> &position = heap.GetOrder ().position;
+  distance.assign (m_graph.routers.size (), DISTINFINITY);
+  heap.Clear ();
+  position.assign (m_graph.routers.size (), GraphCandidateHeap::NO_POSITION);
+  distance[destination] = 0;
+  heap.Push (GraphCandidate (0, destination));
+  while (!heap.Empty ())
+    {
+      GraphCandidate v = heap.Pop ();
+      for (uint32_t i = m_graph.inBegin[v.second]; i < m_graph.inBegin[v.second + 1]; i++)
+        {
+          uint32_t u = m_graph.in[i].first;
+          uint32_t d = v.first + m_graph.in[i].second;
+          if (d < distance[u])
+            {
+              distance[u] = d;
+              if (position[u] != GraphCandidateHeap::NO_POSITION)
+                {
+                  heap.DecreaseKey (position[u], GraphCandidate (d, u));
+                }
+              else
+                {
+                  heap.Push (GraphCandidate (d, u));
+                }
+            }
+        }
+    }
+}
+
+//
+// SPFCalculate rooted at neighbor w of router u gives u, through w, the
+// distance l(w, u) + d(w, t) to each router t reached, l(w, u) being the
+// metric of the first link from w back to u.  Running Dijkstra from t on the
+// reversed graph gives d(w, t) for every w at once, so the routes of every
+// router to t come out of a single tree.  The host routes of each router are
+// recorded neighbor after neighbor, in the order of its links, so that each
+// destination gets its candidates in the same order as with one SPF per
+// neighbor.
+//
+void
+DSRRouteManagerImpl::RunReverseSPFJob (SPFJob &job, SPFContext &context)
+{
+  uint32_t t = job.router;
+  ReverseSPFCalculate (context, t);
+  const std::vector<uint32_t> &distance = context.distance;
+  if (context.exits.empty ())
+    {
+      context.exits.resize (1);
+    }
+  std::vector<DSRVertex::NodeExit_t> &exits = context.exits[0];
+  for (uint32_t u = 0; u < m_graph.routers.size (); u++)
+    {
+      const GraphRouter &router = m_graph.routers[u];
+      if (router.local)
+        {
+          RecordReverseHostRoutes (context, u, t, distance);
+        }
+
+      // the network routes of the trees rooted at u, through every next hop
+      // on a shortest path to t
+      if (!router.rooted || (m_checkStubNodes && router.stub) || u == t || distance[u] == DISTINFINITY)
+        {
+          continue;
+        }
+      exits.clear ();
+      for (uint32_t i = m_graph.linkBegin[u]; i < m_graph.linkBegin[u + 1]; i++)
+        {
+          const GraphLink &link = m_graph.links[i];
+          if (distance[link.router] != DISTINFINITY
+              && link.metric + distance[link.router] == distance[u])
+            {
+              exits.push_back (DSRVertex::NodeExit_t (link.nextHop, link.interface));
+            }
+        }
+      std::sort (exits.begin (), exits.end ());
+      exits.erase (std::unique (exits.begin (), exits.end ()), exits.end ());
+      RecordGraphNetworkRoutes (context, u, t, exits);
+    }
+
+  // the default route of a stub router, instead of the trees rooted at it
+  if (m_checkStubNodes && m_graph.routers[t].rooted && m_graph.routers[t].stub)
+    {
+      RecordStubDefaultRoute (context, t);
+    }
+}
+
+void
+DSRRouteManagerImpl::RecordReverseHostRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                                              const std::vector<uint32_t> &distance)
+{
+  Ipv4DSRRouting *routing = m_graph.routers[router].routing;
+  for (uint32_t i = m_graph.linkBegin[router]; i < m_graph.linkBegin[router + 1]; i++)
+    {
+      const GraphLink &link = m_graph.links[i];
+      if (link.router == to)
+        {
+          // the direct routes to the neighbor, see CollectSPFJobs
+          RouteKeys_t keys = GetRouteKeys (to, true);
+          for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+            {
+              RecordRoute (*context.routes, PendingRoute::HOST, routing, *key, Ipv4Mask::GetOnes (),
+                           link.nextHop, link.interface, link.metric);
+            }
+        }
+      else if (!(m_checkStubNodes && m_graph.routers[link.router].stub)
+               && distance[link.router] != DISTINFINITY)
+        {
+          uint32_t d = link.remoteMetric + distance[link.router];
+          RouteKeys_t keys = GetRouteKeys (to, false);
+          for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+            {
+              RecordRoute (*context.routes, PendingRoute::HOST, routing, *key, Ipv4Mask::GetOnes (),
+                           link.nextHop, link.interface, d);
+            }
+        }
+    }
+  if (DSRRouteManager::GetCandidatesPerDestination () > 0)
+    {
+      RecordTwoHopHostRoutes (context, router, to, distance);
+    }
+}
+
+//
+// A two-hop candidate of u to t goes through neighbor w, which forwards to
+// its neighbor x instead of along its own shortest route.  x must be closer
+// to t than both u and w, so that no router on the way sends the packet
+// back.  Its distance is that of the route of w through x, l(x, w) + d(x, t)
+// or l(w, t) if x is t, plus l(w, u), as for the other candidates of u.
+// The neighbors x on a shortest route of w add nothing to the candidate of
+// u through w and are skipped.
+//
+void
+DSRRouteManagerImpl::RecordTwoHopHostRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                                             const std::vector<uint32_t> &distance)
+{
+  uint32_t k = DSRRouteManager::GetCandidatesPerDestination ();
+  if (distance[router] == DISTINFINITY)
+    {
+      return;
+    }
+  uint32_t nCandidates = 0;
+  std::vector<std::pair<uint32_t, std::pair<uint32_t, uint32_t> > > &twoHops = context.twoHops;
+  twoHops.clear ();
+  for (uint32_t i = m_graph.linkBegin[router]; i < m_graph.linkBegin[router + 1]; i++)
+    {
+      const GraphLink &link = m_graph.links[i];
+      uint32_t w = link.router;
+      if (w == to)
+        {
+          nCandidates++;
+          continue;
+        }
+      if ((m_checkStubNodes && m_graph.routers[w].stub) || distance[w] == DISTINFINITY)
+        {
+          continue;
+        }
+      nCandidates++;
+      for (uint32_t j = m_graph.linkBegin[w]; j < m_graph.linkBegin[w + 1]; j++)
+        {
+          const GraphLink &wx = m_graph.links[j];
+          uint32_t x = wx.router;
+          if (distance[x] >= distance[router] || distance[x] >= distance[w]
+              || wx.metric + distance[x] == distance[w]
+              || (x != to && m_checkStubNodes && m_graph.routers[x].stub))
+            {
+              continue;
+            }
+          uint32_t d = link.remoteMetric + (x == to ? wx.metric : wx.remoteMetric + distance[x]);
+          twoHops.push_back (std::make_pair (d, std::make_pair (i, j)));
+        }
+    }
+  if (nCandidates >= k || twoHops.empty ())
+    {
+      return;
+    }
+  uint32_t n = std::min<uint32_t> (k - nCandidates, twoHops.size ());
+  std::partial_sort (twoHops.begin (), twoHops.begin () + n, twoHops.end ());
+  Ipv4DSRRouting *routing = m_graph.routers[router].routing;
+  for (uint32_t i = 0; i < n; i++)
+    {
+      const GraphLink &link = m_graph.links[twoHops[i].second.first];
+      const GraphLink &wx = m_graph.links[twoHops[i].second.second];
+      RouteKeys_t keys = GetRouteKeys (to, false);
+      for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+        {
+          RecordRoute (*context.routes, PendingRoute::HOST, routing, *key,
+                       Ipv4Mask::GetOnes (), link.nextHop, link.interface, twoHops[i].first);
+          context.routes->back ().via = wx.nextHop;
+        }
+    }
+}
+
+void
+DSRRouteManagerImpl::ReplaceGraphHostRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                                             const std::vector<uint32_t> &distance)
+{
+  NS_LOG_FUNCTION (this << m_graph.routers[router].routerId << m_graph.routers[to].routerId);
+  Ipv4DSRRouting *routing = m_graph.routers[router].routing;
+  for (uint32_t k = 0; k < 2; k++)
+    {
+      RouteKeys_t keys = GetRouteKeys (to, k == 0);
+      for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+        {
+          routing->RemoveHostRoutesTo (*key);
+        }
+    }
+  context.routes->clear ();
+  RecordReverseHostRoutes (context, router, to, distance);
+  InstallRoutes (*context.routes);
+  context.routes->clear ();
+}
+
+//
+// The host routes of a router u to t, and their marks, only read d(y, t)
+// for u and the routers y within one link of it, or two with the two-hop
+// candidates.  When these routers are fewer than the destinations, the
+// trees rooted at them give their distances to every destination at once.
+//
+void
+DSRRouteManagerImpl::ReplaceGraphHostRoutes (SPFContext &context, const std::vector<uint8_t> &routers)
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t nRouters = m_graph.routers.size ();
+  uint32_t hops = DSRRouteManager::GetCandidatesPerDestination () > 0 ? 2 : 1;
+  bool loopFree = DSRRouteManager::GetLoopFreeAlternates ();
+  std::vector<uint32_t> replaced;
+  // the routers near each replaced router, and the roots of the trees
+  std::vector<uint32_t> near;
+  std::vector<uint32_t> nearBegin (1, 0);
+  std::vector<uint32_t> tree (nRouters, DISTINFINITY);
+  std::vector<uint32_t> roots;
+  std::vector<uint32_t> seen (nRouters, DISTINFINITY);
+  for (uint32_t u = 0; u < nRouters; u++)
+    {
+      if (!routers[u] || !m_graph.routers[u].local)
+        {
+          continue;
+        }
+      replaced.push_back (u);
+      uint32_t begin = near.size ();
+      near.push_back (u);
+      seen[u] = u;
+      for (uint32_t h = 0, end = near.size (); h < hops; h++, end = near.size ())
+        {
+          for (uint32_t i = begin; i < end; i++)
+            {
+              for (uint32_t j = m_graph.linkBegin[near[i]]; j < m_graph.linkBegin[near[i] + 1]; j++)
+                {
+                  uint32_t y = m_graph.links[j].router;
+                  if (seen[y] != u)
+                    {
+                      seen[y] = u;
+                      near.push_back (y);
+                    }
+                }
+            }
+          begin = end;
+        }
+      for (uint32_t i = nearBegin.back (); i < near.size (); i++)
+        {
+          if (tree[near[i]] == DISTINFINITY)
+            {
+              tree[near[i]] = roots.size ();
+              roots.push_back (near[i]);
+            }
+        }
+      nearBegin.push_back (near.size ());
+    }
+  if (replaced.empty ())
+    {
+      return;
+    }
+  NS_LOG_LOGIC ("Host routes of " << replaced.size () << " routers to every destination, from "
+                << roots.size () << " trees");
+
+  if (roots.size () < nRouters && (uint64_t) roots.size () * nRouters <= MAX_FORWARD_TREE_WORDS)
+    {
+      std::vector<uint32_t> fromRoots (roots.size () * nRouters);
+      for (uint32_t r = 0; r < roots.size (); r++)
+        {
+          SPFGraphTree (context, roots[r], 0);
+          std::copy (context.distance.begin (), context.distance.end (), fromRoots.begin () + r * nRouters);
+        }
+      std::vector<uint32_t> distance (nRouters, DISTINFINITY);
+      for (uint32_t t = 0; t < nRouters; t++)
+        {
+          for (uint32_t i = 0; i < replaced.size (); i++)
+            {
+              uint32_t u = replaced[i];
+              for (uint32_t j = nearBegin[i]; j < nearBegin[i + 1]; j++)
+                {
+                  distance[near[j]] = fromRoots[tree[near[j]] * nRouters + t];
+                }
+              ReplaceGraphHostRoutes (context, u, t, distance);
+              if (loopFree && u != t)
+                {
+                  MarkLoopFreeAlternates (u, t, distance, m_loopFreeBack.data () + m_graph.linkBegin[u]);
+                }
+              for (uint32_t j = nearBegin[i]; j < nearBegin[i + 1]; j++)
+                {
+                  distance[near[j]] = DISTINFINITY;
+                }
+            }
+        }
+      return;
+    }
+
+  for (uint32_t t = 0; t < nRouters; t++)
+    {
+      ReverseSPFCalculate (context, t);
+      for (uint32_t i = 0; i < replaced.size (); i++)
+        {
+          uint32_t u = replaced[i];
+          ReplaceGraphHostRoutes (context, u, t, context.distance);
+          if (loopFree && u != t)
+            {
+              MarkLoopFreeAlternates (u, t, context.distance, m_loopFreeBack.data () + m_graph.linkBegin[u]);
+            }
+        }
+    }
+}
+
+void
+DSRRouteManagerImpl::ForgetLazyRoutes (uint32_t router, uint32_t to)
+{
+  std::vector<bool> &resolved = m_lazy.resolved[router];
+  if (resolved.empty () || !resolved[to])
+    {
+      return;
+    }
+  NS_LOG_LOGIC ("Forget the routes of " << m_graph.routers[router].routerId << " to "
+                << m_graph.routers[to].routerId);
+  resolved[to] = false;
+  Ipv4DSRRouting *routing = m_graph.routers[router].routing;
+  for (uint32_t k = 0; k < 2; k++)
+    {
+      RouteKeys_t keys = GetRouteKeys (to, k == 0);
+      for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+        {
+          routing->RemoveHostRoutesTo (*key);
+        }
+    }
+}
+
+void
+DSRRouteManagerImpl::ReplaceGraphNetworkRoutes (SPFContext &context, uint32_t router)
+{
+  NS_LOG_FUNCTION (this << m_graph.routers[router].routerId);
+  SPFGraphTree (context, router, 0);
+  context.routes->clear ();
+  if (DSRRouteManager::GetRouteEngine () == DSRRouteManager::REVERSE_SPF)
+    {
+      // once, destination after destination, as RunReverseSPFJob adds them
+      for (uint32_t t = 0; t < m_graph.routers.size (); t++)
+        {
+          if (t != router && context.state[t] == DSRRoutingLSA::LSA_SPF_IN_SPFTREE)
+            {
+              RecordGraphNetworkRoutes (context, router, t, context.exits[t]);
+            }
+        }
+    }
+  else
+    {
+      // once per SPFCalculateGraph rooted at the router, that is per link
+      // to it from a local router
+      for (uint32_t j = m_graph.inBegin[router]; j < m_graph.inBegin[router + 1]; j++)
+        {
+          if (!m_graph.routers[m_graph.in[j].first].local)
+            {
+              continue;
+            }
+          for (uint32_t i = 0; i < context.settled.size (); i++)
+            {
+              RecordGraphNetworkRoutes (context, router, context.settled[i], context.exits[context.settled[i]]);
+            }
+        }
+    }
+  m_graph.routers[router].routing->RemoveNetworkRoutes ();
+  InstallRoutes (*context.routes);
+  context.routes->clear ();
+}
+
+bool
+DSRRouteManagerImpl::SetGraphLinkMetric (uint32_t router, uint32_t link, uint16_t metric)
+{
+  NS_LOG_FUNCTION (this << router << link << metric);
+  GraphLink &l = m_graph.links[link];
+  uint32_t w = l.router;
+  l.metric = metric;
+  // the links of the router to w are in the same order among the links to w
+  uint32_t rank = 0;
+  for (uint32_t i = m_graph.linkBegin[router]; i < link; i++)
+    {
+      if (m_graph.links[i].router == w)
+        {
+          rank++;
+        }
+    }
+  for (uint32_t j = m_graph.inBegin[w], skip = rank; j < m_graph.inBegin[w + 1]; j++)
+    {
+      if (m_graph.in[j].first != router)
+        {
+          continue;
+        }
+      if (skip == 0)
+        {
+          m_graph.in[j].second = metric;
+          break;
+        }
+      skip--;
+    }
+  if (rank == 0)
+    {
+      for (uint32_t i = m_graph.linkBegin[w]; i < m_graph.linkBegin[w + 1]; i++)
+        {
+          if (m_graph.links[i].router == router)
+            {
+              m_graph.links[i].remoteMetric = metric;
+            }
+        }
+    }
+
+  // the point-to-point and stub records of the link, as the router now
+  // advertises them
+  Ipv4Address local = m_graph.linkAddresses[m_graph.linkAddressBegin[router] + link - m_graph.linkBegin[router]];
+  DSRRoutingLSA *lsa = m_lsdb->GetLSA (m_graph.routers[router].routerId);
+  for (uint32_t i = 0; lsa != 0 && i < lsa->GetNLinkRecords (); i++)
+    {
+      DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (i);
+      if ((lr->GetLinkType () == DSRRoutingLinkRecord::PointToPoint && lr->GetLinkData () == local)
+          || (lr->GetLinkType () == DSRRoutingLinkRecord::StubNetwork
+              && lr->GetLinkId () == local.CombineMask (Ipv4Mask (lr->GetLinkData ().Get ()))))
+        {
+          lr->SetMetric (metric);
+        }
+    }
+  return rank == 0;
+}
+
+//
+// The host routes of router u to t through neighbor w are loop-free
+// alternates when d(w, t) < d(w, u) + d(u, t).  The tree of each router w
+// gives d(w, u) for the links of its neighbors u to it, and the reverse tree
+// of each destination t gives d(u, t) and d(w, t) for every u and w, so the
+// test takes two trees per router.  The routes are those RunReverseSPFJob
+// records: to the interface addresses of a neighbor through the links to it,
+// which are always loop-free, and to the link addresses of the other
+// routers.
+//
+void
+DSRRouteManagerImpl::MarkLoopFreeAlternates (SPFContext &context)
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t nRouters = m_graph.routers.size ();
+  ComputeLoopFreeBack (context);
+  uint32_t nMarked = 0;
+  for (uint32_t t = 0; t < nRouters; t++)
+    {
+      ReverseSPFCalculate (context, t);
+      for (uint32_t u = 0; u < nRouters; u++)
+        {
+          if (m_graph.routers[u].local && u != t)
+            {
+              nMarked += MarkLoopFreeAlternates (u, t, context.distance,
+                                                 m_loopFreeBack.data () + m_graph.linkBegin[u]);
+            }
+        }
+    }
+  NS_LOG_INFO ("Marked " << nMarked << " loop-free alternates");
+}
+
+void
+DSRRouteManagerImpl::ComputeLoopFreeBack (SPFContext &context)
+{
+  NS_LOG_FUNCTION (this);
+  m_loopFreeBack.assign (m_graph.links.size (), DISTINFINITY);
+  for (uint32_t w = 0; w < m_graph.routers.size (); w++)
+    {
+      SPFGraphTree (context, w, 0);
+      for (uint32_t j = m_graph.inBegin[w]; j < m_graph.inBegin[w + 1]; j++)
+        {
+          uint32_t u = m_graph.in[j].first;
+          for (uint32_t k = m_graph.linkBegin[u]; k < m_graph.linkBegin[u + 1]; k++)
+            {
+              if (m_graph.links[k].router == w)
+                {
+                  m_loopFreeBack[k] = context.distance[u];
+                }
+            }
+        }
+    }
+}
+
+DSRRouteManagerImpl::RouteKeys_t
+DSRRouteManagerImpl::GetRouteKeys (uint32_t to, bool interfaces) const
+{
+  if (m_aggregate)
+    {
+      const Ipv4Address *routerId = &m_graph.routers[to].routerId;
+      return RouteKeys_t (routerId, routerId + 1);
+    }
+  if (interfaces)
+    {
+      return RouteKeys_t (m_graph.interfaceAddresses.data () + m_graph.interfaceAddressBegin[to],
+                          m_graph.interfaceAddresses.data () + m_graph.interfaceAddressBegin[to + 1]);
+    }
+  return RouteKeys_t (m_graph.linkAddresses.data () + m_graph.linkAddressBegin[to],
+                      m_graph.linkAddresses.data () + m_graph.linkAddressBegin[to + 1]);
+}
+
+//
+// All the addresses of a router have the same candidates: the direct
+// routes of each neighbor through its links to the router, and the routes
+// through the other neighbors.  Stored once under the router ID, they take
+// one entry per candidate instead of one per candidate and address, and
+// the prefix table shared by the nodes maps each address to the router ID.
+// Consecutive addresses of a router share one range of the table.
+//
+void
+DSRRouteManagerImpl::InitializePrefixTable ()
+{
+  NS_LOG_FUNCTION (this);
+  m_aggregate = DSRRouteManager::GetAggregateRoutes ();
+  if (m_aggregate)
+    {
+      RequireSPFGraph ("SetAggregateRoutes");
+    }
+  m_prefixes = 0;
+  if (m_aggregate)
+    {
+      m_prefixes = Create<DsrPrefixTable> ();
+      for (uint32_t t = 0; t < m_graph.routers.size (); t++)
+        {
+          uint32_t routerId = m_graph.routers[t].routerId.Get ();
+          for (uint32_t j = m_graph.interfaceAddressBegin[t]; j < m_graph.interfaceAddressBegin[t + 1]; j++)
+            {
+              m_prefixes->Insert (m_graph.interfaceAddresses[j], Ipv4Mask::GetOnes (), routerId);
+            }
+          for (uint32_t j = m_graph.linkAddressBegin[t]; j < m_graph.linkAddressBegin[t + 1]; j++)
+            {
+              m_prefixes->Insert (m_graph.linkAddresses[j], Ipv4Mask::GetOnes (), routerId);
+            }
+        }
+      m_prefixes->Build ();
+      NS_LOG_INFO ("Prefix table of " << m_prefixes->GetNPrefixes () << " addresses in "
+                   << m_prefixes->GetNRanges () << " ranges");
+    }
+  for (uint32_t u = 0; u < m_graph.routers.size (); u++)
+    {
+      if (m_graph.routers[u].local)
+        {
+          m_graph.routers[u].routing->SetPrefixTable (m_prefixes);
+        }
+    }
+}
+
+uint32_t
+DSRRouteManagerImpl::MarkLoopFreeAlternates (uint32_t router, uint32_t to, const std::vector<uint32_t> &distance,
+                                             const uint32_t *back)
+{
+  Ipv4DSRRouting *routing = m_graph.routers[router].routing;
+  uint32_t nMarked = 0;
+  for (uint32_t k = m_graph.linkBegin[router]; k < m_graph.linkBegin[router + 1]; k++)
+    {
+      const GraphLink &link = m_graph.links[k];
+      if (link.router == to)
+        {
+          RouteKeys_t keys = GetRouteKeys (to, true);
+          for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+            {
+              routing->MarkLoopFreeAlternate (*key, link.nextHop, link.interface);
+            }
+          nMarked++;
+          continue;
+        }
+      if ((m_checkStubNodes && m_graph.routers[link.router].stub)
+          || distance[link.router] == DISTINFINITY
+          || (uint64_t) distance[link.router]
+             >= (uint64_t) back[k - m_graph.linkBegin[router]] + distance[router])
+        {
+          continue;
+        }
+      RouteKeys_t keys = GetRouteKeys (to, false);
+      for (const Ipv4Address *key = keys.first; key != keys.second; key++)
+        {
+          routing->MarkLoopFreeAlternate (*key, link.nextHop, link.interface);
+        }
+      nMarked++;
+    }
+  return nMarked;
+}
+
+void
+DSRRouteManagerImpl::InitializeLazyRoutes (bool enable)
+{
+  NS_LOG_FUNCTION (this << enable);
+  m_lazy.enabled = enable;
+  m_lazy.resolved.clear ();
+  m_lazy.networks.clear ();
+  m_lazy.trees.clear ();
+  m_lazy.clock = 0;
+  m_lazy.back.clear ();
+  m_lazy.backValid.clear ();
+  m_lazy.routes.clear ();
+  for (uint32_t u = 0; u < m_graph.routers.size (); u++)
+    {
+      if (m_graph.routers[u].local)
+        {
+          m_graph.routers[u].routing->SetOnDemandRoutes (enable);
+        }
+    }
+  if (!enable)
+    {
+      return;
+    }
+  if (!m_nodeIndexValid)
+    {
+      BuildNodeIndex ();
+    }
+  m_checkStubNodes = NodeList::GetNNodes () > 0;
+  m_lazy.resolved.resize (m_graph.routers.size ());
+  m_lazy.networks.resize (m_graph.routers.size (), false);
+  m_lazy.back.resize (m_graph.links.size ());
+  m_lazy.backValid.resize (m_graph.routers.size (), false);
+  m_lazy.context.spfroot = 0;
+  m_lazy.context.routes = &m_lazy.routes;
+}
+
+const std::vector<uint32_t> &
+DSRRouteManagerImpl::GetLazyTree (uint32_t to)
+{
+  m_lazy.clock++;
+  std::unordered_map<uint32_t, LazyTree>::iterator i = m_lazy.trees.find (to);
+  if (i != m_lazy.trees.end ())
+    {
+      i->second.used = m_lazy.clock;
+      return i->second.distance;
+    }
+  uint32_t maxTrees = std::max<uint32_t> (1, MAX_LAZY_TREE_WORDS / std::max<uint32_t> (1, m_graph.routers.size ()));
+  if (m_lazy.trees.size () >= maxTrees)
+    {
+      // the scan costs less than the tree it saves
+      std::unordered_map<uint32_t, LazyTree>::iterator oldest = m_lazy.trees.begin ();
+      for (i = m_lazy.trees.begin (); i != m_lazy.trees.end (); i++)
+        {
+          if (i->second.used < oldest->second.used)
+            {
+              oldest = i;
+            }
+        }
+      NS_LOG_LOGIC ("Drop the reverse tree of " << m_graph.routers[oldest->first].routerId);
+      m_lazy.trees.erase (oldest);
+    }
+  ReverseSPFCalculate (m_lazy.context, to);
+  LazyTree &tree = m_lazy.trees[to];
+  tree.distance.swap (m_lazy.context.distance);
+  tree.used = m_lazy.clock;
+  return tree.distance;
+}
+
+const uint32_t *
+DSRRouteManagerImpl::GetLazyBack (uint32_t router)
+{
+  if (!m_lazy.backValid[router])
+    {
+      // only the distances of the neighbors are kept, not the whole tree
+      ReverseSPFCalculate (m_lazy.context, router);
+      for (uint32_t k = m_graph.linkBegin[router]; k < m_graph.linkBegin[router + 1]; k++)
+        {
+          m_lazy.back[k] = m_lazy.context.distance[m_graph.links[k].router];
+        }
+      m_lazy.backValid[router] = true;
+    }
+  return m_lazy.back.data () + m_graph.linkBegin[router];
+}
+
+//
+// The routes of router u to router t computed on demand are those
+// RunReverseSPFJob records for u from the reverse tree of t, which is kept
+// for the other routers asking for t, as long as it is among the trees
+// asked for last.  The network routes of u come with its first request,
+// from its own tree as in UpdateLinkMetric.  With the loop-free
+// alternates, the reverse tree of u gives d(w, u) for the far end w of each
+// link of u, which the forward trees give MarkLoopFreeAlternates; only these
+// distances are kept.
+//
+bool
+DSRRouteManagerImpl::ResolveRoutes (Ptr<Node> node, Ipv4Address dest)
+{
+  NS_LOG_FUNCTION (this << node->GetId () << dest);
+  if (!m_lazy.enabled)
+    {
+      return false;
+    }
+  Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
+  if (rtr == 0)
+    {
+      return false;
+    }
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash>::const_iterator r =
+    m_graph.index.find (rtr->GetRouterId ());
+  if (r == m_graph.index.end () || !m_graph.routers[r->second].local)
+    {
+      return false;
+    }
+  uint32_t u = r->second;
+  SPFContext &context = m_lazy.context;
+  bool added = false;
+  if (!m_lazy.networks[u])
+    {
+      m_lazy.networks[u] = true;
+      if (m_graph.routers[u].rooted && m_checkStubNodes && m_graph.routers[u].stub)
+        {
+          RecordStubDefaultRoute (context, u);
+          InstallRoutes (m_lazy.routes);
+          m_lazy.routes.clear ();
+        }
+      else if (m_graph.routers[u].rooted)
+        {
+          ReplaceGraphNetworkRoutes (context, u);
+        }
+      added = true;
+    }
 
+  const InterfaceRecord *record = GetInterfaceRecord (dest);
+  if (record == 0)
+    {
+      return added;
+    }
+  Ptr<DSRRouter> owner = record->node->GetObject<DSRRouter> ();
+  r = owner != 0 ? m_graph.index.find (owner->GetRouterId ()) : m_graph.index.end ();
+  if (r == m_graph.index.end () || r->second == u)
+    {
+      return added;
+    }
+  uint32_t t = r->second;
+  std::vector<bool> &resolved = m_lazy.resolved[u];
+  if (resolved.empty ())
+    {
+      resolved.resize (m_graph.routers.size (), false);
+    }
+  if (resolved[t])
+    {
+      return added;
+    }
+  resolved[t] = true;
+  NS_LOG_LOGIC ("Routes of " << m_graph.routers[u].routerId << " to " << m_graph.routers[t].routerId);
+  const std::vector<uint32_t> &distance = GetLazyTree (t);
+  RecordReverseHostRoutes (context, u, t, distance);
+  InstallRoutes (m_lazy.routes);
+  m_lazy.routes.clear ();
+  if (DSRRouteManager::GetLoopFreeAlternates ())
+    {
+      // GetLazyBack leaves the tree of t alone
+      MarkLoopFreeAlternates (u, t, distance, GetLazyBack (u));
+    }
+  return true;
+}
 
-                  SPFCalculate (w_lsa->GetLinkStateId (), rtr->GetRouterId (), linkRemote, Iface);
-                }
-                else if (l->GetLinkType () == 
-                          DSRRoutingLinkRecord::TransitNetwork)
-                  {
-                    w_lsa = m_lsdb->GetLSA (l->GetLinkId ());
-                    NS_ASSERT (w_lsa);
-                    NS_LOG_LOGIC ("Found a Transit record from " << 
-                                  v->GetVertexId () << " to " << w_lsa->GetLinkStateId ());
-                    SPFCalculate (w_lsa->GetLinkStateId (), rtr->GetRouterId (), l, i+1);
-                  }
-                else 
-                  {
-                    NS_ASSERT_MSG (0, "illegal Link Type");
-                  }
-                }
+//
+// Progress of the jobs of RunSPFJobs, shared by the worker threads and the
+// thread installing the routes.
+//
+struct DSRRouteManagerImpl::SPFWorkQueue
+{
+  std::vector<SPFJob> *jobs;            //!< the SPF calculations
+  std::vector<uint8_t> done;            //!< whether each calculation is over
+  uint32_t next;                        //!< next calculation to start
+  uint32_t installed;                   //!< calculations whose routes are installed
+  uint32_t window;                      //!< how far the workers may run ahead of the installation
+  std::mutex mutex;                     //!< protects the fields above
+  std::condition_variable jobDone;      //!< signaled when a calculation is over
+  std::condition_variable jobInstalled; //!< signaled when routes are installed
+};
+
+//
+// The SPF calculations run on worker threads, in any order, and only write
+// to their own SPFContext and SPFJob: the LSDB and the node indexes are
+// only read.  This thread installs the routes of the jobs one after the
+// other in the serial order, so the forwarding tables come out identical to
+// those of a single-threaded run.  The workers stay a few jobs ahead of it
+// so that the pending routes do not pile up.
+//
+void
+DSRRouteManagerImpl::RunSPFJobs (std::vector<SPFJob> &jobs, uint32_t nThreads)
+{
+  NS_LOG_FUNCTION (this << jobs.size () << nThreads);
+  SPFWorkQueue queue;
+  queue.jobs = &jobs;
+  queue.done.assign (jobs.size (), 0);
+  queue.next = 0;
+  queue.installed = 0;
+  queue.window = 4 * nThreads;
+  std::vector<std::thread> workers;
+  for (uint32_t i = 0; i < nThreads; i++)
+    {
+      workers.push_back (std::thread (&DSRRouteManagerImpl::SPFWorker, this, &queue));
+    }
+  for (uint32_t i = 0; i < jobs.size (); i++)
+    {
+      {
+        std::unique_lock<std::mutex> lock (queue.mutex);
+        while (!queue.done[i])
+          {
+            queue.jobDone.wait (lock);
           }
+      }
+      InstallRoutes (jobs[i].routes);
+      std::vector<PendingRoute> ().swap (jobs[i].routes);
+      {
+        std::lock_guard<std::mutex> lock (queue.mutex);
+        queue.installed = i + 1;
+      }
+      queue.jobInstalled.notify_all ();
     }
-  NS_LOG_INFO ("Finished DSR-SPF calculation");
+  for (uint32_t i = 0; i < workers.size (); i++)
+    {
+      workers[i].join ();
+    }
+}
+
+void
+DSRRouteManagerImpl::SPFWorker (SPFWorkQueue *queue)
+{
+  SPFContext context;
+  std::unique_lock<std::mutex> lock (queue->mutex);
+  for (;;)
+    {
+      while (queue->next < queue->jobs->size ()
+             && queue->next >= queue->installed + queue->window)
+        {
+          queue->jobInstalled.wait (lock);
+        }
+      if (queue->next >= queue->jobs->size ())
+        {
+          return;
+        }
+      uint32_t i = queue->next++;
+      lock.unlock ();
+      RunSPFJob ((*queue->jobs)[i], context);
+      lock.lock ();
+      queue->done[i] = 1;
+      queue->jobDone.notify_all ();
+    }
+}
+
+void
+DSRRouteManagerImpl::InstallRoutes (const std::vector<PendingRoute> &routes)
+{
+  for (uint32_t i = 0; i < routes.size (); i++)
+    {
+      const PendingRoute &r = routes[i];
+      switch (r.type)
+        {
+        case PendingRoute::HOST:
+          if (r.via == Ipv4Address::GetZero ())
+            {
+              r.routing->AddHostRouteTo (r.dest, r.nextHop, r.interface, r.distance);
+            }
+          else
+            {
+              r.routing->AddHostRouteTo (r.dest, r.nextHop, r.interface, r.distance, r.via);
+            }
+          break;
+        case PendingRoute::NETWORK:
+          r.routing->AddNetworkRouteTo (r.dest, r.mask, r.nextHop, r.interface);
+          break;
+        case PendingRoute::AS_EXTERNAL:
+          r.routing->AddASExternalRouteTo (r.dest, r.mask, r.nextHop, r.interface);
+          break;
+        }
+    }
+}
+
+void
+DSRRouteManagerImpl::RecordRoute (std::vector<PendingRoute> &routes, PendingRoute::Type type,
+                                  Ipv4DSRRouting *routing, Ipv4Address dest, Ipv4Mask mask,
+                                  Ipv4Address nextHop, uint32_t interface, uint32_t distance)
+{
+  PendingRoute r;
+  r.type = type;
+  r.routing = routing;
+  r.dest = dest;
+  r.mask = mask;
+  r.nextHop = nextHop;
+  r.interface = interface;
+  r.distance = distance;
+  r.via = Ipv4Address::GetZero ();
+  routes.push_back (r);
+}
+
+DSRRoutingLSA::SPFStatus
+DSRRouteManagerImpl::GetStatus (const SPFContext &context, const DSRRoutingLSA *lsa)
+{
+  std::unordered_map<const DSRRoutingLSA *, DSRRoutingLSA::SPFStatus>::const_iterator i =
+    context.status.find (lsa);
+  if (i == context.status.end ())
+    {
+      return DSRRoutingLSA::LSA_SPF_NOT_EXPLORED;
+    }
+  return i->second;
+}
+
+void
+DSRRouteManagerImpl::SetStatus (SPFContext &context, const DSRRoutingLSA *lsa, DSRRoutingLSA::SPFStatus status)
+{
+  context.status[lsa] = status;
 }
 
 //
@@ -907,7 +2967,7 @@ DSRRouteManagerImpl::InitializeRoutes ()
 // vertex already on the candidate list, store the new (lower) cost.
 //
 void
-DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
+DSRRouteManagerImpl::SPFNext (SPFContext &context, DSRVertex* v, DsrCandidateQueue& candidate)
 {
   NS_LOG_FUNCTION (this << v << &candidate);
 
@@ -999,7 +3059,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // If the link is to a router that is already in the shortest path first tree
 // then we have it covered -- ignore it.
 //
-      if (w_lsa->GetStatus () == DSRRoutingLSA::LSA_SPF_IN_SPFTREE) 
+      if (GetStatus (context, w_lsa) == DSRRoutingLSA::LSA_SPF_IN_SPFTREE) 
         {
           NS_LOG_LOGIC ("Skipping ->  LSA "<< 
                         w_lsa->GetLinkStateId () << " already in SPF tree");
@@ -1024,7 +3084,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
       NS_LOG_LOGIC ("Considering w_lsa " << w_lsa->GetLinkStateId ());
 
 // Is there already vertex w in candidate list?
-      if (w_lsa->GetStatus () == DSRRoutingLSA::LSA_SPF_NOT_EXPLORED)
+      if (GetStatus (context, w_lsa) == DSRRoutingLSA::LSA_SPF_NOT_EXPLORED)
         {
 // Calculate nexthop to w
 // We need to figure out how to actually get to the new router represented
@@ -1034,9 +3094,9 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 
 // prepare vertex w
           w = new DSRVertex (w_lsa);
-          if (SPFNexthopCalculation (v, w, l, distance))
+          if (SPFNexthopCalculation (context, v, w, l, distance))
             {
-              w_lsa->SetStatus (DSRRoutingLSA::LSA_SPF_CANDIDATE);
+              SetStatus (context, w_lsa, DSRRoutingLSA::LSA_SPF_CANDIDATE);
 //
 // Push this new vertex onto the priority queue (ordered by distance from the
 // root node).
@@ -1051,7 +3111,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
             NS_ASSERT_MSG (0, "SPFNexthopCalculation never " 
                            << "return false, but it does now!");
         }
-      else if (w_lsa->GetStatus () == DSRRoutingLSA::LSA_SPF_CANDIDATE)
+      else if (GetStatus (context, w_lsa) == DSRRoutingLSA::LSA_SPF_CANDIDATE)
         {
 //
 // We have already considered the link represented by <w>.  What wse have to
@@ -1098,7 +3158,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 
 // prepare vertex w
               w = new DSRVertex (w_lsa);
-              SPFNexthopCalculation (v, w, l, distance);
+              SPFNexthopCalculation (context, v, w, l, distance);
               cw->MergeRootExitDirections (w);
               cw->MergeParent (w);
 // DSRVertexAddParent (w) is necessary as the destructor of 
@@ -1117,13 +3177,13 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 // N.B. the nexthop_calculation is conditional, if it finds a valid nexthop
 // it will call spf_add_parents, which will flush the old parents
 //
-              if (SPFNexthopCalculation (v, cw, l, distance))
+              if (SPFNexthopCalculation (context, v, cw, l, distance))
                 {
 //
 // If we've changed the cost to get to the vertex represented by <w>, we 
-// must reorder the priority queue keyed to that cost.
+// must move it up the priority queue keyed to that cost.
 //
-                  candidate.Reorder ();
+                  candidate.DecreaseKey (cw);
                 }
             } // new lower cost path found
         } // end W is already on the candidate list
@@ -1142,6 +3202,7 @@ DSRRouteManagerImpl::SPFNext (DSRVertex* v, DsrCandidateQueue& candidate)
 //
 int
 DSRRouteManagerImpl::SPFNexthopCalculation (
+  SPFContext &context,
   DSRVertex* v, 
   DSRVertex* w,
   DSRRoutingLinkRecord* l,
@@ -1158,7 +3219,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 */
 
 //
-// The vertex m_spfroot is a distinguished vertex representing the node at
+// The vertex context.spfroot is a distinguished vertex representing the node at
 // the root of the calculations.  That is, it is the node for which we are
 // calculating the routes.
 //
@@ -1180,7 +3241,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 // The point-to-point link information is only useful in this calculation when
 // we are examining the root node. 
 //
-  if (v == m_spfroot)
+  if (v == context.spfroot)
     {
 //
 // In this case <v> is the root node, which means it is the starting point
@@ -1225,7 +3286,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
 // from the perspective of <v> -- remember that <l> is the link "from"
 // <v> "to" <w>.
 //
-          uint32_t outIf = FindOutgoingInterfaceId (l->GetLinkData ());
+          uint32_t outIf = FindOutgoingInterfaceId (context, l->GetLinkData ());
 
           w->SetRootExitDirection (nextHop, outIf);
           w->SetDistanceFromRoot (distance);
@@ -1243,7 +3304,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
           DSRRoutingLSA* w_lsa = w->GetLSA ();
           NS_ASSERT (w_lsa->GetLSType () == DSRRoutingLSA::NetworkLSA);
 // Find outgoing interface ID for this network
-          uint32_t outIf = FindOutgoingInterfaceId (w_lsa->GetLinkStateId (), 
+          uint32_t outIf = FindOutgoingInterfaceId (context, w_lsa->GetLinkStateId (), 
                                                     w_lsa->GetNetworkLSANetworkMask () );
 // Set the next hop to 0.0.0.0 meaning "not exist"
           Ipv4Address nextHop = Ipv4Address::GetZero ();
@@ -1260,7 +3321,7 @@ DSRRouteManagerImpl::SPFNexthopCalculation (
   else if (v->GetVertexType () == DSRVertex::VertexNetwork) 
     {
 // See if any of v's parents are the root
-      if (v->GetParent () == m_spfroot)
+      if (v->GetParent () == context.spfroot)
         {
 // 16.1.1 para 5. ...the parent vertex is a network that
 // directly connects the calculating router to the destination
@@ -1420,7 +3481,7 @@ DSRRouteManagerImpl::DebugSPFCalculate (Ipv4Address root)
 // to be run
 //
 bool
-DSRRouteManagerImpl::CheckForStubNode (Ipv4Address root)
+DSRRouteManagerImpl::CheckForStubNode (SPFContext &context, Ipv4Address root)
 {
   NS_LOG_FUNCTION (this << root);
   DSRRoutingLSA *rlsa = m_lsdb->GetLSA (root);
@@ -1483,15 +3544,14 @@ DSRRouteManagerImpl::CheckForStubNode (Ipv4Address root)
               if (lr->GetLinkId () == myRouterId)
                 {
                   // Next hop is stored in the LinkID field of lr
-                  Ptr<DSRRouter> router = rlsa->GetNode ()->GetObject<DSRRouter> ();
-                  NS_ASSERT (router);
-                  Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-                  NS_ASSERT (gr);
-                  gr->AddNetworkRouteTo (Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0"), lr->GetLinkData (), 
-                                         FindOutgoingInterfaceId (transitLink->GetLinkData ()));
+                  const RouterRecord *record = GetRouterRecord (myRouterId);
+                  NS_ASSERT (record);
+                  RecordRoute (*context.routes, PendingRoute::NETWORK, PeekPointer (record->routing),
+                               Ipv4Address ("0.0.0.0"), Ipv4Mask ("0.0.0.0"), lr->GetLinkData (),
+                               FindOutgoingInterfaceId (context, transitLink->GetLinkData ()), 0);
                   NS_LOG_LOGIC ("Inserting default route for node " << myRouterId << " to next hop " << 
                                 lr->GetLinkData () << " via interface " << 
-                                FindOutgoingInterfaceId (transitLink->GetLinkData ()));
+                                FindOutgoingInterfaceId (context, transitLink->GetLinkData ()));
                   return true;
                 }
             }
@@ -1502,15 +3562,17 @@ DSRRouteManagerImpl::CheckForStubNode (Ipv4Address root)
 
 // quagga ospf_spf_calculate
 void
-DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord* l, uint32_t Iface)
+DSRRouteManagerImpl::SPFCalculate (SPFContext &context, Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord* l, uint32_t Iface)
 {
   NS_LOG_FUNCTION (this << root);
   // std::cout << "The interface = " << Iface << std::endl;
   DSRVertex *v;
 //
-// Initialize the Link State Database.
+// Initialize the SPF status of the LSAs: none is explored yet.  The status
+// lives in the context rather than in the LSDB, which other calculations
+// may be reading at the same time.
 //
-  m_lsdb->Initialize ();
+  context.status.clear ();
 //
 // The candidate queue is a priority queue of DSRVertex objects, with the top
 // of the queue being the closest vertex in terms of distance from the root
@@ -1529,15 +3591,14 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
  * @brief add the initroot for dsr
  * \author Pu Yang
  */
-  DSRVertex *v_init;
-  v_init = new DSRVertex (m_lsdb->GetLSA (initroot));
+  DSRVertex v_init (m_lsdb->GetLSA (initroot));
 // 
 // This vertex is the root of the SPF tree and it is distance 0 from the root.
 // We also mark this vertex as being in the SPF tree.
 //
-  m_spfroot= v;
+  context.spfroot= v;
   v->SetDistanceFromRoot (l->GetMetric ());
-  v->GetLSA ()->SetStatus (DSRRoutingLSA::LSA_SPF_IN_SPFTREE);
+  SetStatus (context, v->GetLSA (), DSRRoutingLSA::LSA_SPF_IN_SPFTREE);
   NS_LOG_LOGIC ("Starting SPFCalculate for node " << root);
 
 //
@@ -1547,10 +3608,10 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 // reached.  Instead, short-circuit this computation and just install
 // a default route in the CheckForStubNode() method.
 //
-  if (NodeList::GetNNodes () > 0 && CheckForStubNode (root))
+  if (m_checkStubNodes && CheckForStubNode (context, root))
     {
       NS_LOG_LOGIC ("SPFCalculate truncated for stub node " << root);
-      delete m_spfroot;
+      delete context.spfroot;
       return;
     }
 
@@ -1570,7 +3631,7 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 // shortest path).  If the new vertices represent shorter paths, we use them
 // and update the path cost.
 //
-      SPFNext (v, candidate);
+      SPFNext (context, v, candidate);
 //
 // RFC2328 16.1. (3). 
 //
@@ -1598,7 +3659,7 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 // Update the status field of the vertex to indicate that it is in the SPF
 // tree.
 //
-      v->GetLSA ()->SetStatus (DSRRoutingLSA::LSA_SPF_IN_SPFTREE);
+      SetStatus (context, v->GetLSA (), DSRRoutingLSA::LSA_SPF_IN_SPFTREE);
 //
 // The current vertex has a parent pointer.  By calling this rather oddly 
 // named method (blame quagga) we add the current vertex to the list of 
@@ -1637,11 +3698,11 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 //
       if (v->GetVertexType () == DSRVertex::VertexRouter)
         {
-          SPFIntraAddRouter (v, v_init, l->GetLinkData (), Iface);
+          SPFIntraAddRouter (context, v, &v_init, l->GetLinkData (), Iface);
         }
       else if (v->GetVertexType () == DSRVertex::VertexNetwork)
         {
-          SPFIntraAddTransit (v);
+          SPFIntraAddTransit (context, v);
         }
       else
         {
@@ -1656,13 +3717,13 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
     }  // end for loop
 
 // Second stage of SPF calculation procedure
-  SPFProcessStubs (m_spfroot);
+  SPFProcessStubs (context, context.spfroot);
   for (uint32_t i = 0; i < m_lsdb->GetNumExtLSAs (); i++)
     {
-      m_spfroot->ClearVertexProcessed ();
+      context.spfroot->ClearVertexProcessed ();
       DSRRoutingLSA *extlsa = m_lsdb->GetExtLSA (i);
       NS_LOG_LOGIC ("Processing External LSA with id " << extlsa->GetLinkStateId ());
-      ProcessASExternals (m_spfroot, extlsa);
+      ProcessASExternals (context, context.spfroot, extlsa);
     }
 
 //
@@ -1670,12 +3731,12 @@ DSRRouteManagerImpl::SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRo
 // the SPF tree.  Delete all of the vertices and corresponding resources.  Go
 // possibly do it again for the next router.
 //
-  delete m_spfroot;
-  m_spfroot = 0;
+  delete context.spfroot;
+  context.spfroot = 0;
 }
 
 void
-DSRRouteManagerImpl::ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa)
+DSRRouteManagerImpl::ProcessASExternals (SPFContext &context, DSRVertex* v, DSRRoutingLSA* extlsa)
 {
   NS_LOG_FUNCTION (this << v << extlsa);
   NS_LOG_LOGIC ("Processing external for destination " << 
@@ -1689,7 +3750,7 @@ DSRRouteManagerImpl::ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa)
       if ((rlsa->GetLinkStateId ()) == (extlsa->GetAdvertisingRouter ()))
         {
           NS_LOG_LOGIC ("Found advertising router to destination");
-          SPFAddASExternal (extlsa,v);
+          SPFAddASExternal (context, extlsa,v);
         }
     }
   for (uint32_t i = 0; i < v->GetNChildren (); i++)
@@ -1697,7 +3758,7 @@ DSRRouteManagerImpl::ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa)
       if (!v->GetChild (i)->IsVertexProcessed ())
         {
           NS_LOG_LOGIC ("Vertex's child " << i << " not yet processed, processing...");
-          ProcessASExternals (v->GetChild (i), extlsa);
+          ProcessASExternals (context, v->GetChild (i), extlsa);
           v->GetChild (i)->SetVertexProcessed (true);
         }
     }
@@ -1709,15 +3770,15 @@ DSRRouteManagerImpl::ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa)
 //
 
 void
-DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
+DSRRouteManagerImpl::SPFAddASExternal (SPFContext &context, DSRRoutingLSA *extlsa, DSRVertex *v)
 {
   NS_LOG_FUNCTION (this << extlsa << v);
 
-  NS_ASSERT_MSG (m_spfroot, "DSRRouteManagerImpl::SPFAddASExternal (): Root pointer not set");
+  NS_ASSERT_MSG (context.spfroot, "DSRRouteManagerImpl::SPFAddASExternal (): Root pointer not set");
 // Two cases to consider: We are advertising the external ourselves
 // => No need to add anything
 // OR find best path to the advertising router
-  if (v->GetVertexId () == m_spfroot->GetVertexId ())
+  if (v->GetVertexId () == context.spfroot->GetVertexId ())
     {
       NS_LOG_LOGIC ("External is on local host: " 
                     << v->GetVertexId () << "; returning");
@@ -1726,62 +3787,33 @@ DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
   NS_LOG_LOGIC ("External is on remote host: " 
                 << extlsa->GetAdvertisingRouter () << "; installing");
 
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = context.spfroot->GetVertexId ();
 
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the root vertex.
+// This is the one we're going to write the routing information to.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterRecord *record = GetRouterRecord (routerId);
+  if (record == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the DSRRouter interface, so we need
-// to QI for that interface.  If there's no DSRRouter interface, the node
-// in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
-        {
-          NS_LOG_LOGIC ("No DSRRouter interface on node " << node->GetId ());
-          continue;
-        }
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId)
-        {
-          NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to QI
-// for that interface.  If the node is acting as an IP version 4 router, it
-// should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "QI for <Ipv4> interface failed");
+      NS_LOG_LOGIC ("Can't find root node " << routerId);
+      return;
+    }
+  Node *node = PeekPointer (record->node);
+  NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
 //
 // Get the Global Router Link State Advertisement from the vertex we're
 // adding the routes to.  The LSA will have a number of attached Global Router
 // Link Records corresponding to links off of that vertex / node.  We're going
 // to be interested in the records corresponding to point-to-point links.
 //
-          NS_ASSERT_MSG (v->GetLSA (), 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "Expected valid LSA in DSRVertex* v");
-          Ipv4Mask tempmask = extlsa->GetNetworkLSANetworkMask ();
-          Ipv4Address tempip = extlsa->GetLinkStateId ();
-          tempip = tempip.CombineMask (tempmask);
+  NS_ASSERT_MSG (v->GetLSA (), 
+                 "DSRRouteManagerImpl::SPFIntraAddRouter (): "
+                 "Expected valid LSA in DSRVertex* v");
+  Ipv4Mask tempmask = extlsa->GetNetworkLSANetworkMask ();
+  Ipv4Address tempip = extlsa->GetLinkStateId ();
+  tempip = tempip.CombineMask (tempmask);
 
 //
 // Here's why we did all of that work.  We're going to add a host route to the
@@ -1796,46 +3828,37 @@ DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
 // Similarly, the vertex <v> has an m_rootOif (outbound interface index) to
 // which the packets should be send for forwarding.
 //
-          Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-          if (router == 0)
-            {
-              continue;
-            }
-          Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-          NS_ASSERT (gr);
-          // walk through all next-hop-IPs and out-going-interfaces for reaching
-          // the stub network gateway 'v' from the root node
-          for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
-            {
-              DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
-              Ipv4Address nextHop = exit.first;
-              int32_t outIf = exit.second;
-              /**
-               * \author Pu Yang
-               * \brief get the distance
-              */
-              // uint32_t distance = v->GetDistanceFromRoot ();
-              // std::cout << "the SPF distance = " << distance;
-
-              if (outIf >= 0)
-                {
-                  gr->AddASExternalRouteTo (tempip, tempmask, nextHop, outIf);
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " add external network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " via interface " << outIf);
-                }
-              else
-                {
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " NOT able to add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " since outgoing interface id is negative");
-                }
-            }
-          return;
-        } // if
-    } // for
+  // walk through all next-hop-IPs and out-going-interfaces for reaching
+  // the stub network gateway 'v' from the root node
+  for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
+    {
+      DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
+      Ipv4Address nextHop = exit.first;
+      int32_t outIf = exit.second;
+      /**
+       * \author Pu Yang
+       * \brief get the distance
+      */
+      // uint32_t distance = v->GetDistanceFromRoot ();
+      // std::cout << "the SPF distance = " << distance;
+
+      if (outIf >= 0)
+        {
+          RecordRoute (*context.routes, PendingRoute::AS_EXTERNAL, PeekPointer (record->routing),
+                       tempip, tempmask, nextHop, outIf, 0);
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " add external network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " via interface " << outIf);
+        }
+      else
+        {
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " NOT able to add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " since outgoing interface id is negative");
+        }
+    }
 }
 
 
@@ -1843,7 +3866,7 @@ DSRRouteManagerImpl::SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v)
 // stub link records will exist for point-to-point interfaces and for
 // broadcast interfaces for which no neighboring router can be found
 void
-DSRRouteManagerImpl::SPFProcessStubs (DSRVertex* v)
+DSRRouteManagerImpl::SPFProcessStubs (SPFContext &context, DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << v);
   NS_LOG_LOGIC ("Processing stubs for " << v->GetVertexId ());
@@ -1860,7 +3883,7 @@ DSRRouteManagerImpl::SPFProcessStubs (DSRVertex* v)
           if (l->GetLinkType () == DSRRoutingLinkRecord::StubNetwork)
             {
               NS_LOG_LOGIC ("Found a Stub record to " << l->GetLinkId ());
-              SPFIntraAddStub (l, v);
+              SPFIntraAddStub (context, l, v);
               continue;
             }
         }
@@ -1869,7 +3892,7 @@ DSRRouteManagerImpl::SPFProcessStubs (DSRVertex* v)
     {
       if (!v->GetChild (i)->IsVertexProcessed ())
         {
-          SPFProcessStubs (v->GetChild (i));
+          SPFProcessStubs (context, v->GetChild (i));
           v->GetChild (i)->SetVertexProcessed (true);
         }
     }
@@ -1877,11 +3900,11 @@ DSRRouteManagerImpl::SPFProcessStubs (DSRVertex* v)
 
 // RFC2328 16.1. second stage. 
 void
-DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
+DSRRouteManagerImpl::SPFIntraAddStub (SPFContext &context, DSRRoutingLinkRecord *l, DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << l << v);
 
-  NS_ASSERT_MSG (m_spfroot, 
+  NS_ASSERT_MSG (context.spfroot, 
                  "DSRRouteManagerImpl::SPFIntraAddStub (): Root pointer not set");
 
   // XXX simplifed logic for the moment.  There are two cases to consider:
@@ -1889,7 +3912,7 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
   //    (already handled above)
   // 2) the stub network is on a remote router, so I should use the
   // same next hop that I use to get to vertex v
-  if (v->GetVertexId () == m_spfroot->GetVertexId ())
+  if (v->GetVertexId () == context.spfroot->GetVertexId ())
     {
       NS_LOG_LOGIC ("Stub is on local host: " << v->GetVertexId () << "; returning");
       return;
@@ -1902,64 +3925,33 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
 // going to use this ID to discover which node it is that we're actually going
 // to update.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = context.spfroot->GetVertexId ();
 
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the root vertex.
+// This is the one we're going to write the routing information to.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterRecord *record = GetRouterRecord (routerId);
+  if (record == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the DSRRouter interface, so we need
-// to QI for that interface.  If there's no DSRRouter interface, the node
-// in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
-        {
-          NS_LOG_LOGIC ("No DSRRouter interface on node " << 
-                        node->GetId ());
-          continue;
-        }
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId)
-        {
-          NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to QI
-// for that interface.  If the node is acting as an IP version 4 router, it
-// should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "QI for <Ipv4> interface failed");
+      NS_LOG_LOGIC ("Can't find root node " << routerId);
+      return;
+    }
+  Node *node = PeekPointer (record->node);
+  NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
 //
 // Get the Global Router Link State Advertisement from the vertex we're
 // adding the routes to.  The LSA will have a number of attached Global Router
 // Link Records corresponding to links off of that vertex / node.  We're going
 // to be interested in the records corresponding to point-to-point links.
 //
-          NS_ASSERT_MSG (v->GetLSA (), 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "Expected valid LSA in DSRVertex* v");
-          Ipv4Mask tempmask (l->GetLinkData ().Get ());
-          Ipv4Address tempip = l->GetLinkId ();
-          tempip = tempip.CombineMask (tempmask);
+  NS_ASSERT_MSG (v->GetLSA (), 
+                 "DSRRouteManagerImpl::SPFIntraAddRouter (): "
+                 "Expected valid LSA in DSRVertex* v");
+  Ipv4Mask tempmask (l->GetLinkData ().Get ());
+  Ipv4Address tempip = l->GetLinkId ();
+  tempip = tempip.CombineMask (tempmask);
 //
 // Here's why we did all of that work.  We're going to add a host route to the
 // host address found in the m_linkData field of the point-to-point link
@@ -1973,40 +3965,30 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
 // Similarly, the vertex <v> has an m_rootOif (outbound interface index) to
 // which the packets should be send for forwarding.
 //
-
-          Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-          if (router == 0)
-            {
-              continue;
-            }
-          Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-          NS_ASSERT (gr);
-          // walk through all next-hop-IPs and out-going-interfaces for reaching
-          // the stub network gateway 'v' from the root node
-          for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
-            {
-              DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
-              Ipv4Address nextHop = exit.first;
-              int32_t outIf = exit.second;
-              if (outIf >= 0)
-                {
-                  gr->AddNetworkRouteTo (tempip, tempmask, nextHop, outIf);
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " via interface " << outIf);
-                }
-              else
-                {
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " NOT able to add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " since outgoing interface id is negative");
-                }
-            }
-          return;
-        } // if
-    } // for
+  // walk through all next-hop-IPs and out-going-interfaces for reaching
+  // the stub network gateway 'v' from the root node
+  for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
+    {
+      DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
+      Ipv4Address nextHop = exit.first;
+      int32_t outIf = exit.second;
+      if (outIf >= 0)
+        {
+          RecordRoute (*context.routes, PendingRoute::NETWORK, PeekPointer (record->routing),
+                       tempip, tempmask, nextHop, outIf, 0);
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " via interface " << outIf);
+        }
+      else
+        {
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " NOT able to add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " since outgoing interface id is negative");
+        }
+    }
 }
 
 //
@@ -2017,7 +3999,7 @@ DSRRouteManagerImpl::SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v)
 // for routing assumes -1 to be a legal return value)
 //
 int32_t
-DSRRouteManagerImpl::FindOutgoingInterfaceId (Ipv4Address a, Ipv4Mask amask)
+DSRRouteManagerImpl::FindOutgoingInterfaceId (const SPFContext &context, Ipv4Address a, Ipv4Mask amask)
 {
   NS_LOG_FUNCTION (this << a << amask);
 //
@@ -2028,63 +4010,36 @@ DSRRouteManagerImpl::FindOutgoingInterfaceId (Ipv4Address a, Ipv4Mask amask)
 // node in order to iterate the interfaces and find the one corresponding to
 // the address in question.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = context.spfroot->GetVertexId ();
 //
-// Walk the list of nodes in the system looking for the one corresponding to
-// the node at the root of the SPF tree.  This is the node for which we are
-// building the routing table.
+// Look up the node corresponding to the root of the SPF tree.  This is the
+// node for which we are building the routing table.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterRecord *record = GetRouterRecord (routerId);
+  if (record == 0)
     {
-      Ptr<Node> node = *i;
-
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-//
-// If the node doesn't have a DSRRouter interface it can't be the one
-// we're interested in.
-//
-      if (rtr == 0)
-        {
-          continue;
-        }
-
-      if (rtr->GetRouterId () == routerId)
-        {
 //
-// This is the node we're building the routing table for.  We're going to need
-// the Ipv4 interface to look for the ipv4 interface index.  Since this node
-// is participating in routing IP version 4 packets, it certainly must have 
-// an Ipv4 interface.
+// Couldn't find it.
 //
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::FindOutgoingInterfaceId (): "
-                         "GetObject for <Ipv4> interface failed");
+      NS_LOG_LOGIC ("FindOutgoingInterfaceId():Can't find root node " << routerId);
+      return -1;
+    }
 //
 // Look through the interfaces on this node for one that has the IP address
 // we're looking for.  If we find one, return the corresponding interface
-// index, or -1 if not found.
+// index, or -1 if not found.  The addresses were copied in the node index,
+// so that the Ipv4 object of the node is not used from the SPF threads.
 //
-          int32_t interface = ipv4->GetInterfaceForPrefix (a, amask);
+  int32_t interface = GetInterfaceForPrefix (record, a, amask);
 
 #if 0
-          if (interface < 0)
-            {
-              NS_FATAL_ERROR ("DSRRouteManagerImpl::FindOutgoingInterfaceId(): "
-                              "Expected an interface associated with address a:" << a);
-            }
-#endif 
-          return interface;
-        }
+  if (interface < 0)
+    {
+      NS_FATAL_ERROR ("DSRRouteManagerImpl::FindOutgoingInterfaceId(): "
+                      "Expected an interface associated with address a:" << a);
     }
-//
-// Couldn't find it.
-//
-  NS_LOG_LOGIC ("FindOutgoingInterfaceId():Can't find root node " << routerId);
-  return -1;
+#endif 
+  return interface;
 }
 
 //
@@ -2104,11 +4059,11 @@ DSRRouteManagerImpl::FindOutgoingInterfaceId (Ipv4Address a, Ipv4Mask amask)
 // route.
 //
 void
-DSRRouteManagerImpl::SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Address nextHop, uint32_t Iface)
+DSRRouteManagerImpl::SPFIntraAddRouter (SPFContext &context, DSRVertex* v, DSRVertex* v_init, Ipv4Address nextHop, uint32_t Iface)
 {
   NS_LOG_FUNCTION (this << v);
 
-  NS_ASSERT_MSG (m_spfroot, 
+  NS_ASSERT_MSG (context.spfroot, 
                  "DSRRouteManagerImpl::SPFIntraAddRouter (): Root pointer not set");
 //
 // The root of the Shortest Path First tree is the router to which we are 
@@ -2117,7 +4072,7 @@ DSRRouteManagerImpl::SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Add
 // going to use this ID to discover which node it is that we're actually going
 // to update.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = context.spfroot->GetVertexId ();
 
 /**
  * @brief the router Ipv4 Address to write the routing table
@@ -2127,63 +4082,29 @@ DSRRouteManagerImpl::SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Add
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the initial root
+// vertex.  This is the one we're going to write the routing information to.
 //
-
-  NodeList::Iterator listEnd = NodeList::End ();
-  NodeList::Iterator i = NodeList::Begin (); 
-  
-  for (; i != listEnd; i++)
+  const RouterRecord *record = GetRouterRecord (routerId_init);
+  if (record == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the GlobalRouter interface, so we need
-// to GetObject for that interface.  If there's no GlobalRouter interface, 
-// the node in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
-        {
-          NS_LOG_LOGIC ("No GlobalRouter interface on node " << 
-                        node->GetId ());
-          continue;
-        }
-        // std::cout << "The neighbour node " << node->GetId () << std::endl;
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId_init)
-        {
-          NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to 
-// GetObject for that interface.  If the node is acting as an IP version 4 
-// router, it should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "GetObject for <Ipv4> interface failed");
+      NS_LOG_LOGIC ("Can't find root node " << routerId_init);
+      return;
+    }
+  Node *node = PeekPointer (record->node);
+  NS_LOG_LOGIC ("Setting routes for node " << node->GetId ());
 //
 // Get the Global Router Link State Advertisement from the vertex we're
 // adding the routes to.  The LSA will have a number of attached Global Router
 // Link Records corresponding to links off of that vertex / node.  We're going
 // to be interested in the records corresponding to point-to-point links.
 //
-          DSRRoutingLSA *lsa = v->GetLSA ();
-          NS_ASSERT_MSG (lsa, 
-                         "DSRRouteManagerImpl::SPFIntraAddRouter (): "
-                         "Expected valid LSA in DSRVertex* v");
+  DSRRoutingLSA *lsa = v->GetLSA ();
+  NS_ASSERT_MSG (lsa, 
+                 "DSRRouteManagerImpl::SPFIntraAddRouter (): "
+                 "Expected valid LSA in DSRVertex* v");
 
-          uint32_t nLinkRecords = lsa->GetNLinkRecords ();
+  uint32_t nLinkRecords = lsa->GetNLinkRecords ();
 //
 // Iterate through the link records on the vertex to which we're going to add
 // routes.  To make sure we're being clear, we're going to add routing table
@@ -2192,41 +4113,31 @@ DSRRouteManagerImpl::SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Add
 // the local side of the point-to-point links found on the node described by
 // the vertex <v>.
 //
-          NS_LOG_LOGIC (" Node " << node->GetId () <<
-                        " found " << nLinkRecords << " link records in LSA " << lsa << "with LinkStateId "<< lsa->GetLinkStateId ());
-          for (uint32_t j = 0; j < nLinkRecords; ++j)
-            {
+  NS_LOG_LOGIC (" Node " << node->GetId () <<
+                " found " << nLinkRecords << " link records in LSA " << lsa << "with LinkStateId "<< lsa->GetLinkStateId ());
+  Ipv4DSRRouting *gr = PeekPointer (record->routing);
+  uint32_t distance = v->GetDistanceFromRoot ();
+  for (uint32_t j = 0; j < nLinkRecords; ++j)
+    {
 //
 // We are only concerned about point-to-point links
 //
-              DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
-              if (lr->GetLinkType () != DSRRoutingLinkRecord::PointToPoint)
-                {
-                  continue;
-                }
-              Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-              if (router == 0)
-                {
-                  continue;
-                }
-              Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-              NS_ASSERT (gr);
-              uint32_t distance = v->GetDistanceFromRoot ();
-              gr->AddHostRouteTo (lr->GetLinkData (), nextHop, Iface, distance);
-            }
-//
-// Done adding the routes for the selected node.
-//
-          return;
+      DSRRoutingLinkRecord *lr = lsa->GetLinkRecord (j);
+      if (lr->GetLinkType () != DSRRoutingLinkRecord::PointToPoint)
+        {
+          continue;
         }
+      RecordRoute (*context.routes, PendingRoute::HOST, gr, lr->GetLinkData (), Ipv4Mask::GetOnes (),
+                   nextHop, Iface, distance);
     }
 }
+
 void
-DSRRouteManagerImpl::SPFIntraAddTransit (DSRVertex* v)
+DSRRouteManagerImpl::SPFIntraAddTransit (SPFContext &context, DSRVertex* v)
 {
   NS_LOG_FUNCTION (this << v);
 
-  NS_ASSERT_MSG (m_spfroot, 
+  NS_ASSERT_MSG (context.spfroot, 
                  "DSRRouteManagerImpl::SPFIntraAddTransit (): Root pointer not set");
 //
 // The root of the Shortest Path First tree is the router to which we are 
@@ -2235,99 +4146,60 @@ DSRRouteManagerImpl::SPFIntraAddTransit (DSRVertex* v)
 // going to use this ID to discover which node it is that we're actually going
 // to update.
 //
-  Ipv4Address routerId = m_spfroot->GetVertexId ();
+  Ipv4Address routerId = context.spfroot->GetVertexId ();
 
   NS_LOG_LOGIC ("Vertex ID = " << routerId);
 //
-// We need to walk the list of nodes looking for the one that has the router
-// ID corresponding to the root vertex.  This is the one we're going to write
-// the routing information to.
+// Look up the node that has the router ID corresponding to the root vertex.
+// This is the one we're going to write the routing information to.
 //
-  NodeList::Iterator i = NodeList::Begin (); 
-  NodeList::Iterator listEnd = NodeList::End ();
-  for (; i != listEnd; i++)
+  const RouterRecord *record = GetRouterRecord (routerId);
+  if (record == 0)
     {
-      Ptr<Node> node = *i;
-//
-// The router ID is accessible through the DSRRouter interface, so we need
-// to GetObject for that interface.  If there's no DSRRouter interface, 
-// the node in question cannot be the router we want, so we continue.
-// 
-      Ptr<DSRRouter> rtr = 
-        node->GetObject<DSRRouter> ();
-
-      if (rtr == 0)
-        {
-          NS_LOG_LOGIC ("No DSRRouter interface on node " << 
-                        node->GetId ());
-          continue;
-        }
-//
-// If the router ID of the current node is equal to the router ID of the 
-// root of the SPF tree, then this node is the one for which we need to 
-// write the routing tables.
-//
-      NS_LOG_LOGIC ("Considering router " << rtr->GetRouterId ());
-
-      if (rtr->GetRouterId () == routerId)
-        {
-          NS_LOG_LOGIC ("setting routes for node " << node->GetId ());
-//
-// Routing information is updated using the Ipv4 interface.  We need to 
-// GetObject for that interface.  If the node is acting as an IP version 4 
-// router, it should absolutely have an Ipv4 interface.
-//
-          Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-          NS_ASSERT_MSG (ipv4, 
-                         "DSRRouteManagerImpl::SPFIntraAddTransit (): "
-                         "GetObject for <Ipv4> interface failed");
+      NS_LOG_LOGIC ("Can't find root node " << routerId);
+      return;
+    }
+  Node *node = PeekPointer (record->node);
+  NS_LOG_LOGIC ("setting routes for node " << node->GetId ());
 //
 // Get the Global Router Link State Advertisement from the vertex we're
 // adding the routes to.  The LSA will have a number of attached Global Router
 // Link Records corresponding to links off of that vertex / node.  We're going
 // to be interested in the records corresponding to point-to-point links.
 //
-          DSRRoutingLSA *lsa = v->GetLSA ();
-          NS_ASSERT_MSG (lsa, 
-                         "DSRRouteManagerImpl::SPFIntraAddTransit (): "
-                         "Expected valid LSA in DSRVertex* v");
-          Ipv4Mask tempmask = lsa->GetNetworkLSANetworkMask ();
-          Ipv4Address tempip = lsa->GetLinkStateId ();
-          tempip = tempip.CombineMask (tempmask);
-          Ptr<DSRRouter> router = node->GetObject<DSRRouter> ();
-          if (router == 0)
-            {
-              continue;
-            }
-          Ptr<Ipv4DSRRouting> gr = router->GetRoutingProtocol ();
-          NS_ASSERT (gr);
-          // walk through all available exit directions due to ECMP,
-          // and add host route for each of the exit direction toward
-          // the vertex 'v'
-          for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
-            {
-              DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
-              Ipv4Address nextHop = exit.first;
-              int32_t outIf = exit.second;
+  DSRRoutingLSA *lsa = v->GetLSA ();
+  NS_ASSERT_MSG (lsa, 
+                 "DSRRouteManagerImpl::SPFIntraAddTransit (): "
+                 "Expected valid LSA in DSRVertex* v");
+  Ipv4Mask tempmask = lsa->GetNetworkLSANetworkMask ();
+  Ipv4Address tempip = lsa->GetLinkStateId ();
+  tempip = tempip.CombineMask (tempmask);
+  // walk through all available exit directions due to ECMP,
+  // and add host route for each of the exit direction toward
+  // the vertex 'v'
+  for (uint32_t i = 0; i < v->GetNRootExitDirections (); i++)
+    {
+      DSRVertex::NodeExit_t exit = v->GetRootExitDirection (i);
+      Ipv4Address nextHop = exit.first;
+      int32_t outIf = exit.second;
 
-              if (outIf >= 0)
-                {
-                  gr->AddNetworkRouteTo (tempip, tempmask, nextHop, outIf);
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " via interface " << outIf);
-                }
-              else
-                {
-                  NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
-                                " NOT able to add network route to " << tempip <<
-                                " using next hop " << nextHop <<
-                                " since outgoing interface id is negative " << outIf);
-                }
-            }
+      if (outIf >= 0)
+        {
+          RecordRoute (*context.routes, PendingRoute::NETWORK, PeekPointer (record->routing),
+                       tempip, tempmask, nextHop, outIf, 0);
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " via interface " << outIf);
         }
-    } 
+      else
+        {
+          NS_LOG_LOGIC ("(Route " << i << ") Node " << node->GetId () <<
+                        " NOT able to add network route to " << tempip <<
+                        " using next hop " << nextHop <<
+                        " since outgoing interface id is negative " << outIf);
+        }
+    }
 }
 
 // Derived from quagga ospf_vertex_add_parents ()
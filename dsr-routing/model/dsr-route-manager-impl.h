@@ -26,11 +26,14 @@
 #include <list>
 #include <queue>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include "ns3/object.h"
 #include "ns3/ptr.h"
 #include "ns3/ipv4-address.h"
 #include "dsr-router-interface.h"
+#include "dsr-prefix-table.h"
+#include "dsr-indexed-heap.h"
 
 namespace ns3 {
 
@@ -616,8 +619,8 @@ public:
  * @brief Look up the Link State Advertisement associated with the given
  * link state ID (address).
  *
- * The database map is searched for the given IPV4 address and corresponding
- * DSRRoutingLSA is returned.
+ * The database is hashed by IPV4 address, the corresponding DSRRoutingLSA
+ * is returned in constant time.
  *
  * @see DSRRoutingLSA
  * @see Ipv4Address
@@ -633,6 +636,10 @@ public:
  * to allow the LSA to be found by matching addr with the LinkData field
  * of the TransitNetwork link record.
  *
+ * The link data are indexed when the LSA is inserted; if several LSAs
+ * advertise the same link data, the one with the lowest link state ID is
+ * returned.
+ *
  * @see GetLSA
  * @param addr The IP address associated with the LSA.  Typically the Router 
  * @returns A pointer to the Link State Advertisement for the router specified
@@ -645,9 +652,9 @@ public:
  * @brief Set all LSA flags to an initialized state, for SPF computation
  *
  * This function walks the database and resets the status flags of all of the
- * contained Link State Advertisements to LSA_SPF_NOT_EXPLORED.  This is done
- * prior to each SPF calculation to reset the state of the DSRVertex structures
- * that will reference the LSAs during the calculation.
+ * contained Link State Advertisements to LSA_SPF_NOT_EXPLORED.  The SPF
+ * calculations of DSRRouteManagerImpl keep the status of the LSAs in their
+ * own context instead, so that they can share the database.
  *
  * @see DSRRoutingLSA
  * @see DSRVertex
@@ -676,10 +683,11 @@ public:
 
 
 private:
-  typedef std::map<Ipv4Address, DSRRoutingLSA*> LSDBMap_t; //!< container of IPv4 addresses / Link State Advertisements
+  typedef std::unordered_map<Ipv4Address, DSRRoutingLSA*, Ipv4AddressHash> LSDBMap_t; //!< container of IPv4 addresses / Link State Advertisements
   typedef std::pair<Ipv4Address, DSRRoutingLSA*> LSDBPair_t; //!< pair of IPv4 addresses / Link State Advertisements
 
   LSDBMap_t m_database; //!< database of IPv4 addresses / Link State Advertisements
+  LSDBMap_t m_linkDataIndex; //!< LSAs by the link data of their TransitNetwork link records
   std::vector<DSRRoutingLSA*> m_extdatabase; //!< database of External Link State Advertisements
 
 /**
@@ -815,6 +823,13 @@ public:
  */
   virtual void DeleteDSRRoutes ();
 
+/**
+ * @brief Rebuild the routing database and recompute the routes of every
+ * node, replacing each forwarding table in one step once the new one is
+ * complete
+ */
+  virtual void RecomputeDSRRoutes ();
+
 /**
  * @brief Build the routing database by gathering Link State Advertisements
  * from each node exporting a DSRRouter interface.
@@ -827,6 +842,29 @@ public:
  */
   virtual void InitializeRoutes ();
 
+/**
+ * @brief Change the metric of a point-to-point link and update the routes
+ * that depend on it, leaving the others in place.
+ *
+ * Without a frozen LSDB (transit networks, or no routes computed yet), all
+ * the routes are recomputed instead.
+ *
+ * @param node the node advertising the link
+ * @param interface the interface of the node on the link
+ * @param metric the new metric of the link, from the node
+ */
+  virtual void UpdateLinkMetric (Ptr<Node> node, uint32_t interface, uint16_t metric);
+
+/**
+ * @brief Compute the routes of a router to a destination, when InitializeRoutes
+ * left them to be computed on demand.
+ *
+ * @param node the node of the router
+ * @param dest the destination address
+ * @returns true if routes were added to the table of the router
+ */
+  virtual bool ResolveRoutes (Ptr<Node> node, Ipv4Address dest);
+
 /**
  * @brief Debugging routine; allow client code to supply a pre-built LSDB
  */
@@ -858,8 +896,552 @@ private:
  */
   DSRRouteManagerImpl& operator= (DSRRouteManagerImpl& srmi);
 
-  DSRVertex* m_spfroot; //!< the root node
   DSRRouteManagerLSDB* m_lsdb; //!< the Link State DataBase (LSDB) of the Global Route Manager
+  bool m_checkStubNodes; //!< whether SPFCalculate may short-circuit stub nodes
+
+  /// A router: its node and DSR routing protocol
+  struct RouterRecord
+  {
+    Ptr<Node> node;                 //!< the node
+    Ptr<Ipv4DSRRouting> routing;    //!< its DSR routing protocol
+    /// local addresses of the node and their interface, in interface order
+    std::vector<std::pair<Ipv4Address, uint32_t> > addresses;
+  };
+  /// An interface address: the node owning it and the interface index
+  struct InterfaceRecord
+  {
+    Ptr<Node> node;                 //!< the node
+    uint32_t interface;             //!< the interface index
+  };
+  typedef std::unordered_map<Ipv4Address, RouterRecord, Ipv4AddressHash> RouterIndex_t; //!< routers by router ID
+  typedef std::unordered_map<Ipv4Address, InterfaceRecord, Ipv4AddressHash> InterfaceIndex_t; //!< interfaces by address
+
+  RouterIndex_t m_routerIndex;        //!< routers by router ID
+  InterfaceIndex_t m_interfaceIndex;  //!< interfaces by address
+  bool m_nodeIndexValid;              //!< false until the indexes are built, and after DeleteDSRRoutes
+
+  /**
+   * \brief Index the routers by router ID and the interfaces by address.
+   */
+  void BuildNodeIndex ();
+  /**
+   * \brief Find a router, building the indexes first if needed.
+   * \param routerId the router ID
+   * \returns the router record, or 0 if there is no such router
+   */
+  const RouterRecord *GetRouterRecord (Ipv4Address routerId);
+  /**
+   * \brief Find the node owning an address, building the indexes first if
+   * needed.
+   * \param address the interface address
+   * \returns the interface record, or 0 if no node has this address
+   */
+  const InterfaceRecord *GetInterfaceRecord (Ipv4Address address);
+
+  /// A route found by an SPF calculation, not yet added to its router
+  struct PendingRoute
+  {
+    /// Kind of route, i.e. which Add*RouteTo method installs it
+    enum Type
+    {
+      HOST,             //!< AddHostRouteTo, with a distance
+      NETWORK,          //!< AddNetworkRouteTo
+      AS_EXTERNAL       //!< AddASExternalRouteTo
+    };
+    Type type;                  //!< kind of route
+    Ipv4DSRRouting *routing;    //!< the router to add it to
+    Ipv4Address dest;           //!< destination host or network
+    Ipv4Mask mask;              //!< destination network mask
+    Ipv4Address nextHop;        //!< next hop
+    uint32_t interface;         //!< outgoing interface
+    uint32_t distance;          //!< distance of a host route
+    Ipv4Address via;            //!< next hop of the next hop of a two-hop host route, or 0.0.0.0
+  };
+
+  /// A point-to-point link of the SPF graph
+  struct GraphLink
+  {
+    uint32_t router;                    //!< the router at the other end
+    uint32_t metric;                    //!< metric of the link
+    uint32_t remoteMetric;              //!< metric of the first link back from the other end
+    Ipv4Address nextHop;                //!< address of the other end on the first link back
+    int32_t interface;                  //!< local interface of the link, or -1
+  };
+  /// A network prefix of the SPF graph: a stub network or an external route
+  struct GraphPrefix
+  {
+    Ipv4Address prefix;                 //!< the network address
+    Ipv4Mask mask;                      //!< the network mask
+  };
+  /// A router of the SPF graph
+  struct GraphRouter
+  {
+    Ipv4Address routerId;               //!< its router ID
+    Ipv4DSRRouting *routing;            //!< its DSR routing protocol
+    bool local;                         //!< whether it belongs to this system (distributed sim)
+    bool rooted;                        //!< whether a local router has a link to it
+    bool stub;                          //!< whether it has a single point-to-point link, or none
+  };
+  /**
+   * \brief The router LSAs frozen into flat arrays.
+   *
+   * The routers have dense indexes, in NodeList order.  The links of router
+   * i are links[linkBegin[i]] to links[linkBegin[i + 1] - 1], in LSA order,
+   * and likewise for the links to it, its addresses, its stub networks and
+   * the external routes it advertises (compressed sparse rows).
+   */
+  struct SPFGraph
+  {
+    bool valid;                                 //!< false if not built, or if the LSDB has transit networks
+    std::vector<GraphRouter> routers;           //!< the routers
+    /// the index of each router, by router ID
+    std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> index;
+    std::vector<uint32_t> linkBegin;            //!< first link of each router
+    std::vector<GraphLink> links;               //!< the point-to-point links
+    std::vector<uint32_t> inBegin;              //!< first link to each router
+    /// the links to each router: the router at the other end and the metric
+    std::vector<std::pair<uint32_t, uint32_t> > in;
+    std::vector<uint32_t> linkAddressBegin;     //!< first link address of each router
+    std::vector<Ipv4Address> linkAddresses;     //!< local addresses of the point-to-point links
+    std::vector<uint32_t> interfaceAddressBegin; //!< first interface address of each router
+    std::vector<Ipv4Address> interfaceAddresses; //!< first address of each interface but the loopback
+    std::vector<uint32_t> stubBegin;            //!< first stub network of each router
+    std::vector<GraphPrefix> stubs;             //!< the stub networks
+    std::vector<uint32_t> externalBegin;        //!< first external route of each router
+    std::vector<GraphPrefix> externals;         //!< the external routes
+  };
+
+  SPFGraph m_graph;                     //!< the LSDB frozen by BuildDSRRoutingDatabase
+  /// distance d(w, u) from the far end w of each link of m_graph back to its router u, see MarkLoopFreeAlternates
+  std::vector<uint32_t> m_loopFreeBack;
+
+  /// A candidate (distance, router) of the SPF calculations on m_graph
+  typedef std::pair<uint32_t, uint32_t> GraphCandidate;
+
+  /**
+   * \brief Order of the candidates of the SPF calculations on m_graph,
+   * closest first then lowest router index, and heap position of each
+   * router.
+   */
+  struct GraphCandidateOrder
+  {
+    /**
+     * \param a first operand
+     * \param b second operand
+     * \return true if a should be popped before b
+     */
+    bool Before (const GraphCandidate &a, const GraphCandidate &b) const
+    {
+      return a < b;
+    }
+    /**
+     * \brief Index a candidate at its new heap position.
+     * \param c the candidate
+     * \param pos the heap position, NO_POSITION once popped
+     */
+    void Moved (const GraphCandidate &c, uint32_t pos)
+    {
+      position[c.second] = pos;
+    }
+
+    std::vector<uint32_t> position;     //!< heap position of every router of m_graph
+  };
+
+  /// The candidate routers of the SPF calculations on m_graph
+  typedef DsrIndexedHeap<GraphCandidate, GraphCandidateOrder> GraphCandidateHeap;
+
+  /**
+   * \brief State of one SPF calculation.
+   *
+   * The SPF status of the LSAs is kept here rather than in the shared LSAs,
+   * and the routes found are recorded rather than added, so that several
+   * calculations can run at once on the same LSDB, one per thread.  The
+   * calculations on m_graph keep their state in flat arrays, which are
+   * reset by each calculation but keep their memory for the next one.
+   */
+  struct SPFContext
+  {
+    DSRVertex *spfroot;                 //!< the root of the SPF tree
+    /// SPF status of the LSAs met so far; the others are not explored
+    std::unordered_map<const DSRRoutingLSA *, DSRRoutingLSA::SPFStatus> status;
+    std::vector<PendingRoute> *routes;  //!< where to record the routes found
+    /// distance of every router of m_graph from the root, or to the destination
+    std::vector<uint32_t> distance;
+    /// candidate routers, by distance
+    GraphCandidateHeap heap;
+    /// SPF status of every router of m_graph
+    std::vector<DSRRoutingLSA::SPFStatus> state;
+    /// exits of the root toward every router of m_graph, sorted
+    std::vector<std::vector<DSRVertex::NodeExit_t> > exits;
+    /// routers of m_graph in the order they entered the SPF tree
+    std::vector<uint32_t> settled;
+    /// two-hop candidates (distance, (link, link of the neighbor)) of a router
+    std::vector<std::pair<uint32_t, std::pair<uint32_t, uint32_t> > > twoHops;
+  };
+
+  /// One SPF calculation of InitializeRoutes
+  struct SPFJob
+  {
+    /// How the calculation is done
+    enum Type
+    {
+      LSDB,             //!< SPFCalculate on the LSDB
+      GRAPH,            //!< SPFCalculateGraph on m_graph
+      REVERSE           //!< RunReverseSPFJob on m_graph
+    };
+    Type type;                          //!< how the calculation is done
+    uint32_t router;                    //!< GRAPH: the router the routes are for; REVERSE: the destination
+    uint32_t graphLink;                 //!< GRAPH: the link of router to the root of the tree
+    Ipv4Address root;                   //!< LSDB: root of the SPF tree, a neighbor of initroot
+    Ipv4Address initroot;               //!< LSDB: the router the routes are for
+    DSRRoutingLinkRecord *link;         //!< LSDB: link from initroot to root
+    uint32_t iface;                     //!< LSDB: interface of initroot on that link
+    std::vector<PendingRoute> routes;   //!< routes to add, in order
+  };
+
+  struct SPFWorkQueue;
+
+  /// Reverse tree kept by GetLazyTree
+  struct LazyTree
+  {
+    std::vector<uint32_t> distance;     //!< distance of every router to the destination
+    uint64_t used;                      //!< value of LazyRoutes::clock when last asked for
+  };
+
+  /// Routes computed on demand since InitializeRoutes
+  struct LazyRoutes
+  {
+    bool enabled;                       //!< whether the routes are computed on demand
+    /// per router of m_graph, the destination routers it has routes to; empty until its first request
+    std::vector<std::vector<bool> > resolved;
+    /// per router of m_graph, whether its network routes are installed
+    std::vector<bool> networks;
+    /// reverse trees of the destination routers asked for last, a bounded number
+    std::unordered_map<uint32_t, LazyTree> trees;
+    uint64_t clock;                     //!< number of calls to GetLazyTree
+    /// per link of m_graph, distance from its far end back to its router,
+    /// for the loop-free alternates
+    std::vector<uint32_t> back;
+    /// per router of m_graph, whether the entries of its links in back are set
+    std::vector<bool> backValid;
+    SPFContext context;                 //!< state of the calculations
+    std::vector<PendingRoute> routes;   //!< routes being recorded
+  };
+  LazyRoutes m_lazy;                    //!< routes computed on demand
+
+  /// First key and one past the last key of the host routes to a router
+  typedef std::pair<const Ipv4Address *, const Ipv4Address *> RouteKeys_t;
+  /// whether the host routes to a router of m_graph are keyed by its router ID
+  bool m_aggregate;
+  /// addresses of the routers of m_graph to their router ID, when aggregating
+  Ptr<DsrPrefixTable> m_prefixes;
+  /**
+   * \brief Get the keys of the host routes to a router of m_graph: its
+   * router ID when aggregating, its addresses otherwise.
+   * \param to the router
+   * \param interfaces true for the direct routes of its neighbors, which
+   * go to its interface addresses, false for the others, which go to its
+   * link addresses
+   * \returns the range of the keys
+   */
+  RouteKeys_t GetRouteKeys (uint32_t to, bool interfaces) const;
+  /**
+   * \brief Decide whether the host routes are aggregated, build m_prefixes
+   * if so and give it to the local routers.
+   */
+  void InitializePrefixTable ();
+
+  /**
+   * \brief List the SPF calculations of every router, in the order the
+   * routes are installed.
+   *
+   * The host routes to the direct neighbors are recorded in the job of the
+   * link they use.
+   *
+   * \param jobs the list to fill
+   */
+  void CollectSPFJobs (std::vector<SPFJob> &jobs);
+  /**
+   * \brief Freeze the LSDB into m_graph.
+   *
+   * The graph is left invalid if the LSDB has transit networks, which
+   * only the calculations on the LSDB handle.
+   */
+  void BuildSPFGraph ();
+  /**
+   * \brief Stop the simulation if an option computed on m_graph is asked
+   * for while the LSDB has transit networks.
+   *
+   * Falling back to the calculations on the LSDB would give other routes
+   * than the ones asked for, so the option is not silently dropped.
+   *
+   * \param option the DSRRouteManager setter of the option, for the error
+   * message
+   */
+  void RequireSPFGraph (const char *option) const;
+  /**
+   * \brief List one reverse SPF calculation per router of m_graph.
+   * \param jobs the list to fill
+   */
+  void CollectReverseSPFJobs (std::vector<SPFJob> &jobs);
+  /**
+   * \brief Calculate the SPF tree of SPFCalculate on m_graph.
+   *
+   * The tree is rooted at the neighbor at the other end of the link, and
+   * the routes are the same as those of SPFCalculate; only the order of
+   * the network routes may differ, as equidistant routers are not settled
+   * in the same order.
+   *
+   * \param context the SPF state
+   * \param initroot the router the host routes are for
+   * \param link the link of initroot to the root of the tree
+   */
+  void SPFCalculateGraph (SPFContext &context, uint32_t initroot, uint32_t link);
+  /**
+   * \brief Grow the SPF tree of a router of m_graph.
+   *
+   * Fills the distance, SPF state and root exits of every router, and the
+   * routers in the order they entered the tree, root excluded.
+   *
+   * \param context the SPF state
+   * \param root the root of the tree
+   * \param rootDistance the distance of the root
+   */
+  void SPFGraphTree (SPFContext &context, uint32_t root, uint32_t rootDistance);
+  /**
+   * \brief Record the default route of a stub router of m_graph, as
+   * CheckForStubNode does.
+   * \param context the SPF state
+   * \param router the stub router
+   */
+  void RecordStubDefaultRoute (SPFContext &context, uint32_t router);
+  /**
+   * \brief Record the network and external routes of a router toward
+   * another one.
+   * \param context the SPF state
+   * \param router the router the routes are for
+   * \param to the router with the stub networks and external routes
+   * \param exits the exits of router toward it
+   */
+  void RecordGraphNetworkRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                                 const std::vector<DSRVertex::NodeExit_t> &exits);
+  /**
+   * \brief Compute the distance of every router to a destination with a
+   * Dijkstra run on the reversed router graph.
+   * \param context the SPF state, whose distance vector is filled
+   * \param destination the destination router in m_graph
+   */
+  void ReverseSPFCalculate (SPFContext &context, uint32_t destination);
+  /**
+   * \brief Record the routes of every router to one destination router.
+   *
+   * A router gets, through each neighbor it does not reach as a stub, a host
+   * route to each address of the destination, whose distance is the metric
+   * of the link back from the neighbor plus the distance of the neighbor to
+   * the destination: the distance SPFCalculate finds in the tree rooted at
+   * that neighbor.  The routers that are the root of such trees also get
+   * network routes to the stub networks and external routes of the
+   * destination through their equal-cost next hops.
+   *
+   * \param job the calculation
+   * \param context the SPF state to use
+   */
+  void RunReverseSPFJob (SPFJob &job, SPFContext &context);
+  /**
+   * \brief Record the host routes of a router to the addresses of another
+   * one, as RunReverseSPFJob does.
+   * \param context the SPF state
+   * \param router the router the routes are for
+   * \param to the destination router
+   * \param distance the distance of every router to the destination
+   */
+  void RecordReverseHostRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                                const std::vector<uint32_t> &distance);
+  /**
+   * \brief Record the shortest two-hop host routes of a router to the
+   * addresses of another one, up to DSRRouteManager::GetCandidatesPerDestination ()
+   * candidates with those of RecordReverseHostRoutes.
+   * \param context the SPF state
+   * \param router the router the routes are for
+   * \param to the destination router
+   * \param distance the distance of every router to the destination
+   */
+  void RecordTwoHopHostRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                               const std::vector<uint32_t> &distance);
+  /**
+   * \brief Replace the host routes of a router to the addresses of another
+   * one.
+   * \param context the SPF state
+   * \param router the router the routes are for
+   * \param to the destination router
+   * \param distance the distance of every router to the destination
+   */
+  void ReplaceGraphHostRoutes (SPFContext &context, uint32_t router, uint32_t to,
+                               const std::vector<uint32_t> &distance);
+  /**
+   * \brief Replace the host routes of some routers to every router, and
+   * mark their loop-free alternates if enabled.
+   * \param context the SPF state
+   * \param routers whether to replace the routes of each router of m_graph
+   */
+  void ReplaceGraphHostRoutes (SPFContext &context, const std::vector<uint8_t> &routers);
+  /**
+   * \brief Remove the host routes of a router to another one computed on
+   * demand, so that they are computed again the next time it asks.
+   * \param router the router the routes are for
+   * \param to the destination router
+   */
+  void ForgetLazyRoutes (uint32_t router, uint32_t to);
+  /**
+   * \brief Replace the network and external routes of a router with those
+   * of its SPF tree, in the order and number InitializeRoutes adds them.
+   * \param context the SPF state
+   * \param router the router
+   */
+  void ReplaceGraphNetworkRoutes (SPFContext &context, uint32_t router);
+  /**
+   * \brief Change the metric of a link of m_graph and of its link record.
+   * \param router the router of the link
+   * \param link the link
+   * \param metric the new metric
+   * \returns true if the link is the first one of the router to the other
+   * end, whose metric the other end uses for its routes back through it
+   */
+  bool SetGraphLinkMetric (uint32_t router, uint32_t link, uint16_t metric);
+  /**
+   * \brief Mark the host routes of the local routers of m_graph whose next
+   * hop is a loop-free alternate.
+   * \param context the SPF state
+   */
+  void MarkLoopFreeAlternates (SPFContext &context);
+  /**
+   * \brief Fill m_loopFreeBack from one SPF tree per router.
+   * \param context the SPF state
+   */
+  void ComputeLoopFreeBack (SPFContext &context);
+  /**
+   * \brief Mark the host routes of a router to the addresses of another one
+   * whose next hop is a loop-free alternate.
+   * \param router the router the routes are for
+   * \param to the destination router
+   * \param distance the distance of every router to the destination
+   * \param back the distance d(w, router) from the far end w of each link of
+   * the router, in the order of its links
+   * \returns the number of links whose routes were marked
+   */
+  uint32_t MarkLoopFreeAlternates (uint32_t router, uint32_t to, const std::vector<uint32_t> &distance,
+                                   const uint32_t *back);
+  /**
+   * \brief Prepare m_lazy for routes computed on demand, or reset it.
+   * \param enable whether the routes are computed on demand
+   */
+  void InitializeLazyRoutes (bool enable);
+  /**
+   * \brief Get the distance of every router to a destination router,
+   * growing its reverse tree unless it is kept.
+   *
+   * The trees asked for least recently are dropped to keep their distances
+   * under MAX_LAZY_TREE_WORDS.
+   *
+   * \param to the destination router
+   * \returns the distances, which stay valid until the next call or until
+   * m_lazy is reset
+   */
+  const std::vector<uint32_t> &GetLazyTree (uint32_t to);
+  /**
+   * \brief Get the distances back to a router from the far ends of its
+   * links, growing its reverse tree the first time.
+   * \param router the router
+   * \returns the distances, in the order of the links of \p router
+   */
+  const uint32_t *GetLazyBack (uint32_t router);
+  /**
+   * \brief Compute the routes of every router and install them, the body
+   * of InitializeRoutes without the route cache.
+   */
+  void ComputeRoutes ();
+  /**
+   * \brief Hash what the routes are computed from: the LSDB, the
+   * interfaces of the routers and the options of the route manager.
+   * \returns the 64-bit hash
+   */
+  uint64_t HashRoutingDatabase () const;
+  /**
+   * \brief Write the routes of every router into a route cache buffer.
+   * \param hash the hash of the routing database
+   * \param buffer the buffer, replaced by the header and one block per router
+   */
+  void SerializeRoutes (uint64_t hash, std::vector<uint32_t> &buffer) const;
+  /**
+   * \brief Install the routes of a route cache buffer.
+   *
+   * Nothing is installed unless the whole buffer is valid for the hash and
+   * the routers of the simulation.
+   *
+   * \param hash the hash of the routing database
+   * \param buffer the buffer written by SerializeRoutes
+   * \returns true if the routes were installed
+   */
+  bool DeserializeRoutes (uint64_t hash, const std::vector<uint32_t> &buffer);
+  /**
+   * \brief Run the SPF calculations on worker threads and install their
+   * routes in the order of the jobs.
+   * \param jobs the SPF calculations
+   * \param nThreads the number of worker threads
+   */
+  void RunSPFJobs (std::vector<SPFJob> &jobs, uint32_t nThreads);
+  /**
+   * \brief Body of a worker thread of RunSPFJobs.
+   * \param queue the jobs and their progress
+   */
+  void SPFWorker (SPFWorkQueue *queue);
+  /**
+   * \brief Run one SPF calculation, recording its routes in the job.
+   * \param job the calculation
+   * \param context the SPF state to use
+   */
+  void RunSPFJob (SPFJob &job, SPFContext &context);
+  /**
+   * \brief Add recorded routes to their routers, in order.
+   * \param routes the routes
+   */
+  static void InstallRoutes (const std::vector<PendingRoute> &routes);
+  /**
+   * \brief Record a route to be added later.
+   * \param routes the list to append it to
+   * \param type the kind of route
+   * \param routing the router to add it to
+   * \param dest the destination host or network
+   * \param mask the destination network mask
+   * \param nextHop the next hop
+   * \param interface the outgoing interface
+   * \param distance the distance of a host route
+   */
+  static void RecordRoute (std::vector<PendingRoute> &routes, PendingRoute::Type type, Ipv4DSRRouting *routing,
+                           Ipv4Address dest, Ipv4Mask mask, Ipv4Address nextHop,
+                           uint32_t interface, uint32_t distance);
+  /**
+   * \param context the SPF state
+   * \param lsa an LSA
+   * \returns the SPF status of the LSA in this calculation
+   */
+  static DSRRoutingLSA::SPFStatus GetStatus (const SPFContext &context, const DSRRoutingLSA *lsa);
+  /**
+   * \brief Set the SPF status of an LSA in this calculation.
+   * \param context the SPF state
+   * \param lsa the LSA
+   * \param status the new status
+   */
+  static void SetStatus (SPFContext &context, const DSRRoutingLSA *lsa, DSRRoutingLSA::SPFStatus status);
+  /**
+   * \brief Find the interface of a router that has an address in a prefix,
+   * like Ipv4::GetInterfaceForPrefix but from the node index.
+   * \param record the router
+   * \param a the address
+   * \param amask the prefix mask
+   * \returns the interface index, or -1 if none
+   */
+  static int32_t GetInterfaceForPrefix (const RouterRecord *record, Ipv4Address a, Ipv4Mask amask);
 
   /**
    * \brief Test if a node is a stub, from an OSPF sense.
@@ -868,18 +1450,20 @@ private:
    * can safely be added to the next-hop router and SPF does not need
    * to be run
    *
+   * \param context the SPF state
    * \param root the root node
    * \returns true if the node is a stub
    */
-  bool CheckForStubNode (Ipv4Address root);
+  bool CheckForStubNode (SPFContext &context, Ipv4Address root);
 
   /**
    * \brief Calculate the shortest path first (SPF) tree
    *
    * Equivalent to quagga ospf_spf_calculate
+   * \param context the SPF state
    * \param root the root node
    */
-  void SPFCalculate (Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord *l, uint32_t Iface);
+  void SPFCalculate (SPFContext &context, Ipv4Address root, Ipv4Address initroot, DSRRoutingLinkRecord *l, uint32_t Iface);
 
   /**
    * \brief Process Stub nodes
@@ -888,17 +1472,19 @@ private:
    * stub link records will exist for point-to-point interfaces and for
    * broadcast interfaces for which no neighboring router can be found
    *
+   * \param context the SPF state
    * \param v vertex to be processed
    */
-  void SPFProcessStubs (DSRVertex* v);
+  void SPFProcessStubs (SPFContext &context, DSRVertex* v);
 
   /**
    * \brief Process Autonomous Systems (AS) External LSA
    *
+   * \param context the SPF state
    * \param v vertex to be processed
    * \param extlsa external LSA
    */
-  void ProcessASExternals (DSRVertex* v, DSRRoutingLSA* extlsa);
+  void ProcessASExternals (SPFContext &context, DSRVertex* v, DSRRoutingLSA* extlsa);
 
   /**
    * \brief Examine the links in v's LSA and update the list of candidates with any
@@ -918,10 +1504,11 @@ private:
    * vertices not already on the list.  If a lower-cost path is found to a
    * vertex already on the candidate list, store the new (lower) cost.
    *
+   * \param context the SPF state
    * \param v the vertex
    * \param candidate the SPF candidate queue
    */
-  void SPFNext (DSRVertex* v, DsrCandidateQueue& candidate);
+  void SPFNext (SPFContext &context, DSRVertex* v, DsrCandidateQueue& candidate);
 
   /**
    * \brief Calculate nexthop from root through V (parent) to vertex W (destination)
@@ -930,13 +1517,14 @@ private:
    * This method is derived from quagga ospf_nexthop_calculation() 16.1.1.
    * For now, this is greatly simplified from the quagga code
    *
+   * \param context the SPF state
    * \param v the parent
    * \param w the destination
    * \param l the link record
    * \param distance the target distance
    * \returns 1 on success
    */
-  int SPFNexthopCalculation (DSRVertex* v, DSRVertex* w, 
+  int SPFNexthopCalculation (SPFContext &context, DSRVertex* v, DSRVertex* w, 
                              DSRRoutingLinkRecord* l, uint32_t distance);
 
   /**
@@ -996,33 +1584,37 @@ private:
    * a destination IP address, reachable from the root, to which we add a host
    * route.
    *
+   * \param context the SPF state
    * \param v the vertex
    *
    */
-  void SPFIntraAddRouter (DSRVertex* v, DSRVertex* v_init, Ipv4Address nextHop,  uint32_t Iface);
+  void SPFIntraAddRouter (SPFContext &context, DSRVertex* v, DSRVertex* v_init, Ipv4Address nextHop,  uint32_t Iface);
 
   /**
    * \brief Add a transit to the routing tables
    *
+   * \param context the SPF state
    * \param v the vertex
    */
-  void SPFIntraAddTransit (DSRVertex* v);
+  void SPFIntraAddTransit (SPFContext &context, DSRVertex* v);
 
   /**
    * \brief Add a stub to the routing tables
    *
+   * \param context the SPF state
    * \param l the global routing link record
    * \param v the vertex
    */
-  void SPFIntraAddStub (DSRRoutingLinkRecord *l, DSRVertex* v);
+  void SPFIntraAddStub (SPFContext &context, DSRRoutingLinkRecord *l, DSRVertex* v);
 
   /**
    * \brief Add an external route to the routing tables
    *
+   * \param context the SPF state
    * \param extlsa the external LSA
    * \param v the vertex
    */
-  void SPFAddASExternal (DSRRoutingLSA *extlsa, DSRVertex *v);
+  void SPFAddASExternal (SPFContext &context, DSRRoutingLSA *extlsa, DSRVertex *v);
 
   /**
    * \brief Return the interface number corresponding to a given IP address and mask
@@ -1032,11 +1624,12 @@ private:
    * If no such interface is found, return -1 (note:  unit test framework
    * for routing assumes -1 to be a legal return value)
    *
+   * \param context the SPF state
    * \param a the target IP address
    * \param amask the target subnet mask
    * \return the outgoing interface number
    */
-  int32_t FindOutgoingInterfaceId (Ipv4Address a, 
+  int32_t FindOutgoingInterfaceId (const SPFContext &context, Ipv4Address a, 
                                    Ipv4Mask amask = Ipv4Mask ("255.255.255.255"));
 };
 
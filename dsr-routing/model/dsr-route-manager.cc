@@ -28,6 +28,22 @@ namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("DSRRouteManager");
 
+/// Number of threads computing the routes, 0 for one per core
+static uint32_t g_populationThreads = 1;
+static DSRRouteManager::RouteEngine g_routeEngine = DSRRouteManager::SPF_PER_NEIGHBOR;
+/// Whether the loop-free alternates are marked
+static bool g_loopFreeAlternates = false;
+/// Most candidate routes per router and destination, 0 for one per neighbor
+static uint32_t g_candidatesPerDestination = 0;
+/// Directory of the route cache files, empty when the cache is disabled
+static std::string g_routeCacheDirectory;
+/// Whether the cached routes are compared with freshly computed ones
+static bool g_routeCacheVerification = false;
+/// Whether the routes are computed on demand
+static bool g_lazyRoutes = false;
+/// Whether the host routes are stored once per destination router
+static bool g_aggregateRoutes = false;
+
 // ---------------------------------------------------------------------------
 //
 // DSRRoutingManager Implementation
@@ -42,6 +58,14 @@ DSRRouteManager::DeleteDSRRoutes ()
   DeleteDSRRoutes ();
 }
 
+void
+DSRRouteManager::RecomputeDSRRoutes ()
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  SimulationSingleton<DSRRouteManagerImpl>::Get ()->
+  RecomputeDSRRoutes ();
+}
+
 void
 DSRRouteManager::BuildDSRRoutingDatabase (void) 
 {
@@ -58,6 +82,126 @@ DSRRouteManager::InitializeRoutes (void)
   InitializeRoutes ();
 }
 
+void
+DSRRouteManager::UpdateLinkMetric (Ptr<Node> node, uint32_t interface, uint16_t metric)
+{
+  NS_LOG_FUNCTION (node << interface << metric);
+  SimulationSingleton<DSRRouteManagerImpl>::Get ()->
+  UpdateLinkMetric (node, interface, metric);
+}
+
+bool
+DSRRouteManager::ResolveRoutes (Ptr<Node> node, Ipv4Address dest)
+{
+  NS_LOG_FUNCTION (node << dest);
+  return SimulationSingleton<DSRRouteManagerImpl>::Get ()->
+         ResolveRoutes (node, dest);
+}
+
+void
+DSRRouteManager::SetPopulationThreads (uint32_t n)
+{
+  NS_LOG_FUNCTION (n);
+  g_populationThreads = n;
+}
+
+uint32_t
+DSRRouteManager::GetPopulationThreads (void)
+{
+  return g_populationThreads;
+}
+
+void
+DSRRouteManager::SetRouteEngine (RouteEngine engine)
+{
+  NS_LOG_FUNCTION (engine);
+  g_routeEngine = engine;
+}
+
+DSRRouteManager::RouteEngine
+DSRRouteManager::GetRouteEngine (void)
+{
+  return g_routeEngine;
+}
+
+void
+DSRRouteManager::SetLoopFreeAlternates (bool enable)
+{
+  NS_LOG_FUNCTION (enable);
+  g_loopFreeAlternates = enable;
+}
+
+bool
+DSRRouteManager::GetLoopFreeAlternates (void)
+{
+  return g_loopFreeAlternates;
+}
+
+void
+DSRRouteManager::SetCandidatesPerDestination (uint32_t k)
+{
+  NS_LOG_FUNCTION (k);
+  g_candidatesPerDestination = k;
+}
+
+uint32_t
+DSRRouteManager::GetCandidatesPerDestination (void)
+{
+  return g_candidatesPerDestination;
+}
+
+void
+DSRRouteManager::SetRouteCacheDirectory (const std::string &directory)
+{
+  NS_LOG_FUNCTION (directory);
+  g_routeCacheDirectory = directory;
+}
+
+std::string
+DSRRouteManager::GetRouteCacheDirectory (void)
+{
+  return g_routeCacheDirectory;
+}
+
+void
+DSRRouteManager::SetRouteCacheVerification (bool enable)
+{
+  NS_LOG_FUNCTION (enable);
+  g_routeCacheVerification = enable;
+}
+
+bool
+DSRRouteManager::GetRouteCacheVerification (void)
+{
+  return g_routeCacheVerification;
+}
+
+void
+DSRRouteManager::SetLazyRoutes (bool enable)
+{
+  NS_LOG_FUNCTION (enable);
+  g_lazyRoutes = enable;
+}
+
+bool
+DSRRouteManager::GetLazyRoutes (void)
+{
+  return g_lazyRoutes;
+}
+
+void
+DSRRouteManager::SetAggregateRoutes (bool enable)
+{
+  NS_LOG_FUNCTION (enable);
+  g_aggregateRoutes = enable;
+}
+
+bool
+DSRRouteManager::GetAggregateRoutes (void)
+{
+  return g_aggregateRoutes;
+}
+
 uint32_t
 DSRRouteManager::AllocateRouterId (void)
 {
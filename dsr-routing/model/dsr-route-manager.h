@@ -22,8 +22,14 @@
 #ifndef DSR_ROUTE_MANAGER_H
 #define DSR_ROUTE_MANAGER_H
 
+#include <string>
+#include "ns3/ptr.h"
+#include "ns3/ipv4-address.h"
+
 namespace ns3 {
 
+class Node;
+
 /**
  * \ingroup globalrouting
  *
@@ -40,6 +46,15 @@ namespace ns3 {
 class DSRRouteManager
 {
 public:
+/**
+ * @brief Algorithm computing the routes in InitializeRoutes ()
+ */
+  enum RouteEngine
+  {
+    SPF_PER_NEIGHBOR,   //!< one SPF tree per router and neighbor (the default)
+    REVERSE_SPF         //!< one reverse SPF tree per destination router
+  };
+
 /**
  * @brief Allocate a 32-bit router ID from monotonically increasing counter.
  * @returns A new new RouterId.
@@ -53,6 +68,12 @@ public:
  */
   static void DeleteDSRRoutes ();
 
+/**
+ * @brief Rebuild the routing database and recompute the routes of every
+ * node.  The forwarding tables stay in use until the new ones are complete.
+ */
+  static void RecomputeDSRRoutes ();
+
 /**
  * @brief Build the routing database by gathering Link State Advertisements
  * from each node exporting a DSRRouter interface.
@@ -65,6 +86,215 @@ public:
  */
   static void InitializeRoutes ();
 
+/**
+ * @brief Change the metric of a point-to-point link and update only the
+ * routes that depend on it.
+ *
+ * The shortest path trees of the two ends of the link tell which
+ * destinations may get closer or farther; the host routes to those
+ * destinations are recomputed from one reverse tree each and replaced in
+ * place in the nodes whose candidates changed, and the network routes of
+ * the nodes whose exits may have changed are rebuilt.  The other routes
+ * stay as they are.  The resulting tables are those RecomputeDSRRoutes ()
+ * would give, up to the order of the network routes.  When the routing
+ * database has transit networks, or no routes were computed yet, every
+ * route is recomputed instead.
+ *
+ * @param node the node advertising the link
+ * @param interface the interface of the node on the link
+ * @param metric the new metric of the link, in the direction from the node
+ */
+  static void UpdateLinkMetric (Ptr<Node> node, uint32_t interface, uint16_t metric);
+
+/**
+ * @brief Set the number of threads computing the routes in
+ * InitializeRoutes () and RecomputeDSRRoutes ().
+ *
+ * The SPF trees of the routers are then computed in parallel, but their
+ * routes are installed in the same order as with a single thread, so the
+ * forwarding tables are identical.  Logging of the route manager is not
+ * serialized and should stay disabled when using several threads.
+ *
+ * @param n the number of threads; 0 uses one per hardware core, and 1 (the
+ * default) computes the routes on the calling thread
+ */
+  static void SetPopulationThreads (uint32_t n);
+/**
+ * @brief Get the number of threads computing the routes.
+ * @returns the value set by SetPopulationThreads (), 1 by default
+ */
+  static uint32_t GetPopulationThreads ();
+
+/**
+ * @brief Set the algorithm computing the routes in InitializeRoutes () and
+ * RecomputeDSRRoutes ().
+ *
+ * With REVERSE_SPF, a single Dijkstra run on the reversed graph gives the
+ * distance of every router to one destination; the distance of a router
+ * through each of its neighbors is then the metric of the link plus the
+ * distance of that neighbor, so one tree per destination replaces one tree
+ * per router and neighbor.  The host routes are the same as with
+ * SPF_PER_NEIGHBOR; each network route is installed once instead of once
+ * per neighbor of the router.  Topologies with transit networks are not
+ * supported by REVERSE_SPF: the simulation stops with an error.
+ *
+ * @param engine the algorithm, SPF_PER_NEIGHBOR by default
+ */
+  static void SetRouteEngine (RouteEngine engine);
+/**
+ * @brief Get the algorithm computing the routes.
+ * @returns the value set by SetRouteEngine (), SPF_PER_NEIGHBOR by default
+ */
+  static RouteEngine GetRouteEngine ();
+
+/**
+ * @brief Set whether InitializeRoutes () and RecomputeDSRRoutes () mark
+ * the loop-free alternates among the host routes.
+ *
+ * A host route of router u to t through neighbor w is a loop-free
+ * alternate when d(w, t) < d(w, u) + d(u, t): the shortest paths of w to t
+ * do not go through u (\RFC{5286}).  When one of its interfaces goes down,
+ * a router with the FastFailover attribute of Ipv4DSRRouting set drops the
+ * routes through it and forwards the packets that can no longer meet the
+ * distance expected by the previous hop on an alternate, as long as it
+ * fits in their time budget.  Marking them takes
+ * one SPF tree per router and one reverse tree per destination, and needs
+ * an LSDB without transit networks; the simulation stops with an error
+ * otherwise.
+ *
+ * @param enable true to mark the alternates, false (the default) not to
+ */
+  static void SetLoopFreeAlternates (bool enable);
+/**
+ * @brief Get whether the loop-free alternates are marked.
+ * @returns the value set by SetLoopFreeAlternates (), false by default
+ */
+  static bool GetLoopFreeAlternates ();
+
+/**
+ * @brief Set how many candidate routes InitializeRoutes () and
+ * RecomputeDSRRoutes () give each router to each destination.
+ *
+ * Each router always gets one host route per neighbor, through which the
+ * neighbor takes its own shortest route.  With k above the degree of a
+ * router, its remaining candidates to a destination t are two-hop ones:
+ * through neighbor w, which then forwards to its neighbor x, x being
+ * closer to t than both the router and w (the downstream-path criterion,
+ * so that the packet cannot come back).  The shortest of them are kept,
+ * and the lookahead checks the queue of w toward x, so that a packet can
+ * still meet its budget when the shortest route of w is congested.  It
+ * takes the same number of trees as REVERSE_SPF and needs an LSDB without
+ * transit networks; the simulation stops with an error otherwise.
+ *
+ * @param k the most candidates per destination, counting the one per
+ * neighbor; 0 (the default) adds no two-hop candidate
+ */
+  static void SetCandidatesPerDestination (uint32_t k);
+/**
+ * @brief Get how many candidate routes each router gets to each destination.
+ * @returns the value set by SetCandidatesPerDestination (), 0 by default
+ */
+  static uint32_t GetCandidatesPerDestination ();
+
+/**
+ * @brief Set the directory of the route cache used by InitializeRoutes ()
+ * and RecomputeDSRRoutes ().
+ *
+ * The routing database, the interfaces of the routers and the options of
+ * the route computation are hashed, and the routes of every node are
+ * stored in the file dsr-routes-<hash>.bin of the directory.  When the
+ * file exists, the tables are loaded from it instead of being computed;
+ * otherwise they are computed and the file is written.  The file is a
+ * header followed by one block per node of fixed-size 32-bit words, in
+ * host byte order, so it is only meant to be shared between runs on the
+ * same kind of host.
+ *
+ * @param directory the directory of the cache files, which must exist; an
+ * empty string (the default) disables the cache
+ */
+  static void SetRouteCacheDirectory (const std::string &directory);
+/**
+ * @brief Get the directory of the route cache.
+ * @returns the value set by SetRouteCacheDirectory (), empty by default
+ */
+  static std::string GetRouteCacheDirectory ();
+
+/**
+ * @brief Set whether the route cache is verified.
+ *
+ * When enabled, the routes are always computed and compared with those of
+ * the cache file, if any; the simulation stops with an error naming the
+ * first node whose tables differ.  This catches stale cache files, e.g.
+ * after a change to the route computation that the hash cannot see.
+ *
+ * @param enable true to verify the cache, false (the default) to trust it
+ */
+  static void SetRouteCacheVerification (bool enable);
+/**
+ * @brief Get whether the route cache is verified.
+ * @returns the value set by SetRouteCacheVerification (), false by default
+ */
+  static bool GetRouteCacheVerification ();
+
+/**
+ * @brief Set whether InitializeRoutes () and RecomputeDSRRoutes () leave
+ * the routes to be computed on demand.
+ *
+ * In this mode, no route is computed up front.  The first time a router
+ * looks up a destination it has no host route to, it asks for its routes
+ * to the router owning the address: one reverse SPF tree of that router,
+ * kept for the other routers asking for it, gives them in the same order
+ * as an up-front computation.  Only the trees asked for last are kept,
+ * within a fixed number of distances; the others are grown again when
+ * needed.  The network routes of a router are computed
+ * with its first request.  Startup time and memory then grow with the
+ * routers and destinations in use rather than with the whole topology.
+ * UpdateLinkMetric () drops the routes computed so far that may depend
+ * on the link, which are computed again when next asked for.  It needs
+ * an LSDB without transit networks; the simulation stops with an error
+ * otherwise.
+ *
+ * @param enable true to compute the routes on demand, false (the default)
+ * to compute them all up front
+ */
+  static void SetLazyRoutes (bool enable);
+/**
+ * @brief Get whether the routes are computed on demand.
+ * @returns the value set by SetLazyRoutes (), false by default
+ */
+  static bool GetLazyRoutes ();
+
+/**
+ * @brief Compute the routes of a router to a destination, when the routes
+ * are computed on demand.
+ *
+ * @param node the node of the router
+ * @param dest the destination address
+ * @returns true if routes were added to the table of the router
+ */
+  static bool ResolveRoutes (Ptr<Node> node, Ipv4Address dest);
+
+/**
+ * @brief Set whether InitializeRoutes () and RecomputeDSRRoutes () store
+ * the host routes to a router once, under its router ID, rather than once
+ * per address.
+ *
+ * All the addresses of a router have the same candidate routes.  When
+ * aggregated, a table shared by the nodes maps the addresses to the router
+ * ID with a longest-prefix match, so the tables take one entry per
+ * candidate instead of one per candidate and address of the destination.
+ * The routes chosen are the same.  It needs an LSDB without transit
+ * networks; the simulation stops with an error otherwise.
+ *
+ * @param enable true to aggregate the routes, false (the default) not to
+ */
+  static void SetAggregateRoutes (bool enable);
+/**
+ * @brief Get whether the host routes are aggregated per router.
+ * @returns the value set by SetAggregateRoutes (), false by default
+ */
+  static bool GetAggregateRoutes ();
+
 private:
 /**
  * @brief Global Route Manager copy construction is disallowed.  There's no 
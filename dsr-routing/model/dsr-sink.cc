@@ -15,10 +15,7 @@
 #include "ns3/udp-socket-factory.h"
 #include "ns3/boolean.h"
 #include "dsr-sink.h"
-#include "budget-tag.h"
-#include "priority-tag.h"
-#include "flag-tag.h"
-#include "timestamp-tag.h"
+#include "dsr-tag.h"
 
 namespace ns3 {
 
@@ -98,9 +95,9 @@ DsrPacketSink::GetAcceptedSockets (void) const
 Time DsrPacketSink::GetDelay(const Ptr<Packet> &p) const
 {
   NS_LOG_FUNCTION (this);
-  TimestampTag txTimeTag;
-  p->PeekPacketTag (txTimeTag);
-  Time txTime = txTimeTag.GetTimestamp ();
+  DsrTag dsrTag;
+  p->PeekPacketTag (dsrTag);
+  Time txTime = dsrTag.GetTimestamp ();
   Time delay = Simulator::Now() - txTime;
   return delay;
 }
@@ -182,14 +179,12 @@ void DsrPacketSink::HandleRead (Ptr<Socket> socket)
           break;
         }
         // get packet
-      FlagTag flagTag;
-      if (packet->PeekPacketTag (flagTag) && flagTag.GetFlagTag () == true)
+      DsrTag dsrTag;
+      if (packet->PeekPacketTag (dsrTag) && dsrTag.GetFlag () == true)
       {
-        TimestampTag timeTag;
-        packet->PeekPacketTag (timeTag);
         std::ostream* os = m_delayStream->GetStream ();
-        // timeTag.GetSeconds () << " " 
-        *os << timeTag.GetSeconds () << " " << GetDelay (packet).GetMicroSeconds ()/1000.0 << std::endl;
+        Time delay = Simulator::Now () - dsrTag.GetTimestamp ();
+        *os << dsrTag.GetTimestamp ().GetSeconds () << " " << delay.GetMicroSeconds ()/1000.0 << std::endl;
       }
       // get delay
       m_totalRx += packet->GetSize ();
@@ -0,0 +1,161 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/nstime.h"
+#include "dsr-tag.h"
+
+#define MAX_UINT_32 0xffffffff
+
+namespace ns3 {
+
+//----------------------------------------------------------------------
+//-- DsrTag
+//------------------------------------------------------
+TypeId
+DsrTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("DsrTag")
+    .SetParent<Tag> ()
+    .AddConstructor<DsrTag> ()
+    .AddAttribute ("Budget",
+                   "The budget time in microseconds",
+                   EmptyAttributeValue (),
+                   MakeUintegerAccessor (&DsrTag::GetBudget),
+                   MakeUintegerChecker <uint32_t> ())
+    .AddAttribute ("Distance",
+                   "The distance of the route chosen at the previous hop",
+                   EmptyAttributeValue (),
+                   MakeUintegerAccessor (&DsrTag::GetDistance),
+                   MakeUintegerChecker <uint32_t> ())
+  ;
+  return tid;
+}
+
+DsrTag::DsrTag ()
+  : m_timestamp (0),
+    m_budget (0),
+    m_distance (MAX_UINT_32),
+    m_flag (0),
+    m_priority (0)
+{
+}
+
+TypeId
+DsrTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+DsrTag::GetSerializedSize (void) const
+{
+  return 18;     // 8 + 4 + 4 + 1 + 1 bytes
+}
+
+void
+DsrTag::Serialize (TagBuffer i) const
+{
+  i.WriteU64 (m_timestamp);
+  i.WriteU32 (m_budget);
+  i.WriteU32 (m_distance);
+  i.WriteU8 (m_flag);
+  i.WriteU8 (m_priority);
+}
+
+void
+DsrTag::Deserialize (TagBuffer i)
+{
+  m_timestamp = i.ReadU64 ();
+  m_budget = i.ReadU32 ();
+  m_distance = i.ReadU32 ();
+  m_flag = i.ReadU8 ();
+  m_priority = i.ReadU8 ();
+}
+
+void
+DsrTag::SetTimestamp (Time time)
+{
+  m_timestamp = time.GetNanoSeconds ();
+}
+
+Time
+DsrTag::GetTimestamp (void) const
+{
+  return NanoSeconds (m_timestamp);
+}
+
+int64_t
+DsrTag::GetMicroSeconds (void) const
+{
+  return m_timestamp / 1000;
+}
+
+void
+DsrTag::SetBudget (uint32_t budget)
+{
+  m_budget = budget;
+}
+
+uint32_t
+DsrTag::GetBudget (void) const
+{
+  return m_budget;
+}
+
+void
+DsrTag::SetFlag (bool flag)
+{
+  m_flag = flag ? 1 : 0;
+}
+
+bool
+DsrTag::GetFlag (void) const
+{
+  return m_flag != 0;
+}
+
+void
+DsrTag::SetPriority (uint8_t priority)
+{
+  m_priority = priority;
+}
+
+uint8_t
+DsrTag::GetPriority (void) const
+{
+  return m_priority;
+}
+
+void
+DsrTag::SetDistance (uint32_t distance)
+{
+  m_distance = distance;
+}
+
+uint32_t
+DsrTag::GetDistance (void) const
+{
+  return m_distance;
+}
+
+bool
+DsrTag::HasDistance (void) const
+{
+  return m_distance != MAX_UINT_32;
+}
+
+void
+DsrTag::Print (std::ostream &os) const
+{
+  os << "t=" << m_timestamp << "ns budget=" << m_budget << "us flag=" << (uint32_t) m_flag
+     << " priority=" << (uint32_t) m_priority;
+  if (HasDistance ())
+    {
+      os << " distance=" << m_distance;
+    }
+}
+
+}
@@ -0,0 +1,66 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef DSRTAG_H
+#define DSRTAG_H
+
+#include "ns3/core-module.h"
+#include "ns3/nstime.h"
+#include "ns3/tag.h"
+#include "ns3/packet.h"
+
+namespace ns3 {
+
+/**
+ * \brief Per-packet DSR state, carried as one fixed-layout packet tag.
+ *
+ * Replaces the separate TimestampTag, FlagTag, BudgetTag, PriorityTag and
+ * DistTag so that every hop does a single PeekPacketTag and at most one
+ * ReplacePacketTag.
+ *
+ * Layout (18 bytes): 64-bit send timestamp in nanoseconds, 32-bit budget
+ * in microseconds (0 for best effort traffic), 32-bit distance (all ones
+ * until a router has chosen a route), 8-bit flag, 8-bit priority.
+ */
+class DsrTag : public Tag
+ {
+ public:
+   static TypeId GetTypeId (void);
+   virtual TypeId GetInstanceTypeId (void) const;
+   virtual uint32_t GetSerializedSize (void) const;
+   virtual void Serialize (TagBuffer i) const;
+   virtual void Deserialize (TagBuffer i);
+   virtual void Print (std::ostream &os) const;
+
+   DsrTag ();
+
+   // these are our accessors to our tag structure
+   void SetTimestamp (Time time);
+   Time GetTimestamp (void) const;
+   /// \return the send timestamp in microseconds
+   int64_t GetMicroSeconds (void) const;
+
+   void SetBudget (uint32_t budget);
+   /// \return the budget in microseconds, 0 if the packet has no budget
+   uint32_t GetBudget (void) const;
+
+   void SetFlag (bool flag);
+   bool GetFlag (void) const;
+
+   void SetPriority (uint8_t priority);
+   uint8_t GetPriority (void) const;
+
+   void SetDistance (uint32_t distance);
+   uint32_t GetDistance (void) const;
+   /// \return true if a router has already set the distance
+   bool HasDistance (void) const;
+
+ private:
+   int64_t m_timestamp;   // send time, in nanoseconds
+   uint32_t m_budget;     // in microseconds
+   uint32_t m_distance;   // distance of the route chosen at the previous hop
+   uint8_t m_flag;
+   uint8_t m_priority;
+ };
+
+}
+
+#endif /* DSRTAG_H */
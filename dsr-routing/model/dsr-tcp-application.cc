@@ -13,10 +13,7 @@
 #include "ns3/tcp-socket-factory.h"
 #include "ns3/boolean.h"
 #include "dsr-tcp-application.h"
-#include "budget-tag.h"
-#include "priority-tag.h"
-#include "flag-tag.h"
-#include "timestamp-tag.h"
+#include "dsr-tag.h"
 
 #define MAX_UINT_32 0xffffffff
 
@@ -232,22 +229,19 @@ void DsrTcpApplication::SendData (const Address &from, const Address &to)
       NS_LOG_LOGIC ("sending packet at " << Simulator::Now ());
       Ptr<Packet> packet;
 
-      TimestampTag txTimeTag;
-      FlagTag flagTag;
-      BudgetTag budgetTag;
-      PriorityTag priorityTag;
+      DsrTag dsrTag;
 
-      txTimeTag.SetTimestamp (Simulator::Now ());
-      flagTag.SetFlagTag (m_flag);
+      dsrTag.SetTimestamp (Simulator::Now ());
+      dsrTag.SetFlag (m_flag);
       if (m_budget == MAX_UINT_32)
         {
-          budgetTag.SetBudget (0);
-          priorityTag.SetPriority (99);
+          dsrTag.SetBudget (0);
+          dsrTag.SetPriority (99);
         }
       else
         {
-          budgetTag.SetBudget (m_budget);
-          priorityTag.SetPriority (1);
+          dsrTag.SetBudget (m_budget);
+          dsrTag.SetPriority (1);
         }
 
       if (m_unsentPacket)
@@ -258,10 +252,7 @@ void DsrTcpApplication::SendData (const Address &from, const Address &to)
       else
         {
           packet = Create<Packet> (toSend);
-          packet->AddPacketTag (txTimeTag);
-          packet->AddPacketTag (flagTag);
-          packet->AddPacketTag (budgetTag);
-          packet->AddPacketTag (priorityTag);
+          packet->AddPacketTag (dsrTag);
         }
       int actual = m_socket->Send (packet);
       // std::cout << "packet send: " << actual << std::endl;
@@ -8,10 +8,7 @@
 #include "ns3/internet-module.h"
 #include "ns3/flow-monitor-module.h"
 #include "dsr-udp-application.h"
-#include "budget-tag.h"
-#include "priority-tag.h"
-#include "flag-tag.h"
-#include "timestamp-tag.h"
+#include "dsr-tag.h"
 
 
 #define MAX_UINT_32 0xffffffff
@@ -111,30 +108,24 @@ DsrUdpApplication::StopApplication ()
 void
 DsrUdpApplication::SendPacket()
 {
-    TimestampTag txTimeTag;
-    FlagTag flagTag;
-    BudgetTag budgetTag;
-    PriorityTag priorityTag;
+    DsrTag dsrTag;
     
     Ptr<Packet> packet = Create <Packet> (m_packetSize);
     Time txTime = Simulator::Now ();
     if (m_budget == MAX_UINT_32)
     {
-        budgetTag.SetBudget (0);
-        priorityTag.SetPriority (99);
+        dsrTag.SetBudget (0);
+        dsrTag.SetPriority (99);
     }
     else
     {
-        budgetTag.SetBudget (m_budget);
-        priorityTag.SetPriority (1);
+        dsrTag.SetBudget (m_budget);
+        dsrTag.SetPriority (1);
     }
-    flagTag.SetFlagTag (m_flag);
-    txTimeTag.SetTimestamp (txTime);
+    dsrTag.SetFlag (m_flag);
+    dsrTag.SetTimestamp (txTime);
 
-    packet->AddPacketTag (txTimeTag);
-    packet->AddPacketTag (flagTag);
-    packet->AddPacketTag (budgetTag);
-    packet->AddPacketTag (priorityTag);
+    packet->AddPacketTag (dsrTag);
     m_socket->Send (packet);
     if(++ m_packetSent < m_nPackets)
     {
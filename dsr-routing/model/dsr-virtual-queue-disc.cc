@@ -1,22 +1,54 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
 
+#include <algorithm>
+#include <cmath>
+#include <sstream>
 #include "ns3/log.h"
 #include "ns3/object-factory.h"
 #include "ns3/queue.h"
 #include "ns3/socket.h"
 #include "ns3/simulator.h"
+#include "ns3/string.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
 #include "dsr-virtual-queue-disc.h"
-#include "priority-tag.h"
-#include "timestamp-tag.h"
-
-#define FAST_LANE 0
-#define SLOW_LANE 1
-#define NORMAL_LANE 2
+#include "dsr-deadline-queue.h"
+#include "dsr-flow-queue.h"
+#include "dsr-tag.h"
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("DsrVirtualQueueDisc");
 
+// Bumped whenever a DSR queue disc is initialized or disposed
+static uint32_t g_generation = 0;
+
+// Split a comma or space separated attribute list into its items, then
+// repeat the last item so that there is one per lane.
+static std::vector<std::string>
+SplitLaneList (const std::string &list, uint32_t nLanes)
+{
+  std::string spaced = list;
+  std::replace (spaced.begin (), spaced.end (), ',', ' ');
+  std::istringstream iss (spaced);
+  std::vector<std::string> items;
+  std::string item;
+  while (iss >> item)
+    {
+      items.push_back (item);
+    }
+  if (items.empty ())
+    {
+      return items;
+    }
+  while (items.size () < nLanes)
+    {
+      items.push_back (items.back ());
+    }
+  items.resize (nLanes);
+  return items;
+}
+
 NS_OBJECT_ENSURE_REGISTERED (DsrVirtualQueueDisc);
 
 TypeId DsrVirtualQueueDisc::GetTypeId (void)
@@ -31,14 +63,95 @@ TypeId DsrVirtualQueueDisc::GetTypeId (void)
                    MakeQueueSizeAccessor (&QueueDisc::SetMaxSize,
                                           &QueueDisc::GetMaxSize),
                    MakeQueueSizeChecker ())
+    .AddAttribute ("Lanes",
+                   "The number of lanes.  A packet of DsrTag priority p goes to lane p, untagged packets and priorities past the last lane go to the last lane.",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::m_nLanes),
+                   MakeUintegerChecker<uint32_t> (1, DsrQueueSnapshot::N_LANES))
+    .AddAttribute ("LaneLimits",
+                   "The capacity of each lane, in packets (\"12p\") or bytes (\"12000B\"), separated by commas.  The last one is repeated for the remaining lanes.",
+                   StringValue ("12p,36p,60p"),
+                   MakeStringAccessor (&DsrVirtualQueueDisc::m_laneLimits),
+                   MakeStringChecker ())
+    .AddAttribute ("LaneWeights",
+                   "The share of the link time of each lane, separated by commas.  The last one is repeated for the remaining lanes.",
+                   StringValue ("10,3,2"),
+                   MakeStringAccessor (&DsrVirtualQueueDisc::m_laneWeights),
+                   MakeStringChecker ())
+    .AddAttribute ("Quantum",
+                   "The bytes a lane may send per round and unit of weight.  Keep it at least as large as the packets so that scheduling stays O(1).",
+                   UintegerValue (1500),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::m_quantum),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("LaneTypes",
+                   "The order in which each lane serves its packets, separated by commas: \"fifo\" in arrival order, \"edf\" earliest deadline first, dropping the packets whose deadline has passed when they are dequeued, \"fq\" round robin over the flows, making room for a new packet at the expense of the longest flow.  The last one is repeated for the remaining lanes.",
+                   StringValue ("fifo"),
+                   MakeStringAccessor (&DsrVirtualQueueDisc::m_laneTypes),
+                   MakeStringChecker ())
+    .AddAttribute ("DeadlineBucketWidth",
+                   "The span of deadlines sharing a calendar slot in the edf lanes.",
+                   TimeValue (MicroSeconds (100)),
+                   MakeTimeAccessor (&DsrVirtualQueueDisc::m_deadlineBucketWidth),
+                   MakeTimeChecker (NanoSeconds (1)))
+    .AddAttribute ("DeadlineBuckets",
+                   "The number of calendar buckets of the edf lanes.",
+                   UintegerValue (256),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::m_deadlineBuckets),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("FlowBuckets",
+                   "The number of buckets the flows are hashed into in the fq lanes.",
+                   UintegerValue (16),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::m_flowBuckets),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("LaneAqm",
+                   "The active queue management of each lane, separated by commas: \"none\" or \"codel\".  The last one is repeated for the remaining lanes.",
+                   StringValue ("none"),
+                   MakeStringAccessor (&DsrVirtualQueueDisc::m_laneAqms),
+                   MakeStringChecker ())
+    .AddAttribute ("AqmTarget",
+                   "The sojourn time the codel lanes aim at.",
+                   TimeValue (MilliSeconds (5)),
+                   MakeTimeAccessor (&DsrVirtualQueueDisc::m_aqmTarget),
+                   MakeTimeChecker ())
+    .AddAttribute ("AqmInterval",
+                   "How long the sojourn time of a codel lane may stay above the target before it drops.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&DsrVirtualQueueDisc::m_aqmInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("UseEcn",
+                   "Mark the ECN capable packets instead of dropping them in the codel lanes.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&DsrVirtualQueueDisc::m_useEcn),
+                   MakeBooleanChecker ())
+    .AddAttribute ("SnapshotInterval",
+                   "The period at which lane occupancy snapshots are published to the adjacent routers (0 to disable periodic snapshots).  Keep it below the SnapshotStaleness of the routers.",
+                   TimeValue (MilliSeconds (1)),
+                   MakeTimeAccessor (&DsrVirtualQueueDisc::m_snapshotInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("SnapshotThreshold",
+                   "Publish a snapshot when a lane length moved by this much since the last snapshot, in the unit of the lane limit (0 to disable).  Every snapshot calls each subscriber, so a small threshold costs more per packet than the direct reads snapshots replace.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&DsrVirtualQueueDisc::m_snapshotThreshold),
+                   MakeUintegerChecker<uint32_t> ())
   ;
   return tid;
 }
 
 DsrVirtualQueueDisc::DsrVirtualQueueDisc ()
-  : QueueDisc (QueueDiscSizePolicy::MULTIPLE_QUEUES, QueueSizeUnit::PACKETS)
+  : QueueDisc (QueueDiscSizePolicy::MULTIPLE_QUEUES, QueueSizeUnit::PACKETS),
+    m_activeHead (0),
+    m_nActive (0),
+    m_nonEmptyLanes (0),
+    m_nextLane (NO_LANE),
+    m_turnStarted (false),
+    m_occupancyEpoch (0),
+    m_fullLanes (0)
 {
   NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < DsrQueueSnapshot::N_LANES; i++)
+    {
+      m_publishedLength[i] = 0;
+    }
 }
 
 DsrVirtualQueueDisc::~DsrVirtualQueueDisc ()
@@ -46,18 +159,279 @@ DsrVirtualQueueDisc::~DsrVirtualQueueDisc ()
   NS_LOG_FUNCTION (this);
 }
 
+void
+DsrVirtualQueueDisc::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_snapshotEvent.Cancel ();
+  m_snapshotCallbacks.clear ();
+  g_generation++;
+  QueueDisc::DoDispose ();
+}
+
+void
+DsrVirtualQueueDisc::AddSnapshotCallback (SnapshotCallback cb)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < m_snapshotCallbacks.size (); i++)
+    {
+      if (m_snapshotCallbacks[i].IsEqual (cb))
+        {
+          return;
+        }
+    }
+  m_snapshotCallbacks.push_back (cb);
+  if (m_snapshotInterval.IsStrictlyPositive () && !m_snapshotEvent.IsRunning ())
+    {
+      m_snapshotEvent = Simulator::Schedule (m_snapshotInterval, &DsrVirtualQueueDisc::PeriodicSnapshot, this);
+    }
+  cb (GetSnapshot ());
+}
+
+void
+DsrVirtualQueueDisc::RemoveSnapshotCallback (SnapshotCallback cb)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < m_snapshotCallbacks.size (); i++)
+    {
+      if (m_snapshotCallbacks[i].IsEqual (cb))
+        {
+          m_snapshotCallbacks.erase (m_snapshotCallbacks.begin () + i);
+          break;
+        }
+    }
+  if (m_snapshotCallbacks.empty ())
+    {
+      m_snapshotEvent.Cancel ();
+    }
+}
+
+uint32_t
+DsrVirtualQueueDisc::GetGeneration (void)
+{
+  return g_generation;
+}
+
+DsrQueueSnapshot
+DsrVirtualQueueDisc::GetSnapshot (void) const
+{
+  DsrQueueSnapshot snapshot;
+  snapshot.queue = this;
+  snapshot.timestamp = Simulator::Now ();
+  snapshot.nBytes = GetNBytes ();
+  snapshot.occupancyEpoch = m_occupancyEpoch;
+  // Lanes are described only once InitializeParams has sized their state;
+  // before that the snapshot has no lanes and no lane reads as full.
+  uint32_t nLanes = std::min<uint32_t> (GetNInternalQueues (), m_laneMaxPacket.size ());
+  snapshot.nLanes = std::min<uint32_t> (nLanes, DsrQueueSnapshot::N_LANES);
+  for (uint32_t i = 0; i < DsrQueueSnapshot::N_LANES; i++)
+    {
+      if (i < snapshot.nLanes)
+        {
+          QueueSize limit = GetInternalQueue (i)->GetMaxSize ();
+          snapshot.laneLength[i] = GetInternalQueue (i)->GetCurrentSize ().GetValue ();
+          snapshot.laneLimit[i] = limit.GetValue ();
+          snapshot.laneStep[i] = limit.GetUnit () == QueueSizeUnit::PACKETS
+            ? 1 : std::max<uint32_t> (1, m_laneMaxPacket[i]);
+        }
+      else
+        {
+          snapshot.laneLength[i] = 0;
+          snapshot.laneLimit[i] = 0;
+          snapshot.laneStep[i] = 1;
+        }
+    }
+  return snapshot;
+}
+
+void
+DsrVirtualQueueDisc::PublishSnapshot (void)
+{
+  NS_LOG_FUNCTION (this);
+  DsrQueueSnapshot snapshot = GetSnapshot ();
+  for (uint32_t i = 0; i < DsrQueueSnapshot::N_LANES; i++)
+    {
+      m_publishedLength[i] = snapshot.laneLength[i];
+    }
+  for (uint32_t i = 0; i < m_snapshotCallbacks.size (); i++)
+    {
+      m_snapshotCallbacks[i] (snapshot);
+    }
+}
+
+void
+DsrVirtualQueueDisc::PeriodicSnapshot (void)
+{
+  PublishSnapshot ();
+  m_snapshotEvent = Simulator::Schedule (m_snapshotInterval, &DsrVirtualQueueDisc::PeriodicSnapshot, this);
+}
+
+void
+DsrVirtualQueueDisc::CheckSnapshotThreshold (void)
+{
+  if (m_snapshotCallbacks.empty () || m_snapshotThreshold == 0)
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < DsrQueueSnapshot::N_LANES && i < GetNInternalQueues (); i++)
+    {
+      uint32_t length = GetInternalQueue (i)->GetCurrentSize ().GetValue ();
+      uint32_t moved = length > m_publishedLength[i] ? length - m_publishedLength[i] : m_publishedLength[i] - length;
+      if (moved >= m_snapshotThreshold)
+        {
+          PublishSnapshot ();
+          return;
+        }
+    }
+}
+
+void
+DsrVirtualQueueDisc::UpdateOccupancyEpoch (void)
+{
+  uint32_t fullLanes = 0;
+  for (uint32_t i = 0; i < DsrQueueSnapshot::N_LANES && i < GetNInternalQueues (); i++)
+    {
+      if (IsLaneFull (i))
+        {
+          fullLanes |= 1 << i;
+        }
+    }
+  if (fullLanes != m_fullLanes)
+    {
+      m_fullLanes = fullLanes;
+      m_occupancyEpoch++;
+    }
+}
+
+uint32_t
+DsrVirtualQueueDisc::GetOccupancyEpoch (void) const
+{
+  return m_occupancyEpoch;
+}
+
+uint32_t
+DsrVirtualQueueDisc::GetNAqmDrops (uint32_t lane) const
+{
+  return lane < m_aqm.size () ? m_aqm[lane].nDrops : 0;
+}
+
+uint32_t
+DsrVirtualQueueDisc::GetNAqmMarks (uint32_t lane) const
+{
+  return lane < m_aqm.size () ? m_aqm[lane].nMarks : 0;
+}
+
+uint32_t
+DsrVirtualQueueDisc::GetNLanes (void) const
+{
+  return GetNInternalQueues ();
+}
+
+bool
+DsrVirtualQueueDisc::IsLaneFull (uint32_t lane) const
+{
+  uint32_t nLanes = std::min<uint32_t> (GetNInternalQueues (), m_laneMaxPacket.size ());
+  if (nLanes == 0)
+    {
+      return false;
+    }
+  lane = std::min<uint32_t> (lane, nLanes - 1);
+  Ptr<InternalQueue> queue = GetInternalQueue (lane);
+  QueueSize limit = queue->GetMaxSize ();
+  if (limit.GetUnit () == QueueSizeUnit::PACKETS)
+    {
+      return queue->GetNPackets () + 1 >= limit.GetValue ();
+    }
+  return queue->GetNBytes () + std::max<uint32_t> (1, m_laneMaxPacket[lane]) >= limit.GetValue ();
+}
+
+void
+DsrVirtualQueueDisc::ActivateLane (uint32_t lane)
+{
+  m_activeLanes[(m_activeHead + m_nActive) % m_nLanes] = lane;
+  m_nActive++;
+  m_nonEmptyLanes |= 1 << lane;
+  m_deficit[lane] = 0;
+}
+
+void
+DsrVirtualQueueDisc::DeactivateLane (void)
+{
+  m_nonEmptyLanes &= ~(1 << m_activeLanes[m_activeHead]);
+  m_deficit[m_activeLanes[m_activeHead]] = 0;
+  m_activeHead = (m_activeHead + 1) % m_nLanes;
+  m_nActive--;
+  m_nextLane = NO_LANE;
+  m_turnStarted = false;
+}
+
+void
+DsrVirtualQueueDisc::RotateLanes (void)
+{
+  m_activeLanes[(m_activeHead + m_nActive) % m_nLanes] = m_activeLanes[m_activeHead];
+  m_activeHead = (m_activeHead + 1) % m_nLanes;
+  m_nextLane = NO_LANE;
+  m_turnStarted = false;
+}
+
+bool
+DsrVirtualQueueDisc::LaneFits (uint32_t lane, Ptr<const QueueDiscItem> item) const
+{
+  Ptr<InternalQueue> queue = GetInternalQueue (lane);
+  QueueSize limit = queue->GetMaxSize ();
+  if (limit.GetUnit () == QueueSizeUnit::PACKETS)
+    {
+      return queue->GetNPackets () + 1 <= limit.GetValue ();
+    }
+  return queue->GetNBytes () + item->GetSize () <= limit.GetValue ();
+}
 
 bool
 DsrVirtualQueueDisc::DoEnqueue (Ptr<QueueDiscItem> item)
 {
   NS_LOG_FUNCTION (this << item);
   uint32_t lane = EnqueueClassify (item);
-  // std::cout << "get current size : " << GetInternalQueue(lane)->GetCurrentSize ().GetValue() << std::endl;
-  if (GetInternalQueue(lane)->GetCurrentSize ().GetValue() >= LinesSize[lane])
-  {
-    DropBeforeEnqueue (item, LIMIT_EXCEEDED_DROP);
-  }
-  bool retval = GetInternalQueue (lane)->Enqueue (item);
+  Ptr<InternalQueue> queue = GetInternalQueue (lane);
+  if (!LaneFits (lane, item))
+    {
+      QueueSize limit = queue->GetMaxSize ();
+      if (!m_laneFlows[lane] || limit.GetValue () < (limit.GetUnit () == QueueSizeUnit::PACKETS ? 1 : item->GetSize ()))
+        {
+          NS_LOG_LOGIC ("Lane " << lane << " full, dropping " << item);
+          DropBeforeEnqueue (item, LIMIT_EXCEEDED_DROP);
+          return false;
+        }
+      // an fq lane makes room at the expense of its longest flow
+      Ptr<DsrFlowQueue> flows = StaticCast<DsrFlowQueue> (queue);
+      do
+        {
+          Ptr<QueueDiscItem> victim = flows->DequeueFromLongestFlow ();
+          NS_LOG_LOGIC ("Lane " << lane << " full, dropping " << victim << " of the longest flow");
+          if (lane == m_nextLane)
+            {
+              m_nextLane = NO_LANE;
+            }
+          DropAfterDequeue (victim, LIMIT_EXCEEDED_DROP);
+        }
+      while (!LaneFits (lane, item));
+    }
+  item->SetTimeStamp (Simulator::Now ());
+  bool retval = queue->Enqueue (item);
+  if (retval)
+    {
+      m_laneMaxPacket[lane] = std::max (m_laneMaxPacket[lane], item->GetSize ());
+      if (!(m_nonEmptyLanes & (1 << lane)))
+        {
+          ActivateLane (lane);
+        }
+      else if (lane == m_nextLane && m_laneDeadline[lane])
+        {
+          // the packet may go before the head of its edf lane
+          m_nextLane = NO_LANE;
+        }
+    }
+  UpdateOccupancyEpoch ();
+  CheckSnapshotThreshold ();
   return retval;
 }
 
@@ -66,20 +440,23 @@ DsrVirtualQueueDisc::DoDequeue (void)
 {
   NS_LOG_FUNCTION (this);
 
-  Ptr<QueueDiscItem> item;
-  uint32_t prio = Classify ();
-  if (prio == 88)
-  {
-    return 0;
-  }
-  if (item = GetInternalQueue (prio)->Dequeue ())
+  uint32_t lane = Classify ();
+  if (lane == NO_LANE)
+    {
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
+    }
+  Ptr<QueueDiscItem> item = GetInternalQueue (lane)->Dequeue ();
+  m_nextLane = NO_LANE;
+  m_deficit[lane] -= item->GetSize ();
+  if (GetInternalQueue (lane)->IsEmpty ())
     {
-      NS_LOG_LOGIC ("Popped from band " << prio << ": " << item);
-      NS_LOG_LOGIC ("Number packets band " << prio << ": " << GetInternalQueue (prio)->GetNPackets ());
-      // std::cout << "++++++ Current Queue length: " << GetInternalQueue (prio)->GetNPackets () << " at band: " << item <<  std::endl;
-      return item;
+      DeactivateLane ();
     }
-  NS_LOG_LOGIC ("Queue empty");
+  NS_LOG_LOGIC ("Popped from lane " << lane << ": " << item);
+  NS_LOG_LOGIC ("Number packets lane " << lane << ": " << GetInternalQueue (lane)->GetNPackets ());
+  UpdateOccupancyEpoch ();
+  CheckSnapshotThreshold ();
   return item;
 }
 
@@ -88,19 +465,14 @@ DsrVirtualQueueDisc::DoPeek (void)
 {
   NS_LOG_FUNCTION (this);
 
-  Ptr<const QueueDiscItem> item;
-
-  for (uint32_t i = 0; i < GetNInternalQueues (); i++)
+  uint32_t lane = Classify ();
+  if (lane == NO_LANE)
     {
-      if ((item = GetInternalQueue (i)->Peek ()) != 0)
-        {
-          NS_LOG_LOGIC ("Peeked from band " << i << ": " << item);
-          NS_LOG_LOGIC ("Number packets band " << i << ": " << GetInternalQueue (i)->GetNPackets ());
-          return item;
-        }
+      NS_LOG_LOGIC ("Queue empty");
+      return 0;
     }
-
-  NS_LOG_LOGIC ("Queue empty");
+  Ptr<const QueueDiscItem> item = GetInternalQueue (lane)->Peek ();
+  NS_LOG_LOGIC ("Peeked from lane " << lane << ": " << item);
   return item;
 }
 
@@ -121,42 +493,87 @@ DsrVirtualQueueDisc::CheckConfig (void)
       return false;
     }
   
+  std::vector<std::string> limits = SplitLaneList (m_laneLimits, m_nLanes);
+  std::vector<std::string> weights = SplitLaneList (m_laneWeights, m_nLanes);
+  std::vector<std::string> types = SplitLaneList (m_laneTypes, m_nLanes);
+  std::vector<std::string> aqms = SplitLaneList (m_laneAqms, m_nLanes);
+  if (limits.empty () || weights.empty () || types.empty () || aqms.empty ())
+    {
+      NS_LOG_ERROR ("DsrVirtualQueueDisc needs a limit, a weight, a type and an AQM per lane");
+      return false;
+    }
+
   if (GetNInternalQueues () == 0)
     {
-      // create 3 DropTail queues with GetLimit() packets each
-      ObjectFactory factory;
-      factory.SetTypeId ("ns3::DropTailQueue<QueueDiscItem>");
-      factory.Set ("MaxSize", QueueSizeValue (GetMaxSize ()));
-      AddInternalQueue (factory.Create<InternalQueue> ());
-      AddInternalQueue (factory.Create<InternalQueue> ());
-      AddInternalQueue (factory.Create<InternalQueue> ());
-      GetInternalQueue (0)->SetMaxSize (QueueSize ("12p"));
-      GetInternalQueue (1)->SetMaxSize (QueueSize ("36p"));
-      GetInternalQueue (2)->SetMaxSize (QueueSize ("60p"));
+      // create one queue per lane with the lane limit: DropTail for the
+      // fifo lanes, a calendar of deadlines for the edf lanes, flow
+      // buckets for the fq lanes
+      for (uint32_t i = 0; i < m_nLanes; i++)
+        {
+          ObjectFactory factory;
+          if (types[i] == "fifo")
+            {
+              factory.SetTypeId ("ns3::DropTailQueue<QueueDiscItem>");
+            }
+          else if (types[i] == "edf")
+            {
+              factory.SetTypeId ("ns3::DsrDeadlineQueue");
+              factory.Set ("BucketWidth", TimeValue (m_deadlineBucketWidth));
+              factory.Set ("Buckets", UintegerValue (m_deadlineBuckets));
+            }
+          else if (types[i] == "fq")
+            {
+              factory.SetTypeId ("ns3::DsrFlowQueue");
+              factory.Set ("Flows", UintegerValue (m_flowBuckets));
+            }
+          else
+            {
+              NS_LOG_ERROR ("DsrVirtualQueueDisc lane type " << types[i] << " is not fifo, edf or fq");
+              return false;
+            }
+          factory.Set ("MaxSize", QueueSizeValue (QueueSize (limits[i])));
+          AddInternalQueue (factory.Create<InternalQueue> ());
+        }
     }
 
-  if (GetNInternalQueues () != 3)
+  if (GetNInternalQueues () != m_nLanes)
     {
-      NS_LOG_ERROR ("DsrVirtualQueueDisc needs 3 internal queues");
+      NS_LOG_ERROR ("DsrVirtualQueueDisc needs one internal queue per lane");
       return false;
     }
 
-  if (GetInternalQueue (0)-> GetMaxSize ().GetUnit () != QueueSizeUnit::PACKETS ||
-      GetInternalQueue (1)-> GetMaxSize ().GetUnit () != QueueSizeUnit::PACKETS ||
-      GetInternalQueue (2)-> GetMaxSize ().GetUnit () != QueueSizeUnit::PACKETS)
+  // internal queues may also come from the helper
+  m_laneDeadline.resize (m_nLanes);
+  m_laneFlows.resize (m_nLanes);
+  for (uint32_t i = 0; i < m_nLanes; i++)
     {
-      NS_LOG_ERROR ("PfifoFastQueueDisc needs 3 internal queues operating in packet mode");
-      return false;
+      m_laneDeadline[i] = DynamicCast<DsrDeadlineQueue> (GetInternalQueue (i)) != 0;
+      m_laneFlows[i] = DynamicCast<DsrFlowQueue> (GetInternalQueue (i)) != 0;
     }
 
-  // for (uint8_t i = 0; i < 2; i++)
-  //   {
-  //     if (GetInternalQueue (i)->GetMaxSize () < GetMaxSize ())
-  //       {
-  //         NS_LOG_ERROR ("The capacity of some internal queue(s) is less than the queue disc capacity");
-  //         return false;
-  //       }
-  //   }
+  m_laneQuantum.resize (m_nLanes);
+  for (uint32_t i = 0; i < m_nLanes; i++)
+    {
+      std::istringstream iss (weights[i]);
+      uint32_t weight = 0;
+      if (!(iss >> weight) || weight == 0)
+        {
+          NS_LOG_ERROR ("DsrVirtualQueueDisc lane weights must be positive integers");
+          return false;
+        }
+      m_laneQuantum[i] = weight * m_quantum;
+    }
+
+  m_aqm.resize (m_nLanes);
+  for (uint32_t i = 0; i < m_nLanes; i++)
+    {
+      if (aqms[i] != "none" && aqms[i] != "codel")
+        {
+          NS_LOG_ERROR ("DsrVirtualQueueDisc lane AQM " << aqms[i] << " is not none or codel");
+          return false;
+        }
+      m_aqm[i].enabled = aqms[i] == "codel";
+    }
 
   return true;
 }
@@ -165,111 +582,163 @@ void
 DsrVirtualQueueDisc::InitializeParams (void)
 {
   NS_LOG_FUNCTION (this);
+  g_generation++;
+  m_deficit.assign (m_nLanes, 0);
+  m_laneMaxPacket.assign (m_nLanes, 0);
+  m_activeLanes.assign (m_nLanes, 0);
+  m_activeHead = 0;
+  m_nActive = 0;
+  m_nonEmptyLanes = 0;
+  m_nextLane = NO_LANE;
+  for (uint32_t i = 0; i < m_aqm.size (); i++)
+    {
+      m_aqm[i].dropping = false;
+      m_aqm[i].firstAboveTime = Time (0);
+      m_aqm[i].dropNext = Time (0);
+      m_aqm[i].count = 0;
+      m_aqm[i].lastCount = 0;
+      m_aqm[i].judged = 0;
+      m_aqm[i].nDrops = 0;
+      m_aqm[i].nMarks = 0;
+    }
+  m_turnStarted = false;
 }
 
 uint32_t
-DsrVirtualQueueDisc::Classify ()
+DsrVirtualQueueDisc::Classify (void)
 {
-  if (currentFastWeight > 0)
+  if (m_nextLane != NO_LANE)
     {
-      if (!GetInternalQueue (0)->IsEmpty ())
-        {
-          currentFastWeight--;
-          return 0;
-        }
-      else
-        {
-          currentFastWeight = 0;
-        }
+      return m_nextLane;
     }
-  if (currentSlowWeight > 0)
+  while (m_nonEmptyLanes != 0)
     {
-      if (!GetInternalQueue (1)->IsEmpty ())
+      uint32_t lane = m_activeLanes[m_activeHead];
+      Ptr<InternalQueue> queue = GetInternalQueue (lane);
+      Ptr<const QueueDiscItem> head = queue->Peek ();
+      if (m_laneDeadline[lane] && DsrDeadlineQueue::GetDeadline (head) < Simulator::Now ())
         {
-          currentSlowWeight--;
-          return 1;
+          // a packet past its deadline takes no link time
+          NS_LOG_LOGIC ("Deadline of " << head << " passed in lane " << lane);
+          Ptr<QueueDiscItem> item = queue->Dequeue ();
+          if (queue->IsEmpty ())
+            {
+              DeactivateLane ();
+            }
+          DropAfterDequeue (item, TIMEOUT_DROP);
+          UpdateOccupancyEpoch ();
+          CheckSnapshotThreshold ();
+          continue;
         }
-      else
+      if (m_aqm[lane].enabled && AqmDrop (lane, head))
         {
-          currentSlowWeight = 0;
+          if (m_useEcn && Mark (ConstCast<QueueDiscItem> (head), BUFFERBLOAT_MARK))
+            {
+              NS_LOG_LOGIC ("Marked " << head << " in lane " << lane);
+              m_aqm[lane].nMarks++;
+            }
+          else
+            {
+              NS_LOG_LOGIC ("Sojourn time of lane " << lane << " above target, dropping " << head);
+              m_aqm[lane].nDrops++;
+              Ptr<QueueDiscItem> item = queue->Dequeue ();
+              if (queue->IsEmpty ())
+                {
+                  DeactivateLane ();
+                }
+              DropAfterDequeue (item, BUFFERBLOAT_DROP);
+              UpdateOccupancyEpoch ();
+              CheckSnapshotThreshold ();
+              continue;
+            }
         }
-    }
-  if (currentNormalWeight > 0)
-    {
-      if (!GetInternalQueue (2)->IsEmpty ())
+      if (!m_turnStarted)
         {
-          currentNormalWeight--;
-          return 2;
+          m_deficit[lane] += m_laneQuantum[lane];
+          m_turnStarted = true;
         }
-      else
+      if (head->GetSize () <= m_deficit[lane])
         {
-          currentNormalWeight = 0;
+          m_nextLane = lane;
+          return lane;
         }
+      // the head packet does not fit: keep the deficit for the next round
+      RotateLanes ();
     }
-  currentFastWeight = m_fastWeight;
-  currentSlowWeight = m_slowWeight;
-  currentNormalWeight = m_normalWeight;
-  
-   if (currentFastWeight > 0)
+  return NO_LANE;
+}
+
+// CoDel control law: the next drop comes interval / sqrt (count) after t.
+static Time
+AqmControlLaw (Time t, Time interval, uint32_t count)
+{
+  return t + NanoSeconds ((uint64_t) (interval.GetNanoSeconds () / std::sqrt ((double) count)));
+}
+
+bool
+DsrVirtualQueueDisc::AqmDrop (uint32_t lane, Ptr<const QueueDiscItem> head)
+{
+  LaneAqm &aqm = m_aqm[lane];
+  if (head == aqm.judged)
     {
-      if (!GetInternalQueue (0)->IsEmpty ())
-        {
-          currentFastWeight--;
-          return 0;
-        }
-      else
-        {
-          currentFastWeight = 0;
-        }
+      return false;
     }
-  if (currentSlowWeight > 0)
+  aqm.judged = head;
+
+  Time now = Simulator::Now ();
+  Ptr<InternalQueue> queue = GetInternalQueue (lane);
+  bool okToDrop = false;
+  if (now - head->GetTimeStamp () < m_aqmTarget || queue->GetNBytes () <= m_laneMaxPacket[lane])
     {
-      if (!GetInternalQueue (1)->IsEmpty ())
-        {
-          currentSlowWeight--;
-          return 1;
-        }
-      else
-        {
-          currentSlowWeight = 0;
-        }
+      // below target, or a single packet left: nothing standing
+      aqm.firstAboveTime = Time (0);
+    }
+  else if (aqm.firstAboveTime.IsZero ())
+    {
+      aqm.firstAboveTime = now + m_aqmInterval;
+    }
+  else
+    {
+      okToDrop = now >= aqm.firstAboveTime;
     }
-  if (currentNormalWeight > 0)
+
+  if (aqm.dropping)
     {
-      if (!GetInternalQueue (2)->IsEmpty ())
+      if (!okToDrop)
         {
-          currentNormalWeight--;
-          return 2;
+          aqm.dropping = false;
+          return false;
         }
-      else
+      if (now < aqm.dropNext)
         {
-          currentNormalWeight = 0;
+          return false;
         }
+      aqm.count++;
+      aqm.dropNext = AqmControlLaw (aqm.dropNext, m_aqmInterval, aqm.count);
+      return true;
+    }
+  if (!okToDrop)
+    {
+      return false;
     }
-  return 88;
-}   
+  // enter the dropping state, resuming the drop rate if it was left recently
+  aqm.dropping = true;
+  uint32_t delta = aqm.count - aqm.lastCount;
+  aqm.count = delta > 1 && (now - aqm.dropNext).GetNanoSeconds () < 16 * m_aqmInterval.GetNanoSeconds () ? delta : 1;
+  aqm.lastCount = aqm.count;
+  aqm.dropNext = AqmControlLaw (now, m_aqmInterval, aqm.count);
+  return true;
+}
 
 uint32_t
 DsrVirtualQueueDisc::EnqueueClassify (Ptr<QueueDiscItem> item)
 {
-  PriorityTag priorityTag;
-  if (item->GetPacket ()->PeekPacketTag (priorityTag))
-    {
-      uint32_t priority = priorityTag.GetPriority ();
-      switch (priority)
-      {
-      case 0x00:
-        return FAST_LANE;
-      case 0x01:
-        return SLOW_LANE;
-      default:
-        return NORMAL_LANE;
-      }
-    }
-  else
+  DsrTag dsrTag;
+  if (item->GetPacket ()->PeekPacketTag (dsrTag))
     {
-      return NORMAL_LANE;
+      return std::min<uint32_t> (dsrTag.GetPriority (), m_nLanes - 1);
     }
-
+  return m_nLanes - 1;
 }
-} // namespace ns3
\ No newline at end of file
+
+} // namespace ns3
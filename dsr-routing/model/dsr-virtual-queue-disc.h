@@ -2,10 +2,58 @@
 #ifndef DSR_VIRTUAL_QUEUE_DISC_H
 #define DSR_VIRTUAL_QUEUE_DISC_H
 
+#include <string>
+#include <vector>
 #include "ns3/queue-disc.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/callback.h"
 
 namespace ns3 {
 
+class DsrVirtualQueueDisc;
+
+/**
+ * \brief Lane occupancy of a DsrVirtualQueueDisc at one instant, as
+ * published to the routers adjacent to it.
+ */
+struct DsrQueueSnapshot
+{
+  static const uint32_t N_LANES = 8;    //!< most lanes described
+
+  /**
+   * \brief Check whether a lane can take at most one more packet.
+   *
+   * Lanes past the last one of the queue disc share the state of the last
+   * lane, which is where their packets are classified.  A snapshot with
+   * no lanes has no full lane.
+   *
+   * \param lane the lane index
+   * \return true if the lane was full or within one packet of being full
+   */
+  bool IsLaneFull (uint32_t lane) const
+  {
+    if (nLanes == 0)
+      {
+        return false;
+      }
+    if (lane >= nLanes)
+      {
+        lane = nLanes - 1;
+      }
+    return laneLength[lane] + laneStep[lane] >= laneLimit[lane];
+  }
+
+  const DsrVirtualQueueDisc *queue;     //!< the queue disc described
+  Time timestamp;                       //!< when the snapshot was taken
+  uint32_t nBytes;                      //!< bytes queued in the queue disc
+  uint32_t occupancyEpoch;              //!< occupancy epoch of the queue disc, see GetOccupancyEpoch
+  uint32_t nLanes;                      //!< number of lanes of the queue disc
+  uint32_t laneLength[N_LANES];         //!< occupancy of each lane, in the unit of its limit
+  uint32_t laneLimit[N_LANES];          //!< capacity of each lane, in packets or bytes
+  uint32_t laneStep[N_LANES];           //!< size of one more packet in each lane, in the unit of its limit
+};
+
 class DsrVirtualQueueDisc : public QueueDisc {
 public:
   /**
@@ -14,9 +62,9 @@ public:
    */
   static TypeId GetTypeId (void);
   /**
-   * \brief PfifoFastQueueDisc constructor
+   * \brief DsrVirtualQueueDisc constructor
    *
-   * Creates a queue with a depth of 1000 packets per band by default
+   * Creates three lanes of 12, 36 and 60 packets by default
    */
   DsrVirtualQueueDisc ();
 
@@ -24,28 +72,214 @@ public:
 
   // Reasons for dropping packets
   static constexpr const char* LIMIT_EXCEEDED_DROP = "Queue disc limit exceeded";  //!< Packet dropped due to queue disc limit exceeded
-  static constexpr const char* TIMEOUT_DROP = "time out !!!!!!!!";
-  static constexpr const char* BUFFERBLOAT_DROP = "Buffer bloat !!!!!!!!";
+  static constexpr const char* TIMEOUT_DROP = "time out !!!!!!!!";  //!< Packet of an edf lane dropped at dequeue, past its deadline
+  static constexpr const char* BUFFERBLOAT_DROP = "Buffer bloat !!!!!!!!";  //!< Packet dropped by the AQM of its lane
+  static constexpr const char* BUFFERBLOAT_MARK = "Buffer bloat mark";  //!< Packet marked by the AQM of its lane
+
+  /**
+   * \brief Check whether a lane can take at most one more packet.
+   *
+   * Lanes past the last one share the state of the last lane, which is
+   * where their packets are classified.  In a lane limited in bytes, one
+   * packet is the largest packet that lane has seen.  No lane is full
+   * before the queue disc has been initialized.
+   *
+   * \param lane the lane (internal queue) index
+   * \return true if the lane is full or within one packet of being full
+   */
+  bool IsLaneFull (uint32_t lane) const;
+
+  /**
+   * \return the number of lanes (internal queues) of the queue disc
+   */
+  uint32_t GetNLanes (void) const;
+
+  /// Callback invoked with each published snapshot
+  typedef Callback<void, const DsrQueueSnapshot &> SnapshotCallback;
+
+  /**
+   * \brief Subscribe to the snapshots of this queue disc.
+   *
+   * The callback is invoked once right away with the current state, then
+   * every SnapshotInterval and, if SnapshotThreshold is set, whenever a
+   * lane length moves by that much since the last publication.  Subscribing the
+   * same callback twice has no effect.
+   *
+   * \param cb the callback
+   */
+  void AddSnapshotCallback (SnapshotCallback cb);
+
+  /**
+   * \brief Unsubscribe a callback added with AddSnapshotCallback.
+   * \param cb the callback
+   */
+  void RemoveSnapshotCallback (SnapshotCallback cb);
+
+  /**
+   * \return the current lane occupancy of the queue disc, with no lanes
+   *         before the queue disc has been initialized
+   */
+  DsrQueueSnapshot GetSnapshot (void) const;
+
+  /**
+   * \brief Get the occupancy epoch of the queue disc.
+   *
+   * The epoch changes every time a lane becomes full or stops being full
+   * (in the sense of IsLaneFull), so a decision taken from the lane states
+   * stays valid as long as the epoch has not changed.
+   *
+   * \return the occupancy epoch
+   */
+  uint32_t GetOccupancyEpoch (void) const;
+
+  /**
+   * \brief Get the generation of the DSR queue discs of the simulation.
+   *
+   * The generation changes every time a DsrVirtualQueueDisc is initialized
+   * or disposed, so that the objects caching handles to queue discs can
+   * tell when to look them up again.
+   *
+   * \return the generation
+   */
+  static uint32_t GetGeneration (void);
+
+  /**
+   * \param lane the lane index
+   * \return the packets the AQM of the lane has dropped
+   */
+  uint32_t GetNAqmDrops (uint32_t lane) const;
+
+  /**
+   * \param lane the lane index
+   * \return the packets the AQM of the lane has marked instead of dropping
+   */
+  uint32_t GetNAqmMarks (uint32_t lane) const;
+
+protected:
+  virtual void DoDispose (void);
 
 private:
-  // packet size = 1kB
-  // packet size for test = 52B
-  uint32_t LinesSize[3] = {12,36,100};
-  uint32_t m_fastWeight = 10;
-  uint32_t m_slowWeight = 3;
-  uint32_t m_normalWeight = 2;
-
-  uint32_t currentFastWeight = 0;
-  uint32_t currentSlowWeight = 0;
-  uint32_t currentNormalWeight = 0;
+  /// Lane index returned by Classify when every lane is empty
+  static const uint32_t NO_LANE = 0xffffffff;
+
+  /// Append a lane to the back of the round robin
+  void ActivateLane (uint32_t lane);
+  /// Remove the lane at the front of the round robin
+  void DeactivateLane (void);
+  /// Move the lane at the front of the round robin to the back
+  void RotateLanes (void);
+
+  uint32_t m_nLanes;                        //!< number of lanes
+  std::string m_laneLimits;                 //!< per-lane limits, as given to the LaneLimits attribute
+  std::string m_laneWeights;                //!< per-lane weights, as given to the LaneWeights attribute
+  std::string m_laneTypes;                  //!< per-lane orders, as given to the LaneTypes attribute
+  Time m_deadlineBucketWidth;               //!< calendar slot width of the edf lanes
+  uint32_t m_deadlineBuckets;               //!< calendar buckets of the edf lanes
+  std::vector<bool> m_laneDeadline;         //!< whether each lane is an edf lane
+  uint32_t m_flowBuckets;                   //!< flow buckets of the fq lanes
+  std::vector<bool> m_laneFlows;            //!< whether each lane is an fq lane
+
+  /**
+   * \param lane the lane index
+   * \param item a packet
+   * \return true if the packet fits in the lane without exceeding its limit
+   */
+  bool LaneFits (uint32_t lane, Ptr<const QueueDiscItem> item) const;
+
+  /// CoDel state of a lane
+  struct LaneAqm
+  {
+    bool enabled;                           //!< whether the lane runs CoDel
+    bool dropping;                          //!< whether the lane is in the dropping state
+    Time firstAboveTime;                    //!< when the sojourn time may stay above target for an interval, 0 if below target
+    Time dropNext;                          //!< next drop while dropping
+    uint32_t count;                         //!< drops since entering the dropping state
+    uint32_t lastCount;                     //!< count when the dropping state was last entered
+    Ptr<const QueueDiscItem> judged;        //!< last head the AQM decided about
+    uint32_t nDrops;                        //!< packets dropped by the AQM
+    uint32_t nMarks;                        //!< packets marked by the AQM
+  };
+
+  /**
+   * \brief Run the AQM of a lane on its head packet.
+   *
+   * CoDel (RFC 8289): once the sojourn time of the head packets has stayed
+   * above AqmTarget for AqmInterval, the lane drops a packet, then drops
+   * again at intervals shrinking as the inverse square root of the drops
+   * until the sojourn time falls below the target.  A head packet is only
+   * judged once, however many times Classify looks at it.
+   *
+   * \param lane the lane index
+   * \param head the head packet of the lane
+   * \return true if the packet must be marked or dropped
+   */
+  bool AqmDrop (uint32_t lane, Ptr<const QueueDiscItem> head);
+
+  std::string m_laneAqms;                   //!< per-lane AQMs, as given to the LaneAqm attribute
+  Time m_aqmTarget;                         //!< CoDel sojourn time target
+  Time m_aqmInterval;                       //!< CoDel interval
+  bool m_useEcn;                            //!< mark ECN capable packets instead of dropping them
+  std::vector<LaneAqm> m_aqm;               //!< CoDel state of each lane
+  uint32_t m_quantum;                       //!< bytes a lane may send per round and unit of weight
+  std::vector<uint32_t> m_laneQuantum;      //!< bytes each lane may send per round
+  std::vector<uint32_t> m_deficit;          //!< bytes each lane may still send this round
+  std::vector<uint32_t> m_laneMaxPacket;    //!< largest packet seen by each lane, in bytes
+  std::vector<uint32_t> m_activeLanes;      //!< ring of the non-empty lanes, in service order
+  uint32_t m_activeHead;                    //!< index of the lane being served in m_activeLanes
+  uint32_t m_nActive;                       //!< number of lanes in m_activeLanes
+  uint32_t m_nonEmptyLanes;                 //!< bit i set if lane i is in m_activeLanes
+  uint32_t m_nextLane;                      //!< lane picked by Classify until dequeued from, or NO_LANE
+  bool m_turnStarted;                       //!< whether the lane being served got its quantum
+
+  /// Publish a snapshot to every subscriber
+  void PublishSnapshot (void);
+  /// Publish a snapshot and schedule the next periodic one
+  void PeriodicSnapshot (void);
+  /// Publish a snapshot if a lane moved by more than the threshold
+  void CheckSnapshotThreshold (void);
+  /// Advance the occupancy epoch if a lane became full or stopped being full
+  void UpdateOccupancyEpoch (void);
+
+  Time m_snapshotInterval;                              //!< period of the snapshots, 0 to disable
+  uint32_t m_snapshotThreshold;                         //!< lane length change triggering a snapshot, 0 to disable
+  std::vector<SnapshotCallback> m_snapshotCallbacks;    //!< subscribers
+  uint32_t m_publishedLength[DsrQueueSnapshot::N_LANES]; //!< lane lengths in the last snapshot
+  EventId m_snapshotEvent;                              //!< next periodic snapshot
+  uint32_t m_occupancyEpoch;                            //!< see GetOccupancyEpoch
+  uint32_t m_fullLanes;                                 //!< bit i set if lane i is full
   virtual bool DoEnqueue (Ptr<QueueDiscItem> item);
   virtual Ptr<QueueDiscItem> DoDequeue (void);
   // virtual void DoPrioDequeue (void);
   virtual Ptr<const QueueDiscItem> DoPeek (void);
   virtual bool CheckConfig (void);
   virtual void InitializeParams (void);
-  virtual uint32_t Classify (); 
-  virtual uint32_t EnqueueClassify (Ptr<QueueDiscItem> item);
+  /**
+   * \brief Pick the lane whose head packet is sent next.
+   *
+   * Deficit round robin over the non-empty lanes: the lane at the front of
+   * the round gets its quantum once per turn and keeps the link while its
+   * head packet fits in its deficit.  Each call touches only the lanes
+   * whose turn ends, so it is O(1) as long as the quanta are not smaller
+   * than the packets.  The packets of the edf lanes found past their
+   * deadline on the way are dropped, and so are the packets the AQM of
+   * their lane drops.
+   *
+   * The lane picked is cached until a packet is dequeued from it, so that
+   * DoPeek and DoDequeue, which both start from it, see the same packet.
+   *
+   * \return the lane index, or NO_LANE if every lane is empty
+   */
+  uint32_t Classify (void);
+  /**
+   * \brief Pick the lane of a packet from its DsrTag priority.
+   *
+   * Priority p goes to lane p, untagged packets and priorities past the
+   * last lane go to the last lane.
+   *
+   * \param item the packet
+   * \return the lane index
+   */
+  uint32_t EnqueueClassify (Ptr<QueueDiscItem> item);
 };
 
 }
@@ -14,6 +14,8 @@ NS_LOG_COMPONENT_DEFINE ("Ipv4DSRRoutingTableEntry");
  *****************************************************/
 
 Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry ()
+  : m_loopFree (false),
+    m_via (Ipv4Address::GetZero ())
 {
   NS_LOG_FUNCTION (this);
 }
@@ -27,7 +29,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4DSRRoutingTableEntry con
     m_destNetworkMask (route.m_destNetworkMask),
     m_gateway (route.m_gateway),
     m_interface (route.m_interface),
-    m_distance (route.m_distance)
+    m_distance (route.m_distance),
+    m_loopFree (route.m_loopFree),
+    m_via (route.m_via)
 {
   NS_LOG_FUNCTION (this << route);
 }
@@ -37,7 +41,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4DSRRoutingTableEntry con
     m_destNetworkMask (route->m_destNetworkMask),
     m_gateway (route->m_gateway),
     m_interface (route->m_interface),
-    m_distance (route->m_distance)
+    m_distance (route->m_distance),
+    m_loopFree (route->m_loopFree),
+    m_via (route->m_via)
 {
   NS_LOG_FUNCTION (this << route);
 }
@@ -49,7 +55,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address dest,
     m_destNetworkMask (Ipv4Mask::GetOnes ()),
     m_gateway (gateway),
     m_interface (interface),
-    m_distance (MAX_UINT32)
+    m_distance (MAX_UINT32),
+    m_loopFree (false),
+    m_via (Ipv4Address::GetZero ())
 {
 }
 Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address dest,
@@ -58,7 +66,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address dest,
     m_destNetworkMask (Ipv4Mask::GetOnes ()),
     m_gateway (Ipv4Address::GetZero ()),
     m_interface (interface),
-    m_distance (MAX_UINT32)
+    m_distance (MAX_UINT32),
+    m_loopFree (false),
+    m_via (Ipv4Address::GetZero ())
 {
 }
 Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address network,
@@ -69,7 +79,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address network,
     m_destNetworkMask (networkMask),
     m_gateway (gateway),
     m_interface (interface),
-    m_distance (MAX_UINT32)
+    m_distance (MAX_UINT32),
+    m_loopFree (false),
+    m_via (Ipv4Address::GetZero ())
 {
   NS_LOG_FUNCTION (this << network << networkMask << gateway << interface);
 }
@@ -80,7 +92,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address network,
     m_destNetworkMask (networkMask),
     m_gateway (Ipv4Address::GetZero ()),
     m_interface (interface),
-    m_distance (MAX_UINT32)
+    m_distance (MAX_UINT32),
+    m_loopFree (false),
+    m_via (Ipv4Address::GetZero ())
 {
   NS_LOG_FUNCTION (this << network << networkMask << interface);
 }
@@ -100,7 +114,9 @@ Ipv4DSRRoutingTableEntry::Ipv4DSRRoutingTableEntry (Ipv4Address dest,
     m_destNetworkMask (Ipv4Mask::GetOnes ()),
     m_gateway (gateway),
     m_interface (interface),
-    m_distance (distance)
+    m_distance (distance),
+    m_loopFree (false),
+    m_via (Ipv4Address::GetZero ())
 {
     // std::cout << "CreateNetworkRouteTo with distance" << distance << std::endl;
     NS_LOG_FUNCTION (this << dest << gateway << interface << distance);
@@ -196,6 +212,34 @@ Ipv4DSRRoutingTableEntry::GetDistance (void) const
   return m_distance;
 }
 
+bool
+Ipv4DSRRoutingTableEntry::IsLoopFreeAlternate (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_loopFree;
+}
+
+void
+Ipv4DSRRoutingTableEntry::SetLoopFreeAlternate (bool loopFree)
+{
+  NS_LOG_FUNCTION (this << loopFree);
+  m_loopFree = loopFree;
+}
+
+Ipv4Address
+Ipv4DSRRoutingTableEntry::GetVia (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_via;
+}
+
+void
+Ipv4DSRRoutingTableEntry::SetVia (Ipv4Address via)
+{
+  NS_LOG_FUNCTION (this << via);
+  m_via = via;
+}
+
 Ipv4DSRRoutingTableEntry 
 Ipv4DSRRoutingTableEntry::CreateHostRouteTo (Ipv4Address dest, 
                                           Ipv4Address nextHop,
@@ -74,6 +74,27 @@ public:
    * \return the distance 
   */
   uint32_t GetDistance (void) const;
+  /**
+   * \return true if the next hop of this host route does not forward its
+   * packets back through this node, so that it can take the traffic of a
+   * failed candidate
+   */
+  bool IsLoopFreeAlternate (void) const;
+  /**
+   * \param loopFree whether the next hop of this host route is a loop-free
+   * alternate
+   */
+  void SetLoopFreeAlternate (bool loopFree);
+  /**
+   * \return the next hop the gateway of this host route takes toward the
+   * destination, or 0.0.0.0 if it takes its own shortest route
+   */
+  Ipv4Address GetVia (void) const;
+  /**
+   * \param via the next hop of the gateway of this host route, 0.0.0.0
+   * for its own shortest route
+   */
+  void SetVia (Ipv4Address via);
 
   /**
    * \return An Ipv4RoutingTableEntry object corresponding to the input parameters.
@@ -189,6 +210,8 @@ private:
   Ipv4Address m_gateway;      //!< gateway
   uint32_t m_interface;       //!< output interface
   uint32_t m_distance;        //!< the distance between root and destination
+  bool m_loopFree;            //!< whether the next hop is a loop-free alternate
+  Ipv4Address m_via;          //!< next hop of the gateway, or 0.0.0.0
 };
 
 /**
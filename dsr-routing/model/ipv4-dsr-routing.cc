@@ -17,6 +17,7 @@
 //
 
 #include <vector>
+#include <algorithm>
 #include <iomanip>
 #include "ns3/names.h"
 #include "ns3/log.h"
@@ -29,14 +30,12 @@
 #include "ns3/ipv4-route.h"
 #include "ns3/ipv4-routing-table-entry.h"
 #include "ns3/boolean.h"
+#include "ns3/enum.h"
+#include "ns3/nstime.h"
 #include "ns3/node.h"
 #include "ipv4-dsr-routing.h"
 #include "dsr-route-manager.h"
-#include "budget-tag.h"
-#include "flag-tag.h"
-#include "timestamp-tag.h"
-#include "priority-tag.h"
-#include "dist-tag.h"
+#include "dsr-tag.h"
 #include "ns3/point-to-point-module.h"
 #include "ns3/ipv4-list-routing.h"
 #include "dsr-virtual-queue-disc.h"
@@ -47,6 +46,16 @@ NS_LOG_COMPONENT_DEFINE ("Ipv4DSRRouting");
 
 NS_OBJECT_ENSURE_REGISTERED (Ipv4DSRRouting);
 
+// Bumped whenever a DSR routing protocol is disposed
+static uint32_t g_routingGeneration = 0;
+
+// Generation of the objects the adjacency records hold handles to
+static uint64_t
+HandleGeneration (void)
+{
+  return ((uint64_t) DsrVirtualQueueDisc::GetGeneration () << 32) | g_routingGeneration;
+}
+
 TypeId 
 Ipv4DSRRouting::GetTypeId (void)
 { 
@@ -64,13 +73,58 @@ Ipv4DSRRouting::GetTypeId (void)
                    BooleanValue (false),
                    MakeBooleanAccessor (&Ipv4DSRRouting::m_respondToInterfaceEvents),
                    MakeBooleanChecker ())
+    .AddAttribute ("FastFailover",
+                   "Set to true to take the routes through an interface out of the table as soon as it goes down, so that the packets take the remaining candidates and loop-free alternates, and to put them back when it comes up",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_fastFailover),
+                   MakeBooleanChecker ())
+    .AddAttribute ("FailoverRecomputeDelay",
+                   "With RespondToInterfaceEvents, how long after an interface goes down the global routes are recomputed; the loop-free alternates carry the traffic meanwhile (0 to recompute at once)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_failoverRecomputeDelay),
+                   MakeTimeChecker (Seconds (0)))
+    .AddAttribute ("QueueStateSnapshots",
+                   "Set to true to take the lookahead decisions from the snapshots published by the neighbors' DsrVirtualQueueDisc instead of reading their queues directly",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&Ipv4DSRRouting::m_queueSnapshots),
+                   MakeBooleanChecker ())
+    .AddAttribute ("SnapshotStaleness",
+                   "Queue snapshots older than this are ignored, and the neighbor queue is then assumed not to be overloaded",
+                   TimeValue (MilliSeconds (10)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_snapshotStaleness),
+                   MakeTimeChecker ())
+    .AddAttribute ("CandidatePolicy",
+                   "How a DSR packet picks among the candidate routes that fit in its budget and whose queues can accept it",
+                   EnumValue (Ipv4DSRRouting::SHORTEST_FEASIBLE),
+                   MakeEnumAccessor (&Ipv4DSRRouting::m_candidatePolicy),
+                   MakeEnumChecker (Ipv4DSRRouting::SHORTEST_FEASIBLE, "ShortestFeasible",
+                                    Ipv4DSRRouting::MOST_SLACK, "MostSlack",
+                                    Ipv4DSRRouting::LEAST_LOADED, "LeastLoaded"))
+    .AddAttribute ("DecisionCacheTtl",
+                   "How long a forwarding decision is reused for the following packets to the same destination with a similar budget, with the ShortestFeasible policy only (0 to disable the cache)",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_decisionCacheTtl),
+                   MakeTimeChecker ())
+    .AddAttribute ("DecisionCacheBucket",
+                   "Width of the budget ranges that share a cached forwarding decision",
+                   TimeValue (MilliSeconds (1)),
+                   MakeTimeAccessor (&Ipv4DSRRouting::m_decisionCacheBucket),
+                   MakeTimeChecker (MicroSeconds (1)))
   ;
   return tid;
 }
 
 Ipv4DSRRouting::Ipv4DSRRouting () 
   : m_randomEcmpRouting (false),
-    m_respondToInterfaceEvents (false)
+    m_respondToInterfaceEvents (false),
+    m_fastFailover (false),
+    m_queueSnapshots (false),
+    m_candidatePolicy (SHORTEST_FEASIBLE),
+    m_decisionCacheHits (0),
+    m_decisionCacheMisses (0),
+    m_updating (false),
+    m_onDemand (false),
+    m_handleGeneration (0)
 {
   NS_LOG_FUNCTION (this);
 
@@ -88,9 +142,13 @@ Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
                                    uint32_t interface)
 {
   NS_LOG_FUNCTION (this << dest << nextHop << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface);
-  m_hostRoutes.push_back (route);
+  if (m_updating)
+    {
+      m_stagedHostRoutes.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface));
+      return;
+    }
+  m_hostRoutes.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface));
+  m_decisionCache.clear ();
 }
 
 void 
@@ -98,9 +156,13 @@ Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
                                    uint32_t interface)
 {
   NS_LOG_FUNCTION (this << dest << interface);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  *route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, interface);
-  m_hostRoutes.push_back (route);
+  if (m_updating)
+    {
+      m_stagedHostRoutes.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, interface));
+      return;
+    }
+  m_hostRoutes.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, interface));
+  m_decisionCache.clear ();
 }
 
 /**
@@ -120,10 +182,32 @@ Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
                        uint32_t distance)
 {
   NS_LOG_FUNCTION (this << dest << nextHop << interface << distance);
-  Ipv4DSRRoutingTableEntry *route = new Ipv4DSRRoutingTableEntry ();
-  // std::cout << "add host route with the distance = " << distance;
-  *route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo(dest, nextHop, interface, distance);
-  m_hostRoutes.push_back (route);
+  if (m_updating)
+    {
+      m_stagedHostRoutes.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface, distance));
+      return;
+    }
+  m_hostRoutes.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface, distance));
+  m_decisionCache.clear ();
+}
+
+void
+Ipv4DSRRouting::AddHostRouteTo (Ipv4Address dest,
+                                Ipv4Address nextHop,
+                                uint32_t interface,
+                                uint32_t distance,
+                                Ipv4Address via)
+{
+  NS_LOG_FUNCTION (this << dest << nextHop << interface << distance << via);
+  Ipv4DSRRoutingTableEntry route = Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, nextHop, interface, distance);
+  route.SetVia (via);
+  if (m_updating)
+    {
+      m_stagedHostRoutes.InsertUnique (route);
+      return;
+    }
+  m_hostRoutes.InsertUnique (route);
+  m_decisionCache.clear ();
 }
 
 
@@ -140,7 +224,7 @@ Ipv4DSRRouting::AddNetworkRouteTo (Ipv4Address network,
                                                         networkMask,
                                                         nextHop,
                                                         interface);
-  m_networkRoutes.push_back (route);
+  (m_updating ? m_stagedNetworkRoutes : m_networkRoutes).push_back (route);
 }
 
 void 
@@ -153,7 +237,7 @@ Ipv4DSRRouting::AddNetworkRouteTo (Ipv4Address network,
   *route = Ipv4DSRRoutingTableEntry::CreateNetworkRouteTo (network,
                                                         networkMask,
                                                         interface);
-  m_networkRoutes.push_back (route);
+  (m_updating ? m_stagedNetworkRoutes : m_networkRoutes).push_back (route);
 }
 
 void 
@@ -168,7 +252,7 @@ Ipv4DSRRouting::AddASExternalRouteTo (Ipv4Address network,
                                                         networkMask,
                                                         nextHop,
                                                         interface);
-  m_ASexternalRoutes.push_back (route);
+  (m_updating ? m_stagedASexternalRoutes : m_ASexternalRoutes).push_back (route);
 }
 
 
@@ -180,249 +264,363 @@ Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<NetDevice> oif)
   */
   NS_LOG_FUNCTION (this << dest << oif);
   NS_LOG_LOGIC ("Looking for route for destination " << dest);
-  Ptr<Ipv4Route> rtentry = 0;
-  // store all available routes that bring packets to their destination
-  typedef std::vector<Ipv4DSRRoutingTableEntry*> RouteVec_t;
-  RouteVec_t allRoutes;
-
-  NS_LOG_LOGIC ("Number of m_hostRoutes = " << m_hostRoutes.size ());
-  for (HostRoutesCI i = m_hostRoutes.begin (); 
-       i != m_hostRoutes.end (); 
-       i++) 
+  Ipv4Address key = GetRouteKey (dest);
+  uint32_t nRoutes;
+  const Ipv4DSRRoutingTableEntry *routes = m_hostRoutes.Lookup (key, nRoutes);
+  NS_LOG_LOGIC ("Number of candidate routes = " << nRoutes);
+  bool failedOver = nRoutes > 0 && m_hostRoutes.IsFailedOver (key);
+  const Ipv4DSRRoutingTableEntry *fallback = 0;
+  // candidates are sorted by distance, the first usable one is the shortest
+  for (uint32_t i = 0; i < nRoutes; i++)
     {
-      NS_ASSERT ((*i)->IsHost ());
-      if ((*i)->GetDest () == dest)
+      const Ipv4DSRRoutingTableEntry *route = &routes[i];
+      NS_ASSERT (route->IsHost ());
+      if (oif != 0 && oif != m_ipv4->GetNetDevice (route->GetInterface ()))
         {
-          if (oif != 0)
-            {
-              if (oif != m_ipv4->GetNetDevice ((*i)->GetInterface ()))
-                {
-                  NS_LOG_LOGIC ("Not on requested interface, skipping");
-                  continue;
-                }
-            }
-          allRoutes.push_back (*i);
-          NS_LOG_LOGIC (allRoutes.size () << "Found dsr host route" << *i); 
+          NS_LOG_LOGIC ("Not on requested interface, skipping");
+          continue;
         }
-    }
-  if (allRoutes.size () > 0 ) // if route(s) is found
-    {
-      uint32_t routRef = 0;
-      uint32_t shortestDist = allRoutes.at(0)->GetDistance ();
-      for (uint32_t i = 0; i < allRoutes.size (); i ++)
-      {
-        if (allRoutes.at (i)->GetDistance () <  shortestDist)
+      if (failedOver && !route->IsLoopFreeAlternate ())
         {
-          routRef = i;
+          // the shortest candidates went down with a local interface, and
+          // the next hop of this one may send the packet back
+          fallback = fallback != 0 ? fallback : route;
+          continue;
         }
-      }
-      Ipv4DSRRoutingTableEntry* route = allRoutes.at (routRef);
-
-      // create a Ipv4Route object from the selected routing table entry
-      rtentry = Create<Ipv4Route> ();
-      rtentry->SetDestination (route->GetDest ());
-      /// \todo handle multi-address case
-      rtentry->SetSource (m_ipv4->GetAddress (route->GetInterface (), 0).GetLocal ());
-      rtentry->SetGateway (route->GetGateway ());
-      uint32_t interfaceIdx = route->GetInterface ();
-      rtentry->SetOutputDevice (m_ipv4->GetNetDevice (interfaceIdx));
-      return rtentry;
+      NS_LOG_LOGIC ("Found dsr host route " << route->GetGateway () << " with Cost: " << route->GetDistance ());
+      return CreateRoute (route, dest);
     }
-  else 
+  return fallback != 0 ? CreateRoute (fallback, dest) : 0;
+}
+
+Ptr<Ipv4Route>
+Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice> oif)
+{
+  NS_LOG_FUNCTION (this << dest << p << oif);
+  DsrTag dsrTag;
+  if (!p->PeekPacketTag (dsrTag))
     {
+      NS_LOG_INFO ("No Tags in the packet");
       return 0;
     }
+  Ptr<Ipv4Route> rtentry = LookupDSRRoute (dest, dsrTag, oif);
+  if (rtentry != 0)
+    {
+      p->ReplacePacketTag (dsrTag);
+    }
+  return rtentry;
 }
 
 Ptr<Ipv4Route>
-Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice> oif)
+Ipv4DSRRouting::LookupDSRRoute (Ipv4Address dest, DsrTag &dsrTag, Ptr<NetDevice> oif)
 {
   /**
    * Lookup a Route to forward the DSR packets.
   */
   NS_LOG_FUNCTION (this << dest << oif);
   NS_LOG_LOGIC ("Looking for route for destination " << dest);
-  Ptr<Ipv4Route> rtentry = 0;
-  // store all available routes that bring packets to their destination
-  typedef std::vector<Ipv4DSRRoutingTableEntry*> RouteVec_t;
-  RouteVec_t allRoutes;
+  Ipv4Address routeKey = GetRouteKey (dest);
+  uint32_t nRoutes;
+  const Ipv4DSRRoutingTableEntry *routes = m_hostRoutes.Lookup (routeKey, nRoutes);
+  NS_LOG_LOGIC ("Number of candidate routes = " << nRoutes);
+  if (nRoutes == 0)
+    {
+      return 0;
+    }
+
+  // remaining budget, in Microseconds
+  int64_t remaining = dsrTag.GetMicroSeconds () + dsrTag.GetBudget () - Simulator::Now ().GetMicroSeconds ();
+  // Time out drop
+  if (remaining < 0)
+    {
+      NS_LOG_INFO ("TIMEOUT DROP !!!");
+      return 0;
+    }
+  uint32_t budget = remaining;
+  if (dsrTag.HasDistance ())
+    {
+      uint32_t dist = dsrTag.GetDistance ();
+      budget = (budget < dist)? budget : dist;
+    }
 
-  NS_LOG_LOGIC ("Number of m_hostRoutes = " << m_hostRoutes.size ());
-  for (HostRoutesCI i = m_hostRoutes.begin (); 
-       i != m_hostRoutes.end (); 
-       i++) 
+  bool useCache = m_decisionCacheTtl.IsStrictlyPositive () && oif == 0 && m_candidatePolicy == SHORTEST_FEASIBLE;
+  uint64_t key = 0;
+  if (useCache)
     {
-      NS_ASSERT ((*i)->IsHost ());
-      if ((*i)->GetDest () == dest)
+      key = ((uint64_t) routeKey.Get () << 32) | (budget / m_decisionCacheBucket.GetMicroSeconds ());
+      const Ipv4DSRRoutingTableEntry *route = LookupDecisionCache (key, routes, nRoutes, budget);
+      if (route != 0)
         {
-          if (oif != 0)
-            {
-              if (oif != m_ipv4->GetNetDevice ((*i)->GetInterface ()))
-                {
-                  NS_LOG_LOGIC ("Not on requested interface, skipping");
-                  continue;
-                }
-            }
-          allRoutes.push_back (*i);
-          NS_LOG_LOGIC (allRoutes.size () << "Found dsr host route" << *i << " with Cost: " << (*i)->GetDistance ()); 
-        }
-    }
-  if (allRoutes.size () > 0 ) // if route(s) is found
-    {
-      FlagTag flagTag;
-      BudgetTag budgetTag;
-      TimestampTag timestampTag;
-      if (!(p->PeekPacketTag (flagTag) 
-            && p->PeekPacketTag (budgetTag) 
-            && p->PeekPacketTag (timestampTag)))
-      {
-        NS_LOG_INFO ("No Tags in the packet");
-        return 0;
-      }
-      // Time out drop
-      if (budgetTag.GetBudget () + timestampTag.GetMicroSeconds () < Simulator::Now().GetMicroSeconds ())
-      {
-        NS_LOG_INFO ("TIMEOUT DROP !!!");
-        return 0;
-      }
-      uint32_t budget = budgetTag.GetBudget () + timestampTag.GetMicroSeconds () - Simulator::Now().GetMicroSeconds (); // in Microseconds
-      // std::cout << "print budget : " << budget << std::endl;
-      DistTag distTag;
-      RouteVec_t cRouts;
-      // p->PrintPacketTags (std::cout);
-      if (p->PeekPacketTag (distTag))
-      {
-        uint32_t dist = distTag.GetDistance ();
-        // std::cout << dist << std::endl;
-        budget = (budget < dist)? budget : dist;
-      }
-
-      for (uint32_t i = 0; i < allRoutes.size (); i ++)
-      {
-        if (allRoutes.at (i)->GetDistance () < budget)
-        {
-          // check queue status in current node
-          // Get the netdevice
-          Ptr <NetDevice> dev = m_ipv4->GetNetDevice (allRoutes.at (i)->GetInterface ());
-          //get the queue disc on the device
-          Ptr<QueueDisc> disc = m_ipv4->GetNetDevice (0)->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (dev);
-          Ptr<DsrVirtualQueueDisc> i_dvq = DynamicCast <DsrVirtualQueueDisc> (disc);
-          uint32_t i_fastSize = i_dvq->GetInternalQueue (0) ->GetCurrentSize ().GetValue ();
-          uint32_t i_slowSize = i_dvq->GetInternalQueue (1) ->GetCurrentSize ().GetValue ();
-          if (i_fastSize >= (i_dvq->GetInternalQueue (0)->GetMaxSize ().GetValue ()-1) 
-              || (i_slowSize >= i_dvq->GetInternalQueue (1)->GetMaxSize ().GetValue ()-1))
-            {
-              continue;
-            }
-          
-          Ptr<Channel> channel = dev->GetChannel ();
-          PointToPointChannel *p2pchannel = dynamic_cast <PointToPointChannel *> (PeekPointer (channel));
-          if (p2pchannel != 0)
-          {
-            Ptr<PointToPointNetDevice> d_Dev = p2pchannel->GetDestination (1);
-            Ptr<Node> d_node = d_Dev->GetNode ();
-            // find the out put route
-            Ptr<Ipv4> d_ipv4 = d_node->GetObject<Ipv4> ();
-            if (d_ipv4 != 0 && d_ipv4->GetRoutingProtocol () != 0)
-            {
-              Ptr<Ipv4Route> route;
-              if (d_ipv4->GetRoutingProtocol () != 0)
-              {
-                Ptr<Ipv4RoutingProtocol> routingProtocol = d_ipv4->GetRoutingProtocol ();
-                Ipv4ListRouting *listRoutingProtocol = dynamic_cast <Ipv4ListRouting *> (PeekPointer (routingProtocol));
-                if (listRoutingProtocol != 0)
-                {
-                  int16_t tempprio;
-                  int16_t  *ptr = &tempprio;
-                  Ptr <Ipv4RoutingProtocol> rpt = listRoutingProtocol->GetRoutingProtocol (0, *ptr);
-                  // dynamic_cast routing protocol to Ipv4DSRRouting
-                  Ipv4DSRRouting *dsrRoutingProtocol = dynamic_cast <Ipv4DSRRouting *> (PeekPointer (rpt));
-                  if (dsrRoutingProtocol != 0)
-                  {
-                    route = dsrRoutingProtocol->LookupDSRRoute (dest, oif);
-                    if (route != 0)
-                    {
-                      Ptr<NetDevice> o_dev = route->GetOutputDevice ();
-                      Ptr<QueueDisc> o_disc = o_dev->GetNode ()->GetObject<TrafficControlLayer> ()->GetRootQueueDiscOnDevice (o_dev);
-                      Ptr<DsrVirtualQueueDisc> o_dvq = DynamicCast <DsrVirtualQueueDisc> (o_disc);
-                      // std::cout << "queue disc name : " << o_dvq->GetTypeId ().GetName () << std::endl;
-                      if (o_dvq != 0)
-                      {
-                        uint32_t o_fastSize = o_dvq->GetInternalQueue (0) ->GetCurrentSize ().GetValue ();
-                        uint32_t o_slowSize = o_dvq->GetInternalQueue (1) ->GetCurrentSize ().GetValue ();
-                        // std::cout << "current size : " << o_dvq->GetInternalQueue (0)->GetMaxSize ().GetValue () << std::endl;
-                        // uint32_t o_normalSize = o_dvq->GetInternalQueue (2) ->GetCurrentSize ().GetValue ();
-                        cRouts.push_back (allRoutes.at (i));
-                        if (o_fastSize < (o_dvq->GetInternalQueue (0)->GetMaxSize ().GetValue ()-1) || o_slowSize < (o_dvq->GetInternalQueue (1)->GetMaxSize ().GetValue ()-1))
-                        {
-                          cRouts.push_back (allRoutes.at (i));
-                        }
-                        else
-                        {
-                          std::cout << "route overloaded" << std::endl;
-                        }
-                      }
-                      else
-                      {
-                        NS_LOG_INFO ("Could not find the DSRVirtualQueue, drop this route.");
-                      }
-                    }
-                  }
-                  
-                }
-              }
-            }
-          }
-        }
-      }
-      if (cRouts.size () > 0)
-      {
-        uint32_t routRef = 0;
-        uint32_t shortestDist = cRouts.at(0)->GetDistance ();
-        for (uint32_t i = 0; i < cRouts.size (); i ++)
-        {
-          if (cRouts.at (i)->GetDistance () <  shortestDist)
-          {
-            routRef = i;
-          }
-        }
-        Ipv4DSRRoutingTableEntry* route = cRouts.at (routRef);
-        DistTag distTag;
-        p->PeekPacketTag (distTag);
-        distTag.SetDistance (route->GetDistance ());
-        p->ReplacePacketTag (distTag);
-
-        PriorityTag priorityTag;
-        p->PeekPacketTag (priorityTag);
-        uint32_t bgt = budgetTag.GetBudget () + timestampTag.GetMicroSeconds () - Simulator::Now().GetMicroSeconds ();
-        if (bgt > (route->GetDistance () + 10))
-          {
-            priorityTag.SetPriority (1);
-          }
-        else
-          {
-            priorityTag.SetPriority (0);
-          }
-        p->ReplacePacketTag (priorityTag);
-        // create a Ipv4Route object from the selected routing table entry
-        rtentry = Create<Ipv4Route> ();
-        rtentry->SetDestination (route->GetDest ());
-        rtentry->SetSource (m_ipv4->GetAddress (route->GetInterface (), 0).GetLocal ());
-        rtentry->SetGateway (route->GetGateway ());
-        uint32_t interfaceIdx = route->GetInterface ();
-        rtentry->SetOutputDevice (m_ipv4->GetNetDevice (interfaceIdx));
-        return rtentry;
-      }
+          m_decisionCacheHits++;
+          return SelectRoute (route, dest, remaining, dsrTag);
+        }
+      m_decisionCacheMisses++;
+    }
+  CachedDecision decision;
+  decision.nProbes = 0;
+  CachedDecision *probes = useCache ? &decision : 0;
+
+  // candidates are sorted by distance: only the ones before the cutoff fit
+  // in the budget
+  uint32_t cutoff = std::lower_bound (routes, routes + nRoutes, budget, CompareDistance) - routes;
+  NS_LOG_LOGIC ("Candidates within budget = " << cutoff);
+  const Ipv4DSRRoutingTableEntry *route = 0;
+  uint64_t best = 0;
+  for (uint32_t i = 0; i < cutoff; i++)
+    {
+      if (route != 0 && m_candidatePolicy == MOST_SLACK && routes[i].GetDistance () >= best)
+        {
+          // the queueing delay is never negative, no longer candidate can
+          // leave more slack
+          break;
+        }
+      const Adjacency *adj = GetFeasibleAdjacency (dest, routes[i], oif, probes);
+      if (adj == 0)
+        {
+          continue;
+        }
+      if (m_candidatePolicy == SHORTEST_FEASIBLE)
+        {
+          route = &routes[i];
+          break;
+        }
+      uint64_t cost;
+      if (m_candidatePolicy == MOST_SLACK)
+        {
+          // the slack left is budget - cost
+          cost = routes[i].GetDistance () + EstimateQueueDelay (*adj);
+        }
       else
-      {
-        NS_LOG_INFO ("No Route available");
-        return 0;
-      }
+        {
+          cost = adj->localQueue != 0 ? adj->localQueue->GetNBytes () : 0;
+        }
+      if (route == 0 || cost < best)
+        {
+          route = &routes[i];
+          best = cost;
+        }
+      if (m_candidatePolicy == LEAST_LOADED && best == 0)
+        {
+          break;
+        }
+    }
+  if (route == 0)
+    {
+      route = m_hostRoutes.IsFailedOver (routeKey) ? LookupLoopFreeAlternate (dest, routes, nRoutes, remaining, oif) : 0;
+      if (route == 0)
+        {
+          NS_LOG_INFO ("No Route available");
+          return 0;
+        }
+      // not cached: the decision does not follow from the budget range
+      return SelectRoute (route, dest, remaining, dsrTag);
+    }
+  if (useCache && decision.nProbes <= CachedDecision::MAX_PROBES)
+    {
+      if (m_decisionCache.size () >= MAX_CACHED_DECISIONS)
+        {
+          m_decisionCache.clear ();
+        }
+      decision.expires = Simulator::Now () + m_decisionCacheTtl;
+      decision.route = route - routes;
+      m_decisionCache[key] = decision;
+    }
+  return SelectRoute (route, dest, remaining, dsrTag);
+}
+
+Ptr<Ipv4Route>
+Ipv4DSRRouting::SelectRoute (const Ipv4DSRRoutingTableEntry *route, Ipv4Address dest,
+                             int64_t remaining, DsrTag &dsrTag) const
+{
+  dsrTag.SetDistance (route->GetDistance ());
+  if (remaining > (int64_t) route->GetDistance () + 10)
+    {
+      dsrTag.SetPriority (1);
+    }
+  else
+    {
+      dsrTag.SetPriority (0);
+    }
+  return CreateRoute (route, dest);
+}
+
+//
+// The previous hop chose this node for a distance that the failed candidates
+// gave, and the remaining ones are all longer.  A loop-free alternate does
+// not send the packet back here, and the next hops after it see the distance
+// of the alternate in the tag, so the packet only has to fit in its time
+// budget.
+//
+const Ipv4DSRRoutingTableEntry *
+Ipv4DSRRouting::LookupLoopFreeAlternate (Ipv4Address dest, const Ipv4DSRRoutingTableEntry *routes,
+                                         uint32_t nRoutes, int64_t remaining, Ptr<NetDevice> oif)
+{
+  NS_LOG_FUNCTION (this << dest << remaining);
+  for (uint32_t i = 0; i < nRoutes && routes[i].GetDistance () <= remaining; i++)
+    {
+      if (routes[i].IsLoopFreeAlternate () && GetFeasibleAdjacency (dest, routes[i], oif) != 0)
+        {
+          NS_LOG_LOGIC ("Failing over to " << routes[i].GetGateway () << " with Cost: " << routes[i].GetDistance ());
+          return &routes[i];
+        }
+    }
+  return 0;
+}
+
+const Ipv4DSRRoutingTableEntry *
+Ipv4DSRRouting::LookupDecisionCache (uint64_t key, const Ipv4DSRRoutingTableEntry *routes,
+                                     uint32_t nRoutes, uint32_t budget)
+{
+  CheckHandleGeneration ();
+  DecisionCache::iterator it = m_decisionCache.find (key);
+  if (it == m_decisionCache.end ())
+    {
+      return 0;
+    }
+  const CachedDecision &decision = it->second;
+  if (Simulator::Now () >= decision.expires
+      || decision.route >= nRoutes
+      || routes[decision.route].GetDistance () >= budget)
+    {
+      m_decisionCache.erase (it);
+      return 0;
+    }
+  // every queue looked at for the decision must still be in the same state
+  for (uint32_t i = 0; i < decision.nProbes; i++)
+    {
+      if (GetProbeEpoch (PeekPointer (decision.queue[i]), decision.remote[i]) != decision.epoch[i])
+        {
+          m_decisionCache.erase (it);
+          return 0;
+        }
+    }
+  return &routes[decision.route];
+}
+
+void
+Ipv4DSRRouting::RecordProbe (CachedDecision *decision, Ptr<const DsrVirtualQueueDisc> queue, bool remote) const
+{
+  if (decision == 0 || decision->nProbes > CachedDecision::MAX_PROBES)
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < decision->nProbes; i++)
+    {
+      if (decision->queue[i] == queue)
+        {
+          return;
+        }
+    }
+  if (decision->nProbes == CachedDecision::MAX_PROBES)
+    {
+      // too many queues involved, the decision will not be cached
+      decision->nProbes++;
+      return;
+    }
+  decision->queue[decision->nProbes] = queue;
+  decision->epoch[decision->nProbes] = GetProbeEpoch (PeekPointer (queue), remote);
+  decision->remote[decision->nProbes] = remote;
+  decision->nProbes++;
+}
+
+uint32_t
+Ipv4DSRRouting::GetProbeEpoch (const DsrVirtualQueueDisc *queue, bool remote) const
+{
+  if (!remote || !m_queueSnapshots)
+    {
+      return queue->GetOccupancyEpoch ();
+    }
+  NeighborQueues::const_iterator it = m_neighborQueues.find (queue);
+  if (it == m_neighborQueues.end () || !it->second.received
+      || Simulator::Now () - it->second.snapshot.timestamp > m_snapshotStaleness)
+    {
+      // the lookahead takes the queue as not overloaded
+      return 0xffffffff;
+    }
+  return it->second.snapshot.occupancyEpoch;
+}
+
+uint64_t
+Ipv4DSRRouting::GetDecisionCacheHits (void) const
+{
+  return m_decisionCacheHits;
+}
+
+uint64_t
+Ipv4DSRRouting::GetDecisionCacheMisses (void) const
+{
+  return m_decisionCacheMisses;
+}
+
+Ptr<Ipv4Route>
+Ipv4DSRRouting::CreateRoute (const Ipv4DSRRoutingTableEntry *route, Ipv4Address dest) const
+{
+  // create a Ipv4Route object from the selected routing table entry; its
+  // destination may be the key of an aggregated route
+  Ptr<Ipv4Route> rtentry = Create<Ipv4Route> ();
+  rtentry->SetDestination (dest);
+  /// \todo handle multi-address case
+  rtentry->SetSource (m_ipv4->GetAddress (route->GetInterface (), 0).GetLocal ());
+  rtentry->SetGateway (route->GetGateway ());
+  uint32_t interfaceIdx = route->GetInterface ();
+  rtentry->SetOutputDevice (m_ipv4->GetNetDevice (interfaceIdx));
+  return rtentry;
+}
+
+bool
+Ipv4DSRRouting::CompareDistance (const Ipv4DSRRoutingTableEntry &route, uint32_t distance)
+{
+  return route.GetDistance () < distance;
+}
+
+const Ipv4DSRRouting::Adjacency *
+Ipv4DSRRouting::GetFeasibleAdjacency (Ipv4Address dest, const Ipv4DSRRoutingTableEntry &route, Ptr<NetDevice> oif,
+                                      CachedDecision *probes)
+{
+  uint32_t iface = route.GetInterface ();
+  if (oif != 0 && oif != m_ipv4->GetNetDevice (iface))
+    {
+      return 0;
+    }
+  const Adjacency &adj = GetAdjacency (iface);
+  // check queue status in current node
+  if (adj.localQueue != 0)
+    {
+      RecordProbe (probes, adj.localQueue, false);
+      if (adj.localQueue->IsLaneFull (0) || adj.localQueue->IsLaneFull (1))
+        {
+          return 0;
+        }
+    }
+  // check the queue the neighbor would use towards the destination
+  if (adj.neighbor == 0)
+    {
+      return 0;
+    }
+  DsrVirtualQueueDisc *nextQueue = adj.neighbor->GetEgressQueue (dest, route.GetVia ());
+  if (nextQueue == 0)
+    {
+      NS_LOG_INFO ("Could not find the DSRVirtualQueue, drop this route.");
+      return 0;
     }
-  else 
+  RecordProbe (probes, nextQueue, true);
+  if (IsNextQueueOverloaded (nextQueue))
     {
+      NS_LOG_INFO ("route overloaded");
       return 0;
     }
+  return &adj;
+}
+
+uint64_t
+Ipv4DSRRouting::EstimateQueueDelay (const Adjacency &adj) const
+{
+  if (adj.localQueue == 0 || adj.linkRate.GetBitRate () == 0)
+    {
+      return 0;
+    }
+  // time to drain the local queue, in Microseconds
+  return adj.localQueue->GetNBytes () * 8 * 1000000 / adj.linkRate.GetBitRate ();
 }
 
 uint32_t 
@@ -430,7 +628,7 @@ Ipv4DSRRouting::GetNRoutes (void) const
 {
   NS_LOG_FUNCTION (this);
   uint32_t n = 0;
-  n += m_hostRoutes.size ();
+  n += m_hostRoutes.GetNRoutes ();
   n += m_networkRoutes.size ();
   n += m_ASexternalRoutes.size ();
   return n;
@@ -440,21 +638,11 @@ Ipv4DSRRoutingTableEntry *
 Ipv4DSRRouting::GetRoute (uint32_t index) const
 {
   NS_LOG_FUNCTION (this << index);
-  if (index < m_hostRoutes.size ())
+  if (index < m_hostRoutes.GetNRoutes ())
     {
-      uint32_t tmp = 0;
-      for (HostRoutesCI i = m_hostRoutes.begin (); 
-           i != m_hostRoutes.end (); 
-           i++) 
-        {
-          if (tmp  == index)
-            {
-              return *i;
-            }
-          tmp++;
-        }
+      return m_hostRoutes.GetRoute (index);
     }
-  index -= m_hostRoutes.size ();
+  index -= m_hostRoutes.GetNRoutes ();
   uint32_t tmp = 0;
   if (index < m_networkRoutes.size ())
     {
@@ -489,25 +677,15 @@ void
 Ipv4DSRRouting::RemoveRoute (uint32_t index)
 {
   NS_LOG_FUNCTION (this << index);
-  if (index < m_hostRoutes.size ())
+  if (index < m_hostRoutes.GetNRoutes ())
     {
-      uint32_t tmp = 0;
-      for (HostRoutesI i = m_hostRoutes.begin (); 
-           i != m_hostRoutes.end (); 
-           i++) 
-        {
-          if (tmp  == index)
-            {
-              NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_hostRoutes.size ());
-              delete *i;
-              m_hostRoutes.erase (i);
-              NS_LOG_LOGIC ("Done removing host route " << index << "; host route remaining size = " << m_hostRoutes.size ());
-              return;
-            }
-          tmp++;
-        }
+      NS_LOG_LOGIC ("Removing route " << index << "; size = " << m_hostRoutes.GetNRoutes ());
+      m_hostRoutes.RemoveRoute (index);
+      m_decisionCache.clear ();
+      NS_LOG_LOGIC ("Done removing host route " << index << "; host route remaining size = " << m_hostRoutes.GetNRoutes ());
+      return;
     }
-  index -= m_hostRoutes.size ();
+  index -= m_hostRoutes.GetNRoutes ();
   uint32_t tmp = 0;
   for (NetworkRoutesI j = m_networkRoutes.begin (); 
        j != m_networkRoutes.end (); 
@@ -542,6 +720,225 @@ Ipv4DSRRouting::RemoveRoute (uint32_t index)
   NS_ASSERT (false);
 }
 
+const Ipv4DSRRouting::Adjacency &
+Ipv4DSRRouting::GetAdjacency (uint32_t interface)
+{
+  CheckHandleGeneration ();
+  if (interface >= m_adjacencies.size ())
+    {
+      m_adjacencies.resize (m_ipv4->GetNInterfaces ());
+    }
+  Adjacency &adj = m_adjacencies[interface];
+  if (!adj.resolved)
+    {
+      ResolveAdjacency (interface);
+    }
+  return adj;
+}
+
+void
+Ipv4DSRRouting::ResolveAdjacency (uint32_t interface)
+{
+  NS_LOG_FUNCTION (this << interface);
+  Adjacency &adj = m_adjacencies[interface];
+  ReleaseAdjacency (adj);
+  adj.resolved = true;
+
+  Ptr<NetDevice> dev = m_ipv4->GetNetDevice (interface);
+  Ptr<PointToPointNetDevice> p2pDev = DynamicCast<PointToPointNetDevice> (dev);
+  if (p2pDev != 0)
+    {
+      DataRateValue rate;
+      p2pDev->GetAttribute ("DataRate", rate);
+      adj.linkRate = rate.Get ();
+    }
+  Ptr<TrafficControlLayer> tc = dev->GetNode ()->GetObject<TrafficControlLayer> ();
+  if (tc != 0)
+    {
+      adj.localQueue = DynamicCast<DsrVirtualQueueDisc> (tc->GetRootQueueDiscOnDevice (dev));
+    }
+
+  Ptr<PointToPointChannel> channel = DynamicCast<PointToPointChannel> (dev->GetChannel ());
+  if (channel == 0 || channel->GetNDevices () != 2)
+    {
+      return;
+    }
+  Ptr<NetDevice> peer = channel->GetDevice (0) == dev ? channel->GetDevice (1) : channel->GetDevice (0);
+  Ptr<Ipv4> peerIpv4 = peer->GetNode ()->GetObject<Ipv4> ();
+  if (peerIpv4 == 0 || peerIpv4->GetRoutingProtocol () == 0)
+    {
+      return;
+    }
+  Ptr<Ipv4RoutingProtocol> routingProtocol = peerIpv4->GetRoutingProtocol ();
+  Ptr<Ipv4ListRouting> listRouting = DynamicCast<Ipv4ListRouting> (routingProtocol);
+  if (listRouting != 0)
+    {
+      for (uint32_t i = 0; i < listRouting->GetNRoutingProtocols () && adj.neighbor == 0; i++)
+        {
+          int16_t priority;
+          adj.neighbor = DynamicCast<Ipv4DSRRouting> (listRouting->GetRoutingProtocol (i, priority));
+        }
+    }
+  else
+    {
+      adj.neighbor = DynamicCast<Ipv4DSRRouting> (routingProtocol);
+    }
+  NS_LOG_LOGIC ("Interface " << interface << " local queue " << adj.localQueue << " neighbor " << adj.neighbor);
+  if (m_queueSnapshots && adj.neighbor != 0)
+    {
+      SubscribeToNeighborQueues (adj, peer->GetNode ());
+    }
+}
+
+void
+Ipv4DSRRouting::ReleaseAdjacency (Adjacency &adj)
+{
+  for (uint32_t i = 0; i < adj.neighborQueues.size (); i++)
+    {
+      // the queue disc may also be the neighbor of another interface
+      NeighborQueues::iterator it = m_neighborQueues.find (PeekPointer (adj.neighborQueues[i]));
+      if (it != m_neighborQueues.end () && --it->second.nAdjacencies == 0)
+        {
+          adj.neighborQueues[i]->RemoveSnapshotCallback (MakeCallback (&Ipv4DSRRouting::ReceiveQueueSnapshot, this));
+          m_neighborQueues.erase (it);
+        }
+    }
+  adj.neighborQueues.clear ();
+  adj.resolved = false;
+  adj.localQueue = 0;
+  adj.neighbor = 0;
+  adj.linkRate = DataRate (0);
+}
+
+void
+Ipv4DSRRouting::CheckHandleGeneration (void)
+{
+  if (m_handleGeneration != HandleGeneration ())
+    {
+      NS_LOG_LOGIC ("A DSR queue disc or routing protocol changed, refreshing the adjacencies");
+      RefreshAdjacencies ();
+    }
+}
+
+void
+Ipv4DSRRouting::SubscribeToNeighborQueues (Adjacency &adj, Ptr<Node> peer)
+{
+  NS_LOG_FUNCTION (this << peer->GetId ());
+  Ptr<TrafficControlLayer> tc = peer->GetObject<TrafficControlLayer> ();
+  if (tc == 0)
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < peer->GetNDevices (); i++)
+    {
+      Ptr<DsrVirtualQueueDisc> queue = DynamicCast<DsrVirtualQueueDisc> (tc->GetRootQueueDiscOnDevice (peer->GetDevice (i)));
+      if (queue == 0)
+        {
+          continue;
+        }
+      adj.neighborQueues.push_back (queue);
+      NeighborQueue &nq = m_neighborQueues[PeekPointer (queue)];
+      if (nq.nAdjacencies++ == 0)
+        {
+          // subscribe once the record exists: the first snapshot is
+          // delivered synchronously
+          queue->AddSnapshotCallback (MakeCallback (&Ipv4DSRRouting::ReceiveQueueSnapshot, this));
+        }
+    }
+}
+
+void
+Ipv4DSRRouting::ReceiveQueueSnapshot (const DsrQueueSnapshot &snapshot)
+{
+  NeighborQueues::iterator it = m_neighborQueues.find (snapshot.queue);
+  if (it != m_neighborQueues.end ())
+    {
+      it->second.received = true;
+      it->second.snapshot = snapshot;
+    }
+}
+
+bool
+Ipv4DSRRouting::IsNextQueueOverloaded (const DsrVirtualQueueDisc *queue) const
+{
+  if (!m_queueSnapshots)
+    {
+      return queue->IsLaneFull (0) && queue->IsLaneFull (1);
+    }
+  NeighborQueues::const_iterator it = m_neighborQueues.find (queue);
+  if (it == m_neighborQueues.end ())
+    {
+      return false;
+    }
+  const NeighborQueue &nq = it->second;
+  if (!nq.received || Simulator::Now () - nq.snapshot.timestamp > m_snapshotStaleness)
+    {
+      return false;
+    }
+  return nq.snapshot.IsLaneFull (0) && nq.snapshot.IsLaneFull (1);
+}
+
+void
+Ipv4DSRRouting::RefreshAdjacencies (void)
+{
+  NS_LOG_FUNCTION (this);
+  for (uint32_t i = 0; i < m_adjacencies.size (); i++)
+    {
+      m_adjacencies[i].resolved = false;
+    }
+  m_decisionCache.clear ();
+  m_handleGeneration = HandleGeneration ();
+}
+
+Ipv4Address
+Ipv4DSRRouting::GetRouteKey (Ipv4Address dest) const
+{
+  if (m_prefixes == 0)
+    {
+      return dest;
+    }
+  uint32_t key = m_prefixes->Lookup (dest);
+  return key != DsrPrefixTable::NONE ? Ipv4Address (key) : dest;
+}
+
+void
+Ipv4DSRRouting::ResolveOnDemand (Ipv4Address dest)
+{
+  uint32_t nRoutes;
+  if (m_onDemand && !m_updating && m_hostRoutes.Lookup (GetRouteKey (dest), nRoutes) == 0)
+    {
+      NS_LOG_LOGIC ("No host route to " << dest << ", asking the route manager");
+      DSRRouteManager::ResolveRoutes (m_ipv4->GetObject<Node> (), dest);
+    }
+}
+
+DsrVirtualQueueDisc *
+Ipv4DSRRouting::GetEgressQueue (Ipv4Address dest, Ipv4Address via)
+{
+  uint32_t nRoutes;
+  Ipv4Address key = GetRouteKey (dest);
+  const Ipv4DSRRoutingTableEntry *routes = m_hostRoutes.Lookup (key, nRoutes);
+  if (nRoutes == 0 && m_onDemand)
+    {
+      ResolveOnDemand (dest);
+      routes = m_hostRoutes.Lookup (key, nRoutes);
+    }
+  if (nRoutes == 0)
+    {
+      return 0;
+    }
+  uint32_t i = 0;
+  if (via != Ipv4Address::GetZero ())
+    {
+      while (i < nRoutes && routes[i].GetGateway () != via)
+        {
+          i++;
+        }
+      i = i < nRoutes ? i : 0;
+    }
+  return PeekPointer (GetAdjacency (routes[i].GetInterface ()).localQueue);
+}
+
 int64_t
 Ipv4DSRRouting::AssignStreams (int64_t stream)
 {
@@ -551,27 +948,239 @@ Ipv4DSRRouting::AssignStreams (int64_t stream)
 }
 
 void
-Ipv4DSRRouting::DoDispose (void)
+Ipv4DSRRouting::DeleteRoutes (std::list<Ipv4DSRRoutingTableEntry *> &routes)
 {
-  NS_LOG_FUNCTION (this);
-  for (HostRoutesI i = m_hostRoutes.begin (); 
-       i != m_hostRoutes.end (); 
-       i = m_hostRoutes.erase (i)) 
+  for (std::list<Ipv4DSRRoutingTableEntry *>::iterator i = routes.begin ();
+       i != routes.end ();
+       i = routes.erase (i))
     {
       delete (*i);
     }
-  for (NetworkRoutesI j = m_networkRoutes.begin (); 
-       j != m_networkRoutes.end (); 
-       j = m_networkRoutes.erase (j)) 
+}
+
+void
+Ipv4DSRRouting::ClearRoutes (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_hostRoutes.Clear ();
+  DeleteRoutes (m_networkRoutes);
+  DeleteRoutes (m_ASexternalRoutes);
+  ClearDownRoutes ();
+  m_decisionCache.clear ();
+}
+
+void
+Ipv4DSRRouting::RemoveHostRoutesTo (Ipv4Address dest)
+{
+  NS_LOG_FUNCTION (this << dest);
+  NS_ASSERT_MSG (!m_updating, "RemoveHostRoutesTo during a route update");
+  if (m_hostRoutes.RemoveRoutesTo (dest) > 0)
+    {
+      m_decisionCache.clear ();
+    }
+  // the routes added in their place supersede the ones put aside
+  for (std::map<uint32_t, DownRoutes>::iterator i = m_downRoutes.begin (); i != m_downRoutes.end (); i++)
+    {
+      std::vector<Ipv4DSRRoutingTableEntry> &routes = i->second.hostRoutes;
+      uint32_t kept = 0;
+      for (uint32_t j = 0; j < routes.size (); j++)
+        {
+          if (routes[j].GetDest () != dest)
+            {
+              routes[kept++] = routes[j];
+            }
+        }
+      routes.resize (kept);
+    }
+}
+
+void
+Ipv4DSRRouting::RemoveNetworkRoutes (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (!m_updating, "RemoveNetworkRoutes during a route update");
+  DeleteRoutes (m_networkRoutes);
+  DeleteRoutes (m_ASexternalRoutes);
+  for (std::map<uint32_t, DownRoutes>::iterator i = m_downRoutes.begin (); i != m_downRoutes.end (); i++)
     {
-      delete (*j);
+      DeleteRoutes (i->second.networkRoutes);
     }
-  for (ASExternalRoutesI l = m_ASexternalRoutes.begin (); 
-       l != m_ASexternalRoutes.end ();
-       l = m_ASexternalRoutes.erase (l))
+}
+
+void
+Ipv4DSRRouting::ClearDownRoutes (void)
+{
+  NS_LOG_FUNCTION (this);
+  for (std::map<uint32_t, DownRoutes>::iterator i = m_downRoutes.begin (); i != m_downRoutes.end (); i++)
     {
-      delete (*l);
+      DeleteRoutes (i->second.networkRoutes);
     }
+  m_downRoutes.clear ();
+}
+
+void
+Ipv4DSRRouting::MarkLoopFreeAlternate (Ipv4Address dest, Ipv4Address nextHop, uint32_t interface)
+{
+  NS_LOG_FUNCTION (this << dest << nextHop << interface);
+  DsrFib &hostRoutes = m_updating ? m_stagedHostRoutes : m_hostRoutes;
+  hostRoutes.MarkLoopFreeAlternate (dest, nextHop, interface);
+}
+
+/// Flag of a serialized route marked as a loop-free alternate
+static const uint32_t SERIALIZED_LOOP_FREE = 1;
+
+/**
+ * \brief Append one route to a buffer of 32-bit words.
+ * \param buffer the buffer
+ * \param route the route
+ */
+static void
+SerializeRoute (std::vector<uint32_t> &buffer, const Ipv4DSRRoutingTableEntry &route)
+{
+  buffer.push_back (route.GetDestNetwork ().Get ());
+  buffer.push_back (route.GetDestNetworkMask ().Get ());
+  buffer.push_back (route.GetGateway ().Get ());
+  buffer.push_back (route.GetInterface ());
+  buffer.push_back (route.GetDistance ());
+  buffer.push_back (route.IsLoopFreeAlternate () ? SERIALIZED_LOOP_FREE : 0);
+  buffer.push_back (route.GetVia ().Get ());
+}
+
+void
+Ipv4DSRRouting::SerializeRoutes (std::vector<uint32_t> &buffer) const
+{
+  NS_LOG_FUNCTION (this);
+  const DsrFib &hostRoutes = m_updating ? m_stagedHostRoutes : m_hostRoutes;
+  const NetworkRoutes &networkRoutes = m_updating ? m_stagedNetworkRoutes : m_networkRoutes;
+  const ASExternalRoutes &externalRoutes = m_updating ? m_stagedASexternalRoutes : m_ASexternalRoutes;
+  buffer.push_back (hostRoutes.GetNRoutes ());
+  buffer.push_back (networkRoutes.size ());
+  buffer.push_back (externalRoutes.size ());
+  for (uint32_t i = 0; i < hostRoutes.GetNRoutes (); i++)
+    {
+      SerializeRoute (buffer, *hostRoutes.GetRoute (i));
+    }
+  for (NetworkRoutesCI i = networkRoutes.begin (); i != networkRoutes.end (); i++)
+    {
+      SerializeRoute (buffer, **i);
+    }
+  for (ASExternalRoutesCI i = externalRoutes.begin (); i != externalRoutes.end (); i++)
+    {
+      SerializeRoute (buffer, **i);
+    }
+}
+
+uint32_t
+Ipv4DSRRouting::GetSerializedSize (const uint32_t *data, uint32_t size)
+{
+  if (size < 3)
+    {
+      return 0;
+    }
+  uint64_t words = 3 + (uint64_t (data[0]) + data[1] + data[2]) * ROUTE_RECORD_WORDS;
+  return words <= size ? words : 0;
+}
+
+void
+Ipv4DSRRouting::DeserializeRoutes (const uint32_t *data)
+{
+  NS_LOG_FUNCTION (this);
+  uint32_t nHost = data[0];
+  uint32_t nNetwork = data[1];
+  uint32_t nExternal = data[2];
+  const uint32_t *record = data + 3;
+  for (uint32_t i = 0; i < nHost; i++, record += ROUTE_RECORD_WORDS)
+    {
+      Ipv4Address dest (record[0]);
+      Ipv4Address gateway (record[2]);
+      Ipv4Address via (record[6]);
+      if (via == Ipv4Address::GetZero ())
+        {
+          AddHostRouteTo (dest, gateway, record[3], record[4]);
+        }
+      else
+        {
+          AddHostRouteTo (dest, gateway, record[3], record[4], via);
+        }
+      if (record[5] & SERIALIZED_LOOP_FREE)
+        {
+          MarkLoopFreeAlternate (dest, gateway, record[3]);
+        }
+    }
+  for (uint32_t i = 0; i < nNetwork; i++, record += ROUTE_RECORD_WORDS)
+    {
+      AddNetworkRouteTo (Ipv4Address (record[0]), Ipv4Mask (record[1]),
+                         Ipv4Address (record[2]), record[3]);
+    }
+  for (uint32_t i = 0; i < nExternal; i++, record += ROUTE_RECORD_WORDS)
+    {
+      AddASExternalRouteTo (Ipv4Address (record[0]), Ipv4Mask (record[1]),
+                            Ipv4Address (record[2]), record[3]);
+    }
+}
+
+void
+Ipv4DSRRouting::SetOnDemandRoutes (bool enable)
+{
+  NS_LOG_FUNCTION (this << enable);
+  m_onDemand = enable;
+}
+
+void
+Ipv4DSRRouting::SetPrefixTable (Ptr<DsrPrefixTable> prefixes)
+{
+  NS_LOG_FUNCTION (this << prefixes);
+  m_prefixes = prefixes;
+  m_decisionCache.clear ();
+}
+
+void
+Ipv4DSRRouting::BeginRouteUpdate (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_stagedHostRoutes.Clear ();
+  DeleteRoutes (m_stagedNetworkRoutes);
+  DeleteRoutes (m_stagedASexternalRoutes);
+  m_updating = true;
+}
+
+void
+Ipv4DSRRouting::CommitRouteUpdate (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (m_updating, "CommitRouteUpdate without BeginRouteUpdate");
+  m_hostRoutes.Swap (m_stagedHostRoutes);
+  m_networkRoutes.swap (m_stagedNetworkRoutes);
+  m_ASexternalRoutes.swap (m_stagedASexternalRoutes);
+  m_updating = false;
+  // the previous tables are now the staged ones
+  m_stagedHostRoutes.Clear ();
+  DeleteRoutes (m_stagedNetworkRoutes);
+  DeleteRoutes (m_stagedASexternalRoutes);
+  // the new table was built for the interfaces as they are now
+  ClearDownRoutes ();
+  m_decisionCache.clear ();
+}
+
+void
+Ipv4DSRRouting::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_recomputeEvent.Cancel ();
+  ClearRoutes ();
+  m_updating = false;
+  m_stagedHostRoutes.Clear ();
+  DeleteRoutes (m_stagedNetworkRoutes);
+  DeleteRoutes (m_stagedASexternalRoutes);
+  for (uint32_t i = 0; i < m_adjacencies.size (); i++)
+    {
+      ReleaseAdjacency (m_adjacencies[i]);
+    }
+  m_adjacencies.clear ();
+  m_neighborQueues.clear ();
+  m_decisionCache.clear ();
+  m_prefixes = 0;
+  g_routingGeneration++;
 
   Ipv4RoutingProtocol::DoDispose ();
 }
@@ -657,9 +1266,10 @@ Ipv4DSRRouting::RouteOutput (Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDev
 // See if this is a unicast packet we have a route for.
 //
   NS_LOG_LOGIC ("Unicast destination- looking up");
+  ResolveOnDemand (header.GetDestination ());
   Ptr<Ipv4Route> rtentry;
-  BudgetTag bugetTag;
-  if (p != nullptr && p->GetSize () != 0 && p->PeekPacketTag (bugetTag) && bugetTag.GetBudget () != 0)
+  DsrTag dsrTag;
+  if (p != nullptr && p->GetSize () != 0 && p->PeekPacketTag (dsrTag) && dsrTag.GetBudget () != 0)
     { 
       rtentry = LookupDSRRoute (header.GetDestination (), p, oif);
     }
@@ -685,7 +1295,6 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
                                 UnicastForwardCallback ucb, MulticastForwardCallback mcb,
                                 LocalDeliverCallback lcb, ErrorCallback ecb)
 { 
-  Ptr <Packet> p_copy = p->Copy();
   NS_LOG_FUNCTION (this << p << header << header.GetSource () << header.GetDestination () << idev << &lcb << &ecb);
   // Check if input device supports IP
   NS_ASSERT (m_ipv4->GetInterfaceForDevice (idev) >= 0);
@@ -721,23 +1330,38 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
     }
   // Next, try to find a route
   NS_LOG_LOGIC ("Unicast destination- looking up global route");
-  Ptr<Ipv4Route> rtentry; 
-  BudgetTag budgetTag;
-  
-  if (p->PeekPacketTag (budgetTag) && budgetTag.GetBudget () != 0)
-  {
-    rtentry = LookupDSRRoute (header.GetDestination (), p_copy); 
-  }
+  ResolveOnDemand (header.GetDestination ());
+  Ptr<Ipv4Route> rtentry;
+  DsrTag dsrTag;
+  bool tagged = p->PeekPacketTag (dsrTag) && dsrTag.GetBudget () != 0;
+  bool rewrite = false;
+  if (tagged)
+    {
+      uint32_t distance = dsrTag.GetDistance ();
+      uint8_t priority = dsrTag.GetPriority ();
+      rtentry = LookupDSRRoute (header.GetDestination (), dsrTag);
+      rewrite = dsrTag.GetDistance () != distance || dsrTag.GetPriority () != priority;
+    }
   else
-  {
-    rtentry = LookupDSRRoute (header.GetDestination ());
-  }
+    {
+      rtentry = LookupDSRRoute (header.GetDestination ());
+    }
   if (rtentry != 0)
     {
-      const Ptr <Packet> p_c = p_copy->Copy();
       NS_LOG_LOGIC ("Found unicast destination- calling unicast callback");
-      ucb (rtentry, p_c, header);
-      return true; 
+      if (rewrite)
+        {
+          // the packet is shared with the previous hop, only copy it when
+          // the tag actually has to change
+          Ptr<Packet> packet = p->Copy ();
+          packet->ReplacePacketTag (dsrTag);
+          ucb (rtentry, packet, header);
+        }
+      else
+        {
+          ucb (rtentry, p, header);
+        }
+      return true;
     }
   else
     {
@@ -747,39 +1371,117 @@ Ipv4DSRRouting::RouteInput  (Ptr<const Packet> p, const Ipv4Header &header, Ptr<
     }
 }
 
+//
+// Put back the routes dropped when the interface went down, so that the
+// table is whole again even when the routes are not recomputed.
+//
 void 
 Ipv4DSRRouting::NotifyInterfaceUp (uint32_t i)
 {
   NS_LOG_FUNCTION (this << i);
+  RefreshAdjacencies ();
+  RestoreRoutesThrough (i);
   if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
     {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
+      DSRRouteManager::RecomputeDSRRoutes ();
     }
 }
 
+//
+// With FastFailover, take the routes through the interface out of the
+// table at once, so that the packets take the remaining candidates instead
+// of being lost on the interface until the routes are recomputed.  They are
+// kept aside for NotifyInterfaceUp; a new table built meanwhile discards
+// them.
+//
 void 
 Ipv4DSRRouting::NotifyInterfaceDown (uint32_t i)
 {
   NS_LOG_FUNCTION (this << i);
+  RefreshAdjacencies ();
+  if (m_fastFailover)
+    {
+      RemoveRoutesThrough (i);
+    }
   if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
     {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
+      if (!m_failoverRecomputeDelay.IsStrictlyPositive ())
+        {
+          DSRRouteManager::RecomputeDSRRoutes ();
+        }
+      else if (!m_recomputeEvent.IsRunning ())
+        {
+          m_recomputeEvent = Simulator::Schedule (m_failoverRecomputeDelay, &DSRRouteManager::RecomputeDSRRoutes);
+        }
+    }
+}
+
+void
+Ipv4DSRRouting::RemoveRoutesThrough (uint32_t i)
+{
+  NS_LOG_FUNCTION (this << i);
+  DownRoutes &down = m_downRoutes[i];
+  uint32_t n = m_hostRoutes.RemoveRoutesThrough (i, &down.hostRoutes);
+  for (NetworkRoutesI j = m_networkRoutes.begin (); j != m_networkRoutes.end (); )
+    {
+      if ((*j)->GetInterface () == i)
+        {
+          NetworkRoutesI next = j;
+          next++;
+          down.networkRoutes.splice (down.networkRoutes.end (), m_networkRoutes, j);
+          j = next;
+          n++;
+        }
+      else
+        {
+          j++;
+        }
+    }
+  if (n > 0)
+    {
+      m_decisionCache.clear ();
+    }
+  NS_LOG_LOGIC ("Removed " << n << " routes through interface " << i);
+}
+
+void
+Ipv4DSRRouting::RestoreRoutesThrough (uint32_t interface)
+{
+  NS_LOG_FUNCTION (this << interface);
+  std::map<uint32_t, DownRoutes>::iterator down = m_downRoutes.find (interface);
+  if (down == m_downRoutes.end ())
+    {
+      return;
+    }
+  std::vector<Ipv4DSRRoutingTableEntry> &hostRoutes = down->second.hostRoutes;
+  for (uint32_t j = 0; j < hostRoutes.size (); j++)
+    {
+      m_hostRoutes.InsertUnique (hostRoutes[j]);
+      m_hostRoutes.SetFailedOver (hostRoutes[j].GetDest (), false);
+    }
+  m_networkRoutes.splice (m_networkRoutes.end (), down->second.networkRoutes);
+  NS_LOG_LOGIC ("Restored " << hostRoutes.size () << " host routes through interface " << interface);
+  m_downRoutes.erase (down);
+  // a destination also reached through an interface still down stays
+  // failed over
+  for (down = m_downRoutes.begin (); down != m_downRoutes.end (); down++)
+    {
+      for (uint32_t j = 0; j < down->second.hostRoutes.size (); j++)
+        {
+          m_hostRoutes.SetFailedOver (down->second.hostRoutes[j].GetDest (), true);
+        }
     }
+  m_decisionCache.clear ();
 }
 
 void 
 Ipv4DSRRouting::NotifyAddAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
+  RefreshAdjacencies ();
   if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
     {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
+      DSRRouteManager::RecomputeDSRRoutes ();
     }
 }
 
@@ -787,11 +1489,10 @@ void
 Ipv4DSRRouting::NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
+  RefreshAdjacencies ();
   if (m_respondToInterfaceEvents && Simulator::Now ().GetSeconds () > 0)  // avoid startup events
     {
-      DSRRouteManager::DeleteDSRRoutes ();
-      DSRRouteManager::BuildDSRRoutingDatabase ();
-      DSRRouteManager::InitializeRoutes ();
+      DSRRouteManager::RecomputeDSRRoutes ();
     }
 }
 
@@ -801,6 +1502,8 @@ Ipv4DSRRouting::SetIpv4 (Ptr<Ipv4> ipv4)
   NS_LOG_FUNCTION (this << ipv4);
   NS_ASSERT (m_ipv4 == 0 && ipv4 != 0);
   m_ipv4 = ipv4;
+  m_adjacencies.clear ();
+  m_decisionCache.clear ();
 }
 
 } // namespace ns3
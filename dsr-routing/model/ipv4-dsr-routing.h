@@ -24,6 +24,9 @@
 #define IPV4_DSR_ROUTING_H
 
 #include <list>
+#include <map>
+#include <vector>
+#include <unordered_map>
 #include <stdint.h>
 #include "ns3/ipv4-address.h"
 #include "ns3/ipv4-header.h"
@@ -31,8 +34,13 @@
 #include "ns3/ipv4.h"
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/data-rate.h"
+#include "ns3/event-id.h"
 #include "dsr-route-manager-impl.h"
 #include "ipv4-dsr-routing-table-entry.h"
+#include "dsr-fib.h"
+#include "dsr-prefix-table.h"
+#include "dsr-virtual-queue-disc.h"
 
 namespace ns3 {
 
@@ -44,6 +52,7 @@ class Ipv4Header;
 class Ipv4DSRRoutingTableEntry;
 class Ipv4MulticastRoutingTableEntry;
 class Node;
+class DsrTag;
 
 /**
  * \ingroup ipv4
@@ -80,6 +89,18 @@ public:
    * \return the object TypeId
    */
   static TypeId GetTypeId (void);
+
+  /**
+   * \brief How a DSR packet picks among the candidate routes that fit in
+   * its budget and whose queues can accept it.
+   */
+  enum CandidatePolicy
+  {
+    SHORTEST_FEASIBLE,  //!< the shortest one
+    MOST_SLACK,         //!< the one leaving the most budget once the local queueing delay is added
+    LEAST_LOADED        //!< the one with the fewest bytes queued locally
+  };
+
   /**
    * \brief Construct an empty Ipv4GlobalRouting routing protocol,
    *
@@ -143,6 +164,24 @@ public:
                        Ipv4Address nextHop,
                        uint32_t interface,
                        uint32_t distance);
+  /**
+   * \brief Add a host route through a given next hop of the gateway.
+   *
+   * The lookahead then checks the queue the gateway uses toward \p via
+   * rather than the one of its shortest route.
+   *
+   * \param dest The Ipv4Address destination for this route.
+   * \param nextHop The next hop Ipv4Address
+   * \param interface The network interface index used to send packets to the
+   *  destination
+   * \param distance The distance between root and destination
+   * \param via The next hop of the gateway toward the destination
+   */
+  void AddHostRouteTo (Ipv4Address dest,
+                       Ipv4Address nextHop,
+                       uint32_t interface,
+                       uint32_t distance,
+                       Ipv4Address via);
 
   /**
    * \brief Add a network route to the global routing table.
@@ -214,6 +253,11 @@ public:
    * \return If route is set, a pointer to that Ipv4RoutingTableEntry is returned, otherwise
    * a zero pointer is returned.
    *
+   * \warning Host routes are stored in place in the forwarding table, so a
+   * pointer to a host route is only valid until the next route is added or
+   * removed (AddHostRouteTo, RemoveRoute, a route update or a recomputation
+   * of the routes).  Copy the entry to keep it across such calls.
+   *
    * \see Ipv4RoutingTableEntry
    * \see Ipv4GlobalRouting::RemoveRoute
    */
@@ -263,6 +307,143 @@ public:
    */
   Ptr<Ipv4Route> LookupDSRRoute (Ipv4Address dest, Ptr<NetDevice> oif = 0);
   Ptr<Ipv4Route> LookupDSRRoute (Ipv4Address dest, Ptr<Packet> p, Ptr<NetDevice> oif = 0);
+  /**
+   * \brief Lookup a budget-feasible route for a DSR packet.
+   *
+   * On success the distance and priority of \p tag are updated for the next
+   * hop; writing the tag back to the packet is left to the caller.
+   *
+   * \param dest destination address
+   * \param tag the DSR tag of the packet
+   * \param oif output interface if any (put 0 otherwise)
+   * \return Ipv4Route to route the packet to reach dest address, or 0
+   */
+  Ptr<Ipv4Route> LookupDSRRoute (Ipv4Address dest, DsrTag &tag, Ptr<NetDevice> oif = 0);
+
+  /**
+   * \brief Forget the cached queue disc and neighbor handles of every
+   * interface.
+   *
+   * They are looked up again the next time an interface is used.  This is
+   * done automatically on interface and address notifications; call it
+   * after changing queue discs or links by other means.
+   */
+  void RefreshAdjacencies (void);
+
+  /**
+   * \brief Remove every route of the table.
+   */
+  void ClearRoutes (void);
+  /**
+   * \brief Remove the host routes to a destination.
+   *
+   * Host routes added to it again take the place of the removed ones in
+   * the table.
+   *
+   * \param dest the destination address
+   */
+  void RemoveHostRoutesTo (Ipv4Address dest);
+  /**
+   * \brief Remove the network and external routes of the table.
+   */
+  void RemoveNetworkRoutes (void);
+  /**
+   * \brief Mark a host route as a loop-free alternate: its next hop does
+   * not forward the packets to the destination back through this node.
+   *
+   * While a route update is in progress, the route is looked up in the new
+   * table.
+   *
+   * \param dest the destination address
+   * \param nextHop the next hop of the route
+   * \param interface the interface of the route
+   */
+  void MarkLoopFreeAlternate (Ipv4Address dest, Ipv4Address nextHop, uint32_t interface);
+
+  /**
+   * \brief Number of 32-bit words of each route written by SerializeRoutes ()
+   */
+  static const uint32_t ROUTE_RECORD_WORDS = 7;
+  /**
+   * \brief Append the routes of the table to a buffer of 32-bit words.
+   *
+   * The words are the numbers of host, network and external routes, then
+   * one record per route in the order of GetRoute (): destination, mask,
+   * gateway, interface, distance, flags and via.  While a route update is
+   * in progress, the routes of the new table are written.
+   *
+   * \param buffer the buffer to append to
+   */
+  void SerializeRoutes (std::vector<uint32_t> &buffer) const;
+  /**
+   * \brief Get the size of a block written by SerializeRoutes ().
+   *
+   * \param data the first word of the block
+   * \param size the number of words available from data
+   * \return the number of words of the block, or 0 if it is truncated
+   */
+  static uint32_t GetSerializedSize (const uint32_t *data, uint32_t size);
+  /**
+   * \brief Add the routes of a block written by SerializeRoutes (), in the
+   * same order, so that the table is the one that was written.
+   *
+   * \param data the first word of the block, which must be complete
+   */
+  void DeserializeRoutes (const uint32_t *data);
+
+  /**
+   * \brief Start building a new routing table off to the side.
+   *
+   * Until CommitRouteUpdate () is called, the Add*RouteTo methods fill the
+   * new table while packets keep being forwarded with the current one.
+   * Host routes to the same destination through the same gateway and
+   * interface are merged, keeping the shortest.
+   */
+  void BeginRouteUpdate (void);
+  /**
+   * \brief Replace the routing table with the one built since
+   * BeginRouteUpdate ().
+   */
+  void CommitRouteUpdate (void);
+
+  /**
+   * \brief Set whether the routes are computed on demand.
+   *
+   * When enabled, a destination without host routes is resolved by the
+   * route manager the first time it is looked up.
+   *
+   * \param enable true to ask the route manager for the missing routes
+   *
+   * \see DSRRouteManager::SetLazyRoutes
+   */
+  void SetOnDemandRoutes (bool enable);
+
+  /**
+   * \brief Set the table mapping destination addresses to the key of their
+   * host routes.
+   *
+   * The host routes to an address covered by the table are looked up
+   * under the value it maps the address to, the router ID of the router
+   * owning the address when the route manager aggregates the routes, so
+   * that all the addresses of a router share one set of candidates.  The
+   * other addresses are looked up as they are.
+   *
+   * \param prefixes the table, shared with the other nodes, or 0 to look
+   * up every address as it is
+   *
+   * \see DSRRouteManager::SetAggregateRoutes
+   */
+  void SetPrefixTable (Ptr<DsrPrefixTable> prefixes);
+
+  /**
+   * \return the number of DSR lookups answered from the decision cache
+   */
+  uint64_t GetDecisionCacheHits (void) const;
+  /**
+   * \return the number of DSR lookups that had to evaluate the candidates
+   * while the decision cache was enabled
+   */
+  uint64_t GetDecisionCacheMisses (void) const;
 
 protected:
   void DoDispose (void);
@@ -272,15 +453,253 @@ private:
   bool m_randomEcmpRouting;
   /// Set to true if this interface should respond to interface events by globallly recomputing routes 
   bool m_respondToInterfaceEvents;
+  /// Set to true to drop the routes through an interface as soon as it goes down
+  bool m_fastFailover;
   /// A uniform random number generator for randomly routing packets among ECMP 
   Ptr<UniformRandomVariable> m_rand;
+  /// Set to true to use published queue snapshots instead of reading the neighbors' queue discs
+  bool m_queueSnapshots;
+  /// Snapshots older than this are ignored
+  Time m_snapshotStaleness;
+  /// How a DSR packet picks among its feasible candidate routes
+  CandidatePolicy m_candidatePolicy;
+  /// How long a forwarding decision is reused, 0 to disable the cache
+  Time m_decisionCacheTtl;
+  /// Width of the budget ranges sharing a cached decision
+  Time m_decisionCacheBucket;
+  /// Number of lookups answered from the decision cache
+  uint64_t m_decisionCacheHits;
+  /// Number of lookups not answered from the decision cache
+  uint64_t m_decisionCacheMisses;
+  /// True between BeginRouteUpdate () and CommitRouteUpdate ()
+  bool m_updating;
+  /// True when the route manager computes the routes on demand
+  bool m_onDemand;
+  /// Key of the host routes of the destinations, see SetPrefixTable ()
+  Ptr<DsrPrefixTable> m_prefixes;
+  /// Delay of the route recomputation after an interface goes down
+  Time m_failoverRecomputeDelay;
+  /// The pending route recomputation, if any
+  EventId m_recomputeEvent;
+  /// Generation of the queue discs and routing protocols the handles were resolved at
+  uint64_t m_handleGeneration;
+
+  /**
+   * \brief Create a Ipv4Route object from a routing table entry.
+   * \param route the selected routing table entry
+   * \param dest the destination address of the packet
+   * \return the route
+   */
+  Ptr<Ipv4Route> CreateRoute (const Ipv4DSRRoutingTableEntry *route, Ipv4Address dest) const;
+
+  /**
+   * \brief Last snapshot received from one queue disc of a neighbor.
+   */
+  struct NeighborQueue
+  {
+    NeighborQueue ()
+      : nAdjacencies (0),
+        received (false)
+    {
+    }
+    uint32_t nAdjacencies;           //!< adjacencies subscribed through this queue disc
+    bool received;                   //!< true once a snapshot has been received
+    DsrQueueSnapshot snapshot;       //!< the last snapshot
+  };
+
+  /// Snapshots of the neighbors' queue discs, keyed by queue disc
+  typedef std::unordered_map<const DsrVirtualQueueDisc *, NeighborQueue> NeighborQueues;
+
+  /**
+   * \brief Handles used by the budget lookahead on one interface.
+   *
+   * The record keeps a reference to the objects so that the per-packet
+   * path does not have to search for them.  They are looked up again
+   * after RefreshAdjacencies () and whenever a DSR queue disc or routing
+   * protocol of the simulation is initialized or disposed.
+   */
+  struct Adjacency
+  {
+    Adjacency ()
+      : resolved (false)
+    {
+    }
+    bool resolved;                   //!< true once the handles have been looked up
+    Ptr<DsrVirtualQueueDisc> localQueue; //!< root queue disc of the interface, if it is a DSR one
+    DataRate linkRate;               //!< rate of the point-to-point device, 0 if unknown
+    Ptr<Ipv4DSRRouting> neighbor;    //!< DSR routing of the point-to-point peer, if any
+    std::vector<Ptr<DsrVirtualQueueDisc> > neighborQueues; //!< the peer's queue discs subscribed to
+  };
+
+  /**
+   * \brief A forwarding decision reused for the packets to the same
+   * destination with a budget in the same range.
+   *
+   * Only ShortestFeasible decisions are cached: they follow from which
+   * lanes are full, so the decision stays exact while the occupancy epochs
+   * of the queues looked at to take it are unchanged.  The other policies
+   * compare the bytes queued, which move with every packet.
+   */
+  struct CachedDecision
+  {
+    static const uint32_t MAX_PROBES = 8;           //!< queues recorded at most
+    Time expires;                                   //!< end of validity
+    uint32_t route;                                 //!< index of the selected candidate
+    uint32_t nProbes;                               //!< queues recorded, MAX_PROBES + 1 if too many
+    Ptr<const DsrVirtualQueueDisc> queue[MAX_PROBES]; //!< queues looked at
+    uint32_t epoch[MAX_PROBES];                     //!< their occupancy epochs at the time
+    bool remote[MAX_PROBES];                        //!< whether each queue belongs to a neighbor
+  };
 
-  /// container of Ipv4RoutingTableEntry (routes to hosts)
-  typedef std::list<Ipv4DSRRoutingTableEntry *> HostRoutes;
-  /// const iterator of container of Ipv4RoutingTableEntry (routes to hosts)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::const_iterator HostRoutesCI;
-  /// iterator of container of Ipv4RoutingTableEntry (routes to hosts)
-  typedef std::list<Ipv4DSRRoutingTableEntry *>::iterator HostRoutesI;
+  /// Cached decisions, keyed by destination and budget range
+  typedef std::unordered_map<uint64_t, CachedDecision> DecisionCache;
+  /// The cache is flushed when it grows past this many decisions
+  static const uint32_t MAX_CACHED_DECISIONS = 4096;
+
+  /**
+   * \brief Find a still valid cached decision.
+   * \param key the destination and budget range
+   * \param routes the candidates to the destination
+   * \param nRoutes the number of candidates
+   * \param budget the budget of the packet, in Microseconds
+   * \return the cached candidate, or 0
+   */
+  const Ipv4DSRRoutingTableEntry *LookupDecisionCache (uint64_t key, const Ipv4DSRRoutingTableEntry *routes,
+                                                       uint32_t nRoutes, uint32_t budget);
+  /**
+   * \brief Record a queue looked at while taking a decision.
+   * \param decision the decision being taken, or 0
+   * \param queue the queue disc
+   * \param remote true if the queue disc belongs to a neighbor
+   */
+  void RecordProbe (CachedDecision *decision, Ptr<const DsrVirtualQueueDisc> queue, bool remote) const;
+  /**
+   * \brief Get the occupancy epoch of a queue disc as the lookahead sees it.
+   *
+   * With QueueStateSnapshots the state of a neighbor's queue disc comes
+   * from its last snapshot, and so does its epoch; a missing or stale
+   * snapshot has an epoch of its own.
+   *
+   * \param queue the queue disc
+   * \param remote true if the queue disc belongs to a neighbor
+   * \return the occupancy epoch
+   */
+  uint32_t GetProbeEpoch (const DsrVirtualQueueDisc *queue, bool remote) const;
+  /**
+   * \brief Update the tag of a DSR packet for the selected route.
+   * \param route the selected route
+   * \param dest the destination address of the packet
+   * \param remaining the remaining budget of the packet, in Microseconds
+   * \param dsrTag the tag to update
+   * \return the route
+   */
+  Ptr<Ipv4Route> SelectRoute (const Ipv4DSRRoutingTableEntry *route, Ipv4Address dest,
+                              int64_t remaining, DsrTag &dsrTag) const;
+  /**
+   * \brief Find the shortest feasible loop-free alternate that fits in the
+   * remaining budget, whatever the distance the previous hop expected.
+   * \param dest the destination address
+   * \param routes the candidates to \p dest
+   * \param nRoutes the number of candidates
+   * \param remaining the remaining budget of the packet, in Microseconds
+   * \param oif output interface if any (put 0 otherwise)
+   * \return the alternate, or 0
+   */
+  const Ipv4DSRRoutingTableEntry *LookupLoopFreeAlternate (Ipv4Address dest, const Ipv4DSRRoutingTableEntry *routes,
+                                                           uint32_t nRoutes, int64_t remaining, Ptr<NetDevice> oif);
+
+  /**
+   * \brief Get the adjacency record of an interface, resolving it first if
+   * needed.
+   * \param interface the interface index
+   * \return the adjacency record
+   */
+  const Adjacency &GetAdjacency (uint32_t interface);
+  /**
+   * \brief Look up the queue disc and neighbor handles of an interface.
+   * \param interface the interface index
+   */
+  void ResolveAdjacency (uint32_t interface);
+  /**
+   * \brief Forget the handles of an adjacency record and its snapshot
+   * subscriptions.
+   * \param adj the adjacency record
+   */
+  void ReleaseAdjacency (Adjacency &adj);
+  /**
+   * \brief Refresh the adjacencies if a DSR queue disc or routing protocol
+   * was initialized or disposed since they were resolved.
+   */
+  void CheckHandleGeneration (void);
+  /**
+   * \brief Get the queue disc this node uses on its shortest route to a
+   * destination, or on its route through a given next hop.  Called by the
+   * upstream neighbors during their lookahead.
+   * \param dest the destination address
+   * \param via the next hop, 0.0.0.0 for the shortest route; the shortest
+   * route is also used if there is no route through \p via
+   * \return the queue disc, or 0 if there is no route or it is not a DSR one
+   */
+  DsrVirtualQueueDisc *GetEgressQueue (Ipv4Address dest, Ipv4Address via = Ipv4Address::GetZero ());
+  /**
+   * \brief Ask the route manager for the routes to a destination without
+   * host routes, when the routes are computed on demand.
+   * \param dest the destination address
+   */
+  void ResolveOnDemand (Ipv4Address dest);
+  /**
+   * \brief Get the key of the host routes to a destination.
+   * \param dest the destination address
+   * \return the value of the prefix table for the address, or the address
+   */
+  Ipv4Address GetRouteKey (Ipv4Address dest) const;
+  /**
+   * \brief Subscribe to the snapshots of every DSR queue disc of the peer
+   * of an interface.
+   * \param adj the adjacency record of the interface
+   * \param peer the peer node
+   */
+  void SubscribeToNeighborQueues (Adjacency &adj, Ptr<Node> peer);
+  /**
+   * \brief Store a snapshot published by a queue disc of a neighbor.
+   * \param snapshot the snapshot
+   */
+  void ReceiveQueueSnapshot (const DsrQueueSnapshot &snapshot);
+  /**
+   * \brief Check whether the queue a neighbor would use next is overloaded,
+   * either by reading it directly or from its last snapshot.
+   * \param queue the queue disc of the neighbor
+   * \return true if both the fast and the slow lane are full
+   */
+  bool IsNextQueueOverloaded (const DsrVirtualQueueDisc *queue) const;
+  /**
+   * \brief Check whether a candidate route can take a DSR packet now: it
+   * leaves through \p oif (if given), the local fast and slow lanes have
+   * room and the neighbor's next queue is not overloaded.
+   * \param dest the destination address
+   * \param route the candidate route
+   * \param oif output interface if any (put 0 otherwise)
+   * \param probes if not 0, the queues looked at are recorded there
+   * \return the adjacency record of the route's interface, or 0 if the
+   * candidate is not feasible
+   */
+  const Adjacency *GetFeasibleAdjacency (Ipv4Address dest, const Ipv4DSRRoutingTableEntry &route, Ptr<NetDevice> oif,
+                                         CachedDecision *probes = 0);
+  /**
+   * \brief Estimate how long the packets queued on an interface take to
+   * leave it.
+   * \param adj the adjacency record of the interface
+   * \return the estimated delay in Microseconds, 0 if unknown
+   */
+  uint64_t EstimateQueueDelay (const Adjacency &adj) const;
+  /**
+   * \brief Ordering of the candidates by distance, used to find the budget
+   * cutoff with a binary search.
+   * \param route a candidate route
+   * \param distance a distance
+   * \return true if \p route is shorter than \p distance
+   */
+  static bool CompareDistance (const Ipv4DSRRoutingTableEntry &route, uint32_t distance);
 
   /// container of Ipv4RoutingTableEntry (routes to networks)
   typedef std::list<Ipv4DSRRoutingTableEntry *> NetworkRoutes;
@@ -296,11 +715,51 @@ private:
   /// iterator of container of Ipv4RoutingTableEntry (routes to external AS)
   typedef std::list<Ipv4DSRRoutingTableEntry *>::iterator ASExternalRoutesI;
 
-  HostRoutes m_hostRoutes;             //!< Routes to hosts
+  DsrFib m_hostRoutes;                 //!< Routes to hosts, indexed by destination
   NetworkRoutes m_networkRoutes;       //!< Routes to networks
   ASExternalRoutes m_ASexternalRoutes; //!< External routes imported
 
+  DsrFib m_stagedHostRoutes;                 //!< Routes to hosts being built
+  NetworkRoutes m_stagedNetworkRoutes;       //!< Routes to networks being built
+  ASExternalRoutes m_stagedASexternalRoutes; //!< External routes being built
+
+  /// Routes taken out of the table while their interface is down
+  struct DownRoutes
+  {
+    std::vector<Ipv4DSRRoutingTableEntry> hostRoutes; //!< host routes through the interface
+    NetworkRoutes networkRoutes;                      //!< network routes through the interface
+  };
+  /// Routes of the interfaces that are down, keyed by interface, until
+  /// they come back up or the table is replaced
+  std::map<uint32_t, DownRoutes> m_downRoutes;
+
+  /**
+   * \brief Take the routes through an interface that went down out of the
+   * table, keeping them for RestoreRoutesThrough.
+   * \param interface the interface index
+   */
+  void RemoveRoutesThrough (uint32_t interface);
+  /**
+   * \brief Put back the routes through an interface that came back up.
+   * \param interface the interface index
+   */
+  void RestoreRoutesThrough (uint32_t interface);
+  /**
+   * \brief Forget the routes of the interfaces that are down, once the
+   * table no longer matches them.
+   */
+  void ClearDownRoutes (void);
+
+  /**
+   * \brief Delete the entries of a route list and empty it.
+   * \param routes the route list
+   */
+  static void DeleteRoutes (std::list<Ipv4DSRRoutingTableEntry *> &routes);
+
   Ptr<Ipv4> m_ipv4; //!< associated IPv4 instance
+  std::vector<Adjacency> m_adjacencies; //!< adjacency records, indexed by interface
+  NeighborQueues m_neighborQueues;      //!< snapshots of the queue discs subscribed to
+  DecisionCache m_decisionCache;        //!< reusable forwarding decisions
 
   // DSRRouteManagerNSDB* m_nsdb;
 };
@@ -0,0 +1,218 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: choice of the candidate route by each CandidatePolicy
+//
+//          100Mbps  n1
+//         /            \
+//       n0              n3
+//         \            /
+//          1Mbps    n2
+//
+// - n0 has two candidates towards n3: the shorter one through n1, on the
+//   fast link, and the longer one through n2, on the slow link
+// - packets are put straight into the queue discs of n0, untagged so that
+//   they go to the last lane and leave every candidate feasible:
+//   - fast link loaded, slow link empty: ShortestFeasible keeps n1,
+//     MostSlack and LeastLoaded take n2
+//   - fast link loaded, one packet on the slow link: ShortestFeasible and
+//     MostSlack keep n1, the packet taking longer to drain on the slow
+//     link than the whole queue on the fast one, LeastLoaded takes n2,
+//     which has fewer bytes queued
+// - the expected gateway is also worked out from the distances of the
+//   candidates, so that the test fails if they do not set the cases up
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrCandidatePolicyTest");
+
+static const uint32_t PACKET_SIZE = 1000;
+
+static bool g_pass = true;
+
+static void
+Fill (Ptr<QueueDisc> queue, uint32_t nPackets)
+{
+  for (uint32_t i = 0; i < nPackets; i++)
+    {
+      Ptr<Packet> p = Create<Packet> (PACKET_SIZE);
+      queue->Enqueue (Create<Ipv4QueueDiscItem> (p, Address (), Ipv4L3Protocol::PROT_NUMBER, Ipv4Header ()));
+    }
+}
+
+static const char *
+PolicyName (Ipv4DSRRouting::CandidatePolicy policy)
+{
+  switch (policy)
+    {
+    case Ipv4DSRRouting::SHORTEST_FEASIBLE:
+      return "ShortestFeasible";
+    case Ipv4DSRRouting::MOST_SLACK:
+      return "MostSlack";
+    default:
+      return "LeastLoaded";
+    }
+}
+
+static void
+CheckPolicy (Ptr<Ipv4DSRRouting> routing, Ipv4DSRRouting::CandidatePolicy policy,
+             Ipv4Address dest, Ipv4Address expected, const char *name)
+{
+  routing->SetAttribute ("CandidatePolicy", EnumValue (policy));
+  DsrTag tag;
+  tag.SetTimestamp (Simulator::Now ());
+  tag.SetBudget (1000000);
+  Ptr<Ipv4Route> route = routing->LookupDSRRoute (dest, tag);
+  if (route == 0 || route->GetGateway () != expected)
+    {
+      std::cout << "FAIL: " << name << ", " << PolicyName (policy) << " goes through "
+                << (route != 0 ? route->GetGateway () : Ipv4Address::GetZero ())
+                << " instead of " << expected << std::endl;
+      g_pass = false;
+    }
+}
+
+static void
+RunChecks (Ptr<Ipv4DSRRouting> routing, Ptr<QueueDisc> fastQueue, Ptr<QueueDisc> slowQueue,
+           Ipv4Address dest, Ipv4Address viaFast, Ipv4Address viaSlow)
+{
+  uint32_t distFast = 0;
+  uint32_t distSlow = 0;
+  for (uint32_t i = 0; i < routing->GetNRoutes (); i++)
+    {
+      Ipv4DSRRoutingTableEntry *route = routing->GetRoute (i);
+      if (route->IsHost () && route->GetDest () == dest)
+        {
+          if (route->GetGateway () == viaFast)
+            {
+              distFast = route->GetDistance ();
+            }
+          else if (route->GetGateway () == viaSlow)
+            {
+              distSlow = route->GetDistance ();
+            }
+        }
+    }
+  if (distFast == 0 || distSlow == 0 || distFast >= distSlow)
+    {
+      std::cout << "FAIL: expected a shorter candidate through " << viaFast
+                << " and a longer one through " << viaSlow << std::endl;
+      g_pass = false;
+      return;
+    }
+
+  // 40 packets on 100Mbps drain in 3.3ms, one on 1Mbps in 8.2ms
+  uint32_t nFast = 40;
+  uint64_t fastDelay = uint64_t (nFast) * (PACKET_SIZE + 20) * 8 / 100;
+  uint64_t slowDelay = uint64_t (PACKET_SIZE + 20) * 8;
+  if (distFast + fastDelay <= distSlow || distFast + fastDelay >= distSlow + slowDelay)
+    {
+      std::cout << "FAIL: the distances " << distFast << " and " << distSlow
+                << " do not set the cases up" << std::endl;
+      g_pass = false;
+      return;
+    }
+
+  Fill (fastQueue, nFast);
+  CheckPolicy (routing, Ipv4DSRRouting::SHORTEST_FEASIBLE, dest, viaFast, "fast link loaded");
+  CheckPolicy (routing, Ipv4DSRRouting::MOST_SLACK, dest, viaSlow, "fast link loaded");
+  CheckPolicy (routing, Ipv4DSRRouting::LEAST_LOADED, dest, viaSlow, "fast link loaded");
+
+  Fill (slowQueue, 1);
+  CheckPolicy (routing, Ipv4DSRRouting::SHORTEST_FEASIBLE, dest, viaFast, "both links loaded");
+  CheckPolicy (routing, Ipv4DSRRouting::MOST_SLACK, dest, viaFast, "both links loaded");
+  CheckPolicy (routing, Ipv4DSRRouting::LEAST_LOADED, dest, viaSlow, "both links loaded");
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  NodeContainer nodes;
+  nodes.Create (4);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper fastLink;
+  fastLink.SetDeviceAttribute ("DataRate", StringValue ("100Mbps"));
+  fastLink.SetChannelAttribute ("Delay", StringValue ("1ms"));
+  PointToPointHelper slowLink;
+  slowLink.SetDeviceAttribute ("DataRate", StringValue ("1Mbps"));
+  slowLink.SetChannelAttribute ("Delay", StringValue ("1ms"));
+
+  NetDeviceContainer d01 = fastLink.Install (nodes.Get (0), nodes.Get (1));
+  NetDeviceContainer d02 = slowLink.Install (nodes.Get (0), nodes.Get (2));
+  NetDeviceContainer d13 = fastLink.Install (nodes.Get (1), nodes.Get (3));
+  NetDeviceContainer d23 = fastLink.Install (nodes.Get (2), nodes.Get (3));
+
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc");
+  QueueDiscContainer q01 = tch.Install (d01);
+  QueueDiscContainer q02 = tch.Install (d02);
+  tch.Install (d13);
+  tch.Install (d23);
+
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer i01 = ipv4.Assign (d01);
+  ipv4.NewNetwork ();
+  Ipv4InterfaceContainer i02 = ipv4.Assign (d02);
+  ipv4.NewNetwork ();
+  Ipv4InterfaceContainer i13 = ipv4.Assign (d13);
+  ipv4.NewNetwork ();
+  Ipv4InterfaceContainer i23 = ipv4.Assign (d23);
+  i01.SetMetric (0, 1000);
+  i01.SetMetric (1, 1000);
+  i02.SetMetric (0, 1000);
+  i02.SetMetric (1, 1000);
+  i13.SetMetric (0, 1000);
+  i13.SetMetric (1, 1000);
+  i23.SetMetric (0, 2000);
+  i23.SetMetric (1, 2000);
+
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  Ptr<Ipv4DSRRouting> routing = nodes.Get (0)->GetObject<DSRRouter> ()->GetRoutingProtocol ();
+  // the queue discs are initialized with their node when the simulation starts
+  Simulator::Schedule (Seconds (0.1), &RunChecks, routing, q01.Get (0), q02.Get (0),
+                       i13.GetAddress (1), i01.GetAddress (1), i02.GetAddress (1));
+  Simulator::Stop (Seconds (0.2));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  if (!g_pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
@@ -0,0 +1,165 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: earliest deadline first lanes of DsrVirtualQueueDisc
+//
+// - a DsrDeadlineQueue is filled with packets of random deadlines, some of
+//   them spread over more than a calendar year, some without budget, and
+//   drained while packets keep coming; every packet must come out in
+//   deadline order with respect to the packets queued at that time, the
+//   packets without budget last and in arrival order
+// - a DsrVirtualQueueDisc with an edf lane is left unserved until some of
+//   its packets are past their deadline; they are dropped at dequeue with
+//   TIMEOUT_DROP and the others come out earliest deadline first
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrDeadlineQueueTest");
+
+static Ptr<QueueDiscItem>
+MakeItem (Time timestamp, uint32_t budget, uint32_t id)
+{
+  Ptr<Packet> packet = Create<Packet> (52);
+  DsrTag tag;
+  tag.SetTimestamp (timestamp);
+  tag.SetBudget (budget);
+  tag.SetPriority (0);
+  tag.SetDistance (id);
+  packet->AddPacketTag (tag);
+  return Create<Ipv4QueueDiscItem> (packet, Address (), Ipv4L3Protocol::PROT_NUMBER, Ipv4Header ());
+}
+
+static uint32_t
+GetId (Ptr<const QueueDiscItem> item)
+{
+  DsrTag tag;
+  item->GetPacket ()->PeekPacketTag (tag);
+  return tag.GetDistance ();
+}
+
+static void
+Drain (Ptr<QueueDisc> queue, std::vector<uint32_t> *order)
+{
+  Ptr<QueueDiscItem> item;
+  while ((item = queue->Dequeue ()) != 0)
+    {
+      order->push_back (GetId (item));
+    }
+}
+
+static bool
+CheckOrder (uint32_t nPackets)
+{
+  Ptr<DsrDeadlineQueue> queue = CreateObject<DsrDeadlineQueue> ();
+  queue->SetAttribute ("MaxSize", QueueSizeValue (QueueSize ("100000p")));
+  queue->SetAttribute ("Buckets", UintegerValue (16));
+
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  // deadline -> ids queued with it, in arrival order
+  std::multimap<Time, uint32_t> expected;
+  uint32_t id = 0;
+  uint32_t popped = 0;
+  while (popped < nPackets)
+    {
+      uint32_t burst = random->GetInteger (0, 4);
+      for (uint32_t i = 0; i < burst && id < nPackets; i++, id++)
+        {
+          // 1 in 10 without budget, else up to 50ms, more than 16 slots of 100us
+          uint32_t budget = random->GetInteger (0, 9) == 0 ? 0 : random->GetInteger (1, 50000);
+          Time timestamp = MicroSeconds (random->GetInteger (0, 1000));
+          Ptr<QueueDiscItem> item = MakeItem (timestamp, budget, id);
+          expected.insert (std::make_pair (DsrDeadlineQueue::GetDeadline (item), id));
+          queue->Enqueue (item);
+        }
+      for (uint32_t i = random->GetInteger (0, 3); i > 0 && !expected.empty (); i--, popped++)
+        {
+          Ptr<const QueueDiscItem> peeked = queue->Peek ();
+          Ptr<QueueDiscItem> item = queue->Dequeue ();
+          if (peeked != item || GetId (item) != expected.begin ()->second)
+            {
+              std::cout << "FAIL: packet " << GetId (item) << " popped instead of "
+                        << expected.begin ()->second << std::endl;
+              return false;
+            }
+          expected.erase (expected.begin ());
+        }
+    }
+  return queue->IsEmpty ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nPackets = 100000;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("nPackets", "Packets through the deadline queue", nPackets);
+  cmd.Parse (argc, argv);
+
+  bool pass = true;
+
+  // ------------------- deadline order ----------------------
+  if (!CheckOrder (nPackets))
+    {
+      pass = false;
+    }
+
+  // ------------------- expired packets ----------------------
+  Ptr<DsrVirtualQueueDisc> queue = CreateObject<DsrVirtualQueueDisc> ();
+  queue->SetAttribute ("LaneTypes", StringValue ("edf,fifo"));
+  queue->Initialize ();
+  // deadlines 5, 1, 4, 2, 3 ms
+  uint32_t budgets[] = {5000, 1000, 4000, 2000, 3000};
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      queue->Enqueue (MakeItem (Seconds (0), budgets[i], i));
+    }
+  std::vector<uint32_t> order;
+  Simulator::Schedule (MicroSeconds (2500), &Drain, queue, &order);
+  Simulator::Run ();
+  uint32_t timeouts = queue->GetStats ().GetNDroppedPackets (DsrVirtualQueueDisc::TIMEOUT_DROP);
+  queue->Dispose ();
+  Simulator::Destroy ();
+
+  std::cout << "edf lane at 2.5ms: " << timeouts << " timed out, served";
+  for (uint32_t i = 0; i < order.size (); i++)
+    {
+      std::cout << " " << order[i];
+    }
+  std::cout << std::endl;
+  if (timeouts != 2 || order.size () != 3 || order[0] != 4 || order[1] != 2 || order[2] != 0)
+    {
+      std::cout << "FAIL: expected 2 timed out, served 4 2 0" << std::endl;
+      pass = false;
+    }
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
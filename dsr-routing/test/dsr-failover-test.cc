@@ -0,0 +1,289 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: fast failover on the loop-free alternates when a link goes down
+//
+// Network topology (experiment 2)
+//
+//    n0 ------ n3 ------ n6
+//    |         |         |
+//    n1 ------ n4 ------ n7
+//    |         |         |
+//    n2 ------ n5 ------ n8
+//
+// - same links, rates, delays and metrics as exp2: the shortest paths of
+//   the DSR flow from n2 to n6 go through the link n1 -> n4
+// - the loop-free alternates are marked when the routes are populated, the
+//   routers have FastFailover set, and the routes are never recomputed
+//   (RespondToInterfaceEvents is false)
+// - the link n1 -> n4 fails in the middle of the flow: both its ends drop
+//   every packet they receive, and the interface of n1 on it goes down;
+//   n1 drops its routes through it and sends the flow through n0
+// - the link comes back later in the flow: n1 must get back the routes it
+//   had and send packets on it again
+// - the packets already queued or on the wire of the link when it fails
+//   are lost with it, whatever the routing does; the test passes if the
+//   routing loses none of the others: n1 queues nothing on the link while
+//   it is down, every packet not received is one dropped on the link, and
+//   n0 carries the flow meanwhile
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrFailoverTest");
+
+static uint32_t g_viaN0 = 0;       // packets received by n0 from n1
+static uint32_t g_viaN4 = 0;       // packets received by n4 from n1
+static uint32_t g_droppedN4 = 0;   // packets dropped by n4 on the failed link
+static uint32_t g_queuedN1 = 0;    // packets queued by n1 on the link to n4
+
+static void
+CountPacket (uint32_t *count, Ptr<const Packet> p)
+{
+  (*count)++;
+}
+
+static void
+CountItem (uint32_t *count, Ptr<const QueueDiscItem> item)
+{
+  (*count)++;
+}
+
+static void
+FailLink (Ptr<RateErrorModel> em, Ptr<Ipv4> ipv4, uint32_t interface,
+          Ptr<DsrPacketSink> sink, uint64_t *rxAtFail)
+{
+  em->Enable ();
+  ipv4->SetDown (interface);
+  *rxAtFail = sink->GetTotalRx ();
+  g_viaN0 = 0;
+  g_queuedN1 = 0;
+}
+
+static void
+RestoreLink (Ptr<RateErrorModel> em, Ptr<Ipv4> ipv4, uint32_t interface,
+             uint32_t *viaN0WhileDown, uint32_t *queuedWhileDown)
+{
+  *viaN0WhileDown = g_viaN0;
+  *queuedWhileDown = g_queuedN1;
+  em->Disable ();
+  ipv4->SetUp (interface);
+  g_viaN4 = 0;
+}
+
+static void
+CountRoutes (Ptr<Ipv4DSRRouting> routing, uint32_t *nRoutes)
+{
+  *nRoutes = routing->GetNRoutes ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  double failTime = 0.2;
+  double restoreTime = 0.35;
+  bool loopFreeAlternates = true;
+  bool fastFailover = true;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("failTime", "When the link n1 -> n4 goes down, in seconds", failTime);
+  cmd.AddValue ("restoreTime", "When the link n1 -> n4 comes back, in seconds", restoreTime);
+  cmd.AddValue ("loopFreeAlternates", "Mark the loop-free alternates", loopFreeAlternates);
+  cmd.AddValue ("fastFailover", "Drop the routes through an interface as soon as it goes down", fastFailover);
+  cmd.Parse (argc, argv);
+
+  Config::SetDefault ("ns3::Ipv4DSRRouting::FastFailover", BooleanValue (fastFailover));
+
+  // ------------------ build topology ---------------------------
+  NodeContainer nodes;
+  nodes.Create (9);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  std::string channelDataRate1 = "10Mbps"; // link data rate (High)
+  std::string channelDataRate2 = "5Mbps"; // link data rate (low)
+  uint32_t delayInMicro1 = 3000; // transmission + propagation delay (Short)
+  uint32_t delayInMicro2 = 5000; // transmission + propagation delay (Long)
+  std::vector<NetDeviceContainer> devices (12);
+
+  p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate (channelDataRate1)));
+  p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (delayInMicro1)));
+  devices[10] = p2p.Install (nodes.Get (2), nodes.Get (5));
+  devices[5] = p2p.Install (nodes.Get (1), nodes.Get (4));
+  devices[9] = p2p.Install (nodes.Get (7), nodes.Get (8));
+  devices[1] = p2p.Install (nodes.Get (3), nodes.Get (6));
+  devices[6] = p2p.Install (nodes.Get (4), nodes.Get (7));
+
+  p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate (channelDataRate1)));
+  p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (delayInMicro2)));
+  devices[2] = p2p.Install (nodes.Get (0), nodes.Get (1));
+  devices[8] = p2p.Install (nodes.Get (4), nodes.Get (5));
+
+  p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate (channelDataRate2)));
+  p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (delayInMicro1)));
+  devices[0] = p2p.Install (nodes.Get (0), nodes.Get (3));
+  devices[7] = p2p.Install (nodes.Get (1), nodes.Get (2));
+
+  p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate (channelDataRate2)));
+  p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (delayInMicro2)));
+  devices[4] = p2p.Install (nodes.Get (6), nodes.Get (7));
+  devices[3] = p2p.Install (nodes.Get (3), nodes.Get (4));
+  devices[11] = p2p.Install (nodes.Get (5), nodes.Get (8));
+
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc");
+  std::vector<QueueDiscContainer> queueDiscs (devices.size ());
+  for (uint32_t i = 0; i < devices.size (); i++)
+    {
+      queueDiscs[i] = tch.Install (devices[i]);
+    }
+
+  // ------------------- IP addresses AND Link Metric ----------------------
+  uint16_t Metric1 = 7000;
+  uint16_t Metric2 = 6000;
+  uint16_t Metric3 = 5000;
+  uint16_t Metric4 = 4000;
+  // the links of exp2, in the order their addresses are assigned
+  struct
+  {
+    uint32_t device;
+    const char *base;
+    uint16_t metric;
+  } links[12] = {
+    { 2, "10.1.1.0", Metric2 }, { 0, "10.1.11.0", Metric2 }, { 7, "10.1.2.0", Metric3 },
+    { 5, "10.1.12.0", Metric4 }, { 10, "10.1.13.0", Metric4 }, { 3, "10.1.4.0", Metric1 },
+    { 1, "10.1.14.0", Metric4 }, { 8, "10.1.5.0", Metric2 }, { 6, "10.1.15.0", Metric4 },
+    { 11, "10.1.16.0", Metric1 }, { 4, "10.1.7.0", Metric1 }, { 9, "10.1.8.0", Metric4 }
+  };
+  std::vector<Ipv4InterfaceContainer> interfaces (12);
+  Ipv4AddressHelper ipv4;
+  for (uint32_t i = 0; i < 12; i++)
+    {
+      ipv4.SetBase (links[i].base, "255.255.255.0");
+      interfaces[links[i].device] = ipv4.Assign (devices[links[i].device]);
+      interfaces[links[i].device].SetMetric (0, links[i].metric);
+      interfaces[links[i].device].SetMetric (1, links[i].metric);
+    }
+
+  Ipv4DSRRoutingHelper::SetLoopFreeAlternates (loopFreeAlternates);
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  // ------------------- DSR flow n2 --> n6 ----------------------
+  uint16_t sinkPort = 9;
+  Address sinkAddress (InetSocketAddress (interfaces[4].GetAddress (0), sinkPort));
+  DsrSinkHelper dsrSinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), sinkPort));
+  ApplicationContainer sinkApps = dsrSinkHelper.Install (nodes.Get (6));
+  sinkApps.Start (Seconds (0.0));
+  sinkApps.Stop (Seconds (3.0));
+
+  uint32_t budget = 25; //ms
+  uint32_t packetSize = 52;
+  uint32_t nPacket = 2500;
+  Ptr<Socket> udpSocket = Socket::CreateSocket (nodes.Get (2), UdpSocketFactory::GetTypeId ());
+  Ptr<DsrUdpApplication> app = CreateObject<DsrUdpApplication> ();
+  app->Setup (udpSocket, sinkAddress, packetSize, nPacket, DataRate ("2Mbps"), budget, true);
+  nodes.Get (2)->AddApplication (app);
+  app->SetStartTime (Seconds (0.0));
+  app->SetStopTime (Seconds (3.0));
+
+  // ------------------- failure of the link n1 -> n4 ----------------------
+  // Ipv4::SetDown alone leaves the channel working, so both ends of the
+  // link also drop everything they receive while it is down
+  Ptr<RateErrorModel> em = CreateObject<RateErrorModel> ();
+  em->SetAttribute ("ErrorRate", DoubleValue (1.0));
+  em->SetAttribute ("ErrorUnit", EnumValue (RateErrorModel::ERROR_UNIT_PACKET));
+  em->Disable ();
+  devices[5].Get (0)->SetAttribute ("ReceiveErrorModel", PointerValue (em));
+  devices[5].Get (1)->SetAttribute ("ReceiveErrorModel", PointerValue (em));
+
+  devices[2].Get (0)->TraceConnectWithoutContext ("MacRx", MakeBoundCallback (&CountPacket, &g_viaN0));
+  devices[5].Get (1)->TraceConnectWithoutContext ("MacRx", MakeBoundCallback (&CountPacket, &g_viaN4));
+  devices[5].Get (1)->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&CountPacket, &g_droppedN4));
+  queueDiscs[5].Get (0)->TraceConnectWithoutContext ("Enqueue", MakeBoundCallback (&CountItem, &g_queuedN1));
+
+  Ptr<DsrPacketSink> sink = DynamicCast<DsrPacketSink> (sinkApps.Get (0));
+  Ptr<Ipv4DSRRouting> n1Routing = nodes.Get (1)->GetObject<DSRRouter> ()->GetRoutingProtocol ();
+  uint32_t nRoutesBefore = n1Routing->GetNRoutes ();
+  uint32_t nRoutesAfter = 0;
+  uint64_t rxAtFail = 0;
+  uint32_t viaN0WhileDown = 0;
+  uint32_t queuedWhileDown = 0;
+  std::pair<Ptr<Ipv4>, uint32_t> n1n4 = interfaces[5].Get (0);
+  Simulator::Schedule (Seconds (failTime), &FailLink, em, n1n4.first, n1n4.second, sink, &rxAtFail);
+  Simulator::Schedule (Seconds (restoreTime), &RestoreLink, em, n1n4.first, n1n4.second,
+                       &viaN0WhileDown, &queuedWhileDown);
+  Simulator::Schedule (Seconds (restoreTime), &CountRoutes, n1Routing, &nRoutesAfter);
+
+  Simulator::Stop (Seconds (3.0));
+  Simulator::Run ();
+
+  uint64_t received = sink->GetTotalRx () / packetSize;
+  Simulator::Destroy ();
+
+  std::cout << "sent " << nPacket << ", received " << received
+            << ", lost " << nPacket - received << ", received before the failure " << rxAtFail / packetSize
+            << ", through n0 while the link was down " << viaN0WhileDown
+            << ", in flight on the link when it failed " << g_droppedN4
+            << ", queued on the link while it was down " << queuedWhileDown << std::endl;
+  bool pass = true;
+  if (queuedWhileDown > 0)
+    {
+      std::cout << "FAIL: n1 still sends packets on the link while it is down" << std::endl;
+      pass = false;
+    }
+  if (received + g_droppedN4 < nPacket)
+    {
+      std::cout << "FAIL: " << nPacket - received - g_droppedN4
+                << " packets lost besides those in flight on the link" << std::endl;
+      pass = false;
+    }
+  if (viaN0WhileDown == 0)
+    {
+      std::cout << "FAIL: the flow does not go through n0 while the link is down" << std::endl;
+      pass = false;
+    }
+  if (nRoutesAfter != nRoutesBefore)
+    {
+      std::cout << "FAIL: n1 has " << nRoutesAfter << " routes once the link is back instead of "
+                << nRoutesBefore << std::endl;
+      pass = false;
+    }
+  if (g_viaN4 == 0)
+    {
+      std::cout << "FAIL: the flow does not use the link again once it is back" << std::endl;
+      pass = false;
+    }
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
@@ -0,0 +1,162 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: DsrFib routes by index
+//
+// - random host routes to 200 destinations go into a DsrFib; GetRoute (i)
+//   must return, for every i, the route the flat order gives: the
+//   destinations in the order they were first added, the candidates of a
+//   destination as Lookup returns them
+// - the indexes are walked forwards, backwards and at random, so that the
+//   cursor Locate resumes from is used and reset, and the check is run
+//   again after RemoveRoute, RemoveRoutesTo and more insertions
+
+#include <iostream>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/dsr-fib.h"
+
+using namespace ns3;
+
+// the routes of the table in the flat order, from Lookup
+static std::vector<const Ipv4DSRRoutingTableEntry *>
+FlatRoutes (const DsrFib &fib, const std::vector<Ipv4Address> &dests)
+{
+  std::vector<const Ipv4DSRRoutingTableEntry *> flat;
+  for (uint32_t d = 0; d < dests.size (); d++)
+    {
+      uint32_t n;
+      const Ipv4DSRRoutingTableEntry *routes = fib.Lookup (dests[d], n);
+      for (uint32_t k = 0; k < n; k++)
+        {
+          flat.push_back (&routes[k]);
+        }
+    }
+  return flat;
+}
+
+static bool
+CheckIndexes (const DsrFib &fib, const std::vector<Ipv4Address> &dests, Ptr<UniformRandomVariable> random)
+{
+  std::vector<const Ipv4DSRRoutingTableEntry *> flat = FlatRoutes (fib, dests);
+  if (flat.size () != fib.GetNRoutes ())
+    {
+      std::cout << "FAIL: " << fib.GetNRoutes () << " routes, " << flat.size () << " found by Lookup" << std::endl;
+      return false;
+    }
+  for (uint32_t i = 0; i < flat.size (); i++)
+    {
+      if (fib.GetRoute (i) != flat[i])
+        {
+          std::cout << "FAIL: forward walk, route " << i << std::endl;
+          return false;
+        }
+    }
+  for (uint32_t i = flat.size (); i-- > 0; )
+    {
+      if (fib.GetRoute (i) != flat[i])
+        {
+          std::cout << "FAIL: backward walk, route " << i << std::endl;
+          return false;
+        }
+    }
+  for (uint32_t k = 0; k < flat.size (); k++)
+    {
+      uint32_t i = random->GetInteger (0, flat.size () - 1);
+      if (fib.GetRoute (i) != flat[i])
+        {
+          std::cout << "FAIL: random access, route " << i << std::endl;
+          return false;
+        }
+    }
+  return true;
+}
+
+static void
+AddRoutes (DsrFib &fib, std::vector<Ipv4Address> &dests, uint32_t nRoutes, Ptr<UniformRandomVariable> random)
+{
+  for (uint32_t k = 0; k < nRoutes; k++)
+    {
+      Ipv4Address dest (0x0a000000 + random->GetInteger (1, 200));
+      uint32_t n;
+      if (fib.Lookup (dest, n) == 0)
+        {
+          bool known = false;
+          for (uint32_t d = 0; d < dests.size () && !known; d++)
+            {
+              known = dests[d] == dest;
+            }
+          if (!known)
+            {
+              dests.push_back (dest);
+            }
+        }
+      Ipv4Address gateway (0x0b000000 + random->GetInteger (1, 8));
+      fib.Insert (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, gateway, random->GetInteger (1, 4),
+                                                                random->GetInteger (1000, 9000)));
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  DsrFib fib;
+  std::vector<Ipv4Address> dests;
+  AddRoutes (fib, dests, 1000, random);
+  bool pass = CheckIndexes (fib, dests, random);
+
+  for (uint32_t k = 0; k < 100 && pass; k++)
+    {
+      uint32_t i = random->GetInteger (0, fib.GetNRoutes () - 1);
+      Ipv4Address dest = fib.GetRoute (i)->GetDest ();
+      fib.RemoveRoute (i);
+      uint32_t n;
+      if (fib.Lookup (dest, n) == 0)
+        {
+          // its last route gone, the destination loses its place
+          for (uint32_t d = 0; d < dests.size (); d++)
+            {
+              if (dests[d] == dest)
+                {
+                  dests.erase (dests.begin () + d);
+                  break;
+                }
+            }
+        }
+    }
+  pass = pass && CheckIndexes (fib, dests, random);
+
+  for (uint32_t k = 0; k < 20 && pass; k++)
+    {
+      fib.RemoveRoutesTo (dests[random->GetInteger (0, dests.size () - 1)]);
+    }
+  pass = pass && CheckIndexes (fib, dests, random);
+
+  AddRoutes (fib, dests, 500, random);
+  pass = pass && CheckIndexes (fib, dests, random);
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
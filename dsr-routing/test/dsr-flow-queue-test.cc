@@ -0,0 +1,182 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: per-flow fair queuing in the lanes of DsrVirtualQueueDisc
+//
+//    n0 --2Mbps-- n1
+//
+// - four budgeted DsrUdpApplication flows from n0 to n1 share the lane 0
+//   of the bottleneck, the queue disc of n0: one aggressive flow of 1000 B
+//   packets at 3Mbps, and three light flows of 52 B packets at 64kbps, all
+//   with a 50ms budget, for 4 s
+// - the packets are routed by DSR: the metric of the link, in
+//   Microseconds, is 5us short of the budget, so the route fits in it with
+//   less than 10us to spare and LookupDSRRoute tags the packets priority
+//   0.  The packets leave n0 with their whole budget, so it does not
+//   depend on the time they spend elsewhere.  The test fails if a packet
+//   arrives with another priority
+// - lane 0 holds 800 packets, more than the backlog of the aggressive flow
+//   after 4 s, so the lane is never full and DSR never turns a packet away
+//   from the link
+// - with a fifo lane 0 the backlog of the aggressive flow delays the light
+//   flows past their budget within a few tenths of a second; with an fq
+//   lane 0 they take turns with it and wait one round, about 5ms.  The
+//   test passes if fq raises the mean deadline-hit ratio of the light
+//   flows, packets received within their budget over packets sent, by 0.5
+//   or more; the estimate is about 0.02 with fifo and 1 with fq
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrFlowQueueTest");
+
+static const uint32_t N_FLOWS = 4;
+
+static uint32_t g_otherPriority = 0;
+
+static void
+RxDeadline (uint32_t *onTime, Ptr<const Packet> packet, const Address &from)
+{
+  DsrTag dsrTag;
+  if (!packet->PeekPacketTag (dsrTag))
+    {
+      return;
+    }
+  if (dsrTag.GetPriority () != 0)
+    {
+      g_otherPriority++;
+    }
+  if (Simulator::Now () <= dsrTag.GetTimestamp () + MicroSeconds (dsrTag.GetBudget ()))
+    {
+      (*onTime)++;
+    }
+}
+
+// Run the four flows through the bottleneck and fill the deadline-hit
+// ratio of each flow, the aggressive flow first.
+static void
+RunFlows (const std::string &laneTypes, double hitRatio[N_FLOWS])
+{
+  NodeContainer nodes;
+  nodes.Create (2);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper bottleneckLink;
+  bottleneckLink.SetDeviceAttribute ("DataRate", StringValue ("2Mbps"));
+  bottleneckLink.SetChannelAttribute ("Delay", StringValue ("5ms"));
+  bottleneckLink.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("1p"));
+
+  TrafficControlHelper tchBottleneck;
+  tchBottleneck.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc",
+                                  "LaneTypes", StringValue (laneTypes),
+                                  "LaneLimits", StringValue ("800p,36p,60p"),
+                                  "FlowBuckets", UintegerValue (1024));
+
+  NetDeviceContainer devicesBottleneck = bottleneckLink.Install (nodes.Get (0), nodes.Get (1));
+  tchBottleneck.Install (devicesBottleneck);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfacesBottleneck = address.Assign (devicesBottleneck);
+  uint32_t budget = 50; //ms
+  interfacesBottleneck.SetMetric (0, budget * 1000 - 5);
+  interfacesBottleneck.SetMetric (1, budget * 1000 - 5);
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  uint32_t packetSizes[N_FLOWS] = {1000, 52, 52, 52};
+  uint32_t nPackets[N_FLOWS] = {1500, 600, 600, 600};
+  const char *rates[N_FLOWS] = {"3Mbps", "64kbps", "64kbps", "64kbps"};
+  uint32_t onTime[N_FLOWS] = {0, 0, 0, 0};
+  for (uint32_t i = 0; i < N_FLOWS; i++)
+    {
+      uint16_t port = 9000 + i;
+      DsrSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
+      ApplicationContainer sinkApps = sinkHelper.Install (nodes.Get (1));
+      sinkApps.Start (Seconds (0.0));
+      sinkApps.Stop (Seconds (12.0));
+      sinkApps.Get (0)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&RxDeadline, &onTime[i]));
+
+      Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+      Ptr<DsrUdpApplication> app = CreateObject<DsrUdpApplication> ();
+      app->Setup (socket, InetSocketAddress (interfacesBottleneck.GetAddress (1), port),
+                  packetSizes[i], nPackets[i], DataRate (rates[i]), budget, false);
+      nodes.Get (0)->AddApplication (app);
+      app->SetStartTime (Seconds (0.1));
+      app->SetStopTime (Seconds (10.0));
+    }
+
+  Simulator::Stop (Seconds (12.0));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  for (uint32_t i = 0; i < N_FLOWS; i++)
+    {
+      hitRatio[i] = double (onTime[i]) / nPackets[i];
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  const char *laneTypes[] = {"fifo", "fq,fifo"};
+  double lightHitRatio[2];
+  for (uint32_t run = 0; run < 2; run++)
+    {
+      double hitRatio[N_FLOWS];
+      RunFlows (laneTypes[run], hitRatio);
+      std::cout << "lanes " << laneTypes[run] << ": deadline-hit ratio";
+      lightHitRatio[run] = 0;
+      for (uint32_t i = 0; i < N_FLOWS; i++)
+        {
+          std::cout << " " << hitRatio[i];
+          if (i != 0)
+            {
+              lightHitRatio[run] += hitRatio[i] / (N_FLOWS - 1);
+            }
+        }
+      std::cout << ", light flows " << lightHitRatio[run] << std::endl;
+    }
+
+  if (g_otherPriority != 0)
+    {
+      std::cout << "FAIL: " << g_otherPriority << " packets not tagged priority 0" << std::endl;
+      return 1;
+    }
+  if (lightHitRatio[1] < lightHitRatio[0] + 0.5)
+    {
+      std::cout << "FAIL: fair queuing does not protect the light flows" << std::endl;
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
@@ -0,0 +1,313 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: UpdateLinkMetric gives the tables of a full recomputation
+//
+// Synthetic topology: a 5-wide grid of --routers routers (the last row
+// incomplete by default), each one linked to its right and lower neighbors
+// by a point-to-point link of metric 1000 to 7000
+//
+//    n0 ----- n1 ----- n2 ...
+//    |        |        |
+//    n5 ----- n6 ----- n7 ...
+//
+// - for each set of options (none, two-hop candidates, loop-free
+//   alternates, both, routes on demand), the routes are computed, then a
+//   series of metric changes is applied with UpdateLinkMetric, one after
+//   the other: a link of the middle router raised, then lowered below
+//   every other metric, a link of n1 raised, a link of the last router
+//   lowered, and the first link put back to its metric
+// - after each change, the tables are those of a full recomputation
+//   (DeleteDSRRoutes, BuildDSRRoutingDatabase, InitializeRoutes) with the
+//   same metrics: every host route of every node, with its distance,
+//   flags and via, grouped by destination in candidate order, and the
+//   network routes in any order
+// - with the routes on demand, every router asks for its routes to every
+//   address before and after each change, and only the host routes are
+//   compared, against an up-front recomputation
+// - the time of each UpdateLinkMetric and of each full recomputation is
+//   printed; the test does not depend on it
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrLinkMetricUpdateTest");
+
+static const uint32_t WIDTH = 5;
+
+/// Options of the route computation
+struct Options
+{
+  const char *name;             //!< printed name
+  uint32_t candidates;          //!< SetCandidatesPerDestination
+  bool loopFree;                //!< SetLoopFreeAlternates
+  bool lazy;                    //!< SetLazyRoutes
+};
+
+/// One metric change
+struct Change
+{
+  uint32_t node;                //!< the node advertising the link
+  uint32_t interface;           //!< its interface on the link
+  uint16_t metric;              //!< the new metric, 0 for the metric it had first
+};
+
+static double
+Elapsed (std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+static void
+SetOptions (const Options &options)
+{
+  DSRRouteManager::SetCandidatesPerDestination (options.candidates);
+  DSRRouteManager::SetLoopFreeAlternates (options.loopFree);
+  DSRRouteManager::SetLazyRoutes (options.lazy);
+}
+
+// the node and destination of a host route of DumpRoutes
+static bool
+RouteKeyLess (const std::string &a, const std::string &b)
+{
+  return a.substr (0, a.find (' ', a.find (' ') + 1)) < b.substr (0, b.find (' ', b.find (' ') + 1));
+}
+
+// every route of every node, as written by SerializeRoutes: the host routes
+// grouped by node and destination, keeping the order of the candidates of
+// each destination, then the network and external routes sorted
+static std::vector<std::string>
+DumpRoutes (NodeContainer nodes, bool hostOnly)
+{
+  std::vector<std::string> hosts;
+  std::vector<std::string> others;
+  for (uint32_t i = 0; i < nodes.GetN (); i++)
+    {
+      std::vector<uint32_t> block;
+      nodes.Get (i)->GetObject<DSRRouter> ()->GetRoutingProtocol ()->SerializeRoutes (block);
+      uint32_t nHost = block[0];
+      uint32_t nRoutes = block[0] + block[1] + block[2];
+      const uint32_t *record = &block[3];
+      for (uint32_t j = 0; j < nRoutes; j++, record += Ipv4DSRRouting::ROUTE_RECORD_WORDS)
+        {
+          std::ostringstream oss;
+          oss << i << " " << Ipv4Address (record[0]) << "/" << Ipv4Mask (record[1])
+              << " " << Ipv4Address (record[2]) << " " << record[3] << " " << record[4]
+              << " " << record[5] << " " << Ipv4Address (record[6]);
+          if (j < nHost)
+            {
+              hosts.push_back (oss.str ());
+            }
+          else if (!hostOnly)
+            {
+              others.push_back (oss.str ());
+            }
+        }
+    }
+  std::stable_sort (hosts.begin (), hosts.end (), RouteKeyLess);
+  std::sort (others.begin (), others.end ());
+  hosts.insert (hosts.end (), others.begin (), others.end ());
+  return hosts;
+}
+
+// with the routes on demand, the routes of every router to every address
+static void
+ResolveAll (NodeContainer nodes)
+{
+  for (uint32_t i = 0; i < nodes.GetN (); i++)
+    {
+      for (uint32_t j = 0; j < nodes.GetN (); j++)
+        {
+          Ptr<Ipv4> ipv4 = nodes.Get (j)->GetObject<Ipv4> ();
+          for (uint32_t k = 1; k < ipv4->GetNInterfaces () && i != j; k++)
+            {
+              DSRRouteManager::ResolveRoutes (nodes.Get (i), ipv4->GetAddress (k, 0).GetLocal ());
+            }
+        }
+    }
+}
+
+static bool
+Compare (const std::vector<std::string> &updated, const std::vector<std::string> &computed,
+         const Options &options, uint32_t step)
+{
+  if (updated == computed)
+    {
+      return true;
+    }
+  std::cout << "FAIL: " << options.name << ", change " << step << ": "
+            << updated.size () << " routes updated, " << computed.size () << " computed" << std::endl;
+  for (uint32_t i = 0; i < updated.size () && i < computed.size (); i++)
+    {
+      if (updated[i] != computed[i])
+        {
+          std::cout << "  first difference: " << updated[i] << " instead of " << computed[i] << std::endl;
+          break;
+        }
+    }
+  return false;
+}
+
+static bool
+RunOptions (uint32_t nRouters, const Options &options)
+{
+  NodeContainer nodes;
+  nodes.Create (nRouters);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  p2p.SetDeviceAttribute ("DataRate", StringValue ("10Mbps"));
+  p2p.SetChannelAttribute ("Delay", StringValue ("2ms"));
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.0.0.0", "255.255.255.252");
+  for (uint32_t i = 0; i < nRouters; i++)
+    {
+      uint32_t neighbors[2] = { i + 1, i + WIDTH };
+      for (uint32_t k = 0; k < 2; k++)
+        {
+          uint32_t j = neighbors[k];
+          if (j >= nRouters || (k == 0 && j % WIDTH == 0))
+            {
+              continue;
+            }
+          NetDeviceContainer devices = p2p.Install (nodes.Get (i), nodes.Get (j));
+          Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+          interfaces.SetMetric (0, 1000 * (1 + (i + j) % 7));
+          interfaces.SetMetric (1, 1000 * (1 + (i + j) % 7));
+          ipv4.NewNetwork ();
+        }
+    }
+
+  uint32_t middle = (nRouters / WIDTH / 2) * WIDTH + WIDTH / 2;
+  Change changes[] = {
+    { middle, 1, 9000 },
+    { middle, 1, 100 },
+    { 1, 2, 12000 },
+    { nRouters - 1, 1, 200 },
+    { middle, 1, 0 },
+  };
+  uint32_t nChanges = sizeof (changes) / sizeof (changes[0]);
+  std::vector<uint16_t> firstMetric (nChanges);
+  for (uint32_t i = 0; i < nChanges; i++)
+    {
+      firstMetric[i] = nodes.Get (changes[i].node)->GetObject<Ipv4> ()->GetMetric (changes[i].interface);
+    }
+
+  // the changes, one after the other
+  SetOptions (options);
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  DSRRouteManager::InitializeRoutes ();
+  if (options.lazy)
+    {
+      ResolveAll (nodes);
+    }
+  std::vector<std::vector<std::string> > updated (nChanges);
+  std::vector<double> updateSeconds (nChanges);
+  for (uint32_t i = 0; i < nChanges; i++)
+    {
+      uint16_t metric = changes[i].metric != 0 ? changes[i].metric : firstMetric[i];
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      DSRRouteManager::UpdateLinkMetric (nodes.Get (changes[i].node), changes[i].interface, metric);
+      updateSeconds[i] = Elapsed (start);
+      if (options.lazy)
+        {
+          ResolveAll (nodes);
+        }
+      updated[i] = DumpRoutes (nodes, options.lazy);
+    }
+
+  // the same metrics, every route computed again, up front
+  Options upFront = options;
+  upFront.lazy = false;
+  SetOptions (upFront);
+  for (uint32_t i = nChanges; i-- > 0; )
+    {
+      nodes.Get (changes[i].node)->GetObject<Ipv4> ()->SetMetric (changes[i].interface, firstMetric[i]);
+    }
+  bool ok = true;
+  for (uint32_t i = 0; i < nChanges; i++)
+    {
+      uint16_t metric = changes[i].metric != 0 ? changes[i].metric : firstMetric[i];
+      nodes.Get (changes[i].node)->GetObject<Ipv4> ()->SetMetric (changes[i].interface, metric);
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+      DSRRouteManager::DeleteDSRRoutes ();
+      DSRRouteManager::BuildDSRRoutingDatabase ();
+      DSRRouteManager::InitializeRoutes ();
+      double computeSeconds = Elapsed (start);
+      std::cout << std::setiosflags (std::ios::left) << std::setw (24) << options.name
+                << std::setw (10) << i
+                << std::setw (14) << updateSeconds[i]
+                << std::setw (14) << computeSeconds << std::endl;
+      ok &= Compare (updated[i], DumpRoutes (nodes, options.lazy), options, i);
+    }
+
+  Options defaults = { "defaults", 0, false, false };
+  SetOptions (defaults);
+  Simulator::Destroy ();
+  return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nRouters = 23;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("routers", "Number of routers of the grid, at least 10", nRouters);
+  cmd.Parse (argc, argv);
+
+  Options options[] = {
+    { "none", 0, false, false },
+    { "two-hop", 4, false, false },
+    { "loop-free", 0, true, false },
+    { "two-hop, loop-free", 4, true, false },
+    { "on demand", 0, false, true },
+  };
+  std::cout << std::setiosflags (std::ios::left) << std::setw (24) << "options"
+            << std::setw (10) << "change"
+            << std::setw (14) << "update(s)"
+            << std::setw (14) << "recompute(s)" << std::endl;
+  bool ok = true;
+  for (uint32_t i = 0; i < sizeof (options) / sizeof (options[0]); i++)
+    {
+      ok &= RunOptions (std::max<uint32_t> (nRouters, 10), options[i]);
+    }
+
+  if (!ok)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
@@ -0,0 +1,244 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Benchmark: direct neighbor queue probing vs. published queue snapshots
+//
+// Network topology (same as exp2)
+//
+//    n0 ----- n3 ----- n6
+//    |        |        |
+//    n1 ----- n4 ----- n7
+//    |        |        |
+//    n2 ----- n5 ----- n8
+//
+// - a budgeted target flow n2 -> n6 plus bursty interference flows
+// - the scenario is run once with the lookahead reading the neighbors'
+//   DsrVirtualQueueDisc directly, once with periodic queue snapshots, and
+//   once with snapshots published on every packet (SnapshotThreshold 1) to
+//   show what the threshold costs
+// - for each mode: wall-clock time, simulator events, wall-clock time per
+//   received packet, delivery ratio and ratio of packets delivered within
+//   their budget, then the wall-clock time of the snapshot modes over that
+//   of direct probing
+// - with --runs=N each mode is run N times and keeps its shortest
+//   wall-clock time, and the other figures of its first run
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrQueueSnapshotBenchmark");
+
+struct RunResult
+{
+  double wallSeconds;
+  uint64_t events;
+  uint32_t sent;
+  uint32_t received;
+  uint32_t inBudget;
+};
+
+static uint32_t g_received = 0;
+static uint32_t g_inBudget = 0;
+
+static void
+SinkRx (Ptr<const Packet> p, const Address &from)
+{
+  DsrTag dsrTag;
+  if (!p->PeekPacketTag (dsrTag))
+    {
+      return;
+    }
+  g_received++;
+  Time delay = Simulator::Now () - dsrTag.GetTimestamp ();
+  if (dsrTag.GetBudget () == 0 || delay <= MicroSeconds (dsrTag.GetBudget ()))
+    {
+      g_inBudget++;
+    }
+}
+
+static void
+InstallDsrUdpApplication (Ptr<Node> node, Address sinkAddress, double startTime, double stopTime,
+                          uint32_t packetSize, uint32_t nPacket, uint32_t budget,
+                          double dataRate, bool flag)
+{
+  Ptr<Socket> socket = Socket::CreateSocket (node, UdpSocketFactory::GetTypeId ());
+  Ptr<DsrUdpApplication> app = CreateObject<DsrUdpApplication> ();
+  app->Setup (socket, sinkAddress, packetSize, nPacket, DataRate (std::to_string (dataRate) + "Mbps"), budget, flag);
+  node->AddApplication (app);
+  app->SetStartTime (Seconds (startTime));
+  app->SetStopTime (Seconds (stopTime));
+}
+
+static RunResult
+RunScenario (bool snapshots, double stopTime)
+{
+  g_received = 0;
+  g_inBudget = 0;
+  Config::SetDefault ("ns3::dsr-routing::Ipv4DSRRouting::QueueStateSnapshots", BooleanValue (snapshots));
+
+  NodeContainer nodes;
+  nodes.Create (9);
+  uint32_t links[12][2] = { {0, 3}, {3, 6}, {0, 1}, {3, 4}, {6, 7}, {1, 4},
+                            {4, 7}, {1, 2}, {4, 5}, {7, 8}, {2, 5}, {5, 8} };
+  const char *rates[12] = { "5Mbps", "10Mbps", "10Mbps", "5Mbps", "5Mbps", "10Mbps",
+                            "10Mbps", "5Mbps", "10Mbps", "10Mbps", "10Mbps", "5Mbps" };
+  uint32_t delays[12] = { 3000, 3000, 5000, 5000, 5000, 3000, 3000, 3000, 5000, 3000, 3000, 5000 };
+  uint16_t metrics[12] = { 6000, 4000, 6000, 7000, 7000, 4000, 4000, 5000, 6000, 4000, 4000, 7000 };
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc");
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4Address sinkIp;
+  for (uint32_t i = 0; i < 12; i++)
+    {
+      p2p.SetDeviceAttribute ("DataRate", DataRateValue (DataRate (rates[i])));
+      p2p.SetChannelAttribute ("Delay", TimeValue (MicroSeconds (delays[i])));
+      NetDeviceContainer devices = p2p.Install (nodes.Get (links[i][0]), nodes.Get (links[i][1]));
+      tch.Install (devices);
+      Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+      interfaces.SetMetric (0, metrics[i]);
+      interfaces.SetMetric (1, metrics[i]);
+      ipv4.NewNetwork ();
+      if (links[i][0] == 6)
+        {
+          sinkIp = interfaces.GetAddress (0);
+        }
+    }
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  uint16_t sinkPort = 9;
+  Address sinkAddress (InetSocketAddress (sinkIp, sinkPort));
+  DsrSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), sinkPort));
+  ApplicationContainer sinkApps = sinkHelper.Install (nodes.Get (6));
+  sinkApps.Start (Seconds (0.0));
+  sinkApps.Stop (Seconds (stopTime));
+  sinkApps.Get (0)->TraceConnectWithoutContext ("Rx", MakeCallback (&SinkRx));
+
+  uint32_t budget = 25; // ms
+  uint32_t packetSize = 52;
+  uint32_t sent = 0;
+  InstallDsrUdpApplication (nodes.Get (2), sinkAddress, 0.0, stopTime, packetSize, 10000, budget, 2, true);
+  sent += 10000;
+  // bursty interference flows from the same source
+  for (int i = 2; i <= 10; i += 2)
+    {
+      InstallDsrUdpApplication (nodes.Get (2), sinkAddress, (i - 1) * 0.2, i * 0.2, packetSize, 1000, budget, i * 0.5, false);
+      sent += 1000;
+    }
+
+  Simulator::Stop (Seconds (stopTime));
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  Simulator::Run ();
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now ();
+
+  RunResult result;
+  result.wallSeconds = std::chrono::duration<double> (end - start).count ();
+  result.events = Simulator::GetEventCount ();
+  result.sent = sent;
+  result.received = g_received;
+  result.inBudget = g_inBudget;
+  Simulator::Destroy ();
+  return result;
+}
+
+static RunResult
+RunBest (bool snapshots, double stopTime, uint32_t runs)
+{
+  RunResult best = RunScenario (snapshots, stopTime);
+  for (uint32_t i = 1; i < runs; i++)
+    {
+      RunResult r = RunScenario (snapshots, stopTime);
+      best.wallSeconds = std::min (best.wallSeconds, r.wallSeconds);
+    }
+  return best;
+}
+
+static void
+PrintResult (std::string name, const RunResult &r)
+{
+  std::cout << std::setiosflags (std::ios::left) << std::setw (12) << name
+            << std::setw (12) << r.wallSeconds
+            << std::setw (12) << r.events
+            << std::setw (16) << (r.received > 0 ? 1e6 * r.wallSeconds / r.received : 0)
+            << std::setw (12) << (double) r.received / r.sent
+            << std::setw (12) << (r.received > 0 ? (double) r.inBudget / r.received : 0)
+            << std::endl;
+}
+
+int
+main (int argc, char *argv[])
+{
+  double stopTime = 20.0;
+  std::string interval = "1ms";
+  uint32_t threshold = 0;
+  std::string staleness = "10ms";
+  uint32_t runs = 1;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("stopTime", "Simulation stop time in seconds", stopTime);
+  cmd.AddValue ("interval", "Period of the queue snapshots (0 to disable)", interval);
+  cmd.AddValue ("threshold", "Lane length change that triggers a snapshot (0 to disable)", threshold);
+  cmd.AddValue ("staleness", "Age after which a snapshot is ignored", staleness);
+  cmd.AddValue ("runs", "Runs of each mode, keeping the shortest wall-clock time", runs);
+  cmd.Parse (argc, argv);
+
+  Config::SetDefault ("ns3::DsrVirtualQueueDisc::SnapshotInterval", TimeValue (Time (interval)));
+  Config::SetDefault ("ns3::DsrVirtualQueueDisc::SnapshotThreshold", UintegerValue (threshold));
+  Config::SetDefault ("ns3::dsr-routing::Ipv4DSRRouting::SnapshotStaleness", TimeValue (Time (staleness)));
+
+  runs = std::max<uint32_t> (runs, 1);
+  RunResult direct = RunBest (false, stopTime, runs);
+  RunResult snapshot = RunBest (true, stopTime, runs);
+  Config::SetDefault ("ns3::DsrVirtualQueueDisc::SnapshotThreshold", UintegerValue (1));
+  RunResult perPacket = RunBest (true, stopTime, runs);
+
+  std::cout << std::setiosflags (std::ios::left) << std::setw (12) << "mode"
+            << std::setw (12) << "wall(s)"
+            << std::setw (12) << "events"
+            << std::setw (16) << "us/rx-packet"
+            << std::setw (12) << "delivered"
+            << std::setw (12) << "in-budget" << std::endl;
+  PrintResult ("direct", direct);
+  PrintResult ("snapshot", snapshot);
+  PrintResult ("per-packet", perPacket);
+  if (direct.wallSeconds > 0)
+    {
+      std::cout << "wall-clock time over direct: snapshot " << snapshot.wallSeconds / direct.wallSeconds
+                << ", per-packet " << perPacket.wallSeconds / direct.wallSeconds << std::endl;
+    }
+  return 0;
+}
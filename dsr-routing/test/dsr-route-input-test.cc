@@ -0,0 +1,237 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: RouteInput copies a forwarded packet only to change its DsrTag
+//
+//    n0 ------ n1 ------ n2
+//
+// - packets from n0 to n2 are handed to the RouteInput of n1, which
+//   forwards them through the unicast callback; every link has metric 1000
+// - an untagged packet, and a packet of an application without a budget,
+//   whose tag RouteInput does not look at, are forwarded as they are, the
+//   same packet object
+// - a packet with a budget, tagged by n0 with the distance of its route,
+//   gets the shorter distance of the route of n1: it is forwarded as a
+//   copy carrying a single DsrTag with the new distance, and the packet
+//   given to RouteInput keeps its tag unchanged.  The route has to be
+//   shorter than the distance in the tag, so such a packet is copied at
+//   every hop
+// - a packet with less than 10us of budget to spare on the route of n1 is
+//   copied with priority 0 instead of 1
+// - every packet is forwarded exactly once
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrRouteInputTest");
+
+static bool g_pass = true;
+static uint32_t g_nForwarded = 0;
+static Ptr<const Packet> g_forwarded;
+
+static void
+Forward (Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header)
+{
+  g_nForwarded++;
+  g_forwarded = p;
+}
+
+static void
+MulticastForward (Ptr<Ipv4MulticastRoute> route, Ptr<const Packet> p, const Ipv4Header &header)
+{
+  std::cout << "FAIL: multicast forwarding of a unicast packet" << std::endl;
+  g_pass = false;
+}
+
+static void
+LocalDeliver (Ptr<const Packet> p, const Ipv4Header &header, uint32_t iif)
+{
+  std::cout << "FAIL: local delivery of a packet for n2" << std::endl;
+  g_pass = false;
+}
+
+static void
+Error (Ptr<const Packet> p, const Ipv4Header &header, Socket::SocketErrno errno_)
+{
+  std::cout << "FAIL: forwarding error " << errno_ << std::endl;
+  g_pass = false;
+}
+
+static uint32_t
+CountTags (Ptr<const Packet> p)
+{
+  uint32_t nTags = 0;
+  PacketTagIterator it = p->GetPacketTagIterator ();
+  while (it.HasNext ())
+    {
+      if (it.Next ().GetTypeId () == DsrTag::GetTypeId ())
+        {
+          nTags++;
+        }
+    }
+  return nTags;
+}
+
+// Hand a packet to RouteInput and return the packet forwarded, or 0 if it
+// is not forwarded exactly once.
+static Ptr<const Packet>
+RouteOnce (Ptr<Ipv4DSRRouting> routing, Ptr<const Packet> p, const Ipv4Header &header,
+            Ptr<NetDevice> idev, const char *name)
+{
+  g_nForwarded = 0;
+  g_forwarded = 0;
+  bool routed = routing->RouteInput (p, header, idev, MakeCallback (&Forward),
+                                     MakeCallback (&MulticastForward), MakeCallback (&LocalDeliver),
+                                     MakeCallback (&Error));
+  if (!routed || g_nForwarded != 1)
+    {
+      std::cout << "FAIL: " << name << " packet forwarded " << g_nForwarded << " times" << std::endl;
+      g_pass = false;
+      return 0;
+    }
+  return g_forwarded;
+}
+
+static void
+Check (bool condition, const char *name, const char *what)
+{
+  if (!condition)
+    {
+      std::cout << "FAIL: " << name << " packet " << what << std::endl;
+      g_pass = false;
+    }
+}
+
+static void
+RunChecks (Ptr<Ipv4DSRRouting> routing, Ptr<NetDevice> idev, Ipv4Address source, Ipv4Address dest)
+{
+  Ipv4Header header;
+  header.SetSource (source);
+  header.SetDestination (dest);
+  header.SetProtocol (17);
+  header.SetTtl (64);
+
+  Ptr<Packet> untagged = Create<Packet> (100);
+  Ptr<const Packet> forwarded = RouteOnce (routing, untagged, header, idev, "untagged");
+  Check (forwarded == 0 || forwarded == untagged, "untagged", "copied");
+
+  // as sent by a DsrUdpApplication without a budget
+  DsrTag tag;
+  tag.SetTimestamp (Simulator::Now ());
+  tag.SetBudget (0);
+  tag.SetPriority (99);
+  Ptr<Packet> untimed = Create<Packet> (100);
+  untimed->AddPacketTag (tag);
+  forwarded = RouteOnce (routing, untimed, header, idev, "untimed");
+  Check (forwarded == 0 || forwarded == untimed, "untimed", "copied");
+
+  // as forwarded by n0, whose route is 2000 long
+  tag.SetBudget (50000);
+  tag.SetPriority (1);
+  tag.SetDistance (2000);
+  Ptr<Packet> timed = Create<Packet> (100);
+  timed->AddPacketTag (tag);
+  forwarded = RouteOnce (routing, timed, header, idev, "timed");
+  DsrTag peeked;
+  if (forwarded != 0)
+    {
+      Check (forwarded != timed, "timed", "not copied");
+      Check (CountTags (forwarded) == 1, "timed", "does not carry a single DsrTag");
+      forwarded->PeekPacketTag (peeked);
+      Check (peeked.GetDistance () == 1000, "timed", "without the distance of the route");
+      Check (peeked.GetPriority () == 1, "timed", "not left at priority 1");
+      timed->PeekPacketTag (peeked);
+      Check (peeked.GetDistance () == 2000, "timed", "changed in place");
+    }
+
+  // the route of n1 fits with less than 10us to spare
+  tag.SetBudget (1005);
+  Ptr<Packet> tight = Create<Packet> (100);
+  tight->AddPacketTag (tag);
+  forwarded = RouteOnce (routing, tight, header, idev, "tight");
+  if (forwarded != 0)
+    {
+      Check (forwarded != tight, "tight", "not copied");
+      Check (CountTags (forwarded) == 1, "tight", "does not carry a single DsrTag");
+      forwarded->PeekPacketTag (peeked);
+      Check (peeked.GetPriority () == 0, "tight", "not moved to priority 0");
+      tight->PeekPacketTag (peeked);
+      Check (peeked.GetPriority () == 1, "tight", "changed in place");
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  NodeContainer nodes;
+  nodes.Create (3);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  p2p.SetDeviceAttribute ("DataRate", StringValue ("10Mbps"));
+  p2p.SetChannelAttribute ("Delay", StringValue ("1ms"));
+  NetDeviceContainer d01 = p2p.Install (nodes.Get (0), nodes.Get (1));
+  NetDeviceContainer d12 = p2p.Install (nodes.Get (1), nodes.Get (2));
+
+  TrafficControlHelper tch;
+  tch.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc");
+  tch.Install (d01);
+  tch.Install (d12);
+
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.1.1.0", "255.255.255.0");
+  Ipv4InterfaceContainer i01 = ipv4.Assign (d01);
+  ipv4.NewNetwork ();
+  Ipv4InterfaceContainer i12 = ipv4.Assign (d12);
+  i01.SetMetric (0, 1000);
+  i01.SetMetric (1, 1000);
+  i12.SetMetric (0, 1000);
+  i12.SetMetric (1, 1000);
+
+  Ipv4DSRRoutingHelper::PopulateRoutingTables ();
+
+  Ptr<Ipv4DSRRouting> routing = nodes.Get (1)->GetObject<DSRRouter> ()->GetRoutingProtocol ();
+  // the queue discs are initialized with their node when the simulation starts
+  Simulator::Schedule (Seconds (0.1), &RunChecks, routing, d01.Get (1),
+                       i01.GetAddress (0), i12.GetAddress (1));
+  Simulator::Stop (Seconds (0.2));
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  if (!g_pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
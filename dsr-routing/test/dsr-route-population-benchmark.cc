@@ -0,0 +1,414 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Benchmark: time taken to populate the DSR routing tables
+//
+// Synthetic topology: a grid of routers, each one linked to its right and
+// lower neighbors by a point-to-point link
+//
+//    n0 ----- n1 ----- n2 ...
+//    |        |        |
+//    n(w) --- n(w+1) - n(w+2) ...
+//    |        |        |
+//
+// - the grid is as close to square as possible for the requested number of
+//   routers (the last row may be incomplete)
+// - for each size: wall-clock time of BuildDSRRoutingDatabase (LSA
+//   collection and LSDB insertion), of InitializeRoutes (SPF and FIB
+//   installation) on one thread and on --threads threads, the speedup,
+//   the number of routes installed, and whether both runs produced exactly
+//   the same forwarding tables (host, network and external routes)
+// - the time of InitializeRoutes with the reverse SPF engine (one tree per
+//   destination) on --threads threads, and whether it produced the same
+//   host routes to each destination, in the same order, as the first run
+// - the time of UpdateLinkMetric lowering the metric of one link of the
+//   middle router, and whether its host routes are those a full
+//   recomputation gives
+// - with --cache, the time of InitializeRoutes loading the routes from the
+//   route cache file written by the run before it, and whether the loaded
+//   tables are exactly those that were computed
+// - the time of InitializeRoutes with the routes computed on demand plus
+//   the resolution of the routes of n0 to the last router, and whether they
+//   are the routes of n0 to it of the first run
+// - the number of routes installed with the routes aggregated per
+//   destination router, and whether n0 picks the same next hop to every
+//   address as in the first run
+// - prints a FAIL line and returns 1 if any of the comparisons fails
+// - run it on two revisions to compare them; the largest sizes take a
+//   long time and a lot of memory, use --sizes to pick a subset
+// - built with -DDSR_BENCHMARK_BASELINE, only the LSDB and single-thread
+//   InitializeRoutes times and the number of routes are measured, through
+//   calls every revision of the module has; copy the file to scratch/ of
+//   an older revision and build it that way for the figures before a change
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrRoutePopulationBenchmark");
+
+static double
+Elapsed (std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double> (std::chrono::steady_clock::now () - start).count ();
+}
+
+#ifndef DSR_BENCHMARK_BASELINE
+// the whole table of every node, host, network and external routes, as
+// written by SerializeRoutes
+static std::vector<uint32_t>
+SerializeTables (NodeContainer nodes)
+{
+  std::vector<uint32_t> tables;
+  for (uint32_t i = 0; i < nodes.GetN (); i++)
+    {
+      Ptr<DSRRouter> router = nodes.Get (i)->GetObject<DSRRouter> ();
+      if (router != 0)
+        {
+          tables.push_back (i);
+          router->GetRoutingProtocol ()->SerializeRoutes (tables);
+        }
+    }
+  return tables;
+}
+
+// every host route of every node, in table order
+static std::vector<std::string>
+DumpRoutes (NodeContainer nodes)
+{
+  std::vector<uint32_t> tables = SerializeTables (nodes);
+  std::vector<std::string> routes;
+  for (uint32_t pos = 0; pos < tables.size (); )
+    {
+      uint32_t node = tables[pos];
+      const uint32_t *block = &tables[pos + 1];
+      uint32_t nHost = block[0];
+      const uint32_t *record = block + 3;
+      for (uint32_t j = 0; j < nHost; j++, record += Ipv4DSRRouting::ROUTE_RECORD_WORDS)
+        {
+          std::ostringstream oss;
+          oss << node << " " << Ipv4Address (record[0]) << "/" << Ipv4Mask (record[1])
+              << " " << Ipv4Address (record[2]) << " " << record[3]
+              << " " << record[4];
+          routes.push_back (oss.str ());
+        }
+      pos += 1 + Ipv4DSRRouting::GetSerializedSize (block, tables.size () - pos - 1);
+    }
+  return routes;
+}
+
+// the key of a route of DumpRoutes: node and destination
+static std::string
+RouteKey (const std::string &route)
+{
+  return route.substr (0, route.find (' ', route.find (' ') + 1));
+}
+
+static bool
+RouteKeyLess (const std::string &a, const std::string &b)
+{
+  return RouteKey (a) < RouteKey (b);
+}
+
+// the routes of DumpRoutes of one node to one destination
+static std::vector<std::string>
+RoutesTo (const std::vector<std::string> &routes, uint32_t node, Ipv4Address dest)
+{
+  std::ostringstream oss;
+  oss << node << " " << dest << "/";
+  std::vector<std::string> to;
+  for (uint32_t i = 0; i < routes.size (); i++)
+    {
+      if (routes[i].compare (0, oss.str ().size (), oss.str ()) == 0)
+        {
+          to.push_back (routes[i]);
+        }
+    }
+  return to;
+}
+
+// the host routes of DumpRoutes grouped by node and destination, keeping
+// the order of the routes to each destination
+static std::vector<std::string>
+SortHostRoutes (const std::vector<std::string> &routes)
+{
+  std::vector<std::string> hosts = routes;
+  std::stable_sort (hosts.begin (), hosts.end (), RouteKeyLess);
+  return hosts;
+}
+
+static double
+TimeInitializeRoutes (uint32_t threads, DSRRouteManager::RouteEngine engine)
+{
+  DSRRouteManager::SetPopulationThreads (threads);
+  DSRRouteManager::SetRouteEngine (engine);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  DSRRouteManager::InitializeRoutes ();
+  return Elapsed (start);
+}
+
+static bool
+Check (bool same, uint32_t nRouters, const std::string &what)
+{
+  if (!same)
+    {
+      std::cout << "FAIL: " << nRouters << " routers, " << what << std::endl;
+    }
+  return same;
+}
+#endif /* DSR_BENCHMARK_BASELINE */
+
+// benchmark one grid of routers, false if a comparison fails
+static bool
+RunScenario (uint32_t nRouters, uint32_t threads, const std::string &cache)
+{
+  NodeContainer nodes;
+  nodes.Create (nRouters);
+
+  Ipv4DSRRoutingHelper dsr;
+  Ipv4ListRoutingHelper list;
+  list.Add (dsr, 10);
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (list);
+  internet.Install (nodes);
+
+  PointToPointHelper p2p;
+  p2p.SetDeviceAttribute ("DataRate", StringValue ("10Mbps"));
+  p2p.SetChannelAttribute ("Delay", StringValue ("2ms"));
+  Ipv4AddressHelper ipv4;
+  ipv4.SetBase ("10.0.0.0", "255.255.255.252");
+  uint32_t width = std::ceil (std::sqrt ((double) nRouters));
+  uint32_t nLinks = 0;
+  for (uint32_t i = 0; i < nRouters; i++)
+    {
+      uint32_t neighbors[2] = { i + 1, i + width };
+      for (uint32_t k = 0; k < 2; k++)
+        {
+          uint32_t j = neighbors[k];
+          if (j >= nRouters || (k == 0 && j % width == 0))
+            {
+              continue;
+            }
+          NetDeviceContainer devices = p2p.Install (nodes.Get (i), nodes.Get (j));
+          Ipv4InterfaceContainer interfaces = ipv4.Assign (devices);
+          interfaces.SetMetric (0, 1000 * (1 + (i + j) % 7));
+          interfaces.SetMetric (1, 1000 * (1 + (i + j) % 7));
+          ipv4.NewNetwork ();
+          nLinks++;
+        }
+    }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  double lsdbSeconds = Elapsed (start);
+#ifdef DSR_BENCHMARK_BASELINE
+  start = std::chrono::steady_clock::now ();
+  DSRRouteManager::InitializeRoutes ();
+  double serialSeconds = Elapsed (start);
+#else
+  double serialSeconds = TimeInitializeRoutes (1, DSRRouteManager::SPF_PER_NEIGHBOR);
+#endif
+  uint64_t nRoutes = 0;
+  for (uint32_t i = 0; i < nRouters; i++)
+    {
+      nRoutes += nodes.Get (i)->GetObject<DSRRouter> ()->GetRoutingProtocol ()->GetNRoutes ();
+    }
+
+#ifdef DSR_BENCHMARK_BASELINE
+  std::cout << std::setiosflags (std::ios::left) << std::setw (10) << nRouters
+            << std::setw (10) << nLinks
+            << std::setw (14) << lsdbSeconds
+            << std::setw (14) << serialSeconds
+            << std::setw (14) << nRoutes << std::endl;
+  bool ok = true;
+#else
+  std::vector<std::string> serialRoutes = DumpRoutes (nodes);
+  std::vector<uint32_t> serialTables = SerializeTables (nodes);
+
+  DSRRouteManager::DeleteDSRRoutes ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  double parallelSeconds = TimeInitializeRoutes (threads, DSRRouteManager::SPF_PER_NEIGHBOR);
+  bool parallelSame = SerializeTables (nodes) == serialTables;
+
+  DSRRouteManager::DeleteDSRRoutes ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  double reverseSeconds = TimeInitializeRoutes (threads, DSRRouteManager::REVERSE_SPF);
+  bool reverseSame = SortHostRoutes (DumpRoutes (nodes)) == SortHostRoutes (serialRoutes);
+
+  start = std::chrono::steady_clock::now ();
+  DSRRouteManager::UpdateLinkMetric (nodes.Get (nRouters / 2), 1, 500);
+  double updateSeconds = Elapsed (start);
+  std::vector<std::string> updatedRoutes = SortHostRoutes (DumpRoutes (nodes));
+  DSRRouteManager::DeleteDSRRoutes ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  TimeInitializeRoutes (threads, DSRRouteManager::REVERSE_SPF);
+  bool updateSame = updatedRoutes == SortHostRoutes (DumpRoutes (nodes));
+
+  std::string cachedSeconds = "-";
+  std::string cachedSame = "-";
+  if (!cache.empty ())
+    {
+      DSRRouteManager::SetRouteCacheDirectory (cache);
+      DSRRouteManager::DeleteDSRRoutes ();
+      DSRRouteManager::BuildDSRRoutingDatabase ();
+      TimeInitializeRoutes (threads, DSRRouteManager::REVERSE_SPF);
+      std::vector<uint32_t> computedTables = SerializeTables (nodes);
+      DSRRouteManager::DeleteDSRRoutes ();
+      DSRRouteManager::BuildDSRRoutingDatabase ();
+      cachedSeconds = std::to_string (TimeInitializeRoutes (threads, DSRRouteManager::REVERSE_SPF));
+      cachedSame = SerializeTables (nodes) == computedTables ? "yes" : "NO";
+      DSRRouteManager::SetRouteCacheDirectory ("");
+    }
+
+  Ipv4Address last = nodes.Get (nRouters - 1)->GetObject<Ipv4> ()->GetAddress (1, 0).GetLocal ();
+  DSRRouteManager::SetLazyRoutes (true);
+  DSRRouteManager::DeleteDSRRoutes ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  start = std::chrono::steady_clock::now ();
+  DSRRouteManager::InitializeRoutes ();
+  DSRRouteManager::ResolveRoutes (nodes.Get (0), last);
+  double lazySeconds = Elapsed (start);
+  bool lazySame = RoutesTo (DumpRoutes (nodes), 0, last) == RoutesTo (serialRoutes, 0, last);
+  DSRRouteManager::SetLazyRoutes (false);
+
+  DSRRouteManager::SetAggregateRoutes (true);
+  DSRRouteManager::DeleteDSRRoutes ();
+  DSRRouteManager::BuildDSRRoutingDatabase ();
+  TimeInitializeRoutes (threads, DSRRouteManager::REVERSE_SPF);
+  uint64_t nAggregated = 0;
+  for (uint32_t i = 0; i < nRouters; i++)
+    {
+      nAggregated += nodes.Get (i)->GetObject<DSRRouter> ()->GetRoutingProtocol ()->GetNRoutes ();
+    }
+  bool aggregatedSame = true;
+  Ptr<Ipv4DSRRouting> first = nodes.Get (0)->GetObject<DSRRouter> ()->GetRoutingProtocol ();
+  for (uint32_t i = 0; i < serialRoutes.size () && aggregatedSame; i++)
+    {
+      // "0 <dest>/<mask> <gateway> ...", the first one is the shortest
+      std::istringstream route (serialRoutes[i]);
+      uint32_t node;
+      std::string dest, gateway;
+      route >> node >> dest >> gateway;
+      if (node != 0
+          || (i > 0 && RouteKey (serialRoutes[i - 1]) == RouteKey (serialRoutes[i])))
+        {
+          continue;
+        }
+      Ipv4Header header;
+      header.SetDestination (Ipv4Address (dest.substr (0, dest.find ('/')).c_str ()));
+      Socket::SocketErrno error;
+      Ptr<Ipv4Route> chosen = first->RouteOutput (0, header, 0, error);
+      std::ostringstream oss;
+      if (chosen != 0)
+        {
+          oss << chosen->GetGateway ();
+        }
+      aggregatedSame = oss.str () == gateway;
+    }
+  DSRRouteManager::SetAggregateRoutes (false);
+
+  std::cout << std::setiosflags (std::ios::left) << std::setw (10) << nRouters
+            << std::setw (10) << nLinks
+            << std::setw (14) << lsdbSeconds
+            << std::setw (14) << serialSeconds
+            << std::setw (14) << parallelSeconds
+            << std::setw (10) << serialSeconds / parallelSeconds
+            << std::setw (14) << nRoutes
+            << std::setw (10) << (parallelSame ? "yes" : "NO")
+            << std::setw (14) << reverseSeconds
+            << std::setw (10) << serialSeconds / reverseSeconds
+            << std::setw (10) << (reverseSame ? "yes" : "NO")
+            << std::setw (14) << updateSeconds
+            << std::setw (10) << (updateSame ? "yes" : "NO")
+            << std::setw (14) << cachedSeconds
+            << std::setw (10) << cachedSame
+            << std::setw (14) << lazySeconds
+            << std::setw (10) << (lazySame ? "yes" : "NO")
+            << std::setw (14) << nAggregated
+            << std::setw (10) << (aggregatedSame ? "yes" : "NO")
+            << std::endl;
+  bool ok = Check (parallelSame, nRouters, "the parallel tables differ from the serial ones");
+  ok &= Check (reverseSame, nRouters, "the reverse SPF routes differ from the serial ones");
+  ok &= Check (updateSame, nRouters, "UpdateLinkMetric differs from a full recomputation");
+  ok &= Check (cachedSame != "NO", nRouters, "the cached tables differ from the computed ones");
+  ok &= Check (lazySame, nRouters, "the routes resolved on demand differ from the serial ones");
+  ok &= Check (aggregatedSame, nRouters, "the aggregated routes pick other next hops");
+#endif /* DSR_BENCHMARK_BASELINE */
+  Simulator::Destroy ();
+  return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+  std::string sizes = "100,1000,5000";
+  uint32_t threads = 0;
+  std::string cache = "";
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("sizes", "Comma-separated numbers of routers to benchmark", sizes);
+  cmd.AddValue ("threads", "Threads of the parallel route population (0 for one per core)", threads);
+  cmd.AddValue ("cache", "Existing directory of the route cache files (empty to skip)", cache);
+  cmd.Parse (argc, argv);
+
+#ifdef DSR_BENCHMARK_BASELINE
+  std::cout << std::setiosflags (std::ios::left) << std::setw (10) << "routers"
+            << std::setw (10) << "links"
+            << std::setw (14) << "lsdb(s)"
+            << std::setw (14) << "spf-1(s)"
+            << std::setw (14) << "routes" << std::endl;
+#else
+  std::cout << std::setiosflags (std::ios::left) << std::setw (10) << "routers"
+            << std::setw (10) << "links"
+            << std::setw (14) << "lsdb(s)"
+            << std::setw (14) << "spf-1(s)"
+            << std::setw (14) << "spf-n(s)"
+            << std::setw (10) << "speedup"
+            << std::setw (14) << "routes"
+            << std::setw (10) << "same"
+            << std::setw (14) << "rspf-n(s)"
+            << std::setw (10) << "speedup"
+            << std::setw (10) << "same"
+            << std::setw (14) << "update(s)"
+            << std::setw (10) << "same"
+            << std::setw (14) << "cached(s)"
+            << std::setw (10) << "same"
+            << std::setw (14) << "lazy(s)"
+            << std::setw (10) << "same"
+            << std::setw (14) << "aggr-routes"
+            << std::setw (10) << "same" << std::endl;
+#endif
+  std::istringstream iss (sizes);
+  std::string size;
+  bool ok = true;
+  while (std::getline (iss, size, ','))
+    {
+      ok &= RunScenario (std::stoul (size), threads, cache);
+    }
+  return ok ? 0 : 1;
+}
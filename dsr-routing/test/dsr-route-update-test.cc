@@ -0,0 +1,229 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: bulk build and swap of the routing tables
+//
+// - DsrFib::InsertUnique keeps a single route per destination, gateway and
+//   interface, the shortest one
+// - two DsrFib filled with different destinations are swapped after their
+//   routes were walked by index; each must then list, look up and index the
+//   routes of the other, and no longer find its own
+// - an Ipv4DSRRouting keeps listing its current routes while a new table
+//   is built between BeginRouteUpdate and CommitRouteUpdate; the commit
+//   replaces the host and network routes at once, and an empty update
+//   empties the table
+
+#include <iostream>
+#include <vector>
+
+#include "ns3/core-module.h"
+#include "ns3/dsr-fib.h"
+#include "ns3/ipv4-dsr-routing.h"
+
+using namespace ns3;
+
+struct RouteRecord
+{
+  Ipv4Address dest;
+  Ipv4Address gateway;
+  uint32_t interface;
+  uint32_t distance;
+};
+
+static bool
+SameRoute (const Ipv4DSRRoutingTableEntry *route, const RouteRecord &record)
+{
+  return route->GetDest () == record.dest && route->GetGateway () == record.gateway
+         && route->GetInterface () == record.interface && route->GetDistance () == record.distance;
+}
+
+static std::vector<RouteRecord>
+Records (const DsrFib &fib)
+{
+  std::vector<RouteRecord> records;
+  for (uint32_t i = 0; i < fib.GetNRoutes (); i++)
+    {
+      Ipv4DSRRoutingTableEntry *route = fib.GetRoute (i);
+      RouteRecord record = { route->GetDest (), route->GetGateway (), route->GetInterface (), route->GetDistance () };
+      records.push_back (record);
+    }
+  return records;
+}
+
+// fill a table with nDests destinations from first, three candidates each
+static void
+Fill (DsrFib &fib, uint32_t first, uint32_t nDests)
+{
+  for (uint32_t d = 0; d < nDests; d++)
+    {
+      for (uint32_t k = 0; k < 3; k++)
+        {
+          fib.Insert (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (Ipv4Address (first + d), Ipv4Address (0x0b000001 + k),
+                                                                   1 + k, 1000 * (3 - k) + d));
+        }
+    }
+}
+
+static bool
+CheckTable (const DsrFib &fib, const std::vector<RouteRecord> &records, const char *name)
+{
+  if (fib.GetNRoutes () != records.size ())
+    {
+      std::cout << "FAIL: " << name << " has " << fib.GetNRoutes () << " routes instead of "
+                << records.size () << std::endl;
+      return false;
+    }
+  for (uint32_t i = 0; i < records.size (); i++)
+    {
+      if (!SameRoute (fib.GetRoute (i), records[i]))
+        {
+          std::cout << "FAIL: " << name << ", route " << i << " differs" << std::endl;
+          return false;
+        }
+      uint32_t n;
+      const Ipv4DSRRoutingTableEntry *routes = fib.Lookup (records[i].dest, n);
+      bool found = false;
+      for (uint32_t k = 0; k < n && !found; k++)
+        {
+          found = SameRoute (&routes[k], records[i]);
+        }
+      if (!found)
+        {
+          std::cout << "FAIL: " << name << ", route " << i << " is not found by Lookup" << std::endl;
+          return false;
+        }
+    }
+  return true;
+}
+
+static bool
+TestInsertUnique (void)
+{
+  DsrFib fib;
+  Ipv4Address dest ("10.0.0.1");
+  Ipv4Address gateway ("11.0.0.1");
+  bool added = fib.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, gateway, 1, 5000));
+  fib.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, gateway, 1, 3000));
+  bool longerAdded = fib.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, gateway, 1, 4000));
+  fib.InsertUnique (Ipv4DSRRoutingTableEntry::CreateHostRouteTo (dest, gateway, 2, 6000));
+  uint32_t n;
+  const Ipv4DSRRoutingTableEntry *routes = fib.Lookup (dest, n);
+  if (!added || longerAdded || n != 2 || routes[0].GetDistance () != 3000 || routes[1].GetInterface () != 2)
+    {
+      std::cout << "FAIL: InsertUnique does not keep the shortest route per gateway and interface" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+static bool
+TestFibSwap (void)
+{
+  DsrFib a;
+  DsrFib b;
+  Fill (a, 0x0a000001, 50);
+  Fill (b, 0x0a010001, 80);
+  std::vector<RouteRecord> recordsA = Records (a);
+  std::vector<RouteRecord> recordsB = Records (b);
+  // leave the cursors of both tables in the middle
+  a.GetRoute (a.GetNRoutes () / 2);
+  b.GetRoute (b.GetNRoutes () / 2);
+
+  a.Swap (b);
+  if (!CheckTable (a, recordsB, "swapped table a") || !CheckTable (b, recordsA, "swapped table b"))
+    {
+      return false;
+    }
+  uint32_t n;
+  if (a.Lookup (recordsA[0].dest, n) != 0 || b.Lookup (recordsB[0].dest, n) != 0)
+    {
+      std::cout << "FAIL: a swapped table still finds its previous routes" << std::endl;
+      return false;
+    }
+
+  // the swapped tables keep working as usual
+  Fill (a, 0x0a020001, 10);
+  b.Clear ();
+  if (a.GetNRoutes () != recordsB.size () + 30 || b.GetNRoutes () != 0)
+    {
+      std::cout << "FAIL: a swapped table is not updated" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+static bool
+TestRouteUpdate (void)
+{
+  Ptr<Ipv4DSRRouting> routing = CreateObject<Ipv4DSRRouting> ();
+  Ipv4Address oldDest ("10.0.0.1");
+  Ipv4Address newDest ("10.0.0.2");
+  Ipv4Address gateway ("11.0.0.1");
+  routing->AddHostRouteTo (oldDest, gateway, 1, 1000);
+  routing->AddNetworkRouteTo (Ipv4Address ("10.1.0.0"), Ipv4Mask ("255.255.0.0"), gateway, 1);
+
+  routing->BeginRouteUpdate ();
+  routing->AddHostRouteTo (newDest, gateway, 1, 2000);
+  routing->AddHostRouteTo (newDest, gateway, 1, 1500);
+  routing->AddHostRouteTo (newDest, gateway, 2, 2500);
+  routing->AddNetworkRouteTo (Ipv4Address ("10.2.0.0"), Ipv4Mask ("255.255.0.0"), gateway, 2);
+  routing->AddNetworkRouteTo (Ipv4Address ("10.3.0.0"), Ipv4Mask ("255.255.0.0"), gateway, 2);
+  if (routing->GetNRoutes () != 2 || routing->GetRoute (0)->GetDest () != oldDest
+      || routing->GetRoute (1)->GetDestNetwork () != Ipv4Address ("10.1.0.0"))
+    {
+      std::cout << "FAIL: the routes being built are listed before the commit" << std::endl;
+      return false;
+    }
+
+  routing->CommitRouteUpdate ();
+  if (routing->GetNRoutes () != 4
+      || routing->GetRoute (0)->GetDest () != newDest || routing->GetRoute (0)->GetDistance () != 1500
+      || routing->GetRoute (1)->GetDest () != newDest || routing->GetRoute (1)->GetInterface () != 2
+      || routing->GetRoute (2)->GetDestNetwork () != Ipv4Address ("10.2.0.0")
+      || routing->GetRoute (3)->GetDestNetwork () != Ipv4Address ("10.3.0.0"))
+    {
+      std::cout << "FAIL: the commit does not replace the table with the one built" << std::endl;
+      return false;
+    }
+
+  routing->BeginRouteUpdate ();
+  routing->CommitRouteUpdate ();
+  if (routing->GetNRoutes () != 0)
+    {
+      std::cout << "FAIL: an empty update leaves " << routing->GetNRoutes () << " routes" << std::endl;
+      return false;
+    }
+  routing->Dispose ();
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  bool pass = TestInsertUnique ();
+  pass = TestFibSwap () && pass;
+  pass = TestRouteUpdate () && pass;
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
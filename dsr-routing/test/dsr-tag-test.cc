@@ -0,0 +1,117 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: DsrTag serialization round trip
+//
+// - a tag with every field set, including values needing all the bits of
+//   their field, is added to a packet and peeked back; every field must
+//   come back unchanged
+// - a default tag must come back without a distance
+// - ReplacePacketTag must leave a single tag with the new values, and a
+//   copy of the packet must carry the tag too
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/dsr-tag.h"
+
+using namespace ns3;
+
+static bool
+SameTag (const DsrTag &a, const DsrTag &b)
+{
+  return a.GetTimestamp () == b.GetTimestamp ()
+         && a.GetBudget () == b.GetBudget ()
+         && a.GetDistance () == b.GetDistance ()
+         && a.HasDistance () == b.HasDistance ()
+         && a.GetFlag () == b.GetFlag ()
+         && a.GetPriority () == b.GetPriority ();
+}
+
+static bool
+RoundTrip (const DsrTag &tag, const char *name)
+{
+  Ptr<Packet> p = Create<Packet> (100);
+  p->AddPacketTag (tag);
+  DsrTag peeked;
+  if (!p->PeekPacketTag (peeked) || !SameTag (tag, peeked))
+    {
+      std::cout << "FAIL: " << name << " tag does not survive the round trip" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  bool pass = true;
+
+  DsrTag tag;
+  tag.SetTimestamp (Seconds (12345.678901234));
+  tag.SetBudget (0xfffffffe);
+  tag.SetDistance (123456789);
+  tag.SetFlag (true);
+  tag.SetPriority (255);
+  pass = RoundTrip (tag, "full") && pass;
+
+  DsrTag empty;
+  pass = RoundTrip (empty, "default") && pass;
+  if (empty.HasDistance ())
+    {
+      std::cout << "FAIL: a default tag has a distance" << std::endl;
+      pass = false;
+    }
+
+  Ptr<Packet> p = Create<Packet> (100);
+  p->AddPacketTag (tag);
+  DsrTag next = tag;
+  next.SetDistance (42);
+  next.SetPriority (0);
+  p->ReplacePacketTag (next);
+  DsrTag peeked;
+  p->PeekPacketTag (peeked);
+  if (!SameTag (next, peeked))
+    {
+      std::cout << "FAIL: ReplacePacketTag does not update the tag" << std::endl;
+      pass = false;
+    }
+  DsrTag removed;
+  p->RemovePacketTag (removed);
+  if (p->PeekPacketTag (peeked))
+    {
+      std::cout << "FAIL: ReplacePacketTag leaves two tags" << std::endl;
+      pass = false;
+    }
+  p->AddPacketTag (next);
+  Ptr<Packet> copy = p->Copy ();
+  if (!copy->PeekPacketTag (peeked) || !SameTag (next, peeked))
+    {
+      std::cout << "FAIL: a copy of the packet does not carry the tag" << std::endl;
+      pass = false;
+    }
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
@@ -0,0 +1,149 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: CoDel in the lanes of DsrVirtualQueueDisc
+//
+//    n0 --100Mbps-- n1 --2Mbps-- n2
+//
+// - a 3Mbps flow of 1000 B packets without budget overloads the normal
+//   lane of the bottleneck, which sits full with a standing queue of its
+//   60 packets
+// - the same flow again with CoDel in the slow and normal lanes; the test
+//   passes if CoDel drops packets with BUFFERBLOAT_DROP, counts them as its
+//   own, and the mean delay of the flow falls under half of the delay
+//   without AQM
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrVirtualQueueAqmTest");
+
+static void
+RxDelay (Time *total, uint32_t *count, Ptr<const Packet> packet, const Address &from)
+{
+  DsrTag dsrTag;
+  if (packet->PeekPacketTag (dsrTag))
+    {
+      *total += Simulator::Now () - dsrTag.GetTimestamp ();
+      (*count)++;
+    }
+}
+
+// Run the flow through the bottleneck and return the mean delay of its
+// packets; the drops of the AQM of the normal lane go to aqmDrops.
+static Time
+RunFlow (const std::string &laneAqm, uint32_t *aqmDrops, uint32_t *bufferbloatDrops)
+{
+  NodeContainer nodes;
+  nodes.Create (3);
+
+  PointToPointHelper accessLink;
+  accessLink.SetDeviceAttribute ("DataRate", StringValue ("100Mbps"));
+  accessLink.SetChannelAttribute ("Delay", StringValue ("0.1ms"));
+  PointToPointHelper bottleneckLink;
+  bottleneckLink.SetDeviceAttribute ("DataRate", StringValue ("2Mbps"));
+  bottleneckLink.SetChannelAttribute ("Delay", StringValue ("5ms"));
+  bottleneckLink.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("1p"));
+
+  InternetStackHelper stack;
+  stack.InstallAll ();
+
+  TrafficControlHelper tchAccess;
+  tchAccess.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc", "LaneLimits", StringValue ("1000p"));
+  TrafficControlHelper tchBottleneck;
+  tchBottleneck.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc", "LaneAqm", StringValue (laneAqm));
+
+  NetDeviceContainer devicesAccess = accessLink.Install (nodes.Get (0), nodes.Get (1));
+  tchAccess.Install (devicesAccess);
+  NetDeviceContainer devicesBottleneck = bottleneckLink.Install (nodes.Get (1), nodes.Get (2));
+  QueueDiscContainer qdiscs = tchBottleneck.Install (devicesBottleneck);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.1.0", "255.255.255.0");
+  address.Assign (devicesAccess);
+  address.NewNetwork ();
+  Ipv4InterfaceContainer interfacesBottleneck = address.Assign (devicesBottleneck);
+  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+  uint16_t port = 9000;
+  DsrSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
+  ApplicationContainer sinkApps = sinkHelper.Install (nodes.Get (2));
+  sinkApps.Start (Seconds (0.0));
+  sinkApps.Stop (Seconds (12.0));
+  Time total;
+  uint32_t count = 0;
+  sinkApps.Get (0)->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&RxDelay, &total, &count));
+
+  Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  Ptr<DsrUdpApplication> app = CreateObject<DsrUdpApplication> ();
+  app->Setup (socket, InetSocketAddress (interfacesBottleneck.GetAddress (1), port), 1000, 3000, DataRate ("3Mbps"), false);
+  nodes.Get (0)->AddApplication (app);
+  app->SetStartTime (Seconds (0.1));
+  app->SetStopTime (Seconds (10.0));
+
+  Simulator::Stop (Seconds (12.0));
+  Simulator::Run ();
+
+  Ptr<DsrVirtualQueueDisc> queue = DynamicCast<DsrVirtualQueueDisc> (qdiscs.Get (0));
+  *aqmDrops = queue->GetNAqmDrops (2);
+  *bufferbloatDrops = queue->GetStats ().GetNDroppedPackets (DsrVirtualQueueDisc::BUFFERBLOAT_DROP);
+  Simulator::Destroy ();
+
+  return count == 0 ? Time (0) : NanoSeconds (total.GetNanoSeconds () / count);
+}
+
+int
+main (int argc, char *argv[])
+{
+  CommandLine cmd (__FILE__);
+  cmd.Parse (argc, argv);
+
+  uint32_t aqmDrops;
+  uint32_t bufferbloatDrops;
+  Time dropTail = RunFlow ("none", &aqmDrops, &bufferbloatDrops);
+  std::cout << "no AQM: mean delay " << dropTail.GetMilliSeconds () << "ms, "
+            << bufferbloatDrops << " bufferbloat drops" << std::endl;
+  bool pass = bufferbloatDrops == 0;
+
+  Time codel = RunFlow ("none,codel,codel", &aqmDrops, &bufferbloatDrops);
+  std::cout << "codel: mean delay " << codel.GetMilliSeconds () << "ms, "
+            << bufferbloatDrops << " bufferbloat drops, " << aqmDrops << " in the normal lane" << std::endl;
+  if (aqmDrops == 0 || aqmDrops != bufferbloatDrops)
+    {
+      std::cout << "FAIL: the normal lane AQM does not drop" << std::endl;
+      pass = false;
+    }
+  if (codel.IsZero () || 2 * codel.GetNanoSeconds () > dropTail.GetNanoSeconds ())
+    {
+      std::cout << "FAIL: CoDel does not cut the standing queue" << std::endl;
+      pass = false;
+    }
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
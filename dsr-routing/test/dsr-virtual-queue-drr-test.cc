@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: lane limits and deficit round robin of DsrVirtualQueueDisc
+//
+// - a lane full of packets drops the next packet with LIMIT_EXCEEDED_DROP
+//   and does not queue it anyway
+// - the fast lane carries 52 B packets and the normal lane 1000 B packets,
+//   both lanes stay backlogged; with equal weights each lane gets half of
+//   the bytes dequeued, with the default weights 10/3/2 the fast lane gets
+//   five times the bytes of the normal lane, whatever the packet sizes
+
+#include <iostream>
+#include <cmath>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrVirtualQueueDrrTest");
+
+static Ptr<QueueDiscItem>
+MakeItem (uint32_t size, int priority)
+{
+  Ptr<Packet> packet = Create<Packet> (size);
+  if (priority >= 0)
+    {
+      DsrTag tag;
+      tag.SetPriority (priority);
+      packet->AddPacketTag (tag);
+    }
+  return Create<Ipv4QueueDiscItem> (packet, Address (), Ipv4L3Protocol::PROT_NUMBER, Ipv4Header ());
+}
+
+// Keep the fast lane (52 B) and the normal lane (1000 B) backlogged, dequeue
+// about dequeueBytes and return the share of the fast lane in the bytes.
+static double
+FastShare (const std::string &weights, uint32_t dequeueBytes)
+{
+  Ptr<DsrVirtualQueueDisc> queue = CreateObject<DsrVirtualQueueDisc> ();
+  queue->SetAttribute ("LaneLimits", StringValue ("1000000B"));
+  queue->SetAttribute ("LaneWeights", StringValue (weights));
+  queue->Initialize ();
+
+  for (uint32_t i = 0; i < 20000; i++)
+    {
+      queue->Enqueue (MakeItem (52, 0));
+    }
+  for (uint32_t i = 0; i < 1000; i++)
+    {
+      queue->Enqueue (MakeItem (1000, -1));
+    }
+
+  uint64_t fastBytes = 0;
+  uint64_t totalBytes = 0;
+  while (totalBytes < dequeueBytes)
+    {
+      Ptr<QueueDiscItem> item = queue->Dequeue ();
+      NS_ABORT_MSG_IF (!item, "queue drained before the end of the test");
+      totalBytes += item->GetSize ();
+      if (item->GetSize () == 52)
+        {
+          fastBytes += item->GetSize ();
+        }
+    }
+  queue->Dispose ();
+  return double (fastBytes) / totalBytes;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t dequeueBytes = 300000;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("dequeueBytes", "Bytes dequeued to measure the lane shares", dequeueBytes);
+  cmd.Parse (argc, argv);
+
+  bool pass = true;
+
+  // ------------------- lane limit ----------------------
+  Ptr<DsrVirtualQueueDisc> queue = CreateObject<DsrVirtualQueueDisc> ();
+  queue->Initialize ();
+  uint32_t accepted = 0;
+  for (uint32_t i = 0; i < 20; i++)
+    {
+      accepted += queue->Enqueue (MakeItem (52, 0)) ? 1 : 0;
+    }
+  uint32_t queued = queue->GetInternalQueue (0)->GetNPackets ();
+  uint32_t dropped = queue->GetStats ().GetNDroppedPackets (DsrVirtualQueueDisc::LIMIT_EXCEEDED_DROP);
+  std::cout << "fast lane: accepted " << accepted << ", queued " << queued
+            << ", dropped " << dropped << std::endl;
+  if (accepted != 12 || queued != 12 || dropped != 8 || queue->GetNPackets () != 12)
+    {
+      std::cout << "FAIL: the fast lane does not hold 12 packets" << std::endl;
+      pass = false;
+    }
+  queue->Dispose ();
+
+  // ------------------- byte shares ----------------------
+  double equal = FastShare ("1", dequeueBytes);
+  double weighted = FastShare ("10,3,2", dequeueBytes);
+  std::cout << "fast lane share: " << equal << " with weights 1/1/1, "
+            << weighted << " with weights 10/3/2" << std::endl;
+  if (std::fabs (equal - 0.5) > 0.02)
+    {
+      std::cout << "FAIL: equal weights do not share the bytes equally" << std::endl;
+      pass = false;
+    }
+  if (std::fabs (weighted - 10.0 / 12) > 0.02)
+    {
+      std::cout << "FAIL: weights 10/3/2 do not give 10/12 of the bytes to the fast lane" << std::endl;
+      pass = false;
+    }
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
@@ -0,0 +1,216 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+// Test: Peek and Dequeue of DsrVirtualQueueDisc agree
+//
+// - packets of random sizes, priorities and budgets go through a queue
+//   disc with a fifo, an edf and a fifo lane; before some of the dequeues
+//   the head is peeked, once or twice, and the dequeue must return the
+//   packet peeked
+// - the same queue disc sits on a 2Mbps bottleneck fed with a 52 B
+//   budgeted DsrUdpApplication flow and a 1000 B flow without budget, for
+//   each netdevicesQueueSize and with and without BQL; every packet sent
+//   must be either received or dropped by the queue disc, and the queue
+//   disc must be empty at the end
+//
+//    n0 --100Mbps-- n1 --2Mbps-- n2
+
+#include <iostream>
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/traffic-control-module.h"
+#include "ns3/dsr-routing-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("DsrVirtualQueuePeekTest");
+
+static bool
+CheckPeek (uint32_t nPackets)
+{
+  Ptr<DsrVirtualQueueDisc> queue = CreateObject<DsrVirtualQueueDisc> ();
+  queue->SetAttribute ("LaneTypes", StringValue ("fifo,edf,fifo"));
+  queue->SetAttribute ("LaneLimits", StringValue ("100p"));
+  queue->Initialize ();
+
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  uint32_t dequeued = 0;
+  while (dequeued < nPackets)
+    {
+      if (random->GetInteger (0, 2) != 0)
+        {
+          Ptr<Packet> packet = Create<Packet> (random->GetInteger (0, 1) ? 52 : random->GetInteger (52, 1400));
+          DsrTag tag;
+          tag.SetTimestamp (Simulator::Now ());
+          tag.SetBudget (random->GetInteger (0, 30000));
+          tag.SetPriority (random->GetInteger (0, 3));
+          packet->AddPacketTag (tag);
+          queue->Enqueue (Create<Ipv4QueueDiscItem> (packet, Address (), Ipv4L3Protocol::PROT_NUMBER, Ipv4Header ()));
+          continue;
+        }
+      Ptr<const QueueDiscItem> peeked;
+      for (uint32_t i = random->GetInteger (0, 2); i > 0; i--)
+        {
+          Ptr<const QueueDiscItem> item = queue->Peek ();
+          if (peeked && item != peeked)
+            {
+              std::cout << "FAIL: two peeks return different packets" << std::endl;
+              return false;
+            }
+          peeked = item;
+        }
+      Ptr<QueueDiscItem> item = queue->Dequeue ();
+      if (peeked && item != peeked)
+        {
+          std::cout << "FAIL: dequeue returns another packet than peek" << std::endl;
+          return false;
+        }
+      if (item)
+        {
+          dequeued++;
+        }
+    }
+  queue->Dispose ();
+  return true;
+}
+
+static bool
+CheckBottleneck (uint32_t netdevicesQueueSize, bool bql)
+{
+  NodeContainer nodes;
+  nodes.Create (3);
+
+  PointToPointHelper accessLink;
+  accessLink.SetDeviceAttribute ("DataRate", StringValue ("100Mbps"));
+  accessLink.SetChannelAttribute ("Delay", StringValue ("0.1ms"));
+  accessLink.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue ("1000p"));
+
+  PointToPointHelper bottleneckLink;
+  bottleneckLink.SetDeviceAttribute ("DataRate", StringValue ("2Mbps"));
+  bottleneckLink.SetChannelAttribute ("Delay", StringValue ("5ms"));
+  bottleneckLink.SetQueue ("ns3::DropTailQueue", "MaxSize", StringValue (std::to_string (netdevicesQueueSize) + "p"));
+
+  InternetStackHelper stack;
+  stack.InstallAll ();
+
+  TrafficControlHelper tchAccess;
+  tchAccess.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc", "LaneLimits", StringValue ("1000p"));
+  TrafficControlHelper tchBottleneck;
+  tchBottleneck.SetRootQueueDisc ("ns3::DsrVirtualQueueDisc", "LaneTypes", StringValue ("fifo,edf,fifo"));
+  if (bql)
+    {
+      tchBottleneck.SetQueueLimits ("ns3::DynamicQueueLimits");
+    }
+
+  NetDeviceContainer devicesAccess = accessLink.Install (nodes.Get (0), nodes.Get (1));
+  tchAccess.Install (devicesAccess);
+  NetDeviceContainer devicesBottleneck = bottleneckLink.Install (nodes.Get (1), nodes.Get (2));
+  QueueDiscContainer qdiscs = tchBottleneck.Install (devicesBottleneck);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.1.0", "255.255.255.0");
+  address.Assign (devicesAccess);
+  address.NewNetwork ();
+  Ipv4InterfaceContainer interfacesBottleneck = address.Assign (devicesBottleneck);
+  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+  // 52 B packets with a 30ms budget and 1000 B packets without, 3Mbps in all
+  uint32_t packetSizes[] = {52, 1000};
+  uint32_t nPackets[] = {2000, 500};
+  const char *rates[] = {"1Mbps", "2Mbps"};
+  ApplicationContainer sinkApps;
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      uint16_t port = 9000 + i;
+      DsrSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), port));
+      sinkApps.Add (sinkHelper.Install (nodes.Get (2)));
+      Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+      Ptr<DsrUdpApplication> app = CreateObject<DsrUdpApplication> ();
+      Address sinkAddress (InetSocketAddress (interfacesBottleneck.GetAddress (1), port));
+      if (i == 0)
+        {
+          app->Setup (socket, sinkAddress, packetSizes[i], nPackets[i], DataRate (rates[i]), 30, false);
+        }
+      else
+        {
+          app->Setup (socket, sinkAddress, packetSizes[i], nPackets[i], DataRate (rates[i]), false);
+        }
+      nodes.Get (0)->AddApplication (app);
+      app->SetStartTime (Seconds (0.1));
+      app->SetStopTime (Seconds (5.0));
+    }
+  sinkApps.Start (Seconds (0.0));
+  sinkApps.Stop (Seconds (10.0));
+
+  Simulator::Stop (Seconds (10.0));
+  Simulator::Run ();
+
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      sent += nPackets[i];
+      received += DynamicCast<DsrPacketSink> (sinkApps.Get (i))->GetTotalRx () / packetSizes[i];
+    }
+  Ptr<QueueDisc> queue = qdiscs.Get (0);
+  uint64_t dropped = queue->GetStats ().nTotalDroppedPackets;
+  uint32_t left = queue->GetNPackets ();
+  Simulator::Destroy ();
+
+  std::cout << "netdevicesQueueSize " << netdevicesQueueSize << (bql ? " bql" : "")
+            << ": sent " << sent << ", received " << received << ", dropped " << dropped
+            << ", left " << left << std::endl;
+  if (received + dropped != sent || left != 0)
+    {
+      std::cout << "FAIL: packets lost outside of the queue disc" << std::endl;
+      return false;
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nPackets = 100000;
+
+  CommandLine cmd (__FILE__);
+  cmd.AddValue ("nPackets", "Packets dequeued in the peek test", nPackets);
+  cmd.Parse (argc, argv);
+
+  bool pass = CheckPeek (nPackets);
+
+  uint32_t netdevicesQueueSizes[] = {1, 5, 100};
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      for (uint32_t bql = 0; bql < 2; bql++)
+        {
+          if (!CheckBottleneck (netdevicesQueueSizes[i], bql))
+            {
+              pass = false;
+            }
+        }
+    }
+
+  if (!pass)
+    {
+      return 1;
+    }
+  std::cout << "PASS" << std::endl;
+  return 0;
+}
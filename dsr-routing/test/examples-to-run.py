@@ -0,0 +1,33 @@
+#! /usr/bin/env python3
+## -*- Mode: python; py-indent-offset: 4; indent-tabs-mode: nil; coding: utf-8; -*-
+
+# A list of C++ examples to run in order to ensure that they remain
+# buildable and runnable over time.  Each tuple in the list contains
+#
+#     (example_name, do_run, do_valgrind_run).
+#
+# See test.py for more information.  The benchmarks get short runs.
+cpp_examples = [
+    ("dsr-fib-test", "True", "True"),
+    ("dsr-queue-snapshot-benchmark --stopTime=2", "True", "False"),
+    ("dsr-tag-test", "True", "True"),
+    ("dsr-route-input-test", "True", "True"),
+    ("dsr-candidate-policy-test", "True", "True"),
+    ("dsr-route-update-test", "True", "True"),
+    ("dsr-route-population-benchmark --sizes=16", "True", "False"),
+    ("dsr-link-metric-update-test", "True", "False"),
+    ("dsr-failover-test", "True", "False"),
+    ("dsr-virtual-queue-drr-test", "True", "True"),
+    ("dsr-deadline-queue-test", "True", "True"),
+    ("dsr-virtual-queue-peek-test", "True", "True"),
+    ("dsr-virtual-queue-aqm-test", "True", "False"),
+    ("dsr-flow-queue-test", "True", "True"),
+]
+
+# A list of Python examples to run in order to ensure that they remain
+# runnable over time.  Each tuple in the list contains
+#
+#     (example_name, do_run).
+#
+# See test.py for more information.
+python_examples = []